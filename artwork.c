@@ -0,0 +1,1268 @@
+/*
+ * artwork.c - Cover art pipeline and ArtworkDB I/O for TunesReloaded
+ *
+ * Pipeline: RGBA pixels (decoded by the browser) -> resize to each device
+ * cover format with a separable tent filter (WASM SIMD when built with
+ * -msimd128) -> composite onto the format background -> convert to the
+ * format's pixel layout (RGB565/RGB555/RGB888/UYVY/I420) -> append to the
+ * format's .ithmb file in the MEMFS staging directory.
+ *
+ * ArtworkDB layout (all little-endian):
+ *   mhfd
+ *     mhsd (1) -> mhli -> mhii* -> mhod(2) -> mhni -> mhod(3) ":F<fmt>_<n>.ithmb"
+ *     mhsd (2) -> mhla (empty for cover art)
+ *     mhsd (3) -> mhlf -> mhif* (one per format: id + thumbnail byte size)
+ *
+ * Existing device thumbnails are never read or moved by a normal sync: new
+ * thumbnails are appended after the last known thumbnail of the newest .ithmb
+ * file per format, so only those bytes and the ArtworkDB index are written.
+ * Space left by removed images is reclaimed by the explicit compaction pass
+ * (artwork_compact_plan_json / artwork_compact_apply).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+#include "artwork.h"
+
+#define MHFD_HEADER_LEN 0x84
+#define MHSD_HEADER_LEN 0x60
+#define MHLI_HEADER_LEN 0x5c
+#define MHLA_HEADER_LEN 0x5c
+#define MHLF_HEADER_LEN 0x5c
+#define MHII_HEADER_LEN 0x98
+#define MHOD_HEADER_LEN 0x18
+#define MHNI_HEADER_LEN 0x4c
+#define MHIF_HEADER_LEN 0x7c
+
+#define FIRST_IMAGE_ID 100
+
+/* Start a new .ithmb file once one would grow past this (same cap as libgpod) */
+#define ITHMB_MAX_SIZE (500 * 1000 * 1000)
+
+/* An .ithmb file already on the device (from the loaded ArtworkDB) */
+typedef struct {
+    gint32  format_id;
+    guint32 index;
+    guint32 size;           /* end of the last thumbnail we know of */
+} ArtFile;
+
+/* New thumbnail bytes in the staging directory, to be written at @base of
+ * the device .ithmb file with the same name */
+typedef struct {
+    gint32  format_id;
+    guint32 index;
+    guint32 base;           /* device file offset of the first staged byte */
+    guint32 size;           /* bytes staged so far */
+} StagedFile;
+
+/* One thumbnail relocation of a pending compaction */
+typedef struct {
+    guint32 image_id;
+    guint   thumb;          /* slot in ArtImage.thumbs */
+    gint32  format_id;
+    guint32 src_index;
+    guint32 src_offset;
+    guint32 size;
+    guint32 dst_index;
+    guint32 dst_offset;
+} ArtMove;
+
+static char g_art_error[512] = "";
+static char g_staging_dir[64] = ARTWORK_STAGING_DIR;
+
+static ArtImage **g_images = NULL;
+static guint g_n_images = 0;
+static guint g_images_cap = 0;
+static GHashTable *g_image_by_id = NULL;
+static guint32 g_next_id = FIRST_IMAGE_ID;
+
+static ArtFile *g_files = NULL;
+static guint g_n_files = 0;
+
+static StagedFile *g_staged = NULL;
+static guint g_n_staged = 0;
+
+static ArtMove *g_moves = NULL;
+static guint g_n_moves = 0;
+static gboolean g_compact_planned = FALSE;
+
+static gboolean g_dirty = FALSE;
+static gboolean g_db_staged = FALSE;
+
+/* ============================================================================
+ * Utility Functions
+ * ============================================================================ */
+
+static void art_error(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(g_art_error, sizeof(g_art_error), fmt, args);
+    va_end(args);
+}
+
+const char *artwork_get_error(void) {
+    return g_art_error;
+}
+
+static guint32 rd32(const guchar *p) {
+    return (guint32)p[0] | ((guint32)p[1] << 8) | ((guint32)p[2] << 16) | ((guint32)p[3] << 24);
+}
+
+static guint16 rd16(const guchar *p) {
+    return (guint16)(p[0] | (p[1] << 8));
+}
+
+static guint64 rd64(const guchar *p) {
+    return (guint64)rd32(p) | ((guint64)rd32(p + 4) << 32);
+}
+
+static void ensure_staging_dir(void) {
+    mkdir(g_staging_dir, 0777);
+}
+
+static void staged_path(char *buf, size_t len, gint32 format_id, guint32 index) {
+    snprintf(buf, len, "%s/F%d_%u.ithmb", g_staging_dir, format_id, index);
+}
+
+static void release_staged(gboolean copied);
+static void clear_moves(void);
+
+/* ============================================================================
+ * Image Table
+ * ============================================================================ */
+
+static void images_append(ArtImage *image) {
+    if (g_n_images == g_images_cap) {
+        g_images_cap = g_images_cap ? g_images_cap * 2 : 256;
+        g_images = g_realloc(g_images, g_images_cap * sizeof(ArtImage *));
+    }
+    g_images[g_n_images++] = image;
+    if (!g_image_by_id) g_image_by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_hash_table_insert(g_image_by_id, GUINT_TO_POINTER(image->id), image);
+    if (image->id >= g_next_id) g_next_id = image->id + 1;
+}
+
+void artwork_reset(void) {
+    for (guint i = 0; i < g_n_images; i++) g_free(g_images[i]);
+    g_free(g_images);
+    g_images = NULL;
+    g_n_images = 0;
+    g_images_cap = 0;
+    if (g_image_by_id) {
+        g_hash_table_destroy(g_image_by_id);
+        g_image_by_id = NULL;
+    }
+    g_next_id = FIRST_IMAGE_ID;
+
+    release_staged(FALSE);
+    clear_moves();
+
+    g_free(g_files);
+    g_files = NULL;
+    g_n_files = 0;
+
+    g_dirty = FALSE;
+}
+
+ArtImage *artwork_image_new(guint32 source_size) {
+    ArtImage *image = g_malloc0(sizeof(ArtImage));
+    if (!image) {
+        art_error("Out of memory");
+        return NULL;
+    }
+    image->id = g_next_id;
+    image->source_size = source_size;
+    images_append(image);
+    g_dirty = TRUE;
+    return image;
+}
+
+void artwork_image_discard(ArtImage *image) {
+    if (!image) return;
+    /* Almost always the newest image, so search from the end */
+    for (guint i = g_n_images; i > 0; i--) {
+        if (g_images[i - 1] != image) continue;
+        memmove(&g_images[i - 1], &g_images[i], (g_n_images - i) * sizeof(ArtImage *));
+        g_n_images--;
+        break;
+    }
+    if (g_image_by_id) g_hash_table_remove(g_image_by_id, GUINT_TO_POINTER(image->id));
+    g_free(image);
+}
+
+ArtImage *artwork_image_lookup(guint32 id) {
+    if (!g_image_by_id || id == 0) return NULL;
+    return (ArtImage *)g_hash_table_lookup(g_image_by_id, GUINT_TO_POINTER(id));
+}
+
+void artwork_mark_dirty(void) {
+    g_dirty = TRUE;
+}
+
+/* ============================================================================
+ * ArtworkDB Reader
+ * ============================================================================ */
+
+static void note_device_file(gint32 format_id, guint32 index, guint32 end) {
+    for (guint i = 0; i < g_n_files; i++) {
+        if (g_files[i].format_id == format_id && g_files[i].index == index) {
+            if (end > g_files[i].size) g_files[i].size = end;
+            return;
+        }
+    }
+    g_files = g_realloc(g_files, (g_n_files + 1) * sizeof(ArtFile));
+    g_files[g_n_files].format_id = format_id;
+    g_files[g_n_files].index = index;
+    g_files[g_n_files].size = end;
+    g_n_files++;
+}
+
+/* Parse ":F1055_1.ithmb" (UTF-8 or UTF-16LE) into its file index */
+static guint32 parse_ithmb_index(const guchar *str, guint32 len, int encoding) {
+    char name[64];
+    guint32 n = 0;
+    if (encoding == 2) {
+        for (guint32 i = 0; i + 1 < len && n < sizeof(name) - 1; i += 2) name[n++] = (char)str[i];
+    } else {
+        for (guint32 i = 0; i < len && n < sizeof(name) - 1; i++) name[n++] = (char)str[i];
+    }
+    name[n] = '\0';
+
+    int format_id = 0;
+    unsigned int index = 0;
+    const char *s = name[0] == ':' ? name + 1 : name;
+    if (sscanf(s, "F%d_%u.ithmb", &format_id, &index) == 2) return index;
+    return 0;
+}
+
+static void parse_mhni(const guchar *p, const guchar *end, ArtThumb *thumb) {
+    guint32 hl = rd32(p + 4);
+    guint32 total = rd32(p + 8);
+    thumb->format_id = (gint32)rd32(p + 16);
+    thumb->offset = rd32(p + 20);
+    thumb->size = rd32(p + 24);
+    thumb->vpad = (gint16)rd16(p + 28);
+    thumb->hpad = (gint16)rd16(p + 30);
+    thumb->height = (gint16)rd16(p + 32);
+    thumb->width = (gint16)rd16(p + 34);
+
+    const guchar *child = p + hl;
+    if (child + 36 <= end && child < p + total && memcmp(child, "mhod", 4) == 0 && rd16(child + 12) == 3) {
+        guint32 str_len = rd32(child + 24);
+        int encoding = child[28];
+        if (child + 36 + str_len <= end) {
+            thumb->ithmb_index = parse_ithmb_index(child + 36, str_len, encoding);
+        }
+    }
+}
+
+static int parse_mhii(const guchar *p, const guchar *end) {
+    guint32 hl = rd32(p + 4);
+    guint32 total = rd32(p + 8);
+    if (p + total > end || hl < 52) return -1;
+
+    ArtImage *image = g_malloc0(sizeof(ArtImage));
+    image->id = rd32(p + 16);
+    image->song_dbid = rd64(p + 20);
+    image->source_size = rd32(p + 48);
+
+    const guchar *child = p + hl;
+    const guchar *child_end = p + total;
+    while (child + MHOD_HEADER_LEN <= child_end && memcmp(child, "mhod", 4) == 0) {
+        guint32 m_hl = rd32(child + 4);
+        guint32 m_total = rd32(child + 8);
+        if (m_total < MHOD_HEADER_LEN || child + m_total > child_end) break;
+
+        const guchar *ni = child + m_hl;
+        if (rd16(child + 12) == 2 && ni + MHNI_HEADER_LEN <= child_end && memcmp(ni, "mhni", 4) == 0 &&
+            image->n_thumbs < ART_MAX_FORMATS) {
+            ArtThumb *thumb = &image->thumbs[image->n_thumbs];
+            parse_mhni(ni, child_end, thumb);
+            if (thumb->ithmb_index > 0) {
+                note_device_file(thumb->format_id, thumb->ithmb_index, thumb->offset + thumb->size);
+                image->n_thumbs++;
+            }
+        }
+        child += m_total;
+    }
+
+    images_append(image);
+    return 0;
+}
+
+int artwork_db_load(const guchar *data, gsize len) {
+    artwork_reset();
+
+    if (!data || len < MHFD_HEADER_LEN || memcmp(data, "mhfd", 4) != 0) {
+        art_error("Not an ArtworkDB (missing mhfd header)");
+        return -1;
+    }
+
+    const guchar *end = data + len;
+    guint32 hl = rd32(data + 4);
+    guint32 n_children = rd32(data + 20);
+    guint32 next_id = rd32(data + 28);
+
+    const guchar *sd = data + hl;
+    for (guint32 i = 0; i < n_children && sd + MHSD_HEADER_LEN <= end; i++) {
+        if (memcmp(sd, "mhsd", 4) != 0) break;
+        guint32 sd_hl = rd32(sd + 4);
+        guint32 sd_total = rd32(sd + 8);
+        guint16 index = rd16(sd + 12);
+        if (sd_total < sd_hl || sd + sd_total > end) break;
+
+        const guchar *li = sd + sd_hl;
+        if (index == 1 && li + 12 <= end && memcmp(li, "mhli", 4) == 0) {
+            guint32 count = rd32(li + 8);
+            const guchar *ii = li + rd32(li + 4);
+            for (guint32 k = 0; k < count && ii + 12 <= sd + sd_total; k++) {
+                if (memcmp(ii, "mhii", 4) != 0 || parse_mhii(ii, sd + sd_total) < 0) break;
+                ii += rd32(ii + 8);
+            }
+        }
+        sd += sd_total;
+    }
+
+    if (next_id > g_next_id) g_next_id = next_id;
+    g_dirty = FALSE;
+    return (int)g_n_images;
+}
+
+/* ============================================================================
+ * Resize (separable tent filter)
+ * ============================================================================ */
+
+typedef struct {
+    int    *start;          /* first source index per output sample */
+    int    *count;          /* taps per output sample */
+    float  *weights;        /* [dst_len][max_taps] */
+    int     max_taps;
+} FilterTaps;
+
+static void taps_free(FilterTaps *t) {
+    free(t->start);
+    free(t->count);
+    free(t->weights);
+}
+
+/*
+ * Tent filter taps mapping @src_len samples (starting at @src_off) onto
+ * @dst_len. Support widens with the downscale factor, so minification
+ * averages every covered source pixel; magnification is plain bilinear.
+ */
+static int taps_build(FilterTaps *t, int src_off, int src_len, int src_total, int dst_len) {
+    double scale = (double)src_len / (double)dst_len;
+    double support = scale > 1.0 ? scale : 1.0;
+    t->max_taps = (int)ceil(support) * 2 + 1;
+    t->start = malloc(sizeof(int) * dst_len);
+    t->count = malloc(sizeof(int) * dst_len);
+    t->weights = calloc((size_t)dst_len * t->max_taps, sizeof(float));
+    if (!t->start || !t->count || !t->weights) {
+        taps_free(t);
+        return -1;
+    }
+
+    for (int i = 0; i < dst_len; i++) {
+        double center = src_off + (i + 0.5) * scale - 0.5;
+        int lo = (int)ceil(center - support);
+        int hi = (int)floor(center + support);
+        if (lo < 0) lo = 0;
+        if (hi > src_total - 1) hi = src_total - 1;
+        if (hi - lo + 1 > t->max_taps) hi = lo + t->max_taps - 1;
+
+        float *w = &t->weights[(size_t)i * t->max_taps];
+        double sum = 0.0;
+        for (int j = lo; j <= hi; j++) {
+            double d = fabs((double)j - center) / support;
+            double v = d < 1.0 ? 1.0 - d : 0.0;
+            w[j - lo] = (float)v;
+            sum += v;
+        }
+        if (sum <= 0.0) {
+            /* Degenerate (tiny source): nearest sample */
+            int nearest = (int)floor(center + 0.5);
+            if (nearest < 0) nearest = 0;
+            if (nearest > src_total - 1) nearest = src_total - 1;
+            lo = hi = nearest;
+            w[0] = 1.0f;
+            sum = 1.0;
+        }
+        for (int j = 0; j <= hi - lo; j++) w[j] = (float)(w[j] / sum);
+        t->start[i] = lo;
+        t->count[i] = hi - lo + 1;
+    }
+    return 0;
+}
+
+/*
+ * Resize the (@cx, @cy, @cw, @ch) region of @src (@sw x @sh RGBA8) into
+ * @dst (@dw x @dh RGBA8).
+ */
+static int resize_rgba(const guchar *src, int sw, int sh, int cx, int cy, int cw, int ch,
+                       guchar *dst, int dw, int dh) {
+    FilterTaps hx, vy;
+    if (taps_build(&hx, cx, cw, sw, dw) < 0) return -1;
+    if (taps_build(&vy, cy, ch, sh, dh) < 0) {
+        taps_free(&hx);
+        return -1;
+    }
+
+    /* Horizontal pass over only the source rows the vertical taps touch */
+    int row_lo = vy.start[0];
+    int row_hi = vy.start[dh - 1] + vy.count[dh - 1] - 1;
+    int rows = row_hi - row_lo + 1;
+    float *tmp = malloc(sizeof(float) * 4 * (size_t)dw * rows);
+    if (!tmp) {
+        taps_free(&hx);
+        taps_free(&vy);
+        return -1;
+    }
+
+    for (int y = 0; y < rows; y++) {
+        const guchar *srow = src + (size_t)(row_lo + y) * sw * 4;
+        float *trow = tmp + (size_t)y * dw * 4;
+        for (int x = 0; x < dw; x++) {
+            const float *w = &hx.weights[(size_t)x * hx.max_taps];
+            const guchar *sp = srow + (size_t)hx.start[x] * 4;
+#ifdef __wasm_simd128__
+            v128_t acc = wasm_f32x4_splat(0.0f);
+            for (int k = 0; k < hx.count[x]; k++, sp += 4) {
+                v128_t px = wasm_v128_load32_zero(sp);
+                px = wasm_u32x4_extend_low_u16x8(wasm_u16x8_extend_low_u8x16(px));
+                acc = wasm_f32x4_add(acc, wasm_f32x4_mul(wasm_f32x4_convert_u32x4(px), wasm_f32x4_splat(w[k])));
+            }
+            wasm_v128_store(trow + x * 4, acc);
+#else
+            float r = 0, g = 0, b = 0, a = 0;
+            for (int k = 0; k < hx.count[x]; k++, sp += 4) {
+                r += sp[0] * w[k];
+                g += sp[1] * w[k];
+                b += sp[2] * w[k];
+                a += sp[3] * w[k];
+            }
+            trow[x * 4 + 0] = r;
+            trow[x * 4 + 1] = g;
+            trow[x * 4 + 2] = b;
+            trow[x * 4 + 3] = a;
+#endif
+        }
+    }
+
+    /* Vertical pass */
+    for (int y = 0; y < dh; y++) {
+        const float *w = &vy.weights[(size_t)y * vy.max_taps];
+        const float *tbase = tmp + (size_t)(vy.start[y] - row_lo) * dw * 4;
+        guchar *drow = dst + (size_t)y * dw * 4;
+        for (int x = 0; x < dw; x++) {
+            const float *tp = tbase + x * 4;
+#ifdef __wasm_simd128__
+            v128_t acc = wasm_f32x4_splat(0.5f);
+            for (int k = 0; k < vy.count[y]; k++, tp += (size_t)dw * 4) {
+                acc = wasm_f32x4_add(acc, wasm_f32x4_mul(wasm_v128_load(tp), wasm_f32x4_splat(w[k])));
+            }
+            v128_t v32 = wasm_i32x4_trunc_sat_f32x4(acc);
+            v128_t v16 = wasm_i16x8_narrow_i32x4(v32, v32);
+            v128_t v8 = wasm_u8x16_narrow_i16x8(v16, v16);
+            wasm_v128_store32_lane(drow + x * 4, v8, 0);
+#else
+            float acc[4] = { 0.5f, 0.5f, 0.5f, 0.5f };
+            for (int k = 0; k < vy.count[y]; k++, tp += (size_t)dw * 4) {
+                for (int c = 0; c < 4; c++) acc[c] += tp[c] * w[k];
+            }
+            for (int c = 0; c < 4; c++) {
+                float v = acc[c];
+                drow[x * 4 + c] = (guchar)(v < 0.0f ? 0 : (v > 255.0f ? 255 : (int)v));
+            }
+#endif
+        }
+    }
+
+    free(tmp);
+    taps_free(&hx);
+    taps_free(&vy);
+    return 0;
+}
+
+/* ============================================================================
+ * Pixel Format Conversion
+ * ============================================================================ */
+
+static int bytes_per_pixel(ItdbThumbFormat f) {
+    switch (f) {
+        case THUMB_FORMAT_RGB565_LE: case THUMB_FORMAT_RGB565_BE:
+        case THUMB_FORMAT_RGB555_LE: case THUMB_FORMAT_RGB555_BE:
+        case THUMB_FORMAT_UYVY_LE:   case THUMB_FORMAT_UYVY_BE:
+            return 2;
+        case THUMB_FORMAT_RGB888_LE: case THUMB_FORMAT_RGB888_BE:
+            return 4;
+        case THUMB_FORMAT_I420_LE:   case THUMB_FORMAT_I420_BE:
+            return 1; /* luma plane; chroma planes follow */
+        default:
+            return 0;
+    }
+}
+
+static void put_u16(guchar *p, guint16 v, gboolean big_endian) {
+    if (big_endian) { p[0] = (guchar)(v >> 8); p[1] = (guchar)v; }
+    else            { p[0] = (guchar)v; p[1] = (guchar)(v >> 8); }
+}
+
+static guchar rgb_to_y(int r, int g, int b) { return (guchar)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16); }
+static guchar rgb_to_u(int r, int g, int b) { return (guchar)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128); }
+static guchar rgb_to_v(int r, int g, int b) { return (guchar)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128); }
+
+/*
+ * Convert a full-slot RGB image (@w x @h, 3 bytes per pixel, already
+ * composited onto the background) into @format's layout. Returns a newly
+ * allocated buffer and its size, or NULL for unsupported formats.
+ */
+static guchar *convert_pixels(const guchar *rgb, int w, int h, const Itdb_ArtworkFormat *format, guint32 *out_size) {
+    ItdbThumbFormat f = format->format;
+    int bpp = bytes_per_pixel(f);
+    if (bpp == 0) return NULL;
+
+    if (f == THUMB_FORMAT_I420_LE || f == THUMB_FORMAT_I420_BE) {
+        int cw = (w + 1) / 2, ch = (h + 1) / 2;
+        guint32 size = (guint32)(w * h + 2 * cw * ch);
+        guchar *out = g_malloc0(size);
+        guchar *py = out, *pu = out + w * h, *pv = pu + cw * ch;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                const guchar *p = rgb + ((size_t)y * w + x) * 3;
+                py[y * w + x] = rgb_to_y(p[0], p[1], p[2]);
+                if ((x & 1) == 0 && (y & 1) == 0) {
+                    pu[(y / 2) * cw + x / 2] = rgb_to_u(p[0], p[1], p[2]);
+                    pv[(y / 2) * cw + x / 2] = rgb_to_v(p[0], p[1], p[2]);
+                }
+            }
+        }
+        *out_size = size;
+        return out;
+    }
+
+    int stride = w * bpp;
+    if (format->align_row_bytes || format->row_bytes_alignment > 0) {
+        int align = format->row_bytes_alignment > 0 ? format->row_bytes_alignment : 4;
+        stride = (stride + align - 1) / align * align;
+    }
+
+    guint32 size = (guint32)(stride * h);
+    guchar *out = g_malloc0(size);
+    gboolean be = (f == THUMB_FORMAT_RGB565_BE || f == THUMB_FORMAT_RGB555_BE ||
+                   f == THUMB_FORMAT_RGB888_BE || f == THUMB_FORMAT_UYVY_BE);
+
+    for (int y = 0; y < h; y++) {
+        /* Interlaced formats store even rows first, then odd rows */
+        int dst_row = y;
+        if (format->interlaced) dst_row = (y % 2 == 0) ? y / 2 : (h + 1) / 2 + y / 2;
+        guchar *d = out + (size_t)dst_row * stride;
+        const guchar *s = rgb + (size_t)y * w * 3;
+
+        if (f == THUMB_FORMAT_UYVY_LE || f == THUMB_FORMAT_UYVY_BE) {
+            for (int x = 0; x < w; x += 2) {
+                const guchar *p0 = s + x * 3;
+                const guchar *p1 = (x + 1 < w) ? p0 + 3 : p0;
+                int r = (p0[0] + p1[0]) / 2, g = (p0[1] + p1[1]) / 2, b = (p0[2] + p1[2]) / 2;
+                guchar u = rgb_to_u(r, g, b), v = rgb_to_v(r, g, b);
+                guchar y0 = rgb_to_y(p0[0], p0[1], p0[2]), y1 = rgb_to_y(p1[0], p1[1], p1[2]);
+                guchar *q = d + x * 2;
+                if (be) { q[0] = u; q[1] = y0; q[2] = v; q[3] = y1; }
+                else    { q[0] = y0; q[1] = u; q[2] = y1; q[3] = v; }
+            }
+            continue;
+        }
+
+        for (int x = 0; x < w; x++) {
+            const guchar *p = s + x * 3;
+            guchar *q = d + x * bpp;
+            if (f == THUMB_FORMAT_RGB565_LE || f == THUMB_FORMAT_RGB565_BE) {
+                put_u16(q, (guint16)(((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[2] >> 3)), be);
+            } else if (f == THUMB_FORMAT_RGB555_LE || f == THUMB_FORMAT_RGB555_BE) {
+                put_u16(q, (guint16)(0x8000 | ((p[0] >> 3) << 10) | ((p[1] >> 3) << 5) | (p[2] >> 3)), be);
+            } else {
+                guint32 v = 0xFF000000u | ((guint32)p[0] << 16) | ((guint32)p[1] << 8) | p[2];
+                if (be) { q[0] = (guchar)(v >> 24); q[1] = (guchar)(v >> 16); q[2] = (guchar)(v >> 8); q[3] = (guchar)v; }
+                else    { q[0] = (guchar)v; q[1] = (guchar)(v >> 8); q[2] = (guchar)(v >> 16); q[3] = (guchar)(v >> 24); }
+            }
+        }
+    }
+
+    *out_size = size;
+    return out;
+}
+
+/* ============================================================================
+ * Staging
+ * ============================================================================ */
+
+static const ArtFile *last_device_file(gint32 format_id) {
+    const ArtFile *last = NULL;
+    for (guint i = 0; i < g_n_files; i++) {
+        if (g_files[i].format_id == format_id && (!last || g_files[i].index > last->index)) last = &g_files[i];
+    }
+    return last;
+}
+
+/* Staged file that @need more bytes go into: the newest device file for the
+ * format while it has room, otherwise a fresh file after it */
+static StagedFile *staged_file_for(gint32 format_id, guint32 need) {
+    StagedFile *current = NULL;
+    for (guint i = 0; i < g_n_staged; i++) {
+        if (g_staged[i].format_id == format_id && (!current || g_staged[i].index > current->index)) {
+            current = &g_staged[i];
+        }
+    }
+    if (current && (guint64)current->base + current->size + need <= ITHMB_MAX_SIZE) return current;
+
+    guint32 index;
+    guint32 base = 0;
+    if (current) {
+        index = current->index + 1;
+    } else {
+        const ArtFile *last = last_device_file(format_id);
+        if (!last) {
+            index = 1;
+        } else if ((guint64)last->size + need <= ITHMB_MAX_SIZE) {
+            index = last->index;
+            base = last->size;
+        } else {
+            index = last->index + 1;
+        }
+    }
+
+    g_staged = g_realloc(g_staged, (g_n_staged + 1) * sizeof(StagedFile));
+    StagedFile *sf = &g_staged[g_n_staged++];
+    sf->format_id = format_id;
+    sf->index = index;
+    sf->base = base;
+    sf->size = 0;
+
+    char path[256];
+    staged_path(path, sizeof(path), format_id, index);
+    unlink(path); /* stale data from an abandoned sync */
+    return sf;
+}
+
+static int stage_bytes(gint32 format_id, const guchar *data, guint32 size, ArtThumb *thumb) {
+    StagedFile *sf = staged_file_for(format_id, size);
+    char path[256];
+    staged_path(path, sizeof(path), sf->format_id, sf->index);
+
+    ensure_staging_dir();
+    FILE *fp = fopen(path, "ab");
+    if (!fp) {
+        art_error("Cannot open %s for writing", path);
+        return -1;
+    }
+    size_t written = fwrite(data, 1, size, fp);
+    fclose(fp);
+    if (written != size) {
+        art_error("Short write to %s", path);
+        return -1;
+    }
+
+    thumb->ithmb_index = sf->index;
+    thumb->offset = sf->base + sf->size;
+    thumb->size = size;
+    sf->size += size;
+    return 0;
+}
+
+int artwork_add_thumb(ArtImage *image, const guchar *rgba, int width, int height,
+                      const Itdb_ArtworkFormat *format) {
+    if (!image || !rgba || width <= 0 || height <= 0 || !format) {
+        art_error("Invalid artwork arguments");
+        return -1;
+    }
+    if (image->n_thumbs >= ART_MAX_FORMATS) {
+        art_error("Too many artwork formats");
+        return -1;
+    }
+    if (bytes_per_pixel(format->format) == 0) {
+        return 1; /* JPEG / recursive layouts: not supported, skip this format */
+    }
+
+    int fw = format->width, fh = format->height;
+    if (fw <= 0 || fh <= 0) return 1;
+
+    /* Crop-to-fill or fit-inside, keeping aspect ratio */
+    int cx = 0, cy = 0, cw = width, ch = height;
+    int dw = fw, dh = fh;
+    if (format->crop) {
+        if ((gint64)width * fh > (gint64)height * fw) {
+            cw = (int)((gint64)height * fw / fh);
+            cx = (width - cw) / 2;
+        } else {
+            ch = (int)((gint64)width * fh / fw);
+            cy = (height - ch) / 2;
+        }
+    } else if ((gint64)width * fh > (gint64)height * fw) {
+        dh = (int)((gint64)height * fw / width);
+    } else {
+        dw = (int)((gint64)width * fh / height);
+    }
+    if (dw < 1) dw = 1;
+    if (dh < 1) dh = 1;
+    if (cw < 1) cw = 1;
+    if (ch < 1) ch = 1;
+
+    guchar *scaled = malloc((size_t)dw * dh * 4);
+    guchar *slot = malloc((size_t)fw * fh * 3);
+    if (!scaled || !slot) {
+        free(scaled);
+        free(slot);
+        art_error("Out of memory");
+        return -1;
+    }
+    if (resize_rgba(rgba, width, height, cx, cy, cw, ch, scaled, dw, dh) < 0) {
+        free(scaled);
+        free(slot);
+        art_error("Out of memory while resizing artwork");
+        return -1;
+    }
+
+    /* Center on the format background, flattening any alpha */
+    int hpad = (fw - dw) / 2, vpad = (fh - dh) / 2;
+    const guchar *bg = format->back_color;
+    for (int i = 0; i < fw * fh; i++) {
+        slot[i * 3 + 0] = bg[0];
+        slot[i * 3 + 1] = bg[1];
+        slot[i * 3 + 2] = bg[2];
+    }
+    for (int y = 0; y < dh; y++) {
+        const guchar *s = scaled + (size_t)y * dw * 4;
+        guchar *d = slot + ((size_t)(y + vpad) * fw + hpad) * 3;
+        for (int x = 0; x < dw; x++, s += 4, d += 3) {
+            int a = s[3];
+            d[0] = (guchar)((s[0] * a + d[0] * (255 - a) + 127) / 255);
+            d[1] = (guchar)((s[1] * a + d[1] * (255 - a) + 127) / 255);
+            d[2] = (guchar)((s[2] * a + d[2] * (255 - a) + 127) / 255);
+        }
+    }
+    free(scaled);
+
+    guint32 size = 0;
+    guchar *pixels = convert_pixels(slot, fw, fh, format, &size);
+    free(slot);
+    if (!pixels) return 1;
+
+    ArtThumb *thumb = &image->thumbs[image->n_thumbs];
+    memset(thumb, 0, sizeof(*thumb));
+    thumb->format_id = format->format_id;
+    thumb->width = (gint16)dw;
+    thumb->height = (gint16)dh;
+    thumb->hpad = (gint16)hpad;
+    thumb->vpad = (gint16)vpad;
+
+    int rc = stage_bytes(format->format_id, pixels, size, thumb);
+    g_free(pixels);
+    if (rc < 0) return -1;
+
+    image->n_thumbs++;
+    g_dirty = TRUE;
+    return 0;
+}
+
+/* ============================================================================
+ * ArtworkDB Writer
+ * ============================================================================ */
+
+typedef struct {
+    guchar *data;
+    gsize   len;
+    gsize   cap;
+} Buf;
+
+static gsize buf_alloc(Buf *b, gsize n) {
+    if (b->len + n > b->cap) {
+        gsize cap = b->cap ? b->cap : 65536;
+        while (cap < b->len + n) cap *= 2;
+        b->data = g_realloc(b->data, cap);
+        b->cap = cap;
+    }
+    gsize at = b->len;
+    memset(b->data + at, 0, n);
+    b->len += n;
+    return at;
+}
+
+static void wr32(Buf *b, gsize at, guint32 v) {
+    guchar *p = b->data + at;
+    p[0] = (guchar)v; p[1] = (guchar)(v >> 8); p[2] = (guchar)(v >> 16); p[3] = (guchar)(v >> 24);
+}
+
+static void wr16(Buf *b, gsize at, guint16 v) {
+    b->data[at] = (guchar)v;
+    b->data[at + 1] = (guchar)(v >> 8);
+}
+
+static void wr64(Buf *b, gsize at, guint64 v) {
+    wr32(b, at, (guint32)v);
+    wr32(b, at + 4, (guint32)(v >> 32));
+}
+
+static gsize begin_chunk(Buf *b, const char *tag, guint32 header_len) {
+    gsize at = buf_alloc(b, header_len);
+    memcpy(b->data + at, tag, 4);
+    wr32(b, at + 4, header_len);
+    return at;
+}
+
+static void end_chunk(Buf *b, gsize at) {
+    wr32(b, at + 8, (guint32)(b->len - at));
+}
+
+static void write_filename_mhod(Buf *b, const ArtThumb *thumb) {
+    char name[64];
+    snprintf(name, sizeof(name), ":F%d_%u.ithmb", thumb->format_id, thumb->ithmb_index);
+    guint32 n = (guint32)strlen(name);
+    guint32 str_bytes = n * 2;                     /* UTF-16LE, ASCII only */
+    guint32 body = 12 + str_bytes;
+    guint32 pad = (4 - ((MHOD_HEADER_LEN + body) % 4)) % 4;
+
+    gsize at = begin_chunk(b, "mhod", MHOD_HEADER_LEN);
+    wr16(b, at + 12, 3);
+    b->data[at + 15] = (guchar)pad;
+    gsize s = buf_alloc(b, body + pad);
+    wr32(b, s, str_bytes);
+    b->data[s + 4] = 2;                            /* encoding: UTF-16LE */
+    for (guint32 i = 0; i < n; i++) b->data[s + 12 + i * 2] = (guchar)name[i];
+    end_chunk(b, at);
+}
+
+static void write_mhii(Buf *b, const ArtImage *image) {
+    gsize at = begin_chunk(b, "mhii", MHII_HEADER_LEN);
+    wr32(b, at + 12, image->n_thumbs);
+    wr32(b, at + 16, image->id);
+    wr64(b, at + 20, image->song_dbid);
+    wr32(b, at + 48, image->source_size);
+
+    for (guint i = 0; i < image->n_thumbs; i++) {
+        const ArtThumb *t = &image->thumbs[i];
+        gsize mhod = begin_chunk(b, "mhod", MHOD_HEADER_LEN);
+        wr16(b, mhod + 12, 2);
+
+        gsize ni = begin_chunk(b, "mhni", MHNI_HEADER_LEN);
+        wr32(b, ni + 12, 1);
+        wr32(b, ni + 16, (guint32)t->format_id);
+        wr32(b, ni + 20, t->offset);
+        wr32(b, ni + 24, t->size);
+        wr16(b, ni + 28, (guint16)t->vpad);
+        wr16(b, ni + 30, (guint16)t->hpad);
+        wr16(b, ni + 32, (guint16)t->height);
+        wr16(b, ni + 34, (guint16)t->width);
+        wr32(b, ni + 40, t->size);
+        write_filename_mhod(b, t);
+        end_chunk(b, ni);
+
+        end_chunk(b, mhod);
+    }
+    end_chunk(b, at);
+}
+
+/*
+ * Resolve which images are still linked from a track, refresh each image's
+ * song_dbid, and drop the rest. Returns the number of images kept.
+ */
+static guint prune_unlinked_images(Itdb_iTunesDB *itdb) {
+    GHashTable *linked = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (GList *l = itdb->tracks; l != NULL; l = l->next) {
+        Itdb_Track *track = (Itdb_Track *)l->data;
+        if (!track || !track->mhii_link) continue;
+        ArtImage *image = artwork_image_lookup(track->mhii_link);
+        if (!image) continue;
+        if (!g_hash_table_contains(linked, image)) {
+            g_hash_table_insert(linked, image, image);
+            image->song_dbid = track->dbid;
+        }
+    }
+
+    guint kept = 0;
+    for (guint i = 0; i < g_n_images; i++) {
+        ArtImage *image = g_images[i];
+        if (g_hash_table_contains(linked, image)) {
+            g_images[kept++] = image;
+        } else {
+            g_hash_table_remove(g_image_by_id, GUINT_TO_POINTER(image->id));
+            g_free(image);
+        }
+    }
+    g_n_images = kept;
+    g_hash_table_destroy(linked);
+    return kept;
+}
+
+int artwork_db_write(Itdb_iTunesDB *itdb) {
+    if (!itdb) {
+        art_error("No database");
+        return -1;
+    }
+    if (!g_dirty) return 0;
+
+    prune_unlinked_images(itdb);
+
+    Buf b = { 0 };
+    gsize fd = begin_chunk(&b, "mhfd", MHFD_HEADER_LEN);
+    wr32(&b, fd + 16, 2);                          /* iTunes 4.9+ databases; iTunes 7 wipes others */
+    wr32(&b, fd + 20, 3);
+    wr32(&b, fd + 28, g_next_id);
+    b.data[fd + 48] = 2;
+
+    /* mhsd 1: image list */
+    gsize sd = begin_chunk(&b, "mhsd", MHSD_HEADER_LEN);
+    wr16(&b, sd + 12, 1);
+    gsize li = begin_chunk(&b, "mhli", MHLI_HEADER_LEN);
+    wr32(&b, li + 8, g_n_images);
+    for (guint i = 0; i < g_n_images; i++) write_mhii(&b, g_images[i]);
+    end_chunk(&b, sd);
+
+    /* mhsd 2: album list (unused for cover art) */
+    sd = begin_chunk(&b, "mhsd", MHSD_HEADER_LEN);
+    wr16(&b, sd + 12, 2);
+    begin_chunk(&b, "mhla", MHLA_HEADER_LEN);
+    end_chunk(&b, sd);
+
+    /* mhsd 3: one mhif per format in use */
+    gint32 formats[64];
+    guint32 format_sizes[64];
+    guint n_formats = 0;
+    for (guint i = 0; i < g_n_images; i++) {
+        for (guint k = 0; k < g_images[i]->n_thumbs; k++) {
+            const ArtThumb *t = &g_images[i]->thumbs[k];
+            guint f = 0;
+            while (f < n_formats && formats[f] != t->format_id) f++;
+            if (f == n_formats && n_formats < G_N_ELEMENTS(formats)) {
+                formats[n_formats] = t->format_id;
+                format_sizes[n_formats] = t->size;
+                n_formats++;
+            }
+        }
+    }
+    sd = begin_chunk(&b, "mhsd", MHSD_HEADER_LEN);
+    wr16(&b, sd + 12, 3);
+    gsize lf = begin_chunk(&b, "mhlf", MHLF_HEADER_LEN);
+    wr32(&b, lf + 8, n_formats);
+    for (guint f = 0; f < n_formats; f++) {
+        gsize mf = begin_chunk(&b, "mhif", MHIF_HEADER_LEN);
+        wr32(&b, mf + 16, (guint32)formats[f]);
+        wr32(&b, mf + 20, format_sizes[f]);
+        end_chunk(&b, mf);
+    }
+    end_chunk(&b, sd);
+
+    end_chunk(&b, fd);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/ArtworkDB", g_staging_dir);
+    ensure_staging_dir();
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        g_free(b.data);
+        art_error("Cannot open %s for writing", path);
+        return -1;
+    }
+    size_t written = fwrite(b.data, 1, b.len, fp);
+    fclose(fp);
+    g_free(b.data);
+    if (written != b.len) {
+        art_error("Short write to %s", path);
+        return -1;
+    }
+
+    g_db_staged = TRUE;
+    g_dirty = FALSE;
+    return 1;
+}
+
+/* ============================================================================
+ * Compaction
+ * ============================================================================ */
+
+static void buf_printf(Buf *b, const char *fmt, ...) {
+    char tmp[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, args);
+    va_end(args);
+    if (n <= 0) return;
+    if ((size_t)n >= sizeof(tmp)) n = sizeof(tmp) - 1;
+    gsize at = buf_alloc(b, (gsize)n);
+    memcpy(b->data + at, tmp, (gsize)n);
+}
+
+static void clear_moves(void) {
+    g_free(g_moves);
+    g_moves = NULL;
+    g_n_moves = 0;
+    g_compact_planned = FALSE;
+}
+
+char *artwork_compact_plan_json(Itdb_iTunesDB *itdb) {
+    clear_moves();
+    if (!itdb) {
+        art_error("No database");
+        return NULL;
+    }
+    if (g_n_staged > 0) {
+        art_error("Artwork changes are waiting to be synced; sync before compacting");
+        return NULL;
+    }
+
+    prune_unlinked_images(itdb);
+    g_dirty = TRUE;
+
+    guint total_thumbs = 0;
+    for (guint i = 0; i < g_n_images; i++) total_thumbs += g_images[i]->n_thumbs;
+    g_moves = g_malloc0(sizeof(ArtMove) * (total_thumbs ? total_thumbs : 1));
+    g_compact_planned = TRUE;
+
+    /* Pack each format's live thumbnails into new files after the current ones,
+     * so the old files stay valid until the new ArtworkDB is on the device */
+    guint64 bytes_before = 0, bytes_after = 0;
+    for (guint f = 0; f < g_n_files; f++) bytes_before += g_files[f].size;
+
+    for (guint f = 0; f < g_n_files; f++) {
+        gint32 format_id = g_files[f].format_id;
+        gboolean seen = FALSE;
+        for (guint k = 0; k < f && !seen; k++) seen = (g_files[k].format_id == format_id);
+        if (seen) continue;
+
+        guint32 dst_index = last_device_file(format_id)->index + 1;
+        guint32 dst_offset = 0;
+        for (guint i = 0; i < g_n_images; i++) {
+            ArtImage *image = g_images[i];
+            for (guint t = 0; t < image->n_thumbs; t++) {
+                const ArtThumb *thumb = &image->thumbs[t];
+                if (thumb->format_id != format_id) continue;
+                if ((guint64)dst_offset + thumb->size > ITHMB_MAX_SIZE) {
+                    dst_index++;
+                    dst_offset = 0;
+                }
+                ArtMove *m = &g_moves[g_n_moves++];
+                m->image_id = image->id;
+                m->thumb = t;
+                m->format_id = format_id;
+                m->src_index = thumb->ithmb_index;
+                m->src_offset = thumb->offset;
+                m->size = thumb->size;
+                m->dst_index = dst_index;
+                m->dst_offset = dst_offset;
+                dst_offset += thumb->size;
+                bytes_after += thumb->size;
+            }
+        }
+    }
+
+    /* Adjacent thumbnails that stay adjacent are copied as one range */
+    Buf b = { 0 };
+    buf_printf(&b, "{\"moves\":[");
+    guint ranges = 0;
+    for (guint i = 0; i < g_n_moves;) {
+        const ArtMove *m = &g_moves[i];
+        guint32 size = m->size;
+        guint j = i + 1;
+        while (j < g_n_moves && g_moves[j].format_id == m->format_id &&
+               g_moves[j].src_index == m->src_index && g_moves[j].src_offset == m->src_offset + size &&
+               g_moves[j].dst_index == m->dst_index && g_moves[j].dst_offset == m->dst_offset + size) {
+            size += g_moves[j].size;
+            j++;
+        }
+        buf_printf(&b, "%s{\"src\":\"F%d_%u.ithmb\",\"srcOffset\":%u,\"size\":%u,\"dst\":\"F%d_%u.ithmb\",\"dstOffset\":%u}",
+                   ranges++ ? "," : "", m->format_id, m->src_index, m->src_offset, size,
+                   m->format_id, m->dst_index, m->dst_offset);
+        i = j;
+    }
+    buf_printf(&b, "],\"obsolete\":[");
+    for (guint f = 0; f < g_n_files; f++) {
+        buf_printf(&b, "%s\"F%d_%u.ithmb\"", f ? "," : "", g_files[f].format_id, g_files[f].index);
+    }
+    buf_printf(&b, "],\"bytesBefore\":%llu,\"bytesAfter\":%llu}",
+               (unsigned long long)bytes_before, (unsigned long long)bytes_after);
+
+    gsize at = buf_alloc(&b, 1);
+    b.data[at] = '\0';
+
+    /* Hand back a malloc'd copy so callers free it like every other JSON string */
+    char *json = malloc(b.len);
+    if (json) memcpy(json, b.data, b.len);
+    g_free(b.data);
+    if (!json) art_error("Out of memory");
+    return json;
+}
+
+int artwork_compact_apply(void) {
+    if (!g_compact_planned) {
+        art_error("No compaction planned");
+        return -1;
+    }
+    if (g_n_staged > 0) {
+        clear_moves();
+        art_error("Artwork changed after the compaction was planned");
+        return -1;
+    }
+
+    g_free(g_files);
+    g_files = NULL;
+    g_n_files = 0;
+
+    int moved = 0;
+    for (guint i = 0; i < g_n_moves; i++) {
+        const ArtMove *m = &g_moves[i];
+        ArtImage *image = artwork_image_lookup(m->image_id);
+        if (!image || m->thumb >= image->n_thumbs) continue;
+        ArtThumb *thumb = &image->thumbs[m->thumb];
+        thumb->ithmb_index = m->dst_index;
+        thumb->offset = m->dst_offset;
+        note_device_file(m->format_id, m->dst_index, m->dst_offset + m->size);
+        moved++;
+    }
+
+    clear_moves();
+    g_dirty = TRUE;
+    return moved;
+}
+
+/* ============================================================================
+ * Staged File Hand-off
+ * ============================================================================ */
+
+char *artwork_staged_files_json(void) {
+    size_t cap = 64 + (g_n_staged + 1) * 200;
+    char *json = malloc(cap);
+    if (!json) return NULL;
+
+    size_t pos = 0;
+    json[pos++] = '[';
+    /* .ithmb data first: the ArtworkDB that references it must land last */
+    for (guint i = 0; i < g_n_staged; i++) {
+        char path[256];
+        staged_path(path, sizeof(path), g_staged[i].format_id, g_staged[i].index);
+        pos += snprintf(json + pos, cap - pos,
+                        "%s{\"name\":\"F%d_%u.ithmb\",\"path\":\"%s\",\"offset\":%u,\"size\":%u}",
+                        pos > 1 ? "," : "", g_staged[i].format_id, g_staged[i].index, path,
+                        g_staged[i].base, g_staged[i].size);
+    }
+    if (g_db_staged) {
+        pos += snprintf(json + pos, cap - pos, "%s{\"name\":\"ArtworkDB\",\"path\":\"%s/ArtworkDB\"}",
+                        pos > 1 ? "," : "", g_staging_dir);
+    }
+    json[pos++] = ']';
+    json[pos] = '\0';
+    return json;
+}
+
+static void release_staged(gboolean copied) {
+    for (guint i = 0; i < g_n_staged; i++) {
+        char path[256];
+        staged_path(path, sizeof(path), g_staged[i].format_id, g_staged[i].index);
+        unlink(path);
+        /* The staged file now exists on the device */
+        if (copied) note_device_file(g_staged[i].format_id, g_staged[i].index, g_staged[i].base + g_staged[i].size);
+    }
+    g_free(g_staged);
+    g_staged = NULL;
+    g_n_staged = 0;
+
+    if (g_db_staged) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/ArtworkDB", g_staging_dir);
+        unlink(path);
+        g_db_staged = FALSE;
+    }
+}
+
+void artwork_commit_staged(void) {
+    release_staged(TRUE);
+}
+
+/* ============================================================================
+ * Parked State (several databases per module)
+ * ============================================================================ */
+
+struct ArtworkState {
+    ArtImage  **images;
+    guint       n_images;
+    guint       images_cap;
+    GHashTable *image_by_id;
+    guint32     next_id;
+    ArtFile    *files;
+    guint       n_files;
+    StagedFile *staged;
+    guint       n_staged;
+    gboolean    db_staged;
+    ArtMove    *moves;
+    guint       n_moves;
+    gboolean    compact_planned;
+    gboolean    dirty;
+    char        staging_dir[sizeof(g_staging_dir)];
+};
+
+void artwork_set_staging_dir(const char *dir) {
+    snprintf(g_staging_dir, sizeof(g_staging_dir), "%s", dir && *dir ? dir : ARTWORK_STAGING_DIR);
+}
+
+ArtworkState *artwork_state_detach(void) {
+    ArtworkState *state = g_malloc0(sizeof(ArtworkState));
+    state->images = g_images;
+    state->n_images = g_n_images;
+    state->images_cap = g_images_cap;
+    state->image_by_id = g_image_by_id;
+    state->next_id = g_next_id;
+    state->files = g_files;
+    state->n_files = g_n_files;
+    state->staged = g_staged;
+    state->n_staged = g_n_staged;
+    state->db_staged = g_db_staged;
+    state->moves = g_moves;
+    state->n_moves = g_n_moves;
+    state->compact_planned = g_compact_planned;
+    state->dirty = g_dirty;
+    memcpy(state->staging_dir, g_staging_dir, sizeof(g_staging_dir));
+
+    /* Leave the module as if freshly reset, without freeing anything */
+    g_images = NULL;
+    g_n_images = 0;
+    g_images_cap = 0;
+    g_image_by_id = NULL;
+    g_next_id = FIRST_IMAGE_ID;
+    g_files = NULL;
+    g_n_files = 0;
+    g_staged = NULL;
+    g_n_staged = 0;
+    g_db_staged = FALSE;
+    g_moves = NULL;
+    g_n_moves = 0;
+    g_compact_planned = FALSE;
+    g_dirty = FALSE;
+    artwork_set_staging_dir(NULL);
+    return state;
+}
+
+void artwork_state_attach(ArtworkState *state) {
+    artwork_reset();
+    if (!state) return;
+    g_images = state->images;
+    g_n_images = state->n_images;
+    g_images_cap = state->images_cap;
+    g_image_by_id = state->image_by_id;
+    g_next_id = state->next_id;
+    g_files = state->files;
+    g_n_files = state->n_files;
+    g_staged = state->staged;
+    g_n_staged = state->n_staged;
+    g_db_staged = state->db_staged;
+    g_moves = state->moves;
+    g_n_moves = state->n_moves;
+    g_compact_planned = state->compact_planned;
+    g_dirty = state->dirty;
+    memcpy(g_staging_dir, state->staging_dir, sizeof(g_staging_dir));
+    g_free(state);
+}
@@ -0,0 +1,113 @@
+/*
+ * artwork.h - Cover art pipeline and ArtworkDB I/O for TunesReloaded
+ *
+ * libgpod's artwork writer depends on gdk-pixbuf, which is not part of the
+ * WASM build. This module replaces it: thumbnails are resized and converted
+ * to each device cover format here, appended to .ithmb files, and indexed in
+ * our own ArtworkDB writer.
+ */
+
+#ifndef TUNESRELOADED_ARTWORK_H
+#define TUNESRELOADED_ARTWORK_H
+
+#include "itdb.h"
+#include "itdb_device.h"
+
+#define ART_MAX_FORMATS 8
+
+/* Default MEMFS directory where new .ithmb data and the rewritten ArtworkDB
+ * are staged before JavaScript copies them to iPod_Control/Artwork. */
+#define ARTWORK_STAGING_DIR "/artwork_out"
+
+/* One rendered thumbnail of an image, stored in an .ithmb file */
+typedef struct {
+    gint32  format_id;      /* correlation id from the device format table */
+    guint32 ithmb_index;    /* N in F<format_id>_<N>.ithmb */
+    guint32 offset;         /* byte offset inside the .ithmb file */
+    guint32 size;           /* bytes occupied in the .ithmb file */
+    gint16  width;          /* content size (excluding padding) */
+    gint16  height;
+    gint16  hpad;
+    gint16  vpad;
+} ArtThumb;
+
+/* One ArtworkDB image (mhii), shared by every track whose mhii_link matches */
+typedef struct {
+    guint32  id;
+    guint64  song_dbid;     /* dbid of one referencing track */
+    guint32  source_size;   /* size of the original encoded image */
+    guint    n_thumbs;
+    ArtThumb thumbs[ART_MAX_FORMATS];
+} ArtImage;
+
+/* Last error from an artwork_* call (static buffer) */
+const char *artwork_get_error(void);
+
+/* Drop all loaded and staged artwork state (new database / disconnect) */
+void artwork_reset(void);
+
+/* Load an existing ArtworkDB (raw file bytes). Returns number of images or -1. */
+int artwork_db_load(const guchar *data, gsize len);
+
+/* Allocate a new image with a fresh mhii id. Returns NULL on error. */
+ArtImage *artwork_image_new(guint32 source_size);
+
+/* Drop an image no track links to yet (a failed render). Thumbnails it has
+ * already staged stay in their .ithmb files as dead space until compaction. */
+void artwork_image_discard(ArtImage *image);
+
+/* Look up an image by mhii id */
+ArtImage *artwork_image_lookup(guint32 id);
+
+/*
+ * Resize @rgba (@width x @height, tightly packed RGBA8) to @format, convert to
+ * its pixel layout and stage the bytes in the format's .ithmb file.
+ * Appends a thumb to @image. Returns 0 on success, 1 if the pixel format is
+ * not supported (skipped), -1 on error.
+ */
+int artwork_add_thumb(ArtImage *image, const guchar *rgba, int width, int height,
+                      const Itdb_ArtworkFormat *format);
+
+/* Mark that the ArtworkDB index must be rewritten on the next write */
+void artwork_mark_dirty(void);
+
+/*
+ * Write the ArtworkDB for @itdb into the staging directory, dropping images no
+ * track links to. Call after itdb_write() so new tracks have their dbids.
+ * Returns 1 if an ArtworkDB was written, 0 if nothing changed, -1 on error.
+ */
+int artwork_db_write(Itdb_iTunesDB *itdb);
+
+/* JSON array of staged files ([{"name":..,"path":..,"offset":..}], caller frees) */
+char *artwork_staged_files_json(void);
+
+/* Forget staged files after JavaScript copied them to the device */
+void artwork_commit_staged(void);
+
+/*
+ * Plan a compaction: drop unlinked images and pack every live thumbnail into
+ * new .ithmb files after the existing ones. Returns JSON (caller frees):
+ * {"moves":[{"src","srcOffset","size","dst","dstOffset"}],"obsolete":[names],
+ *  "bytesBefore":N,"bytesAfter":N}, or NULL on error (e.g. unsynced artwork).
+ */
+char *artwork_compact_plan_json(Itdb_iTunesDB *itdb);
+
+/* Point the index at the planned locations once JavaScript copied the
+ * ranges; the next artwork_db_write() stages the new ArtworkDB.
+ * Returns number of thumbnails moved, or -1 if nothing was planned. */
+int artwork_compact_apply(void);
+
+/* Loaded artwork of a database that is not the active one */
+typedef struct ArtworkState ArtworkState;
+
+/* Stage into @dir instead of ARTWORK_STAGING_DIR (NULL restores the default).
+ * Databases open side by side each need their own directory. */
+void artwork_set_staging_dir(const char *dir);
+
+/* Take the loaded and staged artwork out of the module, leaving it empty */
+ArtworkState *artwork_state_detach(void);
+
+/* Drop the current artwork and install @state (consumed; NULL = empty) */
+void artwork_state_attach(ArtworkState *state);
+
+#endif /* TUNESRELOADED_ARTWORK_H */
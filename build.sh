@@ -86,6 +86,9 @@ LIBS=(
 # Thread stubs for single-threaded WASM
 THREAD_STUBS="glib_thread_stubs.c"
 
+# Self-contained helpers compiled alongside ipod_manager.c
+EXTRA_SOURCES="mp3_scan.c artwork.c sync_plan.c spl.c"
+
 # Compiler flags
 CFLAGS=(
     "-O2"
@@ -97,6 +100,7 @@ CFLAGS=(
     "-Wno-implicit-function-declaration"
     "-Wno-int-conversion"
     "-DEMSCRIPTEN"
+    "-msimd128"                        # WASM SIMD (sync-word search in mp3_scan.c)
 )
 
 # Emscripten specific flags
@@ -108,9 +112,9 @@ EMFLAGS=(
     "-s" "INITIAL_MEMORY=67108864"     # 64MB initial
     "-s" "MAXIMUM_MEMORY=536870912"    # 512MB max
     "-s" "FORCE_FILESYSTEM=1"
-    "-s" "EXPORTED_RUNTIME_METHODS=['FS','UTF8ToString','stringToUTF8','lengthBytesUTF8','ccall','cwrap']"
+    "-s" "EXPORTED_RUNTIME_METHODS=['FS','UTF8ToString','stringToUTF8','lengthBytesUTF8','ccall','cwrap','HEAPU8']"
     "-s" "USE_SQLITE3=1"
-    "-s" "EXPORTED_FUNCTIONS=['_malloc','_free','_ipod_set_mountpoint','_ipod_get_mountpoint','_ipod_parse_db','_ipod_init_new','_ipod_write_db','_ipod_close_db','_ipod_is_db_loaded','_ipod_get_track_count','_ipod_get_track_json','_ipod_get_all_tracks_json','_ipod_free_string','_ipod_add_track','_ipod_track_set_path','_ipod_track_finalize','_ipod_finalize_last_track','_ipod_finalize_last_track_no_stat','_ipod_get_track_dest_path','_ipod_remove_track','_ipod_update_track','_ipod_device_supports_artwork','_ipod_track_set_artwork_from_data','_ipod_get_playlist_count','_ipod_get_playlist_json','_ipod_get_all_playlists_json','_ipod_get_playlist_tracks_json','_ipod_create_playlist','_ipod_delete_playlist','_ipod_rename_playlist','_ipod_playlist_add_track','_ipod_playlist_remove_track','_ipod_path_to_ipod_format','_ipod_path_to_fs_format','_ipod_get_last_error','_ipod_clear_error','_ipod_get_device_info_json']"
+    "-s" "EXPORTED_FUNCTIONS=['_malloc','_free','_ipod_set_mountpoint','_ipod_get_mountpoint','_ipod_parse_db','_ipod_init_new','_ipod_write_db','_ipod_close_db','_ipod_ctx_open','_ipod_ctx_select','_ipod_ctx_current','_ipod_ctx_close','_ipod_ctx_list_json','_ipod_is_db_loaded','_ipod_get_track_count','_ipod_get_track_json','_ipod_get_all_tracks_json','_ipod_free_string','_ipod_add_track','_ipod_track_set_path','_ipod_track_finalize','_ipod_finalize_last_track','_ipod_finalize_last_track_no_stat','_ipod_get_track_dest_path','_ipod_remove_track','_ipod_remove_tracks','_ipod_update_track','_ipod_update_tracks_batch','_ipod_track_index_by_handle','_ipod_get_track_json_by_handle','_ipod_update_track_by_handle','_ipod_remove_tracks_by_handle','_ipod_device_supports_artwork','_ipod_track_set_artwork_from_data','_ipod_track_set_artwork_rgba','_ipod_track_set_artwork_cached','_ipod_artwork_load_db','_ipod_artwork_get_staged_files_json','_ipod_artwork_commit_staged','_ipod_artwork_compact_plan_json','_ipod_artwork_compact_apply','_ipod_sync_plan_begin','_ipod_sync_plan_add_local','_ipod_sync_plan_get_json','_ipod_sync_plan_end','_ipod_path_set_begin','_ipod_path_set_filter_unreferenced','_ipod_path_set_end','_ipod_get_track_paths_packed','_ipod_get_playlist_count','_ipod_get_playlist_json','_ipod_get_all_playlists_json','_ipod_get_playlist_tracks_json','_ipod_create_playlist','_ipod_delete_playlist','_ipod_rename_playlist','_ipod_playlist_add_track','_ipod_playlist_remove_track','_ipod_playlist_move_tracks','_ipod_playlist_sort','_ipod_spl_update_all','_ipod_sel_buffer','_ipod_sel_size','_ipod_sel_clear','_ipod_sel_set_range','_ipod_sel_invert','_ipod_sel_count','_ipod_sel_remove_tracks','_ipod_sel_playlist_add','_ipod_sel_playlist_remove','_ipod_sel_update_tracks','_ipod_txn_begin','_ipod_txn_commit','_ipod_txn_rollback','_ipod_txn_active','_ipod_path_to_ipod_format','_ipod_path_to_fs_format','_ipod_get_last_error','_ipod_clear_error','_ipod_get_device_info_json','_ipod_mp3_scan_begin','_ipod_mp3_scan_feed','_ipod_mp3_scan_finish','_ipod_mp3_scan_frame_count','_ipod_mp3_scan_samplerate','_ipod_mp3_scan_avg_bitrate']"
     "-s" "NO_EXIT_RUNTIME=1"
     "-s" "ASYNCIFY=1"
     "-s" "EMULATE_FUNCTION_POINTER_CASTS=1"
@@ -126,7 +130,7 @@ echo ""
 
 # Build command - include thread stubs before libraries
 mkdir -p public
-CMD="emcc ipod_manager.c ${THREAD_STUBS} ${CFLAGS[*]} ${INCLUDE_PATHS[*]} ${LIB_PATHS[*]} ${LIBS[*]} ${EMFLAGS[*]} -o ${OUTPUT_JS}"
+CMD="emcc ipod_manager.c ${EXTRA_SOURCES} ${THREAD_STUBS} ${CFLAGS[*]} ${INCLUDE_PATHS[*]} ${LIB_PATHS[*]} ${LIBS[*]} ${EMFLAGS[*]} -o ${OUTPUT_JS}"
 
 echo "Build command:"
 echo "$CMD"
@@ -135,13 +139,36 @@ echo ""
 # Execute build
 eval $CMD
 
+# Standalone copy of the MP3 frame scanner for the metadata workers (ES module, no
+# libgpod/glib), so whole-file scans during import run off the main thread
+SCAN_OUTPUT_JS="public/mp3_scan.mjs"
+SCAN_OUTPUT_WASM="public/mp3_scan.wasm"
+SCAN_EMFLAGS=(
+    "-s" "WASM=1"
+    "-s" "MODULARIZE=1"
+    "-s" "EXPORT_ES6=1"
+    "-s" "EXPORT_NAME='createMp3ScanModule'"
+    "-s" "ENVIRONMENT=worker"
+    "-s" "ALLOW_MEMORY_GROWTH=1"
+    "-s" "EXPORTED_RUNTIME_METHODS=['HEAPU8']"
+    "-s" "EXPORTED_FUNCTIONS=['_malloc','_free','_ipod_mp3_scan_begin','_ipod_mp3_scan_feed','_ipod_mp3_scan_finish','_ipod_mp3_scan_frame_count','_ipod_mp3_scan_samplerate','_ipod_mp3_scan_avg_bitrate']"
+    "--no-entry"
+)
+
+echo -e "${YELLOW}Compiling mp3_scan.c for the metadata workers...${NC}"
+SCAN_CMD="emcc mp3_scan.c -O2 -msimd128 ${SCAN_EMFLAGS[*]} -o ${SCAN_OUTPUT_JS}"
+echo "$SCAN_CMD"
+eval $SCAN_CMD
+
 if [ $? -eq 0 ]; then
     echo ""
     echo -e "${GREEN}=== Build Successful ===${NC}"
     echo -e "Output files:"
     echo -e "  - ${OUTPUT_JS}"
     echo -e "  - ${OUTPUT_WASM}"
-    ls -lh ${OUTPUT_JS} ${OUTPUT_WASM} 2>/dev/null
+    echo -e "  - ${SCAN_OUTPUT_JS}"
+    echo -e "  - ${SCAN_OUTPUT_WASM}"
+    ls -lh ${OUTPUT_JS} ${OUTPUT_WASM} ${SCAN_OUTPUT_JS} ${SCAN_OUTPUT_WASM} 2>/dev/null
     echo ""
     echo -e "${YELLOW}To serve locally:${NC}"
     echo "  python3 -m http.server 8080"
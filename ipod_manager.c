@@ -6,14 +6,19 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <time.h>
 #include <ctype.h>
+#include <errno.h>
 #include <emscripten.h>
 #include "itdb.h"
 #include "itdb_device.h"
+#include "artwork.h"
+#include "sync_plan.h"
+#include "spl.h"
 
 /* Global database pointer */
 static Itdb_iTunesDB *g_itdb = NULL;
@@ -21,6 +26,35 @@ static char g_mountpoint[4096] = "";
 static char g_last_error[1024] = "";
 static Itdb_Track *g_last_added_track = NULL;  /* Track pointer for finalization */
 
+static void art_cache_reset(void);
+static void track_json_reset(void);
+static void track_json_invalidate(Itdb_Track *track);
+static void track_json_invalidate_all(void);
+static void path_set_reset(void);
+static void track_handles_reset(void);
+static void track_handles_register_all(void);
+static guint64 track_handle(Itdb_Track *track);
+static void track_handle_forget(Itdb_Track *track);
+static void playlist_table_reset(void);
+static void playlist_members_reset(void);
+static void playlist_members_flush_all(void);
+static void playlist_members_flush(Itdb_Playlist *pl);
+static void sel_reset(void);
+static void sel_clear_all(void);
+
+typedef struct TxnLog TxnLog;
+static void txn_reset(void);
+static void txn_log_track_added(Itdb_Track *track);
+static gboolean txn_log_track_removed(Itdb_Track *track, int track_index);
+static void txn_log_track_membership(Itdb_Playlist *pl, gint pos);
+static void txn_log_track_update(Itdb_Track *track, guint32 fields);
+static void txn_log_track_file(Itdb_Track *track);
+static void txn_log_member(Itdb_Playlist *pl, Itdb_Track *track, gboolean added, gint pos);
+static void txn_log_playlist_created(Itdb_Playlist *pl);
+static gboolean txn_log_playlist_deleted(Itdb_Playlist *pl);
+static void txn_log_playlist_renamed(Itdb_Playlist *pl);
+static void txn_log_playlist_order(Itdb_Playlist *pl);
+
 /* ============================================================================
  * Utility Functions
  * ============================================================================ */
@@ -42,6 +76,15 @@ static void log_info(const char *fmt, ...) {
     printf("[INFO] %s\n", buf);
 }
 
+static void log_warning(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    char buf[1024];
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    printf("[WARN] %s\n", buf);
+}
+
 /* Helper: Validate and sanitize UTF-8 string
  * Returns a newly allocated string (caller must free) or NULL on error
  * Invalid UTF-8 sequences are stripped
@@ -330,6 +373,17 @@ int ipod_parse_db(void) {
         itdb_free(g_itdb);
         g_itdb = NULL;
     }
+    artwork_reset();
+    art_cache_reset();
+    sync_plan_reset();
+    path_set_reset();
+    track_handles_reset();
+    playlist_table_reset();
+    playlist_members_reset();
+    spl_reset();
+    txn_reset();
+    track_json_reset();
+    sel_reset();
 
     log_info("Parsing iTunesDB from: %s", g_mountpoint);
     g_itdb = itdb_parse(g_mountpoint, &error);
@@ -346,6 +400,7 @@ int ipod_parse_db(void) {
 
     // Set mountpoint on the database
     itdb_set_mountpoint(g_itdb, g_mountpoint);
+    track_handles_register_all();
     
     // Read SysInfo to populate device information (model, generation, etc.)
     if (g_itdb->device) {
@@ -397,7 +452,8 @@ int ipod_init_new(const char *model_number, const char *ipod_name) {
 }
 
 /**
- * Write/save the iTunesDB back to the iPod
+ * Write/save the iTunesDB back to the iPod. A failed ArtworkDB write is only
+ * logged as a warning: the iTunesDB is already saved by then.
  */
 EMSCRIPTEN_KEEPALIVE
 int ipod_write_db(void) {
@@ -408,6 +464,9 @@ int ipod_write_db(void) {
         return -1;
     }
 
+    // Reordered playlists keep their members in arrays until now
+    playlist_members_flush_all();
+
     // Ensure mountpoint is set on the database before writing
     // This is required for proper database structure validation
     if (strlen(g_mountpoint) > 0) {
@@ -482,20 +541,42 @@ int ipod_write_db(void) {
                 g_list_free_1(member_node);  // Free just this node, not the track
             }
         }
+        if (to_remove) spl_reset();  // compiled membership no longer matches the lists
         g_list_free(to_remove);
     }
 
     log_info("Writing iTunesDB...");
     
-    // Disable smart playlists to prevent validation issues
-    for (GList *l = g_itdb->playlists; l != NULL; l = l->next) {
+    // Recompute smart playlists natively instead of freezing them into static
+    // playlists: rules, limits and the live-update flag are written unchanged.
+    // Track edits already patched unlimited ones; only deferred work runs here.
+    int spl_count = spl_refresh(g_itdb);
+    if (spl_count > 0) log_info("Updated %d smart playlist(s)", spl_count);
+
+    gboolean written = itdb_write(g_itdb, &error);
+
+    // Older builds cleared is_spl before every write to keep libgpod from
+    // rejecting smart playlists. Keep that as the fallback: write them as
+    // static playlists holding their current members, then restore the flag.
+    GList *frozen = NULL;
+    for (GList *l = g_itdb->playlists; !written && l != NULL; l = l->next) {
         Itdb_Playlist *pl = (Itdb_Playlist *)l->data;
-        if (pl && pl->is_spl) {
-            pl->is_spl = FALSE;
+        if (pl && pl->is_spl) frozen = g_list_prepend(frozen, pl);
+    }
+    if (frozen) {
+        log_warning("Writing smart playlists failed (%s), retrying with them as static playlists",
+                    error ? error->message : "unknown error");
+        if (error) {
+            g_error_free(error);
+            error = NULL;
         }
+        for (GList *l = frozen; l != NULL; l = l->next) ((Itdb_Playlist *)l->data)->is_spl = FALSE;
+        written = itdb_write(g_itdb, &error);
+        for (GList *l = frozen; l != NULL; l = l->next) ((Itdb_Playlist *)l->data)->is_spl = TRUE;
+        g_list_free(frozen);
     }
 
-    if (!itdb_write(g_itdb, &error)) {
+    if (!written) {
         if (error) {
             set_error("Failed to write iTunesDB: %s", error->message);
             g_error_free(error);
@@ -506,6 +587,17 @@ int ipod_write_db(void) {
     }
 
     log_info("Successfully wrote iTunesDB");
+
+    /* New tracks now have dbids: every cached track JSON is stale */
+    track_json_invalidate_all();
+
+    /* ArtworkDB goes after the iTunesDB so new tracks have their dbids. The
+     * iTunesDB is already written by now, so a failure here only costs the
+     * new covers (the device keeps its old ArtworkDB), not the sync. */
+    if (artwork_db_write(g_itdb) < 0) {
+        log_warning("Failed to write ArtworkDB, new artwork not saved: %s", artwork_get_error());
+    }
+
     return 0;
 }
 
@@ -519,6 +611,18 @@ void ipod_close_db(void) {
         g_itdb = NULL;
         log_info("Database closed");
     }
+    g_last_added_track = NULL;
+    artwork_reset();
+    art_cache_reset();
+    sync_plan_reset();
+    path_set_reset();
+    track_handles_reset();
+    playlist_table_reset();
+    playlist_members_reset();
+    spl_reset();
+    txn_reset();
+    track_json_reset();
+    sel_reset();
 }
 
 /**
@@ -542,28 +646,37 @@ int ipod_get_track_count(void) {
     return (int)itdb_tracks_number(g_itdb);
 }
 
-/**
- * Get track info as JSON string (caller must free)
- * Returns NULL on error
- */
-EMSCRIPTEN_KEEPALIVE
-char* ipod_get_track_json(int index) {
-    if (!g_itdb) {
-        set_error("No database loaded");
-        return NULL;
-    }
+/* Serialized JSON of each track, minus its leading "id" (the list index,
+ * which shifts when tracks are removed), so refreshing the track list mostly
+ * copies bytes. Editing a track drops its entry; bumping g_track_json_gen
+ * invalidates every entry at once (itdb_write assigns dbids to new tracks). */
+typedef struct {
+    guint gen;
+    gsize len;
+    char  body[];
+} TrackJson;
+
+static GHashTable *g_track_json = NULL;    /* Itdb_Track* -> TrackJson* */
+static guint g_track_json_gen = 1;
+
+static void track_json_reset(void) {
+    if (g_track_json) g_hash_table_destroy(g_track_json);
+    g_track_json = NULL;
+    g_track_json_gen++;
+}
 
-    GList *tracks = g_itdb->tracks;
-    Itdb_Track *track = (Itdb_Track *)g_list_nth_data(tracks, index);
+static void track_json_invalidate(Itdb_Track *track) {
+    if (g_track_json) g_hash_table_remove(g_track_json, track);
+}
 
-    if (!track) {
-        set_error("Track index %d out of range", index);
-        return NULL;
-    }
+static void track_json_invalidate_all(void) {
+    g_track_json_gen++;
+}
 
-    /* Build JSON string - escape special characters */
-    char *json = (char *)malloc(8192);
-    if (!json) return NULL;
+static const TrackJson *track_json(Itdb_Track *track) {
+    if (!g_track_json) g_track_json = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    TrackJson *cached = g_hash_table_lookup(g_track_json, track);
+    if (cached && cached->gen == g_track_json_gen) return cached;
 
     char title_esc[512] = "", artist_esc[512] = "", album_esc[512] = "";
     char genre_esc[256] = "", path_esc[1024] = "";
@@ -574,12 +687,10 @@ char* ipod_get_track_json(int index) {
     escape_json_string(genre_esc, track->genre, sizeof(genre_esc));
     escape_json_string(path_esc, track->ipod_path, sizeof(path_esc));
 
-    /* NOTE: "id" is the track INDEX in the list, not track->id
-     * This is because track->id is 0 for newly added tracks until itdb_write() */
-    snprintf(json, 8192,
-        "{"
-        "\"id\":%d,"
+    char body[8192];
+    int len = snprintf(body, sizeof(body),
         "\"dbid\":%llu,"
+        "\"handle\":\"%llu\","
         "\"title\":\"%s\","
         "\"artist\":\"%s\","
         "\"album\":\"%s\","
@@ -596,8 +707,8 @@ char* ipod_get_track_json(int index) {
         "\"ipod_path\":\"%s\","
         "\"transferred\":%s"
         "}",
-        index,  /* Use index instead of track->id */
         (unsigned long long)track->dbid,
+        (unsigned long long)track_handle(track),
         title_esc,
         artist_esc,
         album_esc,
@@ -614,58 +725,106 @@ char* ipod_get_track_json(int index) {
         path_esc,
         track->transferred ? "true" : "false"
     );
+    if (len < 0 || (size_t)len >= sizeof(body)) len = (int)strlen(body);
+
+    TrackJson *entry = g_malloc(sizeof(TrackJson) + (gsize)len + 1);
+    entry->gen = g_track_json_gen;
+    entry->len = (gsize)len;
+    memcpy(entry->body, body, (gsize)len + 1);
+    g_hash_table_replace(g_track_json, track, entry);
+    return entry;
+}
 
+/* Append {"id":@index,<body>} to the growing array in @json */
+static gboolean append_track_json(char **json, size_t *pos, size_t *cap, int index, Itdb_Track *track) {
+    const TrackJson *tj = track_json(track);
+    char head[32];
+    int head_len = snprintf(head, sizeof(head), "%s{\"id\":%d,", *pos > 1 ? "," : "", index);
+
+    if (*pos + (size_t)head_len + tj->len + 2 > *cap) {
+        size_t new_cap = *cap * 2;
+        while (*pos + (size_t)head_len + tj->len + 2 > new_cap) new_cap *= 2;
+        char *grown = realloc(*json, new_cap);
+        if (!grown) return FALSE;
+        *json = grown;
+        *cap = new_cap;
+    }
+    memcpy(*json + *pos, head, (size_t)head_len);
+    *pos += (size_t)head_len;
+    memcpy(*json + *pos, tj->body, tj->len);
+    *pos += tj->len;
+    return TRUE;
+}
+
+/* Start a JSON array for about @count tracks */
+static char *begin_track_array(int count, size_t *pos, size_t *cap) {
+    *cap = (size_t)count * 400 + 256;
+    *pos = 0;
+    char *json = malloc(*cap);
+    if (json) json[(*pos)++] = '[';
+    return json;
+}
+
+static char *end_track_array(char *json, size_t pos) {
+    json[pos++] = ']';
+    json[pos] = '\0';
     return json;
 }
 
 /**
- * Get all tracks as JSON array (caller must free)
+ * Get track info as JSON string (caller must free)
+ * Returns NULL on error
  */
 EMSCRIPTEN_KEEPALIVE
-char* ipod_get_all_tracks_json(void) {
+char* ipod_get_track_json(int index) {
     if (!g_itdb) {
         set_error("No database loaded");
         return NULL;
     }
 
-    int count = ipod_get_track_count();
+    GList *tracks = g_itdb->tracks;
+    Itdb_Track *track = (Itdb_Track *)g_list_nth_data(tracks, index);
 
-    /* Estimate size: ~1KB per track */
-    size_t buf_size = count * 1024 + 256;
-    char *json = (char *)malloc(buf_size);
+    if (!track) {
+        set_error("Track index %d out of range", index);
+        return NULL;
+    }
+
+    /* NOTE: "id" is the track INDEX in the list, not track->id
+     * This is because track->id is 0 for newly added tracks until itdb_write() */
+    const TrackJson *tj = track_json(track);
+    char *json = (char *)malloc(tj->len + 32);
     if (!json) return NULL;
+    snprintf(json, tj->len + 32, "{\"id\":%d,%s", index, tj->body);
 
-    strcpy(json, "[");
-    size_t pos = 1;
+    return json;
+}
 
-    for (int i = 0; i < count; i++) {
-        char *track_json = ipod_get_track_json(i);
-        if (track_json) {
-            size_t track_len = strlen(track_json);
+/**
+ * Get all tracks as JSON array (caller must free)
+ */
+EMSCRIPTEN_KEEPALIVE
+char* ipod_get_all_tracks_json(void) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return NULL;
+    }
 
-            /* Grow buffer if needed */
-            if (pos + track_len + 10 > buf_size) {
-                buf_size *= 2;
-                char *new_buf = realloc(json, buf_size);
-                if (!new_buf) {
-                    free(json);
-                    free(track_json);
-                    return NULL;
-                }
-                json = new_buf;
-            }
+    size_t pos, cap;
+    char *json = begin_track_array(ipod_get_track_count(), &pos, &cap);
+    if (!json) return NULL;
 
-            if (i > 0) json[pos++] = ',';
-            memcpy(json + pos, track_json, track_len);
-            pos += track_len;
-            free(track_json);
+    /* One walk over the list; unchanged tracks are copied from the cache */
+    int i = 0;
+    for (GList *l = g_itdb->tracks; l != NULL; l = l->next, i++) {
+        if (!l->data) continue;
+        if (!append_track_json(&json, &pos, &cap, i, (Itdb_Track *)l->data)) {
+            free(json);
+            return NULL;
         }
     }
 
-    json[pos++] = ']';
-    json[pos] = '\0';
-
-    return json;
+    return end_track_array(json, pos);
 }
 
 /**
@@ -750,10 +909,15 @@ int ipod_add_track(
 
     /* Also add to master playlist (if not already present) */
     Itdb_Playlist *mpl = itdb_playlist_mpl(g_itdb);
+    if (mpl) playlist_members_flush(mpl);  // a pending member array would overwrite the add
     if (mpl && !itdb_playlist_contains_track(mpl, track)) {
         itdb_playlist_add_track(mpl, track, -1);
     }
 
+    track_handle(track);
+    spl_track_added(track);
+    txn_log_track_added(track);
+
     /* Store pointer for finalization (IDs are not assigned until write) */
     g_last_added_track = track;
 
@@ -768,6 +932,12 @@ int ipod_add_track(
     return track_index;
 }
 
+/* Finalizing sets the real file size, which size rules and limits test */
+static void spl_track_size_changed(Itdb_Track *track) {
+    guint32 field = ITDB_SPLFIELD_SIZE;
+    spl_track_changed(track, &field, 1);
+}
+
 /**
  * Finalize track after file is copied using libgpod's proper function
  * This sets ipod_path, filetype_marker, transferred, and size
@@ -791,6 +961,8 @@ int ipod_track_finalize(int track_index, const char *dest_filename) {
     }
 
     GError *error = NULL;
+    txn_log_track_file(track);
+    track_json_invalidate(track);
     
     // Use libgpod's proper function to finalize the track
     // This sets ipod_path (converts from FS to iPod format), filetype_marker, transferred, size
@@ -807,6 +979,8 @@ int ipod_track_finalize(int track_index, const char *dest_filename) {
         return -1;
     }
 
+    spl_track_size_changed(track);
+
     log_info("Finalized track index %d: %s", track_index, track->ipod_path ? track->ipod_path : "NULL");
     return 0;
 }
@@ -828,6 +1002,8 @@ int ipod_finalize_last_track(const char *dest_filename) {
     }
 
     GError *error = NULL;
+    txn_log_track_file(g_last_added_track);
+    track_json_invalidate(g_last_added_track);
     Itdb_Track *finalized = itdb_cp_finalize(g_last_added_track, g_mountpoint, dest_filename, &error);
     
     if (!finalized) {
@@ -840,6 +1016,8 @@ int ipod_finalize_last_track(const char *dest_filename) {
         return -1;
     }
 
+    spl_track_size_changed(g_last_added_track);
+
     log_info("Finalized last track: %s", g_last_added_track->ipod_path ? g_last_added_track->ipod_path : "NULL");
     return 0;
 }
@@ -881,6 +1059,8 @@ int ipod_finalize_last_track_no_stat(const char *dest_filename, int size_bytes)
     }
 
     Itdb_Track *track = g_last_added_track;
+    txn_log_track_file(track);
+    track_json_invalidate(track);
 
     /* Update transferred + size */
     track->transferred = TRUE;
@@ -928,6 +1108,8 @@ int ipod_finalize_last_track_no_stat(const char *dest_filename, int size_bytes)
     }
     track->filetype_marker = marker;
 
+    spl_track_size_changed(track);
+
     log_info("Finalized last track (no-stat): %s", track->ipod_path ? track->ipod_path : "NULL");
     return 0;
 }
@@ -950,6 +1132,8 @@ int ipod_track_set_path(int track_index, const char *ipod_path) {
         return -1;
     }
 
+    txn_log_track_file(track);
+    track_json_invalidate(track);
     if (track->ipod_path) {
         g_free(track->ipod_path);
     }
@@ -991,6 +1175,56 @@ char* ipod_get_track_dest_path(const char *original_filename) {
     return strdup(dest_path);
 }
 
+/* Unlink @track from every playlist and the database, then free it */
+static void remove_track_ptr(Itdb_Track *track, int track_index) {
+    char *title = track->title ? g_strdup(track->title) : g_strdup("Unknown");
+
+    // Its ArtworkDB entry is dropped on the next write if no other track shares it
+    if (track->mhii_link) {
+        artwork_mark_dirty();
+    }
+
+    playlist_members_flush_all();
+
+    // Takes it out of smart playlists (and their rule sets) directly
+    spl_track_removed(track);
+
+    // An open transaction keeps the track (and where it was) to undo the removal
+    gboolean keep = txn_log_track_removed(track, track_index);
+
+    // CRITICAL: itdb_track_remove does NOT remove tracks from playlists!
+    // We must explicitly remove the track from all playlists first to prevent
+    // broken links that cause "prepare_itdb_for_write: assertion 'link' failed"
+    // The membership test finds the position the transaction log keeps.
+    GList *playlists = g_itdb->playlists;
+    for (GList *l = playlists; l != NULL; l = l->next) {
+        Itdb_Playlist *pl = (Itdb_Playlist *)l->data;
+        gint pos = pl ? g_list_index(pl->members, track) : -1;
+        if (pos < 0) continue;
+        if (keep) txn_log_track_membership(pl, pos);
+        itdb_playlist_remove_track(pl, track);
+        log_info("Removed track index %d from playlist: %s", track_index, pl->name ? pl->name : "Unknown");
+    }
+
+    track_handle_forget(track);
+    track_json_invalidate(track);
+    sel_clear_all();
+
+    // Now remove the track from the database
+    // Unless a transaction keeps it, this frees the track memory, so we can't
+    // access track after this call
+    if (keep) itdb_track_unlink(track);
+    else itdb_track_remove(track);
+
+    // Clear last_added_track if it was this track
+    if (g_last_added_track == track) {
+        g_last_added_track = NULL;
+    }
+
+    log_info("Removed track: %s (index: %d)", title, track_index);
+    g_free(title);
+}
+
 /**
  * Remove a track from the database
  * @track_index: index of track in the tracks list (NOT the track ID!)
@@ -1008,33 +1242,233 @@ int ipod_remove_track(int track_index) {
         return -1;
     }
 
-    char *title = track->title ? g_strdup(track->title) : g_strdup("Unknown");
+    remove_track_ptr(track, track_index);
+    return 0;
+}
 
-    // CRITICAL: itdb_track_remove does NOT remove tracks from playlists!
-    // We must explicitly remove the track from all playlists first to prevent
-    // broken links that cause "prepare_itdb_for_write: assertion 'link' failed"
-    GList *playlists = g_itdb->playlists;
-    for (GList *l = playlists; l != NULL; l = l->next) {
-        Itdb_Playlist *pl = (Itdb_Playlist *)l->data;
-        if (pl && itdb_playlist_contains_track(pl, track)) {
-            itdb_playlist_remove_track(pl, track);
-            log_info("Removed track index %d from playlist: %s", track_index, pl->name ? pl->name : "Unknown");
-        }
+/**
+ * Remove several tracks in one call
+ * @indices: track list indices, in any order (duplicates and out-of-range entries are skipped)
+ * Indices all refer to the list before any removal, so callers need not sort them.
+ * @return number of tracks removed, or -1 on error
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_remove_tracks(const int *indices, int count) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    if (count <= 0) return 0;
+    if (!indices) {
+        set_error("No track indices given");
+        return -1;
     }
 
-    // Now remove the track from the database
-    // This frees the track memory, so we can't access track after this call
-    itdb_track_remove(track);
+    // Resolve every index up front, in one pass over the list
+    guint n_tracks = g_list_length(g_itdb->tracks);
+    Itdb_Track **by_index = g_malloc(sizeof(Itdb_Track *) * (n_tracks ? n_tracks : 1));
+    guint i = 0;
+    for (GList *l = g_itdb->tracks; l != NULL; l = l->next) {
+        by_index[i++] = (Itdb_Track *)l->data;
+    }
 
-    // Clear last_added_track if it was this track
-    if (g_last_added_track == track) {
-        g_last_added_track = NULL;
+    guint8 *marked = g_malloc0(n_tracks ? n_tracks : 1);
+    for (int k = 0; k < count; k++) {
+        int idx = indices[k];
+        if (idx >= 0 && (guint)idx < n_tracks) marked[idx] = 1;
     }
 
-    log_info("Removed track: %s (index: %d)", title, track_index);
-    g_free(title);
+    // Highest index first: the ones below stay put, so each index is still the
+    // track's position when it is removed (which a transaction logs)
+    int removed = 0;
+    for (guint k = n_tracks; k > 0; k--) {
+        if (!marked[k - 1]) continue;
+        remove_track_ptr(by_index[k - 1], (int)(k - 1));
+        removed++;
+    }
+    g_free(marked);
+    g_free(by_index);
+    return removed;
+}
 
-    return 0;
+/* Writable track fields, in field-mask bit order (bit i = k_track_fields[i]).
+ * JavaScript mirrors this order in wasmApi.js. */
+typedef enum {
+    TF_STRING,
+    TF_INT32,
+    TF_UINT32,
+    TF_INT16,
+    TF_UINT8
+} TrackFieldType;
+
+typedef struct {
+    const char    *name;
+    TrackFieldType type;
+    size_t         offset;
+    guint32        spl_field;   /* ITDB_SPLFIELD_* that rules test it by, 0 if none */
+    gint64         min, max;    /* accepted values; 0, 0 for the whole range of the C type */
+} TrackField;
+
+#define TRACK_FIELD_RANGE(member, type, spl, lo, hi) { #member, type, offsetof(Itdb_Track, member), spl, lo, hi }
+#define TRACK_FIELD(member, type, spl) TRACK_FIELD_RANGE(member, type, spl, 0, 0)
+#define TRACK_FIELD_FLAG(member, spl) TRACK_FIELD_RANGE(member, TF_UINT8, spl, 0, 1)
+
+static const TrackField k_track_fields[] = {
+    TRACK_FIELD(title,                      TF_STRING, ITDB_SPLFIELD_SONG_NAME),
+    TRACK_FIELD(artist,                     TF_STRING, ITDB_SPLFIELD_ARTIST),
+    TRACK_FIELD(album,                      TF_STRING, ITDB_SPLFIELD_ALBUM),
+    TRACK_FIELD(genre,                      TF_STRING, ITDB_SPLFIELD_GENRE),
+    TRACK_FIELD(track_nr,                   TF_INT32,  ITDB_SPLFIELD_TRACKNUMBER),
+    TRACK_FIELD(year,                       TF_INT32,  ITDB_SPLFIELD_YEAR),
+    TRACK_FIELD_RANGE(rating,               TF_UINT32, ITDB_SPLFIELD_RATING, 0, 100),
+    TRACK_FIELD(albumartist,                TF_STRING, ITDB_SPLFIELD_ALBUMARTIST),
+    TRACK_FIELD(composer,                   TF_STRING, ITDB_SPLFIELD_COMPOSER),
+    TRACK_FIELD(comment,                    TF_STRING, ITDB_SPLFIELD_COMMENT),
+    TRACK_FIELD(grouping,                   TF_STRING, ITDB_SPLFIELD_GROUPING),
+    TRACK_FIELD(description,                TF_STRING, ITDB_SPLFIELD_DESCRIPTION),
+    TRACK_FIELD(category,                   TF_STRING, ITDB_SPLFIELD_CATEGORY),
+    TRACK_FIELD(keywords,                   TF_STRING, 0),
+    TRACK_FIELD(sort_title,                 TF_STRING, 0),
+    TRACK_FIELD(sort_artist,                TF_STRING, 0),
+    TRACK_FIELD(sort_album,                 TF_STRING, 0),
+    TRACK_FIELD(sort_albumartist,           TF_STRING, 0),
+    TRACK_FIELD(sort_composer,              TF_STRING, 0),
+    TRACK_FIELD(tracks,                     TF_INT32,  0),
+    TRACK_FIELD(cd_nr,                      TF_INT32,  ITDB_SPLFIELD_DISC_NUMBER),
+    TRACK_FIELD(cds,                        TF_INT32,  0),
+    TRACK_FIELD(BPM,                        TF_INT16,  ITDB_SPLFIELD_BPM),
+    TRACK_FIELD_FLAG(compilation,           ITDB_SPLFIELD_COMPILATION),
+    TRACK_FIELD_RANGE(volume,               TF_INT32,  0, -255, 255),
+    TRACK_FIELD(starttime,                  TF_UINT32, 0),
+    TRACK_FIELD(stoptime,                   TF_UINT32, 0),
+    TRACK_FIELD_FLAG(checked,               0),
+    TRACK_FIELD_FLAG(skip_when_shuffling,   0),
+    TRACK_FIELD_FLAG(remember_playback_position, 0),
+};
+
+#define N_TRACK_FIELDS G_N_ELEMENTS(k_track_fields)
+#define TRACK_FIELD_BIT(f) (1u << (f))
+
+/* Bits of the fields ipod_update_track() has always taken */
+enum {
+    TRACK_FIELD_TITLE, TRACK_FIELD_ARTIST, TRACK_FIELD_ALBUM, TRACK_FIELD_GENRE,
+    TRACK_FIELD_TRACK_NR, TRACK_FIELD_YEAR, TRACK_FIELD_RATING
+};
+
+#define ALL_TRACK_FIELDS ((guint32)((1ull << N_TRACK_FIELDS) - 1))
+
+/* A field value: @s for string fields (NULL clears the field), @n otherwise */
+typedef struct {
+    gchar *s;
+    gint64 n;
+} TrackFieldValue;
+
+static void track_field_get(const Itdb_Track *track, guint f, TrackFieldValue *out) {
+    const void *p = (const char *)track + k_track_fields[f].offset;
+    out->s = NULL;
+    out->n = 0;
+    switch (k_track_fields[f].type) {
+    case TF_STRING: out->s = g_strdup(*(gchar * const *)p); break;
+    case TF_INT32:  out->n = *(const gint32 *)p; break;
+    case TF_UINT32: out->n = *(const guint32 *)p; break;
+    case TF_INT16:  out->n = *(const gint16 *)p; break;
+    case TF_UINT8:  out->n = *(const guint8 *)p; break;
+    }
+}
+
+static void track_field_set(Itdb_Track *track, guint f, const TrackFieldValue *value) {
+    void *p = (char *)track + k_track_fields[f].offset;
+    switch (k_track_fields[f].type) {
+    case TF_STRING:
+        g_free(*(gchar **)p);
+        *(gchar **)p = value->s ? sanitize_utf8_string(value->s) : NULL;
+        break;
+    case TF_INT32:  *(gint32 *)p = (gint32)value->n; break;
+    case TF_UINT32: *(guint32 *)p = (guint32)value->n; break;
+    case TF_INT16:  *(gint16 *)p = (gint16)value->n; break;
+    case TF_UINT8:  *(guint8 *)p = (guint8)value->n; break;
+    }
+}
+
+/* ITDB_SPLFIELD_* values of the fields in @fields, plus the modification date */
+static guint track_fields_to_spl(guint32 fields, guint32 *out) {
+    guint n = 0;
+    for (guint f = 0; f < N_TRACK_FIELDS; f++) {
+        if ((fields & TRACK_FIELD_BIT(f)) && k_track_fields[f].spl_field) out[n++] = k_track_fields[f].spl_field;
+    }
+    out[n++] = ITDB_SPLFIELD_DATE_MODIFIED;
+    return n;
+}
+
+/* Write @values (one per bit of @fields, in field order) to @track. All the
+ * per-track bookkeeping - undo log, modification time, smart playlist
+ * re-test - runs once for the whole set of fields. */
+static void track_apply_fields(Itdb_Track *track, guint32 fields, const TrackFieldValue *values) {
+    txn_log_track_update(track, fields);
+
+    guint k = 0;
+    for (guint f = 0; f < N_TRACK_FIELDS; f++) {
+        if (fields & TRACK_FIELD_BIT(f)) track_field_set(track, f, &values[k++]);
+    }
+    track->time_modified = time(NULL);
+    track_json_invalidate(track);
+
+    // Only smart playlists with rules on these fields re-test the track
+    guint32 changed[N_TRACK_FIELDS + 1];
+    guint n_changed = track_fields_to_spl(fields, changed);
+    spl_track_changed(track, changed, n_changed);
+}
+
+/* The values field @f accepts, from its table entry or else its C type */
+static void track_field_range(guint f, gint64 *min, gint64 *max) {
+    const TrackField *tf = &k_track_fields[f];
+    if (tf->min != 0 || tf->max != 0) {
+        *min = tf->min;
+        *max = tf->max;
+        return;
+    }
+    switch (tf->type) {
+    case TF_INT32:  *min = G_MININT32; *max = G_MAXINT32; break;
+    case TF_UINT32: *min = 0;          *max = G_MAXUINT32; break;
+    case TF_INT16:  *min = G_MININT16; *max = G_MAXINT16; break;
+    case TF_UINT8:  *min = 0;          *max = G_MAXUINT8; break;
+    default:        *min = 0;          *max = 0; break;
+    }
+}
+
+/* Set the error and return FALSE if @n is out of range for field @f */
+static gboolean track_field_check(guint f, gint64 n) {
+    gint64 min, max;
+    track_field_range(f, &min, &max);
+    if (n >= min && n <= max) return TRUE;
+    set_error("%s must be between %" G_GINT64_FORMAT " and %" G_GINT64_FORMAT ", got %" G_GINT64_FORMAT,
+              k_track_fields[f].name, min, max, n);
+    return FALSE;
+}
+
+/* Returns FALSE (nothing changed, error set) if a number is out of range */
+static gboolean update_track_ptr(Itdb_Track *track, const char *title, const char *artist, const char *album,
+                                 const char *genre, int track_nr, int year, int rating) {
+    TrackFieldValue values[7];
+    guint32 fields = 0;
+    guint k = 0;
+
+    const char *strings[] = { title, artist, album, genre };
+    for (guint f = TRACK_FIELD_TITLE; f <= TRACK_FIELD_GENRE; f++) {
+        if (!strings[f]) continue;
+        fields |= TRACK_FIELD_BIT(f);
+        values[k++].s = (gchar *)strings[f];
+    }
+    const int numbers[] = { track_nr, year, rating };
+    for (guint f = TRACK_FIELD_TRACK_NR; f <= TRACK_FIELD_RATING; f++) {
+        if (numbers[f - TRACK_FIELD_TRACK_NR] < 0) continue;
+        if (!track_field_check(f, numbers[f - TRACK_FIELD_TRACK_NR])) return FALSE;
+        fields |= TRACK_FIELD_BIT(f);
+        values[k++].n = numbers[f - TRACK_FIELD_TRACK_NR];
+    }
+
+    track_apply_fields(track, fields, values);
+    return TRUE;
 }
 
 /**
@@ -1063,104 +1497,866 @@ int ipod_update_track(
         return -1;
     }
 
-    if (title) { g_free(track->title); track->title = sanitize_utf8_string(title); }
-    if (artist) { g_free(track->artist); track->artist = sanitize_utf8_string(artist); }
-    if (album) { g_free(track->album); track->album = sanitize_utf8_string(album); }
-    if (genre) { g_free(track->genre); track->genre = sanitize_utf8_string(genre); }
-    if (track_nr >= 0) track->track_nr = track_nr;
-    if (year >= 0) track->year = year;
-    if (rating >= 0) track->rating = rating;
-
-    track->time_modified = time(NULL);
+    if (!update_track_ptr(track, title, artist, album, genre, track_nr, year, rating)) return -1;
 
     log_info("Updated track index: %d", track_index);
     return 0;
 }
 
-/**
- * Returns 1 if the current device supports artwork (cover images), 0 otherwise.
- * Call after ipod_parse_db() so that device info is available.
- */
-EMSCRIPTEN_KEEPALIVE
-int ipod_device_supports_artwork(void) {
-    if (!g_itdb || !g_itdb->device)
-        return 0;
-    return itdb_device_supports_artwork(g_itdb->device) ? 1 : 0;
+/* Parse the packed value at @p (NUL-terminated) for field @f into @out.
+ * An empty string clears a string field. Returns FALSE (error set) if it is
+ * not a number or is outside the field's range. */
+static gboolean parse_field_value(guint f, const char *p, TrackFieldValue *out) {
+    out->s = NULL;
+    out->n = 0;
+    if (k_track_fields[f].type == TF_STRING) {
+        out->s = *p ? (gchar *)p : NULL;
+        return TRUE;
+    }
+    char *end = NULL;
+    errno = 0;
+    out->n = strtoll(p, &end, 10);
+    if (!*p || !end || *end != '\0' || errno == ERANGE) {
+        set_error("Invalid %s value: \"%s\"", k_track_fields[f].name, p);
+        return FALSE;
+    }
+    return track_field_check(f, out->n);
 }
 
 /**
- * Set a track's artwork (cover image) from raw image data.
- * @param track_index: index of track in the tracks list (same as other track APIs).
- * @param image_data: pointer to raw image bytes (e.g. JPEG/PNG file contents).
- * @param image_data_len: length of image_data in bytes.
- * @return 0 on success, -1 on error (check ipod_get_last_error()).
+ * Update several fields of several tracks in one call
+ * @indices: track list indices (out-of-range entries are skipped)
+ * @field_mask: bit i selects field i of k_track_fields: title, artist, album,
+ *        genre, track_nr, year, rating, albumartist, composer, comment,
+ *        grouping, description, category, keywords, sort_title, sort_artist,
+ *        sort_album, sort_albumartist, sort_composer, tracks, cd_nr, cds, BPM,
+ *        compilation, volume, starttime, stoptime, checked,
+ *        skip_when_shuffling, remember_playback_position
+ * @values: @values_len bytes of NUL-terminated values (numbers in decimal,
+ *        "" clears a string; numbers outside the field's range are rejected),
+ *        one per selected field in bit order. Either one group applied to
+ *        every track, or @n groups (one per index).
+ * @return number of tracks updated, or -1 on error (nothing is changed)
  */
 EMSCRIPTEN_KEEPALIVE
-int ipod_track_set_artwork_from_data(int track_index, const unsigned char *image_data, unsigned int image_data_len) {
+int ipod_update_tracks_batch(const int *indices, int n, unsigned int field_mask, const char *values, int values_len) {
     if (!g_itdb) {
         set_error("No database loaded");
         return -1;
     }
-    if (!image_data && image_data_len > 0) {
-        set_error("Null image data");
+    if (n <= 0 || field_mask == 0) return 0;
+    if (!indices || !values || values_len <= 0) {
+        set_error("No track indices or values given");
         return -1;
     }
-    Itdb_Track *track = (Itdb_Track *)g_list_nth_data(g_itdb->tracks, (guint)track_index);
-    if (!track) {
-        set_error("Track not found at index: %d", track_index);
+    if (field_mask & ~ALL_TRACK_FIELDS) {
+        set_error("Unknown field in mask 0x%x", field_mask);
         return -1;
     }
-    if (!itdb_track_set_thumbnails_from_data(track, image_data, (gsize)image_data_len)) {
-        set_error("Failed to set artwork for track index %d", track_index);
+    if (values[values_len - 1] != '\0') {
+        set_error("Packed values must end with a NUL byte");
         return -1;
     }
-    log_info("Set artwork for track index %d (%u bytes)", track_index, image_data_len);
-    return 0;
+
+    guint selected[N_TRACK_FIELDS];
+    guint n_fields = 0;
+    for (guint f = 0; f < N_TRACK_FIELDS; f++) {
+        if (field_mask & TRACK_FIELD_BIT(f)) selected[n_fields++] = f;
+    }
+
+    // Split and check every value before touching a track
+    guint n_values = 0;
+    for (int i = 0; i < values_len; i++) {
+        if (values[i] == '\0') n_values++;
+    }
+    gboolean per_track = n > 1 && n_values == n_fields * (guint)n;
+    if (n_values != n_fields && !per_track) {
+        set_error("Expected %u or %u values, got %u", n_fields, n_fields * (guint)n, n_values);
+        return -1;
+    }
+    TrackFieldValue *parsed = g_new(TrackFieldValue, n_values);
+    const char *p = values;
+    for (guint v = 0; v < n_values; v++) {
+        guint f = selected[v % n_fields];
+        if (!parse_field_value(f, p, &parsed[v])) {
+            g_free(parsed);
+            return -1;
+        }
+        p += strlen(p) + 1;
+    }
+
+    // Resolve every index up front, in one pass over the list
+    guint n_tracks = g_list_length(g_itdb->tracks);
+    Itdb_Track **by_index = g_malloc(sizeof(Itdb_Track *) * (n_tracks ? n_tracks : 1));
+    guint i = 0;
+    for (GList *l = g_itdb->tracks; l != NULL; l = l->next) {
+        by_index[i++] = (Itdb_Track *)l->data;
+    }
+
+    int updated = 0;
+    for (int k = 0; k < n; k++) {
+        int idx = indices[k];
+        if (idx < 0 || (guint)idx >= n_tracks || !by_index[idx]) continue;
+        track_apply_fields(by_index[idx], field_mask, &parsed[per_track ? (guint)k * n_fields : 0]);
+        updated++;
+    }
+    g_free(by_index);
+    g_free(parsed);
+
+    log_info("Updated %d track(s) (fields 0x%x)", updated, field_mask);
+    return updated;
 }
 
 /* ============================================================================
- * Playlist Functions
+ * Track Handles (stable across removals)
  * ============================================================================ */
 
+/* A track's handle is its dbid, or a session id while the dbid is still 0
+ * (new tracks before itdb_write). Once handed out it never changes for the
+ * session, even when itdb_write later assigns a dbid. Handles are passed to
+ * and from JavaScript as decimal strings: they do not fit in a double. */
+#define SESSION_HANDLE_TAG 0xF000000000000000ULL
+
+static GHashTable *g_track_by_handle = NULL;   /* guint64* -> Itdb_Track* */
+static GHashTable *g_handle_by_track = NULL;   /* Itdb_Track* -> guint64* (same key) */
+static guint64 g_next_session_handle = 1;
+
+static void track_handles_reset(void) {
+    if (g_handle_by_track) g_hash_table_destroy(g_handle_by_track);
+    if (g_track_by_handle) g_hash_table_destroy(g_track_by_handle);
+    g_handle_by_track = NULL;
+    g_track_by_handle = NULL;
+    g_next_session_handle = 1;
+}
+
+static void track_handles_ensure(void) {
+    if (g_track_by_handle) return;
+    g_track_by_handle = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    g_handle_by_track = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+static guint64 track_handle(Itdb_Track *track) {
+    track_handles_ensure();
+    guint64 *known = g_hash_table_lookup(g_handle_by_track, track);
+    if (known) return *known;
+
+    guint64 handle = track->dbid;
+    while (handle == 0 || g_hash_table_contains(g_track_by_handle, &handle)) {
+        handle = SESSION_HANDLE_TAG | g_next_session_handle++;
+    }
+    guint64 *key = g_new(guint64, 1);
+    *key = handle;
+    g_hash_table_insert(g_track_by_handle, key, track);
+    g_hash_table_insert(g_handle_by_track, track, key);
+    return handle;
+}
+
+static void track_handle_forget(Itdb_Track *track) {
+    if (!g_handle_by_track) return;
+    guint64 *key = g_hash_table_lookup(g_handle_by_track, track);
+    if (!key) return;
+    g_hash_table_remove(g_handle_by_track, track);
+    g_hash_table_remove(g_track_by_handle, key);
+}
+
+/* Give a track that is linked back in the handle it had before removal */
+static void track_handle_restore(Itdb_Track *track, guint64 handle) {
+    track_handles_ensure();
+    if (g_hash_table_contains(g_track_by_handle, &handle)) return;
+    guint64 *key = g_new(guint64, 1);
+    *key = handle;
+    g_hash_table_insert(g_track_by_handle, key, track);
+    g_hash_table_insert(g_handle_by_track, track, key);
+}
+
+/* Register every parsed track, so a lookup by dbid finds tracks whose handle
+ * was never requested. Added tracks register in ipod_add_track(), removed ones
+ * are dropped in remove_track_ptr(), so lookups never rescan the list. */
+static void track_handles_register_all(void) {
+    track_handles_ensure();
+    for (GList *l = g_itdb->tracks; l != NULL; l = l->next) {
+        if (l->data) track_handle((Itdb_Track *)l->data);
+    }
+}
+
+static Itdb_Track *track_by_handle(const char *handle_str) {
+    if (!g_itdb || !g_track_by_handle || !handle_str || !*handle_str) return NULL;
+    char *end = NULL;
+    guint64 handle = strtoull(handle_str, &end, 10);
+    if (!end || *end != '\0') return NULL;
+
+    return (Itdb_Track *)g_hash_table_lookup(g_track_by_handle, &handle);
+}
+
 /**
- * Get total number of playlists
+ * Current list index of the track with @handle, or -1 if it no longer exists
  */
 EMSCRIPTEN_KEEPALIVE
-int ipod_get_playlist_count(void) {
-    if (!g_itdb) return 0;
-    return (int)itdb_playlists_number(g_itdb);
+int ipod_track_index_by_handle(const char *handle) {
+    Itdb_Track *track = track_by_handle(handle);
+    if (!track) {
+        set_error("Track not found: %s", handle ? handle : "(null)");
+        return -1;
+    }
+    return g_list_index(g_itdb->tracks, track);
 }
 
 /**
- * Get playlist info as JSON (caller must free)
+ * Get track info by handle as JSON string (caller must free)
+ * Built from the track itself, so it has no "id": the list index is not
+ * looked up (use ipod_track_index_by_handle() when it is needed).
  */
 EMSCRIPTEN_KEEPALIVE
-char* ipod_get_playlist_json(int index) {
+char* ipod_get_track_json_by_handle(const char *handle) {
     if (!g_itdb) {
         set_error("No database loaded");
         return NULL;
     }
-
-    Itdb_Playlist *pl = itdb_playlist_by_nr(g_itdb, (guint32)index);
-    if (!pl) {
-        set_error("Playlist index %d out of range", index);
+    Itdb_Track *track = track_by_handle(handle);
+    if (!track) {
+        set_error("Track not found: %s", handle ? handle : "(null)");
         return NULL;
     }
 
-    char name_esc[512] = "";
-    escape_json_string(name_esc, pl->name, sizeof(name_esc));
-
-    char *json = (char *)malloc(2048);
+    const TrackJson *tj = track_json(track);
+    char *json = (char *)malloc(tj->len + 2);
     if (!json) return NULL;
+    json[0] = '{';
+    memcpy(json + 1, tj->body, tj->len + 1);
+    return json;
+}
 
-    snprintf(json, 2048,
-        "{"
-        "\"id\":%llu,"
-        "\"name\":\"%s\","
-        "\"track_count\":%u,"
-        "\"is_master\":%s,"
-        "\"is_podcast\":%s,"
-        "\"is_smart\":%s"
+/**
+ * Update track metadata by handle (same conventions as ipod_update_track)
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_update_track_by_handle(
+    const char *handle,
+    const char *title,
+    const char *artist,
+    const char *album,
+    const char *genre,
+    int track_nr,
+    int year,
+    int rating
+) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    Itdb_Track *track = track_by_handle(handle);
+    if (!track) {
+        set_error("Track not found: %s", handle ? handle : "(null)");
+        return -1;
+    }
+
+    if (!update_track_ptr(track, title, artist, album, genre, track_nr, year, rating)) return -1;
+
+    log_info("Updated track handle: %s", handle);
+    return 0;
+}
+
+/**
+ * Remove tracks by handle
+ * @handles: newline-separated handles; unknown handles are skipped
+ * @return number of tracks removed, or -1 on error
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_remove_tracks_by_handle(const char *handles) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    if (!handles) return 0;
+
+    int removed = 0;
+    const char *start = handles;
+    while (*start) {
+        const char *end = strchr(start, '\n');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        if (len > 0 && len < 32) {
+            char handle[32];
+            memcpy(handle, start, len);
+            handle[len] = '\0';
+            Itdb_Track *track = track_by_handle(handle);
+            if (track) {
+                remove_track_ptr(track, -1);
+                removed++;
+            }
+        }
+        if (!end) break;
+        start = end + 1;
+    }
+    return removed;
+}
+
+/**
+ * Returns 1 if the current device supports artwork (cover images), 0 otherwise.
+ * Call after ipod_parse_db() so that device info is available.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_device_supports_artwork(void) {
+    if (!g_itdb || !g_itdb->device)
+        return 0;
+    return itdb_device_supports_artwork(g_itdb->device) ? 1 : 0;
+}
+
+/**
+ * Set a track's artwork (cover image) from raw image data.
+ * @param track_index: index of track in the tracks list (same as other track APIs).
+ * @param image_data: pointer to raw image bytes (e.g. JPEG/PNG file contents).
+ * @param image_data_len: length of image_data in bytes.
+ * @return 0 on success, -1 on error (check ipod_get_last_error()).
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_track_set_artwork_from_data(int track_index, const unsigned char *image_data, unsigned int image_data_len) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    if (!image_data && image_data_len > 0) {
+        set_error("Null image data");
+        return -1;
+    }
+    Itdb_Track *track = (Itdb_Track *)g_list_nth_data(g_itdb->tracks, (guint)track_index);
+    if (!track) {
+        set_error("Track not found at index: %d", track_index);
+        return -1;
+    }
+    if (!itdb_track_set_thumbnails_from_data(track, image_data, (gsize)image_data_len)) {
+        set_error("Failed to set artwork for track index %d", track_index);
+        return -1;
+    }
+    log_info("Set artwork for track index %d (%u bytes)", track_index, image_data_len);
+    return 0;
+}
+
+/* Tracks with identical cover bytes (typically an album) share one ArtworkDB
+ * image, so each unique cover is resized/encoded once. Keyed by the SHA-256
+ * of the encoded image plus its length, so a hash hit is a byte match without
+ * keeping every cover in memory; cleared with the database. */
+#define ART_DIGEST_LEN 32
+
+typedef struct {
+    guint8  digest[ART_DIGEST_LEN];
+    guint32 len;
+    guint32 image_id;
+} ArtCacheEntry;
+
+static GHashTable *g_art_cache = NULL;
+
+static guint art_cache_hash(gconstpointer key) {
+    const ArtCacheEntry *e = (const ArtCacheEntry *)key;
+    guint h;
+    memcpy(&h, e->digest, sizeof(h));
+    return h;
+}
+
+static gboolean art_cache_equal(gconstpointer a, gconstpointer b) {
+    const ArtCacheEntry *x = (const ArtCacheEntry *)a, *y = (const ArtCacheEntry *)b;
+    return x->len == y->len && memcmp(x->digest, y->digest, ART_DIGEST_LEN) == 0;
+}
+
+static void art_cache_reset(void) {
+    if (g_art_cache) {
+        g_hash_table_destroy(g_art_cache);
+        g_art_cache = NULL;
+    }
+}
+
+static void art_cache_key(ArtCacheEntry *key, const unsigned char *data, unsigned int len) {
+    memset(key, 0, sizeof(*key));
+    key->len = len;
+    GChecksum *sum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(sum, data, (gssize)len);
+    gsize digest_len = ART_DIGEST_LEN;
+    g_checksum_get_digest(sum, key->digest, &digest_len);
+    g_checksum_free(sum);
+}
+
+/* Returns the cached image for these cover bytes, dropping stale entries */
+static ArtImage *art_cache_lookup(const ArtCacheEntry *key) {
+    if (!g_art_cache) return NULL;
+    ArtCacheEntry *e = (ArtCacheEntry *)g_hash_table_lookup(g_art_cache, key);
+    if (!e) return NULL;
+    ArtImage *image = artwork_image_lookup(e->image_id);
+    if (!image) {
+        /* Dropped from the ArtworkDB after its last track was removed */
+        g_hash_table_remove(g_art_cache, e);
+    }
+    return image;
+}
+
+static void art_cache_insert(const ArtCacheEntry *key, guint32 image_id) {
+    if (!g_art_cache) {
+        g_art_cache = g_hash_table_new_full(art_cache_hash, art_cache_equal, g_free, NULL);
+    }
+    ArtCacheEntry *e = g_malloc(sizeof(ArtCacheEntry));
+    *e = *key;
+    e->image_id = image_id;
+    g_hash_table_replace(g_art_cache, e, e);
+}
+
+static void link_track_artwork(Itdb_Track *track, const ArtImage *image) {
+    track->mhii_link = image->id;
+    track->has_artwork = 0x01;
+    track->artwork_count = 1;
+    track->artwork_size = image->source_size;
+    track->time_modified = time(NULL);
+    artwork_mark_dirty(); /* the previous image may now be unreferenced */
+}
+
+/**
+ * Link a track to an already-rendered image with the same cover bytes.
+ * @param image_data: encoded cover (JPEG/PNG bytes) as embedded in the file.
+ * @return 1 if the track now shares a cached image, 0 if the cover has not been
+ * rendered yet (call ipod_track_set_artwork_rgba), -1 on error.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_track_set_artwork_cached(int track_index, const unsigned char *image_data, unsigned int image_data_len) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    if (!image_data || image_data_len == 0) {
+        set_error("Null image data");
+        return -1;
+    }
+    Itdb_Track *track = (Itdb_Track *)g_list_nth_data(g_itdb->tracks, (guint)track_index);
+    if (!track) {
+        set_error("Track not found at index: %d", track_index);
+        return -1;
+    }
+
+    ArtCacheEntry key;
+    art_cache_key(&key, image_data, image_data_len);
+    ArtImage *image = art_cache_lookup(&key);
+    if (!image) return 0;
+
+    link_track_artwork(track, image);
+    log_info("Shared artwork image %u with track index %d", image->id, track_index);
+    return 1;
+}
+
+/**
+ * Set a track's artwork from decoded pixels, rendering every cover format the
+ * device lists. Does not need gdk-pixbuf (unlike ipod_track_set_artwork_from_data):
+ * thumbnails are staged under ARTWORK_STAGING_DIR and the ArtworkDB is written
+ * by ipod_write_db().
+ * @param track_index: index of track in the tracks list (same as other track APIs).
+ * @param rgba: tightly packed RGBA8 pixels, width * height * 4 bytes.
+ * @param image_data: the encoded cover the pixels were decoded from; used as the
+ * dedup key for ipod_track_set_artwork_cached() and for the stored source size.
+ * @return 0 on success, -1 on error (check ipod_get_last_error()).
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_track_set_artwork_rgba(int track_index, const unsigned char *rgba, int width, int height,
+                                const unsigned char *image_data, unsigned int image_data_len) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    if (!rgba || width <= 0 || height <= 0) {
+        set_error("Invalid image: %dx%d", width, height);
+        return -1;
+    }
+    Itdb_Track *track = (Itdb_Track *)g_list_nth_data(g_itdb->tracks, (guint)track_index);
+    if (!track) {
+        set_error("Track not found at index: %d", track_index);
+        return -1;
+    }
+
+    ArtCacheEntry key;
+    if (image_data && image_data_len > 0) {
+        art_cache_key(&key, image_data, image_data_len);
+        ArtImage *cached = art_cache_lookup(&key);
+        if (cached) {
+            link_track_artwork(track, cached);
+            return 0;
+        }
+    }
+
+    GList *formats = g_itdb->device ? itdb_device_get_cover_art_formats(g_itdb->device) : NULL;
+    if (!formats) {
+        set_error("Device does not support cover artwork");
+        return -1;
+    }
+
+    ArtImage *image = artwork_image_new(image_data_len);
+    if (!image) {
+        g_list_free(formats);
+        set_error("Failed to allocate artwork: %s", artwork_get_error());
+        return -1;
+    }
+
+    for (GList *l = formats; l != NULL; l = l->next) {
+        const Itdb_ArtworkFormat *format = (const Itdb_ArtworkFormat *)l->data;
+        if (artwork_add_thumb(image, rgba, width, height, format) < 0) {
+            g_list_free(formats);
+            set_error("Failed to render artwork: %s", artwork_get_error());
+            artwork_image_discard(image);
+            return -1;
+        }
+    }
+    g_list_free(formats);
+
+    if (image->n_thumbs == 0) {
+        set_error("Device cover formats are not supported");
+        artwork_image_discard(image);
+        return -1;
+    }
+
+    if (image_data && image_data_len > 0) {
+        art_cache_insert(&key, image->id);
+    }
+    link_track_artwork(track, image);
+
+    log_info("Set artwork for track index %d (%dx%d, %u thumbnails, image id %u)",
+             track_index, width, height, image->n_thumbs, image->id);
+    return 0;
+}
+
+/**
+ * Load the device's existing ArtworkDB so its images are kept when the
+ * ArtworkDB is rewritten. Pass the raw file bytes; call after ipod_parse_db().
+ * @return number of images loaded, or -1 on error.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_artwork_load_db(const unsigned char *data, unsigned int len) {
+    art_cache_reset();
+    int count = artwork_db_load(data, (gsize)len);
+    if (count < 0) {
+        set_error("Failed to load ArtworkDB: %s", artwork_get_error());
+        return -1;
+    }
+    log_info("Loaded ArtworkDB: %d images", count);
+    return count;
+}
+
+/**
+ * Get the artwork files staged for copying to iPod_Control/Artwork.
+ * Returns JSON array: [{"name":"F1055_2.ithmb","path":"/artwork_out/...","offset":N,"size":N}, ...]
+ * .ithmb entries hold only new thumbnails, to be written at "offset" of the
+ * device file (existing bytes kept). ArtworkDB (if rewritten) is last and
+ * replaces the device file.
+ * Caller must free with ipod_free_string()
+ */
+EMSCRIPTEN_KEEPALIVE
+char* ipod_artwork_get_staged_files_json(void) {
+    char *json = artwork_staged_files_json();
+    if (!json) {
+        set_error("Out of memory");
+    }
+    return json;
+}
+
+/**
+ * Release staged artwork files once they have been copied to the device.
+ */
+EMSCRIPTEN_KEEPALIVE
+void ipod_artwork_commit_staged(void) {
+    artwork_commit_staged();
+}
+
+/**
+ * Plan an ArtworkDB compaction (explicit maintenance; normal syncs only append).
+ * Returns JSON: {"moves":[{"src","srcOffset","size","dst","dstOffset"}],
+ * "obsolete":[names],"bytesBefore":N,"bytesAfter":N}. JavaScript copies each
+ * range from the device .ithmb files into the new ones, then calls
+ * ipod_artwork_compact_apply().
+ * Caller must free with ipod_free_string()
+ */
+EMSCRIPTEN_KEEPALIVE
+char* ipod_artwork_compact_plan_json(void) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return NULL;
+    }
+    char *json = artwork_compact_plan_json(g_itdb);
+    if (!json) {
+        set_error("Failed to plan artwork compaction: %s", artwork_get_error());
+    }
+    return json;
+}
+
+/**
+ * Switch the artwork index to the compacted files and stage the new ArtworkDB
+ * (see ipod_artwork_get_staged_files_json). The iTunesDB is unchanged.
+ * @return number of thumbnails moved, or -1 on error.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_artwork_compact_apply(void) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    int moved = artwork_compact_apply();
+    if (moved < 0 || artwork_db_write(g_itdb) < 0) {
+        set_error("Failed to apply artwork compaction: %s", artwork_get_error());
+        return -1;
+    }
+    log_info("Compacted artwork: %d thumbnails moved", moved);
+    return moved;
+}
+
+/* ============================================================================
+ * Sync Planning
+ * ============================================================================ */
+
+/**
+ * Start a differential sync plan: index every track of the loaded database.
+ * Track indices in the plan refer to the list as it is now, so apply the plan
+ * before any other add/remove.
+ * @return number of tracks indexed, or -1 on error.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_sync_plan_begin(void) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    int count = sync_plan_begin(g_itdb);
+    log_info("Sync plan: indexed %d tracks", count);
+    return count;
+}
+
+/**
+ * Classify one file of the local library against the iPod.
+ * @local_id: caller's id for the file, echoed back in the plan JSON
+ * @size_bytes: size of the local file
+ * @write_bytes: bytes the upload writes (for a transcode, the expected size
+ *              of the converted file)
+ * @transcoded: non-zero if the file is converted on upload (e.g. FLAC), so
+ *              the iPod copy is matched by duration instead of size
+ * Sizes are doubles so files over 2GB survive the JS number -> wasm call.
+ * @return 0 unchanged, 1 add, 2 replace (audio changed), 3 metadata only,
+ *         -1 if no plan is active
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_sync_plan_add_local(
+    int local_id,
+    const char *title,
+    const char *artist,
+    const char *album,
+    const char *genre,
+    int track_nr,
+    int year,
+    double size_bytes,
+    double write_bytes,
+    int duration_ms,
+    int transcoded
+) {
+    int track_index = -1;
+    int action = sync_plan_add_local(local_id, title, artist, album, genre, track_nr, year,
+                                     (guint64)(size_bytes > 0 ? size_bytes : 0),
+                                     (guint64)(write_bytes > 0 ? write_bytes : 0),
+                                     (guint32)(duration_ms > 0 ? duration_ms : 0),
+                                     transcoded, &track_index);
+    if (action < 0) {
+        set_error("No sync plan active. Call ipod_sync_plan_begin first.");
+    }
+    return action;
+}
+
+/**
+ * Get the finished plan as JSON (caller must free with ipod_free_string):
+ * {"add":[local],"replace":[[local,track]],"metadata":[[local,track]],
+ *  "delete":[track],"unchanged":N,"bytesToWrite":N,"bytesToDelete":N}
+ * "delete" lists tracks that no local file matched.
+ */
+EMSCRIPTEN_KEEPALIVE
+char* ipod_sync_plan_get_json(void) {
+    char *json = sync_plan_json();
+    if (!json) {
+        set_error("No sync plan active");
+    }
+    return json;
+}
+
+/**
+ * Free the sync plan indexes
+ */
+EMSCRIPTEN_KEEPALIVE
+void ipod_sync_plan_end(void) {
+    sync_plan_reset();
+}
+
+/* ============================================================================
+ * Playlist Functions
+ * ============================================================================ */
+
+/* Dense array of g_itdb->playlists (list order) plus a pointer -> index map,
+ * so index <-> playlist lookups are O(1) instead of walking the list like
+ * itdb_playlist_by_nr. Entry points that add or remove playlists bump
+ * g_playlists_gen; the table is rebuilt on the next lookup. */
+static Itdb_Playlist **g_playlist_table = NULL;
+static guint g_playlist_table_len = 0;
+static guint g_playlist_table_cap = 0;
+static GHashTable *g_playlist_index = NULL;    /* Itdb_Playlist* -> index + 1 */
+static guint g_playlists_gen = 1;
+static guint g_playlist_table_gen = 0;
+
+static void playlist_table_reset(void) {
+    if (g_playlist_index) g_hash_table_destroy(g_playlist_index);
+    g_playlist_index = NULL;
+    g_free(g_playlist_table);
+    g_playlist_table = NULL;
+    g_playlist_table_len = 0;
+    g_playlist_table_cap = 0;
+    g_playlists_gen++;
+}
+
+static void playlist_table_append(Itdb_Playlist *pl) {
+    if (g_playlist_table_len == g_playlist_table_cap) {
+        g_playlist_table_cap = g_playlist_table_cap ? g_playlist_table_cap * 2 : 64;
+        g_playlist_table = g_realloc(g_playlist_table, sizeof(Itdb_Playlist *) * g_playlist_table_cap);
+    }
+    g_playlist_table[g_playlist_table_len++] = pl;
+    g_hash_table_insert(g_playlist_index, pl, GUINT_TO_POINTER(g_playlist_table_len));
+}
+
+static void playlist_table_ensure(void) {
+    if (g_playlist_table_gen == g_playlists_gen && g_playlist_index) return;
+
+    if (g_playlist_index) g_hash_table_remove_all(g_playlist_index);
+    else g_playlist_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_playlist_table_len = 0;
+    for (GList *l = g_itdb ? g_itdb->playlists : NULL; l != NULL; l = l->next) {
+        playlist_table_append((Itdb_Playlist *)l->data);
+    }
+    g_playlist_table_gen = g_playlists_gen;
+}
+
+static Itdb_Playlist *playlist_at(int index) {
+    if (!g_itdb || index < 0) return NULL;
+    playlist_table_ensure();
+    return (guint)index < g_playlist_table_len ? g_playlist_table[index] : NULL;
+}
+
+static int playlist_index_of(Itdb_Playlist *pl) {
+    if (!g_itdb || !pl) return -1;
+    playlist_table_ensure();
+    return (int)GPOINTER_TO_UINT(g_hash_table_lookup(g_playlist_index, pl)) - 1;
+}
+
+/* Playlists being reordered keep their members in a contiguous array, so a
+ * move or sort is one O(n) pass instead of O(n) GList surgery per track. The
+ * array is turned back into pl->members only when something needs the list
+ * (membership edits, track removal, ipod_write_db). */
+typedef struct {
+    Itdb_Track **items;
+    guint len;
+} MemberArray;
+
+static GHashTable *g_member_arrays = NULL;   /* Itdb_Playlist* -> MemberArray* */
+
+static void member_array_free(gpointer data) {
+    MemberArray *a = (MemberArray *)data;
+    g_free(a->items);
+    g_free(a);
+}
+
+static void playlist_members_reset(void) {
+    if (g_member_arrays) g_hash_table_destroy(g_member_arrays);
+    g_member_arrays = NULL;
+}
+
+static const MemberArray *playlist_members_pending(Itdb_Playlist *pl) {
+    return g_member_arrays ? g_hash_table_lookup(g_member_arrays, pl) : NULL;
+}
+
+static MemberArray *playlist_members_array(Itdb_Playlist *pl) {
+    if (!g_member_arrays) {
+        g_member_arrays = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, member_array_free);
+    }
+    MemberArray *a = g_hash_table_lookup(g_member_arrays, pl);
+    if (a) return a;
+
+    a = g_new0(MemberArray, 1);
+    a->len = g_list_length(pl->members);
+    a->items = g_new(Itdb_Track *, a->len ? a->len : 1);
+    guint i = 0;
+    for (GList *l = pl->members; l != NULL; l = l->next) a->items[i++] = (Itdb_Track *)l->data;
+    g_hash_table_insert(g_member_arrays, pl, a);
+    return a;
+}
+
+static void members_to_list(Itdb_Playlist *pl, const MemberArray *a) {
+    // The list was edited directly while the array was pending (a missing
+    // flush): writing the array back would drop those edits, so keep the list
+    if (g_list_length(pl->members) != a->len) {
+        log_warning("Playlist %s changed under a pending reorder; reorder dropped",
+                    pl->name ? pl->name : "Unknown");
+        return;
+    }
+    GList *members = NULL;
+    for (guint i = a->len; i > 0; i--) members = g_list_prepend(members, a->items[i - 1]);
+    g_list_free(pl->members);
+    pl->members = members;
+}
+
+static void playlist_members_flush(Itdb_Playlist *pl) {
+    const MemberArray *a = playlist_members_pending(pl);
+    if (!a) return;
+    members_to_list(pl, a);
+    g_hash_table_remove(g_member_arrays, pl);
+}
+
+static void playlist_members_flush_all(void) {
+    if (!g_member_arrays || g_hash_table_size(g_member_arrays) == 0) return;
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, g_member_arrays);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        members_to_list((Itdb_Playlist *)key, (const MemberArray *)value);
+    }
+    g_hash_table_remove_all(g_member_arrays);
+}
+
+/* Playlist is being deleted: its array is dropped, not written back */
+static void playlist_members_discard(Itdb_Playlist *pl) {
+    if (g_member_arrays) g_hash_table_remove(g_member_arrays, pl);
+}
+
+/**
+ * Get total number of playlists
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_get_playlist_count(void) {
+    if (!g_itdb) return 0;
+    return (int)itdb_playlists_number(g_itdb);
+}
+
+/**
+ * Get playlist info as JSON (caller must free)
+ */
+EMSCRIPTEN_KEEPALIVE
+char* ipod_get_playlist_json(int index) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return NULL;
+    }
+
+    Itdb_Playlist *pl = playlist_at(index);
+    if (!pl) {
+        set_error("Playlist index %d out of range", index);
+        return NULL;
+    }
+
+    char name_esc[512] = "";
+    escape_json_string(name_esc, pl->name, sizeof(name_esc));
+
+    char *json = (char *)malloc(2048);
+    if (!json) return NULL;
+
+    snprintf(json, 2048,
+        "{"
+        "\"id\":%llu,"
+        "\"name\":\"%s\","
+        "\"track_count\":%u,"
+        "\"is_master\":%s,"
+        "\"is_podcast\":%s,"
+        "\"is_smart\":%s"
         "}",
         (unsigned long long)pl->id,
         name_esc,
@@ -1170,270 +2366,1154 @@ char* ipod_get_playlist_json(int index) {
         pl->is_spl ? "true" : "false"
     );
 
-    return json;
+    return json;
+}
+
+/**
+ * Get all playlists as JSON array
+ */
+EMSCRIPTEN_KEEPALIVE
+char* ipod_get_all_playlists_json(void) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return NULL;
+    }
+
+    int count = ipod_get_playlist_count();
+    size_t buf_size = count * 512 + 256;
+    char *json = (char *)malloc(buf_size);
+    if (!json) return NULL;
+
+    strcpy(json, "[");
+    size_t pos = 1;
+
+    for (int i = 0; i < count; i++) {
+        char *pl_json = ipod_get_playlist_json(i);
+        if (pl_json) {
+            size_t pl_len = strlen(pl_json);
+            if (pos + pl_len + 10 > buf_size) {
+                buf_size *= 2;
+                char *new_buf = realloc(json, buf_size);
+                if (!new_buf) { free(json); free(pl_json); return NULL; }
+                json = new_buf;
+            }
+            if (i > 0) json[pos++] = ',';
+            memcpy(json + pos, pl_json, pl_len);
+            pos += pl_len;
+            free(pl_json);
+        }
+    }
+
+    json[pos++] = ']';
+    json[pos] = '\0';
+
+    return json;
+}
+
+/**
+ * Get tracks in a playlist as JSON array
+ */
+EMSCRIPTEN_KEEPALIVE
+char* ipod_get_playlist_tracks_json(int playlist_index) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return NULL;
+    }
+
+    Itdb_Playlist *pl = playlist_at(playlist_index);
+    if (!pl) {
+        set_error("Playlist index %d out of range", playlist_index);
+        return NULL;
+    }
+
+    /* Track list indices for the "id" fields, built once instead of per member */
+    GHashTable *index_of = g_hash_table_new(g_direct_hash, g_direct_equal);
+    int i = 0;
+    for (GList *t = g_itdb->tracks; t != NULL; t = t->next, i++) {
+        g_hash_table_insert(index_of, t->data, GINT_TO_POINTER(i + 1));
+    }
+
+    /* A reordered playlist is read from its member array; the GList is stale */
+    const MemberArray *pending = playlist_members_pending(pl);
+    GList *l = pending ? NULL : pl->members;
+    int n_members = pending ? (int)pending->len : (int)g_list_length(pl->members);
+
+    size_t pos, cap;
+    char *json = begin_track_array(n_members, &pos, &cap);
+    if (!json) {
+        g_hash_table_destroy(index_of);
+        return NULL;
+    }
+
+    for (int idx = 0; idx < n_members; idx++) {
+        Itdb_Track *track = pending ? pending->items[idx] : (Itdb_Track *)l->data;
+        if (l) l = l->next;
+        if (!track) continue;
+
+        int track_idx = GPOINTER_TO_INT(g_hash_table_lookup(index_of, track)) - 1;
+        if (track_idx < 0) continue;
+
+        if (!append_track_json(&json, &pos, &cap, track_idx, track)) {
+            free(json);
+            g_hash_table_destroy(index_of);
+            return NULL;
+        }
+    }
+    g_hash_table_destroy(index_of);
+
+    return end_track_array(json, pos);
+}
+
+/**
+ * Create a new playlist
+ * Returns playlist index on success, -1 on error
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_create_playlist(const char *name) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+
+    if (!name || strlen(name) == 0) {
+        set_error("Playlist name cannot be empty");
+        return -1;
+    }
+
+    Itdb_Playlist *pl = itdb_playlist_new(name, FALSE);
+    if (!pl) {
+        set_error("Failed to create playlist");
+        return -1;
+    }
+
+    /* Appended at the end of the list: extend the table instead of rebuilding it */
+    playlist_table_ensure();
+    itdb_playlist_add(g_itdb, pl, -1);
+    playlist_table_append(pl);
+    txn_log_playlist_created(pl);
+    int idx = playlist_index_of(pl);
+
+    log_info("Created playlist: %s (index: %d)", name, idx);
+    return idx;
 }
 
 /**
- * Get all playlists as JSON array
+ * Delete a playlist
  */
 EMSCRIPTEN_KEEPALIVE
-char* ipod_get_all_playlists_json(void) {
+int ipod_delete_playlist(int playlist_index) {
     if (!g_itdb) {
         set_error("No database loaded");
-        return NULL;
+        return -1;
     }
 
-    int count = ipod_get_playlist_count();
-    size_t buf_size = count * 512 + 256;
-    char *json = (char *)malloc(buf_size);
-    if (!json) return NULL;
+    Itdb_Playlist *pl = playlist_at(playlist_index);
+    if (!pl) {
+        set_error("Playlist index %d out of range", playlist_index);
+        return -1;
+    }
 
-    strcpy(json, "[");
-    size_t pos = 1;
+    if (itdb_playlist_is_mpl(pl)) {
+        set_error("Cannot delete master playlist");
+        return -1;
+    }
 
-    for (int i = 0; i < count; i++) {
-        char *pl_json = ipod_get_playlist_json(i);
-        if (pl_json) {
-            size_t pl_len = strlen(pl_json);
-            if (pos + pl_len + 10 > buf_size) {
-                buf_size *= 2;
-                char *new_buf = realloc(json, buf_size);
-                if (!new_buf) { free(json); free(pl_json); return NULL; }
-                json = new_buf;
-            }
-            if (i > 0) json[pos++] = ',';
-            memcpy(json + pos, pl_json, pl_len);
-            pos += pl_len;
-            free(pl_json);
-        }
+    char *name = pl->name ? g_strdup(pl->name) : g_strdup("Unknown");
+
+    // An open transaction keeps the playlist, members included, to undo the deletion
+    gboolean keep = txn_log_playlist_deleted(pl);
+    if (keep) playlist_members_flush(pl);
+    else playlist_members_discard(pl);
+    spl_playlist_removed(pl);
+    if (keep) itdb_playlist_unlink(pl);
+    else itdb_playlist_remove(pl);
+    g_playlists_gen++;
+
+    log_info("Deleted playlist: %s", name);
+    g_free(name);
+
+    return 0;
+}
+
+/**
+ * Rename a playlist
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_rename_playlist(int playlist_index, const char *new_name) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
     }
 
-    json[pos++] = ']';
-    json[pos] = '\0';
+    Itdb_Playlist *pl = playlist_at(playlist_index);
+    if (!pl) {
+        set_error("Playlist index %d out of range", playlist_index);
+        return -1;
+    }
 
-    return json;
+    if (!new_name || strlen(new_name) == 0) {
+        set_error("Playlist name cannot be empty");
+        return -1;
+    }
+
+    txn_log_playlist_renamed(pl);
+    g_free(pl->name);
+    pl->name = g_strdup(new_name);
+
+    log_info("Renamed playlist %d to: %s", playlist_index, new_name);
+    return 0;
 }
 
 /**
- * Get tracks in a playlist as JSON array
+ * Add a track to a playlist
+ * @track_index: index of track in the tracks list (NOT the track ID!)
  */
 EMSCRIPTEN_KEEPALIVE
-char* ipod_get_playlist_tracks_json(int playlist_index) {
+int ipod_playlist_add_track(int playlist_index, int track_index) {
     if (!g_itdb) {
         set_error("No database loaded");
-        return NULL;
+        return -1;
     }
 
-    Itdb_Playlist *pl = itdb_playlist_by_nr(g_itdb, (guint32)playlist_index);
+    Itdb_Playlist *pl = playlist_at(playlist_index);
     if (!pl) {
         set_error("Playlist index %d out of range", playlist_index);
-        return NULL;
+        return -1;
     }
 
-    int count = itdb_playlist_tracks_number(pl);
-    size_t buf_size = count * 1024 + 256;
-    char *json = (char *)malloc(buf_size);
-    if (!json) return NULL;
+    Itdb_Track *track = (Itdb_Track *)g_list_nth_data(g_itdb->tracks, (guint)track_index);
+    if (!track) {
+        set_error("Track not found at index: %d", track_index);
+        return -1;
+    }
 
-    strcpy(json, "[");
-    size_t pos = 1;
+    playlist_members_flush(pl);
+    if (itdb_playlist_contains_track(pl, track)) {
+        log_info("Track index %d already in playlist %d", track_index, playlist_index);
+        return 0; /* Not an error */
+    }
 
-    GList *members = pl->members;
-    int idx = 0;
-    for (GList *l = members; l != NULL; l = l->next, idx++) {
-        Itdb_Track *track = (Itdb_Track *)l->data;
-        if (!track) continue;
+    itdb_playlist_add_track(pl, track, -1);
+    spl_playlist_track_changed(pl, track, TRUE);
+    txn_log_member(pl, track, TRUE, -1);
 
-        /* Find track index in main list */
-        int track_idx = g_list_index(g_itdb->tracks, track);
-        if (track_idx < 0) continue;
+    log_info("Added track index %d to playlist %d", track_index, playlist_index);
+    return 0;
+}
 
-        char *track_json = ipod_get_track_json(track_idx);
-        if (track_json) {
-            size_t track_len = strlen(track_json);
-            if (pos + track_len + 10 > buf_size) {
-                buf_size *= 2;
-                char *new_buf = realloc(json, buf_size);
-                if (!new_buf) { free(json); free(track_json); return NULL; }
-                json = new_buf;
-            }
-            if (idx > 0) json[pos++] = ',';
-            memcpy(json + pos, track_json, track_len);
-            pos += track_len;
-            free(track_json);
+/**
+ * Remove a track from a playlist
+ * @track_index: index of track in the tracks list (NOT the track ID!)
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_playlist_remove_track(int playlist_index, int track_index) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+
+    Itdb_Playlist *pl = playlist_at(playlist_index);
+    if (!pl) {
+        set_error("Playlist index %d out of range", playlist_index);
+        return -1;
+    }
+
+    Itdb_Track *track = (Itdb_Track *)g_list_nth_data(g_itdb->tracks, (guint)track_index);
+    if (!track) {
+        set_error("Track not found at index: %d", track_index);
+        return -1;
+    }
+
+    playlist_members_flush(pl);
+    if (!itdb_playlist_contains_track(pl, track)) {
+        set_error("Track index %d not in playlist %d", track_index, playlist_index);
+        return -1;
+    }
+
+    gint pos = g_list_index(pl->members, track);
+    itdb_playlist_remove_track(pl, track);
+    spl_playlist_track_changed(pl, track, FALSE);
+    txn_log_member(pl, track, FALSE, pos);
+
+    log_info("Removed track index %d from playlist %d", track_index, playlist_index);
+    return 0;
+}
+
+/* Sort keys for ipod_playlist_sort() */
+typedef enum {
+    SORT_TITLE, SORT_ARTIST, SORT_ALBUM, SORT_GENRE,
+    SORT_YEAR, SORT_TRACK_NR, SORT_CD_NR, SORT_RATING,
+    SORT_PLAYCOUNT, SORT_TRACKLEN, SORT_TIME_ADDED
+} SortField;
+
+static const struct { const char *name; SortField field; gboolean is_string; } k_sort_fields[] = {
+    { "title", SORT_TITLE, TRUE },         { "artist", SORT_ARTIST, TRUE },
+    { "album", SORT_ALBUM, TRUE },         { "genre", SORT_GENRE, TRUE },
+    { "year", SORT_YEAR, FALSE },          { "track_nr", SORT_TRACK_NR, FALSE },
+    { "cd_nr", SORT_CD_NR, FALSE },        { "rating", SORT_RATING, FALSE },
+    { "playcount", SORT_PLAYCOUNT, FALSE }, { "tracklen", SORT_TRACKLEN, FALSE },
+    { "time_added", SORT_TIME_ADDED, FALSE },
+};
+
+#define MAX_SORT_KEYS 4
+
+typedef struct {
+    SortField field;
+    gboolean is_string;
+    gboolean descending;
+} SortKey;
+
+typedef struct {
+    Itdb_Track *track;
+    guint pos;                          /* original position: keeps the sort stable */
+    gchar *collate[MAX_SORT_KEYS];      /* collation keys of the string fields */
+} SortItem;
+
+/* qsort has no user data argument; sorts never nest */
+static SortKey g_sort_keys[MAX_SORT_KEYS];
+static int g_n_sort_keys = 0;
+
+static const char *track_string_field(const Itdb_Track *t, SortField f) {
+    switch (f) {
+    case SORT_TITLE:  return t->title;
+    case SORT_ARTIST: return t->artist;
+    case SORT_ALBUM:  return t->album;
+    case SORT_GENRE:  return t->genre;
+    default:          return NULL;
+    }
+}
+
+static gint64 track_int_field(const Itdb_Track *t, SortField f) {
+    switch (f) {
+    case SORT_YEAR:       return t->year;
+    case SORT_TRACK_NR:   return t->track_nr;
+    case SORT_CD_NR:      return t->cd_nr;
+    case SORT_RATING:     return t->rating;
+    case SORT_PLAYCOUNT:  return t->playcount;
+    case SORT_TRACKLEN:   return t->tracklen;
+    case SORT_TIME_ADDED: return (gint64)t->time_added;
+    default:              return 0;
+    }
+}
+
+static int compare_sort_items(const void *pa, const void *pb) {
+    const SortItem *a = (const SortItem *)pa;
+    const SortItem *b = (const SortItem *)pb;
+    for (int k = 0; k < g_n_sort_keys; k++) {
+        const SortKey *key = &g_sort_keys[k];
+        int c;
+        if (key->is_string) {
+            c = strcmp(a->collate[k], b->collate[k]);
+        } else {
+            gint64 x = track_int_field(a->track, key->field);
+            gint64 y = track_int_field(b->track, key->field);
+            c = (x > y) - (x < y);
         }
+        if (c != 0) return key->descending ? -c : c;
     }
+    return (a->pos > b->pos) - (a->pos < b->pos);
+}
 
-    json[pos++] = ']';
-    json[pos] = '\0';
+static int parse_sort_keys(const char *keys) {
+    g_n_sort_keys = 0;
+    gchar **parts = g_strsplit(keys ? keys : "", ",", -1);
+    for (int i = 0; parts[i] != NULL; i++) {
+        const char *name = g_strstrip(parts[i]);
+        if (!*name) continue;
+        gboolean descending = (*name == '-');
+        if (descending) name++;
+
+        guint f;
+        for (f = 0; f < G_N_ELEMENTS(k_sort_fields); f++) {
+            if (strcmp(name, k_sort_fields[f].name) == 0) break;
+        }
+        if (f == G_N_ELEMENTS(k_sort_fields)) {
+            set_error("Unknown sort key: %s", name);
+            g_strfreev(parts);
+            return -1;
+        }
+        if (g_n_sort_keys == MAX_SORT_KEYS) {
+            set_error("At most %d sort keys are supported", MAX_SORT_KEYS);
+            g_strfreev(parts);
+            return -1;
+        }
+        g_sort_keys[g_n_sort_keys].field = k_sort_fields[f].field;
+        g_sort_keys[g_n_sort_keys].is_string = k_sort_fields[f].is_string;
+        g_sort_keys[g_n_sort_keys].descending = descending;
+        g_n_sort_keys++;
+    }
+    g_strfreev(parts);
+    if (g_n_sort_keys == 0) {
+        set_error("No sort keys given");
+        return -1;
+    }
+    return 0;
+}
 
-    return json;
+static Itdb_Playlist *reorderable_playlist(int playlist_index) {
+    Itdb_Playlist *pl = playlist_at(playlist_index);
+    if (!pl) {
+        set_error("Playlist index %d out of range", playlist_index);
+        return NULL;
+    }
+    if (pl->is_spl) {
+        set_error("Smart playlists are ordered by their rules");
+        return NULL;
+    }
+    if (itdb_playlist_is_mpl(pl)) {
+        set_error("The master playlist keeps the library order");
+        return NULL;
+    }
+    return pl;
 }
 
 /**
- * Create a new playlist
- * Returns playlist index on success, -1 on error
+ * Move tracks within a playlist
+ * @positions: positions (0-based, within the playlist) of the tracks to move
+ * @dest: position, counted before the move, that the tracks are inserted in
+ *        front of (the playlist length appends). Moved tracks keep their
+ *        relative order.
+ * Returns the new position of the first moved track, or -1 on error
  */
 EMSCRIPTEN_KEEPALIVE
-int ipod_create_playlist(const char *name) {
+int ipod_playlist_move_tracks(int playlist_index, const int *positions, int n, int dest) {
     if (!g_itdb) {
         set_error("No database loaded");
         return -1;
     }
+    Itdb_Playlist *pl = reorderable_playlist(playlist_index);
+    if (!pl) return -1;
 
-    if (!name || strlen(name) == 0) {
-        set_error("Playlist name cannot be empty");
+    MemberArray *a = playlist_members_array(pl);
+    if (n <= 0 || !positions) return dest;
+    if (dest < 0 || (guint)dest > a->len) {
+        set_error("Destination %d out of range", dest);
         return -1;
     }
 
-    Itdb_Playlist *pl = itdb_playlist_new(name, FALSE);
-    if (!pl) {
-        set_error("Failed to create playlist");
+    guint8 *moved = g_malloc0(a->len ? a->len : 1);
+    guint n_moved = 0;
+    for (int i = 0; i < n; i++) {
+        int p = positions[i];
+        if (p < 0 || (guint)p >= a->len) {
+            g_free(moved);
+            set_error("Position %d out of range", p);
+            return -1;
+        }
+        if (!moved[p]) n_moved++;
+        moved[p] = 1;
+    }
+
+    txn_log_playlist_order(pl);
+    Itdb_Track **out = g_new(Itdb_Track *, a->len ? a->len : 1);
+    guint o = 0;
+    int first = -1;
+    for (guint i = 0; i <= a->len; i++) {
+        if (i == (guint)dest) {
+            first = (int)o;
+            for (guint j = 0; j < a->len; j++) {
+                if (moved[j]) out[o++] = a->items[j];
+            }
+        }
+        if (i < a->len && !moved[i]) out[o++] = a->items[i];
+    }
+    g_free(moved);
+    g_free(a->items);
+    a->items = out;
+
+    log_info("Moved %u track(s) in playlist %d to position %d", n_moved, playlist_index, first);
+    return first;
+}
+
+/**
+ * Sort a playlist by one or more fields (stable)
+ * @keys: comma-separated fields, "-" prefix for descending, e.g.
+ *        "artist,album,cd_nr,track_nr". Fields: title, artist, album, genre,
+ *        year, track_nr, cd_nr, rating, playcount, tracklen, time_added
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_playlist_sort(int playlist_index, const char *keys) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    Itdb_Playlist *pl = reorderable_playlist(playlist_index);
+    if (!pl) return -1;
+    if (parse_sort_keys(keys) < 0) return -1;
+
+    txn_log_playlist_order(pl);
+    MemberArray *a = playlist_members_array(pl);
+    SortItem *items = g_new0(SortItem, a->len ? a->len : 1);
+    for (guint i = 0; i < a->len; i++) {
+        items[i].track = a->items[i];
+        items[i].pos = i;
+        for (int k = 0; k < g_n_sort_keys; k++) {
+            if (!g_sort_keys[k].is_string) continue;
+            const char *value = track_string_field(a->items[i], g_sort_keys[k].field);
+            gchar *fold = g_utf8_casefold(value ? value : "", -1);
+            items[i].collate[k] = g_utf8_collate_key(fold, -1);
+            g_free(fold);
+        }
+    }
+
+    qsort(items, a->len, sizeof(SortItem), compare_sort_items);
+
+    for (guint i = 0; i < a->len; i++) {
+        a->items[i] = items[i].track;
+        for (int k = 0; k < g_n_sort_keys; k++) g_free(items[i].collate[k]);
+    }
+    g_free(items);
+
+    log_info("Sorted playlist %d by %s", playlist_index, keys);
+    return 0;
+}
+
+/**
+ * Re-evaluate every smart playlist against the current library
+ * (ipod_write_db does this too). Returns the number of smart playlists.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_spl_update_all(void) {
+    if (!g_itdb) {
+        set_error("No database loaded");
         return -1;
     }
+    return spl_update_all(g_itdb);
+}
 
-    itdb_playlist_add(g_itdb, pl, -1);
+/* ============================================================================
+ * Track Selection (bitset)
+ * ============================================================================ */
 
-    /* Find the index */
-    int idx = -1;
-    GList *playlists = g_itdb->playlists;
-    int i = 0;
-    for (GList *l = playlists; l != NULL; l = l->next, i++) {
-        if (l->data == pl) {
-            idx = i;
-            break;
+/* The UI's track selection: bit i of word i / 32 is track list index i.
+ * JavaScript reads and writes the words in place (see ipod_sel_buffer);
+ * range, invert and count work a word at a time, and the bulk operations
+ * below take the selection instead of an index array. Removing tracks shifts
+ * the indices after them, so it clears the selection. */
+static guint32 *g_sel_words = NULL;
+static guint g_sel_bits = 0;
+
+#define SEL_WORDS(bits) (((bits) + 31) / 32)
+#define SEL_TEST(i) ((g_sel_words[(i) / 32] >> ((i) % 32)) & 1u)
+
+static void sel_reset(void) {
+    g_free(g_sel_words);
+    g_sel_words = NULL;
+    g_sel_bits = 0;
+}
+
+static void sel_clear_all(void) {
+    if (g_sel_words) memset(g_sel_words, 0, sizeof(guint32) * SEL_WORDS(g_sel_bits));
+}
+
+/* Size the bitset to the track list. New bits start cleared, and bits past
+ * the end stay zero so word-wide operations need no bounds checks. */
+static void sel_fit(void) {
+    guint bits = g_itdb ? g_list_length(g_itdb->tracks) : 0;
+    if (g_sel_words && bits == g_sel_bits) return;
+
+    guint old_words = g_sel_words ? SEL_WORDS(g_sel_bits) : 0;
+    guint words = SEL_WORDS(bits);
+    g_sel_words = g_realloc(g_sel_words, sizeof(guint32) * (words ? words : 1));
+    if (words > old_words) memset(g_sel_words + old_words, 0, sizeof(guint32) * (words - old_words));
+    if (bits % 32) g_sel_words[bits / 32] &= (1u << (bits % 32)) - 1;
+    g_sel_bits = bits;
+}
+
+static guint sel_count(void) {
+    guint n = 0;
+    for (guint w = 0; w < SEL_WORDS(g_sel_bits); w++) n += (guint)__builtin_popcount(g_sel_words[w]);
+    return n;
+}
+
+/* Selected track indices, ascending (g_free the result) */
+static int *sel_indices(guint *n_out) {
+    sel_fit();
+    guint n = sel_count();
+    int *indices = g_new(int, n ? n : 1);
+    guint k = 0;
+    for (guint w = 0; w < SEL_WORDS(g_sel_bits); w++) {
+        for (guint32 bits = g_sel_words[w]; bits; bits &= bits - 1) {
+            indices[k++] = (int)(w * 32 + (guint)__builtin_ctz(bits));
         }
     }
+    *n_out = n;
+    return indices;
+}
+
+/* Selected tracks, in list order (g_free the result) */
+static Itdb_Track **sel_tracks(guint *n_out) {
+    sel_fit();
+    guint n = sel_count();
+    Itdb_Track **tracks = g_new(Itdb_Track *, n ? n : 1);
+    guint i = 0, k = 0;
+    for (GList *l = g_itdb->tracks; l != NULL && k < n; l = l->next, i++) {
+        if (SEL_TEST(i) && l->data) tracks[k++] = (Itdb_Track *)l->data;
+    }
+    *n_out = k;
+    return tracks;
+}
+
+/**
+ * Get the selection bitset, sized to the current track list (empty without
+ * a database). JavaScript may read and write its ceil(ipod_sel_size() / 32)
+ * words in place; the buffer moves when a later selection call resizes it
+ * and is freed when the database is closed or reloaded.
+ */
+EMSCRIPTEN_KEEPALIVE
+unsigned int *ipod_sel_buffer(void) {
+    sel_fit();
+    return g_sel_words;
+}
+
+/**
+ * Number of bits (tracks) the selection buffer covers
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_sel_size(void) {
+    return (int)g_sel_bits;
+}
+
+/**
+ * Deselect every track
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_sel_clear(void) {
+    sel_clear_all();
+    return 0;
+}
+
+/**
+ * Select (@on = 1) or deselect tracks [@from, @to); the range is clamped to the list
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_sel_set_range(int from, int to, int on) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    sel_fit();
+    guint lo = from < 0 ? 0 : (guint)from;
+    guint hi = to < 0 ? 0 : MIN((guint)to, g_sel_bits);
+    while (lo < hi) {
+        guint w = lo / 32, bit = lo % 32;
+        guint span = MIN(32 - bit, hi - lo);
+        guint32 mask = (span == 32 ? 0xFFFFFFFFu : ((1u << span) - 1)) << bit;
+        if (on) g_sel_words[w] |= mask;
+        else g_sel_words[w] &= ~mask;
+        lo += span;
+    }
+    return 0;
+}
+
+/**
+ * Select exactly the tracks that were not selected
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_sel_invert(void) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    sel_fit();
+    for (guint w = 0; w < SEL_WORDS(g_sel_bits); w++) g_sel_words[w] = ~g_sel_words[w];
+    if (g_sel_bits % 32) g_sel_words[g_sel_bits / 32] &= (1u << (g_sel_bits % 32)) - 1;
+    return 0;
+}
 
-    log_info("Created playlist: %s (index: %d)", name, idx);
-    return idx;
+/**
+ * Number of selected tracks
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_sel_count(void) {
+    if (!g_itdb) return 0;
+    sel_fit();
+    return (int)sel_count();
 }
 
 /**
- * Delete a playlist
+ * Remove every selected track (the selection is cleared)
+ * @return number of tracks removed, or -1 on error
  */
 EMSCRIPTEN_KEEPALIVE
-int ipod_delete_playlist(int playlist_index) {
+int ipod_sel_remove_tracks(void) {
     if (!g_itdb) {
         set_error("No database loaded");
         return -1;
     }
+    guint n = 0;
+    int *indices = sel_indices(&n);
+    int removed = ipod_remove_tracks(indices, (int)n);
+    g_free(indices);
+    sel_clear_all();
+    return removed;
+}
 
-    Itdb_Playlist *pl = itdb_playlist_by_nr(g_itdb, (guint32)playlist_index);
-    if (!pl) {
-        set_error("Playlist index %d out of range", playlist_index);
+/**
+ * Add every selected track that is not already a member to a playlist,
+ * in list order
+ * @return number of tracks added, or -1 on error
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_sel_playlist_add(int playlist_index) {
+    if (!g_itdb) {
+        set_error("No database loaded");
         return -1;
     }
-
-    if (itdb_playlist_is_mpl(pl)) {
-        set_error("Cannot delete master playlist");
+    Itdb_Playlist *pl = playlist_at(playlist_index);
+    if (!pl) {
+        set_error("Playlist index %d out of range", playlist_index);
         return -1;
     }
 
-    char *name = pl->name ? g_strdup(pl->name) : g_strdup("Unknown");
-
-    itdb_playlist_remove(pl);
-
-    log_info("Deleted playlist: %s", name);
-    g_free(name);
-
-    return 0;
+    guint n = 0;
+    Itdb_Track **tracks = sel_tracks(&n);
+    playlist_members_flush(pl);
+    GHashTable *members = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (GList *l = pl->members; l != NULL; l = l->next) g_hash_table_add(members, l->data);
+
+    // Appending walks the member list each time; insert at the head of the
+    // reversed list instead, then turn it back around
+    pl->members = g_list_reverse(pl->members);
+    int added = 0;
+    for (guint k = 0; k < n; k++) {
+        if (!g_hash_table_add(members, tracks[k])) continue;
+        itdb_playlist_add_track(pl, tracks[k], 0);
+        spl_playlist_track_changed(pl, tracks[k], TRUE);
+        txn_log_member(pl, tracks[k], TRUE, -1);
+        added++;
+    }
+    pl->members = g_list_reverse(pl->members);
+
+    g_hash_table_destroy(members);
+    g_free(tracks);
+    log_info("Added %d selected track(s) to playlist %d", added, playlist_index);
+    return added;
 }
 
 /**
- * Rename a playlist
+ * Remove every selected track from a playlist
+ * @return number of entries removed, or -1 on error
  */
 EMSCRIPTEN_KEEPALIVE
-int ipod_rename_playlist(int playlist_index, const char *new_name) {
+int ipod_sel_playlist_remove(int playlist_index) {
     if (!g_itdb) {
         set_error("No database loaded");
         return -1;
     }
-
-    Itdb_Playlist *pl = itdb_playlist_by_nr(g_itdb, (guint32)playlist_index);
+    Itdb_Playlist *pl = playlist_at(playlist_index);
     if (!pl) {
         set_error("Playlist index %d out of range", playlist_index);
         return -1;
     }
 
-    if (!new_name || strlen(new_name) == 0) {
-        set_error("Playlist name cannot be empty");
-        return -1;
-    }
+    guint n = 0;
+    Itdb_Track **tracks = sel_tracks(&n);
+    GHashTable *selected = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (guint k = 0; k < n; k++) g_hash_table_add(selected, tracks[k]);
+    g_free(tracks);
 
-    g_free(pl->name);
-    pl->name = g_strdup(new_name);
+    // One pass over the members; @pos is where each entry sits at the moment
+    // it is removed, as the undo log expects
+    playlist_members_flush(pl);
+    int removed = 0;
+    gint pos = 0;
+    for (GList *l = pl->members; l != NULL;) {
+        GList *next = l->next;
+        Itdb_Track *track = (Itdb_Track *)l->data;
+        if (g_hash_table_contains(selected, track)) {
+            pl->members = g_list_delete_link(pl->members, l);
+            spl_playlist_track_changed(pl, track, FALSE);
+            txn_log_member(pl, track, FALSE, pos);
+            removed++;
+        } else {
+            pos++;
+        }
+        l = next;
+    }
 
-    log_info("Renamed playlist %d to: %s", playlist_index, new_name);
-    return 0;
+    g_hash_table_destroy(selected);
+    log_info("Removed %d selected track(s) from playlist %d", removed, playlist_index);
+    return removed;
 }
 
 /**
- * Add a track to a playlist
- * @track_index: index of track in the tracks list (NOT the track ID!)
+ * Update fields of every selected track (same @field_mask and @values as
+ * ipod_update_tracks_batch; per-track groups follow list order)
+ * @return number of tracks updated, or -1 on error
  */
 EMSCRIPTEN_KEEPALIVE
-int ipod_playlist_add_track(int playlist_index, int track_index) {
+int ipod_sel_update_tracks(unsigned int field_mask, const char *values, int values_len) {
     if (!g_itdb) {
         set_error("No database loaded");
         return -1;
     }
+    guint n = 0;
+    int *indices = sel_indices(&n);
+    int updated = ipod_update_tracks_batch(indices, (int)n, field_mask, values, values_len);
+    g_free(indices);
+    return updated;
+}
 
-    Itdb_Playlist *pl = itdb_playlist_by_nr(g_itdb, (guint32)playlist_index);
-    if (!pl) {
-        set_error("Playlist index %d out of range", playlist_index);
-        return -1;
-    }
+/* ============================================================================
+ * Transactions (undo log)
+ * ============================================================================ */
 
-    Itdb_Track *track = (Itdb_Track *)g_list_nth_data(g_itdb->tracks, (guint)track_index);
-    if (!track) {
-        set_error("Track not found at index: %d", track_index);
-        return -1;
+/* While a transaction is open, every edit appends the state it overwrites to
+ * an operation log, and rollback undoes the log newest-first. Removed tracks
+ * and deleted playlists are only unlinked from the database, so undoing them
+ * relinks the same objects (pointers and handles stay valid); commit frees
+ * them. Each undo step restores exactly the state the next older step saw,
+ * so positions recorded at edit time are still right when they are replayed.
+ * Artwork changes on existing tracks are not logged. */
+
+typedef enum {
+    TXN_TRACK_ADD,
+    TXN_TRACK_REMOVE,
+    TXN_TRACK_UPDATE,
+    TXN_TRACK_FILE,
+    TXN_MEMBER_ADD,
+    TXN_MEMBER_REMOVE,
+    TXN_PLAYLIST_CREATE,
+    TXN_PLAYLIST_DELETE,
+    TXN_PLAYLIST_RENAME,
+    TXN_PLAYLIST_ORDER
+} TxnOpType;
+
+typedef struct {
+    Itdb_Playlist *pl;
+    gint pos;
+} TxnMembership;
+
+typedef struct {
+    TxnOpType      type;
+    Itdb_Track    *track;
+    Itdb_Playlist *pl;
+    gint           pos;        /* list position the track/playlist/member was removed from */
+    guint64        handle;     /* TXN_TRACK_REMOVE: handle to restore, 0 if none was handed out */
+    gchar         *str[4];     /* previous ipod_path or playlist name */
+    gint64         num[4];     /* previous numeric fields */
+    guint32        fields;     /* TXN_TRACK_UPDATE: TRACK_FIELD_BIT mask of the fields saved */
+    TrackFieldValue *saved;    /* TXN_TRACK_UPDATE: their previous values, in field order */
+    TxnMembership *members;    /* TXN_TRACK_REMOVE: playlists the track was taken out of */
+    guint          n_members;
+    MemberArray   *order;      /* TXN_PLAYLIST_ORDER: members before the first reorder */
+} TxnOp;
+
+struct TxnLog {
+    TxnOp      *ops;
+    guint       n_ops;
+    guint       cap;
+    GHashTable *reordered;     /* Itdb_Playlist* already snapshotted by this transaction */
+};
+
+static TxnLog *g_txn = NULL;
+
+static TxnOp *txn_push(TxnOpType type) {
+    if (g_txn->n_ops == g_txn->cap) {
+        g_txn->cap = g_txn->cap ? g_txn->cap * 2 : 64;
+        g_txn->ops = g_realloc(g_txn->ops, sizeof(TxnOp) * g_txn->cap);
+    }
+    TxnOp *op = &g_txn->ops[g_txn->n_ops++];
+    memset(op, 0, sizeof(*op));
+    op->type = type;
+    return op;
+}
+
+/* Release what @op owns; @applied means the edit stays, so objects it
+ * unlinked are freed for good */
+static void txn_op_free(TxnOp *op, gboolean applied) {
+    for (int i = 0; i < 4; i++) g_free(op->str[i]);
+    if (op->saved) {
+        guint k = 0;
+        for (guint f = 0; f < N_TRACK_FIELDS; f++) {
+            if (op->fields & TRACK_FIELD_BIT(f)) g_free(op->saved[k++].s);
+        }
+        g_free(op->saved);
     }
+    g_free(op->members);
+    if (op->order) member_array_free(op->order);
+    if (!applied) return;
+    if (op->type == TXN_TRACK_REMOVE) itdb_track_free(op->track);
+    if (op->type == TXN_PLAYLIST_DELETE) itdb_playlist_free(op->pl);
+}
 
-    if (itdb_playlist_contains_track(pl, track)) {
-        log_info("Track index %d already in playlist %d", track_index, playlist_index);
-        return 0; /* Not an error */
+static void txn_free(TxnLog *txn, gboolean applied) {
+    if (!txn) return;
+    for (guint i = 0; i < txn->n_ops; i++) txn_op_free(&txn->ops[i], applied);
+    g_free(txn->ops);
+    if (txn->reordered) g_hash_table_destroy(txn->reordered);
+    g_free(txn);
+}
+
+/* Database closed or reloaded: nothing left to undo into */
+static void txn_reset(void) {
+    txn_free(g_txn, TRUE);
+    g_txn = NULL;
+}
+
+static void txn_log_track_added(Itdb_Track *track) {
+    if (!g_txn) return;
+    txn_push(TXN_TRACK_ADD)->track = track;
+}
+
+/* Called after spl_track_removed() and before the track leaves its
+ * playlists. Returns TRUE if the log keeps @track: unlink it, don't free it. */
+/* @track_index: its list position when the caller already knows it, else -1.
+ * The playlists it is taken out of follow through txn_log_track_membership(). */
+static gboolean txn_log_track_removed(Itdb_Track *track, int track_index) {
+    if (!g_txn) return FALSE;
+    TxnOp *op = txn_push(TXN_TRACK_REMOVE);
+    op->track = track;
+    op->pos = track_index >= 0 ? track_index : g_list_index(g_itdb->tracks, track);
+    guint64 *handle = g_handle_by_track ? g_hash_table_lookup(g_handle_by_track, track) : NULL;
+    if (handle) op->handle = *handle;
+    return TRUE;
+}
+
+/* The track of the TXN_TRACK_REMOVE just logged was at @pos in @pl */
+static void txn_log_track_membership(Itdb_Playlist *pl, gint pos) {
+    TxnOp *op = &g_txn->ops[g_txn->n_ops - 1];
+    op->members = g_realloc(op->members, sizeof(TxnMembership) * (op->n_members + 1));
+    op->members[op->n_members].pl = pl;
+    op->members[op->n_members].pos = pos;
+    op->n_members++;
+}
+
+/* Before @fields (TRACK_FIELD_BIT mask) of @track are overwritten */
+static void txn_log_track_update(Itdb_Track *track, guint32 fields) {
+    if (!g_txn) return;
+    TxnOp *op = txn_push(TXN_TRACK_UPDATE);
+    op->track = track;
+    op->fields = fields;
+    op->num[0] = (gint64)track->time_modified;
+
+    guint n = 0;
+    for (guint f = 0; f < N_TRACK_FIELDS; f++) {
+        if (fields & TRACK_FIELD_BIT(f)) n++;
+    }
+    op->saved = g_new(TrackFieldValue, n ? n : 1);
+    guint k = 0;
+    for (guint f = 0; f < N_TRACK_FIELDS; f++) {
+        if (fields & TRACK_FIELD_BIT(f)) track_field_get(track, f, &op->saved[k++]);
     }
+}
 
-    itdb_playlist_add_track(pl, track, -1);
+static void txn_log_track_file(Itdb_Track *track) {
+    if (!g_txn) return;
+    TxnOp *op = txn_push(TXN_TRACK_FILE);
+    op->track = track;
+    op->str[0] = g_strdup(track->ipod_path);
+    op->num[0] = track->size;
+    op->num[1] = track->transferred;
+    op->num[2] = track->filetype_marker;
+}
 
-    log_info("Added track index %d to playlist %d", track_index, playlist_index);
-    return 0;
+/* @pos: position the track was removed from (ignored for additions) */
+static void txn_log_member(Itdb_Playlist *pl, Itdb_Track *track, gboolean added, gint pos) {
+    if (!g_txn) return;
+    TxnOp *op = txn_push(added ? TXN_MEMBER_ADD : TXN_MEMBER_REMOVE);
+    op->pl = pl;
+    op->track = track;
+    op->pos = pos;
+}
+
+static void txn_log_playlist_created(Itdb_Playlist *pl) {
+    if (!g_txn) return;
+    txn_push(TXN_PLAYLIST_CREATE)->pl = pl;
+}
+
+/* Returns TRUE if the log keeps @pl: unlink it, don't free it */
+static gboolean txn_log_playlist_deleted(Itdb_Playlist *pl) {
+    if (!g_txn) return FALSE;
+    TxnOp *op = txn_push(TXN_PLAYLIST_DELETE);
+    op->pl = pl;
+    op->pos = g_list_index(g_itdb->playlists, pl);
+    return TRUE;
+}
+
+static void txn_log_playlist_renamed(Itdb_Playlist *pl) {
+    if (!g_txn) return;
+    TxnOp *op = txn_push(TXN_PLAYLIST_RENAME);
+    op->pl = pl;
+    op->str[0] = g_strdup(pl->name);
+}
+
+/* Before a move or sort: the first one per playlist snapshots the order,
+ * later ones are covered by restoring that snapshot */
+static void txn_log_playlist_order(Itdb_Playlist *pl) {
+    if (!g_txn) return;
+    if (!g_txn->reordered) g_txn->reordered = g_hash_table_new(g_direct_hash, g_direct_equal);
+    if (g_hash_table_contains(g_txn->reordered, pl)) return;
+    g_hash_table_add(g_txn->reordered, pl);
+
+    const MemberArray *a = playlist_members_array(pl);
+    TxnOp *op = txn_push(TXN_PLAYLIST_ORDER);
+    op->pl = pl;
+    op->order = g_new0(MemberArray, 1);
+    op->order->len = a->len;
+    op->order->items = g_new(Itdb_Track *, a->len ? a->len : 1);
+    memcpy(op->order->items, a->items, sizeof(Itdb_Track *) * a->len);
+}
+
+static void txn_undo(TxnOp *op) {
+    switch (op->type) {
+    case TXN_TRACK_ADD:
+        remove_track_ptr(op->track, -1);
+        break;
+
+    case TXN_TRACK_REMOVE: {
+        Itdb_Track *track = op->track;
+        itdb_track_add(g_itdb, track, op->pos);
+        for (guint i = 0; i < op->n_members; i++) {
+            const TxnMembership *m = &op->members[i];
+            playlist_members_flush(m->pl);
+            itdb_playlist_add_track(m->pl, track, m->pos);
+            // Back in the "playlist is" member sets the removal dropped it from
+            if (!m->pl->is_spl) spl_playlist_track_changed(m->pl, track, TRUE);
+        }
+        if (op->handle) track_handle_restore(track, op->handle);
+        else track_handle(track);
+        if (track->mhii_link) artwork_mark_dirty();
+        spl_track_added(track);
+        break;
+    }
+
+    case TXN_TRACK_UPDATE: {
+        guint k = 0;
+        for (guint f = 0; f < N_TRACK_FIELDS; f++) {
+            if (op->fields & TRACK_FIELD_BIT(f)) track_field_set(op->track, f, &op->saved[k++]);
+        }
+        op->track->time_modified = (time_t)op->num[0];
+        track_json_invalidate(op->track);
+        guint32 changed[N_TRACK_FIELDS + 1];
+        guint n_changed = track_fields_to_spl(op->fields, changed);
+        spl_track_changed(op->track, changed, n_changed);
+        break;
+    }
+
+    case TXN_TRACK_FILE:
+        g_free(op->track->ipod_path);
+        op->track->ipod_path = op->str[0];
+        op->str[0] = NULL;
+        op->track->size = (guint32)op->num[0];
+        op->track->transferred = (gboolean)op->num[1];
+        op->track->filetype_marker = (guint32)op->num[2];
+        track_json_invalidate(op->track);
+        spl_track_size_changed(op->track);
+        break;
+
+    case TXN_MEMBER_ADD:
+        playlist_members_flush(op->pl);
+        itdb_playlist_remove_track(op->pl, op->track);
+        spl_playlist_track_changed(op->pl, op->track, FALSE);
+        break;
+
+    case TXN_MEMBER_REMOVE:
+        playlist_members_flush(op->pl);
+        itdb_playlist_add_track(op->pl, op->track, op->pos);
+        spl_playlist_track_changed(op->pl, op->track, TRUE);
+        break;
+
+    case TXN_PLAYLIST_CREATE:
+        playlist_members_discard(op->pl);
+        spl_playlist_removed(op->pl);
+        itdb_playlist_remove(op->pl);
+        g_playlists_gen++;
+        break;
+
+    case TXN_PLAYLIST_DELETE:
+        itdb_playlist_add(g_itdb, op->pl, op->pos);
+        g_playlists_gen++;
+        spl_reset();  // "playlist is" rules recompile on the next refresh
+        break;
+
+    case TXN_PLAYLIST_RENAME:
+        g_free(op->pl->name);
+        op->pl->name = op->str[0];
+        op->str[0] = NULL;
+        break;
+
+    case TXN_PLAYLIST_ORDER: {
+        MemberArray *a = playlist_members_array(op->pl);
+        g_free(a->items);
+        a->items = op->order->items;
+        a->len = op->order->len;
+        op->order->items = NULL;
+        break;
+    }
+    }
 }
 
 /**
- * Remove a track from a playlist
- * @track_index: index of track in the tracks list (NOT the track ID!)
+ * Start recording edits so they can be rolled back as one batch.
+ * Transactions do not nest. ipod_write_db may be called inside one; rolling
+ * back afterwards restores the in-memory database, not the files written.
  */
 EMSCRIPTEN_KEEPALIVE
-int ipod_playlist_remove_track(int playlist_index, int track_index) {
+int ipod_txn_begin(void) {
     if (!g_itdb) {
         set_error("No database loaded");
         return -1;
     }
-
-    Itdb_Playlist *pl = itdb_playlist_by_nr(g_itdb, (guint32)playlist_index);
-    if (!pl) {
-        set_error("Playlist index %d out of range", playlist_index);
+    if (g_txn) {
+        set_error("A transaction is already open");
         return -1;
     }
+    g_txn = g_new0(TxnLog, 1);
+    return 0;
+}
 
-    Itdb_Track *track = (Itdb_Track *)g_list_nth_data(g_itdb->tracks, (guint)track_index);
-    if (!track) {
-        set_error("Track not found at index: %d", track_index);
+/**
+ * Keep every edit made since ipod_txn_begin and drop the log
+ * Returns the number of operations committed, or -1 if none is open
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_txn_commit(void) {
+    if (!g_txn) {
+        set_error("No transaction is open");
         return -1;
     }
+    int n_ops = (int)g_txn->n_ops;
+    txn_reset();
+    log_info("Committed %d operation(s)", n_ops);
+    return n_ops;
+}
 
-    if (!itdb_playlist_contains_track(pl, track)) {
-        set_error("Track index %d not in playlist %d", track_index, playlist_index);
+/**
+ * Undo every edit made since ipod_txn_begin, newest first
+ * Returns the number of operations undone, or -1 if none is open
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_txn_rollback(void) {
+    if (!g_txn) {
+        set_error("No transaction is open");
         return -1;
     }
 
-    itdb_playlist_remove_track(pl, track);
+    /* Detached first, so the undo steps are not logged themselves */
+    TxnLog *txn = g_txn;
+    g_txn = NULL;
+    for (guint i = txn->n_ops; i > 0; i--) {
+        txn_undo(&txn->ops[i - 1]);
+        txn_op_free(&txn->ops[i - 1], FALSE);
+    }
+    int n_ops = (int)txn->n_ops;
+    txn->n_ops = 0;
+    txn_free(txn, FALSE);
+    // Tracks came back or went away: list indices moved
+    sel_clear_all();
 
-    log_info("Removed track index %d from playlist %d", track_index, playlist_index);
-    return 0;
+    log_info("Rolled back %d operation(s)", n_ops);
+    return n_ops;
+}
+
+/**
+ * Returns 1 while a transaction is open, 0 otherwise
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_txn_active(void) {
+    return g_txn ? 1 : 0;
 }
 
 
@@ -1476,3 +3556,371 @@ char* ipod_path_to_fs_format(const char *ipod_path) {
 
     return fs_path;
 }
+
+/* ============================================================================
+ * Path Index (device file scans)
+ * ============================================================================ */
+
+/* Lower-cased relative FS paths ("ipod_control/music/f00/abcd.mp3") of every
+ * track; FAT32 is case-insensitive, so lookups are too. */
+static GHashTable *g_path_set = NULL;
+
+static char *rel_fs_key(const char *path, gboolean is_ipod_format) {
+    char *key = strdup(path);
+    if (!key) return NULL;
+    if (is_ipod_format) itdb_filename_ipod2fs(key);
+
+    char *p = key;
+    while (*p == '/') p++;
+    memmove(key, p, strlen(p) + 1);
+    for (p = key; *p; p++) *p = (char)tolower((unsigned char)*p);
+    return key;
+}
+
+static void path_set_reset(void) {
+    if (g_path_set) {
+        g_hash_table_destroy(g_path_set);
+        g_path_set = NULL;
+    }
+}
+
+/**
+ * Index the file path of every track for ipod_path_set_filter_unreferenced().
+ * @return number of paths indexed, or -1 on error.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_path_set_begin(void) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return -1;
+    }
+    path_set_reset();
+    g_path_set = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+
+    for (GList *l = g_itdb->tracks; l != NULL; l = l->next) {
+        Itdb_Track *track = (Itdb_Track *)l->data;
+        if (!track || !track->ipod_path || !*track->ipod_path) continue;
+        char *key = rel_fs_key(track->ipod_path, TRUE);
+        if (key) g_hash_table_replace(g_path_set, key, key);
+    }
+    return (int)g_hash_table_size(g_path_set);
+}
+
+/**
+ * Filter a batch of device files down to those no track references.
+ * @rel_paths: newline-separated relative FS paths ("iPod_Control/Music/F00/ABCD.mp3")
+ * Returns JSON array of the 0-based line numbers that are unreferenced.
+ * Caller must free with ipod_free_string()
+ */
+EMSCRIPTEN_KEEPALIVE
+char* ipod_path_set_filter_unreferenced(const char *rel_paths) {
+    if (!g_path_set) {
+        set_error("Path index not built. Call ipod_path_set_begin first.");
+        return NULL;
+    }
+    if (!rel_paths) rel_paths = "";
+
+    size_t lines = 1;
+    for (const char *p = rel_paths; *p; p++) if (*p == '\n') lines++;
+    size_t cap = 3 + lines * 12;
+    char *json = malloc(cap);
+    if (!json) {
+        set_error("Out of memory");
+        return NULL;
+    }
+
+    size_t pos = 0;
+    json[pos++] = '[';
+    int line = 0;
+    const char *start = rel_paths;
+    while (*start) {
+        const char *end = strchr(start, '\n');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        if (len > 0) {
+            char *path = strndup(start, len);
+            char *key = path ? rel_fs_key(path, FALSE) : NULL;
+            if (key && !g_hash_table_contains(g_path_set, key)) {
+                pos += snprintf(json + pos, cap - pos, "%s%d", pos > 1 ? "," : "", line);
+            }
+            free(key);
+            free(path);
+        }
+        if (!end) break;
+        start = end + 1;
+        line++;
+    }
+    json[pos++] = ']';
+    json[pos] = '\0';
+    return json;
+}
+
+/**
+ * Free the path index
+ */
+EMSCRIPTEN_KEEPALIVE
+void ipod_path_set_end(void) {
+    path_set_reset();
+}
+
+/**
+ * Relative FS path of every track, packed as one buffer: line N is the file
+ * of track index N ("iPod_Control/Music/F00/ABCD.mp3"), or empty if the track
+ * has no file. One call instead of a JSON object per track.
+ * Caller must free with ipod_free_string()
+ */
+EMSCRIPTEN_KEEPALIVE
+char* ipod_get_track_paths_packed(void) {
+    if (!g_itdb) {
+        set_error("No database loaded");
+        return NULL;
+    }
+
+    size_t cap = 1;
+    for (GList *l = g_itdb->tracks; l != NULL; l = l->next) {
+        Itdb_Track *track = (Itdb_Track *)l->data;
+        cap += 1 + (track && track->ipod_path ? strlen(track->ipod_path) : 0);
+    }
+    char *buf = malloc(cap);
+    if (!buf) {
+        set_error("Out of memory");
+        return NULL;
+    }
+
+    size_t pos = 0;
+    for (GList *l = g_itdb->tracks; l != NULL; l = l->next) {
+        Itdb_Track *track = (Itdb_Track *)l->data;
+        if (l != g_itdb->tracks) buf[pos++] = '\n';
+        if (!track || !track->ipod_path || !*track->ipod_path) continue;
+
+        // Same length after conversion: ':' -> '/' minus the leading separator
+        const char *src = track->ipod_path;
+        while (*src == ':') src++;
+        for (; *src; src++) buf[pos++] = (*src == ':') ? '/' : *src;
+    }
+    buf[pos] = '\0';
+    return buf;
+}
+
+/* ============================================================================
+ * Contexts (several databases per module)
+ * ============================================================================ */
+
+/* Every export works on the active context, whose state lives in the globals
+ * above. Other contexts are parked here: selecting one swaps the per-database
+ * state (database, mountpoint, track handles, artwork, smart playlist rules,
+ * open transaction, track selection) in and out, and drops what is only a
+ * cache or a per-call scratch area (playlist table, sync plan, path set,
+ * track JSON). Each context stages artwork in its own MEMFS directory, so
+ * staged files survive a switch. Context 1 always exists, so callers that
+ * never open a context keep working on it unchanged. The last error is
+ * shared: it describes the latest failing call, whichever context it ran on.
+ * The selection is module-wide: callers switch, make their calls and switch
+ * back without yielding to other callers in between. */
+
+#define MAX_CONTEXTS 16
+
+typedef struct {
+    gboolean       in_use;
+    Itdb_iTunesDB *itdb;
+    char           mountpoint[sizeof(g_mountpoint)];
+    Itdb_Track    *last_added_track;
+    GHashTable    *track_by_handle;
+    GHashTable    *handle_by_track;
+    guint64        next_session_handle;
+    GHashTable    *art_cache;
+    ArtworkState  *artwork;
+    SplState      *spl;
+    TxnLog        *txn;
+    guint32       *sel_words;
+    guint          sel_bits;
+} IpodContext;
+
+static IpodContext g_contexts[MAX_CONTEXTS];
+static int g_active_ctx = 1;
+
+static IpodContext *ctx_lookup(int ctx) {
+    if (ctx < 1 || ctx > MAX_CONTEXTS) return NULL;
+    if (ctx != 1 && !g_contexts[ctx - 1].in_use) return NULL;
+    return &g_contexts[ctx - 1];
+}
+
+/* Move the active database's state into @c, leaving the module empty */
+static void ctx_park(IpodContext *c) {
+    playlist_members_flush_all();
+
+    c->itdb = g_itdb;
+    memcpy(c->mountpoint, g_mountpoint, sizeof(g_mountpoint));
+    c->last_added_track = g_last_added_track;
+    c->track_by_handle = g_track_by_handle;
+    c->handle_by_track = g_handle_by_track;
+    c->next_session_handle = g_next_session_handle;
+    c->art_cache = g_art_cache;
+    c->artwork = artwork_state_detach();
+    c->spl = spl_state_detach();
+    c->txn = g_txn;
+    c->sel_words = g_sel_words;
+    c->sel_bits = g_sel_bits;
+
+    g_itdb = NULL;
+    g_mountpoint[0] = '\0';
+    g_last_added_track = NULL;
+    g_track_by_handle = NULL;
+    g_handle_by_track = NULL;
+    g_next_session_handle = 1;
+    g_art_cache = NULL;
+    g_txn = NULL;
+    g_sel_words = NULL;
+    g_sel_bits = 0;
+
+    sync_plan_reset();
+    path_set_reset();
+    playlist_table_reset();
+    playlist_members_reset();
+    track_json_reset();
+}
+
+/* Install the state parked in @c (the module must be empty) */
+static void ctx_unpark(IpodContext *c) {
+    g_itdb = c->itdb;
+    memcpy(g_mountpoint, c->mountpoint, sizeof(g_mountpoint));
+    g_last_added_track = c->last_added_track;
+    g_track_by_handle = c->track_by_handle;
+    g_handle_by_track = c->handle_by_track;
+    g_next_session_handle = c->next_session_handle ? c->next_session_handle : 1;
+    g_art_cache = c->art_cache;
+    artwork_state_attach(c->artwork);
+    spl_state_attach(c->spl);
+    g_txn = c->txn;
+    g_sel_words = c->sel_words;
+    g_sel_bits = c->sel_bits;
+
+    gboolean in_use = c->in_use;
+    memset(c, 0, sizeof(*c));
+    c->in_use = in_use;
+}
+
+static int ctx_switch(int ctx) {
+    IpodContext *target = ctx_lookup(ctx);
+    if (!target) {
+        set_error("No such iPod context: %d", ctx);
+        return -1;
+    }
+    if (ctx == g_active_ctx) return 0;
+
+    ctx_park(&g_contexts[g_active_ctx - 1]);
+    ctx_unpark(target);
+    g_active_ctx = ctx;
+    return 0;
+}
+
+/**
+ * Open a new, empty context for another iPod and make it active.
+ * @mountpoint: MEMFS directory of that iPod (must differ between contexts)
+ * Continue with ipod_parse_db() or ipod_init_new() as usual.
+ * @return context id (> 1), or -1 on error
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_ctx_open(const char *mountpoint) {
+    if (!mountpoint || strlen(mountpoint) == 0) {
+        set_error("Mountpoint cannot be empty");
+        return -1;
+    }
+
+    int ctx = 0;
+    for (int i = 2; i <= MAX_CONTEXTS && !ctx; i++) {
+        if (!g_contexts[i - 1].in_use) ctx = i;
+    }
+    if (!ctx) {
+        set_error("Too many open iPod contexts (max %d)", MAX_CONTEXTS);
+        return -1;
+    }
+
+    g_contexts[ctx - 1].in_use = TRUE;
+    ctx_switch(ctx);
+    ipod_set_mountpoint(mountpoint);
+
+    // Staged artwork stays with its database across switches
+    char staging_dir[32];
+    snprintf(staging_dir, sizeof(staging_dir), "%s_%d", ARTWORK_STAGING_DIR, ctx);
+    artwork_set_staging_dir(staging_dir);
+
+    log_info("Opened iPod context %d at %s", ctx, mountpoint);
+    return ctx;
+}
+
+/**
+ * Make @ctx the context every other export works on
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_ctx_select(int ctx) {
+    return ctx_switch(ctx);
+}
+
+/**
+ * Get the active context id
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_ctx_current(void) {
+    return g_active_ctx;
+}
+
+/**
+ * Free the database of @ctx and release the context. Closing the active
+ * context makes context 1 active; context 1 itself is only emptied.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_ctx_close(int ctx) {
+    if (!ctx_lookup(ctx)) {
+        set_error("No such iPod context: %d", ctx);
+        return -1;
+    }
+
+    int previous = g_active_ctx;
+    if (ctx_switch(ctx) < 0) return -1;
+    ipod_close_db();
+    g_mountpoint[0] = '\0';
+    if (ctx == 1) return ctx_switch(previous);
+
+    /* Nothing left to park: install the next context directly */
+    int next = previous == ctx ? 1 : previous;
+    memset(&g_contexts[ctx - 1], 0, sizeof(IpodContext));
+    ctx_unpark(&g_contexts[next - 1]);
+    g_active_ctx = next;
+
+    log_info("Closed iPod context %d", ctx);
+    return 0;
+}
+
+/**
+ * Get all contexts as JSON
+ * [{"id":1,"mountpoint":"/iPod","loaded":true,"active":true}, ...]
+ */
+EMSCRIPTEN_KEEPALIVE
+char* ipod_ctx_list_json(void) {
+    size_t cap = 2;
+    for (int ctx = 1; ctx <= MAX_CONTEXTS; ctx++) {
+        const IpodContext *c = ctx_lookup(ctx);
+        if (c) cap += 80 + 2 * strlen(ctx == g_active_ctx ? g_mountpoint : c->mountpoint);
+    }
+    char *json = malloc(cap);
+    if (!json) {
+        set_error("Out of memory");
+        return NULL;
+    }
+
+    size_t pos = 0;
+    json[pos++] = '[';
+    for (int ctx = 1; ctx <= MAX_CONTEXTS; ctx++) {
+        const IpodContext *c = ctx_lookup(ctx);
+        if (!c) continue;
+        gboolean active = ctx == g_active_ctx;
+        char mp[sizeof(g_mountpoint) * 2];
+        escape_json_string(mp, active ? g_mountpoint : c->mountpoint, sizeof(mp));
+        pos += snprintf(json + pos, cap - pos, "%s{\"id\":%d,\"mountpoint\":\"%s\",\"loaded\":%s,\"active\":%s}",
+                        pos > 1 ? "," : "", ctx, mp,
+                        (active ? g_itdb : c->itdb) ? "true" : "false", active ? "true" : "false");
+    }
+    json[pos++] = ']';
+    json[pos] = '\0';
+    return json;
+}
@@ -1,19 +1,31 @@
 import { createLogger } from './modules/logger.js';
 import { createWasmApi } from './modules/wasmApi.js';
 import { createFsSync } from './modules/fsSync.js';
+import { createDirHandleCache } from './modules/dirHandleCache.js';
 import { createPaths } from './modules/paths.js';
 import { createContextMenu } from './modules/contextMenu.js';
 import { createFirewireSetup } from './modules/firewireSetup.js';
 import { createModalManager } from './modules/modalManager.js';
 import { createAppState } from './modules/state.js';
 import { readAudioMetadata, getFiletypeFromName, isAudioFile } from './modules/audio.js';
-import { renderTracks, renderPlaylists, formatDuration, updateConnectionStatus, enableUIIfReady } from './modules/uiRender.js';
+import { renderTracks, renderPlaylists, updateAllTracksCount, formatDuration, updateConnectionStatus, enableUIIfReady } from './modules/uiRender.js';
 import { createIpodConnectionMonitor } from './modules/ipodConnectionMonitor.js';
 import { createUploadQueue } from './modules/uploadQueue.js';
 import { createTrackOps } from './modules/trackOps.js';
 import { createSyncPipeline } from './modules/syncPipeline.js';
 import { createTranscodePool } from './modules/transcode.js';
 import { createTrackSelection } from './modules/trackSelection.js';
+import { createPlaylistReorder } from './modules/playlistReorder.js';
+import { createMetadataPool } from './modules/metadataPool.js';
+import { createMp3DurationScanner } from './modules/mp3Duration.js';
+import { createArtworkManager } from './modules/artwork.js';
+import { createSyncPlanner } from './modules/syncPlanner.js';
+import { createOrphanScanner } from './modules/orphanScanner.js';
+import { createMissingFileDetector } from './modules/missingFiles.js';
+import { createSyncTargets } from './modules/syncTargets.js';
+import { createTrackSearch } from './modules/trackSearch.js';
+import { scanAudioFileHandles } from './modules/folderScan.js';
+import { mapWithConcurrency } from './modules/concurrency.js';
 
 /**
  * TunesReloaded - module entrypoint
@@ -26,8 +38,13 @@ const appState = createAppState();
 // Module instances
 const { log, escapeHtml, logEntries } = createLogger();
 const wasm = createWasmApi({ log });
-const fsSync = createFsSync({ log, wasm, mountpoint: '/iPod' });
+const dirCache = createDirHandleCache();
+const fsSync = createFsSync({ log, wasm, mountpoint: '/iPod', dirCache });
 const paths = createPaths({ wasm, mountpoint: '/iPod' });
+const artwork = createArtworkManager({ wasm, fsSync, log });
+const orphanScanner = createOrphanScanner({ appState, wasm, log });
+const missingFiles = createMissingFileDetector({ wasm, log, dirCache });
+const syncTargets = createSyncTargets({ wasm, log });
 const firewireSetup = createFirewireSetup({ log });
 const modals = createModalManager();
 
@@ -35,6 +52,7 @@ const ipodMonitor = createIpodConnectionMonitor({
     appState,
     wasm,
     log,
+    dirCache,
     updateConnectionStatus,
     enableUIIfReady,
     renderTracks,
@@ -61,6 +79,18 @@ async function parseDatabase() {
     const result = wasm.wasmCallWithError('ipod_parse_db');
     if (result !== 0) return;
 
+    try {
+        await artwork.loadFromDevice(appState.ipodHandle);
+    } catch (e) {
+        log(`Could not load ArtworkDB: ${e?.message || e}`, 'warning');
+    }
+
+    // Smart playlists on disk may be stale (the device only updates live ones it can evaluate)
+    if (wasm.wasmHasFunction('ipod_spl_update_all')) {
+        const spls = wasm.wasmCall('ipod_spl_update_all');
+        if (spls > 0) log(`Refreshed ${spls} smart playlist(s)`, 'info');
+    }
+
     appState.isConnected = true;
     updateConnectionStatus(true);
     enableUIIfReady({ wasmReady: appState.wasmReady, isConnected: appState.isConnected });
@@ -75,7 +105,7 @@ async function loadTracks() {
     const tracks = wasm.wasmGetJson('ipod_get_all_tracks_json');
     if (tracks) {
         appState.tracks = tracks;
-        renderTracks({ tracks: getAllTracksWithQueued(), escapeHtml, selectedTrackIds: appState.selectedTrackIds });
+        renderAllTracks();
         trackSelection?.applySelectionToDom?.();
 
         // Ensure the sidebar "All Tracks" count reflects the latest track list,
@@ -84,18 +114,38 @@ async function loadTracks() {
     }
 }
 
-function getAllTracksWithQueued() {
-    const queued = (appState.pendingUploads || []).map((item, idx) => ({
-        id: `queued-${idx}`,
-        __queued: true,
-        _queueIndex: idx,
-        title: item.meta?.title || item.name || 'Queued track',
-        artist: item.meta?.artist || 'Queued',
-        album: item.meta?.album || '',
-        genre: item.meta?.genre || '',
-        tracklen: Number.isFinite(item.meta?.durationMs) ? item.meta.durationMs : null,
-    }));
-    return [...(appState.tracks || []), ...queued];
+// Queued rows are cached per pending upload, so a queue refresh only rebuilds the rows whose
+// metadata arrived. The key stays with the upload when earlier ones are removed.
+const queuedRowCache = new WeakMap();
+let nextQueuedKey = 0;
+
+function getQueuedTrackRows() {
+    return (appState.pendingUploads || []).map((item, idx) => {
+        let cached = queuedRowCache.get(item);
+        if (!cached) {
+            cached = { key: `queued-${nextQueuedKey++}`, row: null };
+            queuedRowCache.set(item, cached);
+        }
+        if (!cached.row || cached.meta !== item.meta) {
+            cached.meta = item.meta;
+            cached.row = {
+                id: cached.key,
+                __queued: true,
+                title: item.meta?.title || item.name || 'Queued track',
+                artist: item.meta?.artist || 'Queued',
+                album: item.meta?.album || '',
+                genre: item.meta?.genre || '',
+                tracklen: Number.isFinite(item.meta?.durationMs) ? item.meta.durationMs : null,
+            };
+        }
+        // Position only: the table writes it onto the row without rebuilding it
+        cached.row._queueIndex = idx;
+        return cached.row;
+    });
+}
+
+function renderAllTracks() {
+    renderTracks({ tracks: appState.tracks, queued: getQueuedTrackRows(), escapeHtml, selectedTrackIds: trackSelection.isSelected });
 }
 
 function getAllTracksCount() {
@@ -111,11 +161,12 @@ function renderSidebarPlaylists() {
     });
 }
 
+// Queue changes: renderTracks() already re-applies the selection to the rows it patches, and
+// of the sidebar only the "All Tracks" count can have changed
 function rerenderAllTracksIfVisible() {
+    updateAllTracksCount(getAllTracksCount());
     if (appState.currentPlaylistIndex !== -1) return;
-    renderTracks({ tracks: getAllTracksWithQueued(), escapeHtml, selectedTrackIds: appState.selectedTrackIds });
-    trackSelection?.applySelectionToDom?.();
-    renderSidebarPlaylists();
+    renderAllTracks();
 }
 
 async function loadPlaylists() {
@@ -127,6 +178,9 @@ async function loadPlaylists() {
     }
 }
 
+// Tracks of the playlist on screen, which the search box filters in playlist view
+let playlistViewTracks = [];
+
 async function loadPlaylistTracks(index) {
     if (index < 0 || index >= appState.playlists.length) {
         log(`Invalid playlist index: ${index}`, 'error');
@@ -138,11 +192,28 @@ async function loadPlaylistTracks(index) {
 
     const tracks = wasm.wasmGetJson('ipod_get_playlist_tracks_json', index);
     if (tracks) {
-        renderTracks({ tracks, escapeHtml, selectedTrackIds: appState.selectedTrackIds });
+        playlistViewTracks = tracks;
+        const playlist = appState.playlists[index];
+        const reorderable = !playlist.is_master && !playlist.is_smart && wasm.wasmHasFunction('ipod_playlist_move_tracks');
+        renderTracks({ tracks, escapeHtml, selectedTrackIds: trackSelection.isSelected, reorderable });
         trackSelection.applySelectionToDom();
     }
 }
 
+// Mirror a successful ipod_playlist_move_tracks in the loaded rows: the rows at `positions`
+// go, in order, in front of position `dest` (counted before the move)
+function movePlaylistViewRows(positions, dest) {
+    const moved = new Set(positions);
+    const rows = playlistViewTracks;
+    const out = [];
+    for (let i = 0; i <= rows.length; i++) {
+        if (i === dest) out.push(...rows.filter((_, j) => moved.has(j)));
+        if (i < rows.length && !moved.has(i)) out.push(rows[i]);
+    }
+    playlistViewTracks = out;
+    renderTracks({ tracks: out, escapeHtml, selectedTrackIds: trackSelection.isSelected, reorderable: true });
+}
+
 async function refreshCurrentView() {
     await loadPlaylists();
     const idx = appState.currentPlaylistIndex;
@@ -164,10 +235,19 @@ async function refreshTracks() {
     log('Refreshed track list', 'info');
 }
 
+const metadataPool = createMetadataPool({ log });
+const trackSearch = createTrackSearch({ log });
+const mp3Scanner = createMp3DurationScanner({ wasm, log });
+
+// Tag reads on the main thread also get exact MP3 durations from the frame scanner.
+const readAudioMetadataExact = (file) => readAudioMetadata(file, { scanStreamProps: mp3Scanner.scanStreamProps });
+
 const uploadQueue = createUploadQueue({
     appState,
     log,
-    readAudioMetadata,
+    readAudioMetadata: readAudioMetadataExact,
+    metadataPool,
+    durationScanner: mp3Scanner,
     rerenderAllTracksIfVisible,
 });
 
@@ -181,14 +261,33 @@ const trackOps = createTrackOps({
     logWasmError,
     refreshCurrentView,
     loadPlaylists,
+    selectTracks: (ids) => trackSelection.setSelectedTrackIds(ids),
+    getSelectedTrackIds: () => trackSelection.getSelectedTrackIds(),
+    movePlaylistViewRows,
 });
 
-const trackSelection = createTrackSelection({ appState, log });
+const trackSelection = createTrackSelection({ appState, wasm, log });
+const playlistReorder = createPlaylistReorder({
+    appState,
+    getSelectedTrackIds: () => trackSelection.getSelectedTrackIds(),
+    moveTracksInPlaylist: (...args) => trackOps.moveTracksInPlaylist(...args),
+});
+
+const syncPlanner = createSyncPlanner({
+    appState,
+    wasm,
+    paths,
+    log,
+    uploadQueue,
+    collectAudioFiles: collectAudioFilesFromDirectory,
+    refreshCurrentView,
+});
 
 const syncPipeline = createSyncPipeline({
     appState,
     wasm,
     fsSync,
+    artwork,
     paths,
     log,
     logWasmError,
@@ -196,10 +295,11 @@ const syncPipeline = createSyncPipeline({
     refreshCurrentView,
     rerenderAllTracksIfVisible,
     getOrComputeQueuedMeta: uploadQueue.getOrComputeQueuedMeta,
-    readAudioMetadata,
+    readAudioMetadata: readAudioMetadataExact,
     transcodeFlacToAlacM4a: transcodePool.transcodeFlacToAlacM4a,
     getFiletypeFromName,
     formatDuration,
+    getSyncTargets: () => syncTargets.list(),
 });
 
 // === Connect / FS ===
@@ -208,6 +308,7 @@ async function selectIpodFolder() {
         log('Opening folder picker...');
         const handle = await window.showDirectoryPicker({ mode: 'readwrite' });
         appState.ipodHandle = handle;
+        dirCache.clear();
         log(`Selected folder: ${handle.name}`, 'success');
 
         const isValid = await fsSync.verifyIpodStructure(handle);
@@ -362,18 +463,16 @@ async function uploadTracks() {
     }
 }
 
+// Folders listed (and files opened) at once while scanning a local library
+const FOLDER_SCAN_CONCURRENCY = 8;
+
+// Files (not handles) for callers that need sizes and bytes up front, e.g. sync planning
 async function collectAudioFilesFromDirectory(dirHandle, collected = [], onProgress = null) {
-    for await (const entry of dirHandle.values()) {
-        if (entry.kind === 'file') {
-            if (isAudioFile(entry.name)) {
-                const file = await entry.getFile();
-                collected.push(file);
-                onProgress?.(collected.length);
-            }
-        } else if (entry.kind === 'directory') {
-            await collectAudioFilesFromDirectory(entry, collected, onProgress);
-        }
-    }
+    const { handles } = await scanAudioFileHandles(dirHandle, {
+        isAudioFile,
+        onProgress: ({ files }) => onProgress?.(files),
+    });
+    collected.push(...await mapWithConcurrency(handles, FOLDER_SCAN_CONCURRENCY, (handle) => handle.getFile()));
     return collected;
 }
 
@@ -389,20 +488,29 @@ async function uploadFolder() {
         if (saveBtn) saveBtn.disabled = true;
         if (dropZoneText) dropZoneText.textContent = 'Scanning folder... Found 0 files';
 
-        const fileHandles = await collectAudioFilesFromDirectory(dirHandle, [], (count) => {
-            if (dropZoneText) dropZoneText.textContent = `Scanning folder... Found ${count} files`;
+        // Matches are queued batch by batch while the scan continues; tags are read lazily
+        const folderQueue = uploadQueue.startFolderQueue();
+        const scan = await scanAudioFileHandles(dirHandle, {
+            isAudioFile,
+            concurrency: FOLDER_SCAN_CONCURRENCY,
+            onBatch: (handles) => folderQueue.add(handles),
+            onProgress: ({ files, filesPerSec }) => {
+                if (dropZoneText) dropZoneText.textContent = `Scanning folder... Found ${files} files (${Math.round(filesPerSec)}/s)`;
+            },
         });
 
         if (dropZoneText) dropZoneText.textContent = originalDropText;
         if (saveBtn && appState.isConnected && appState.wasmReady) saveBtn.disabled = false;
 
-        if (fileHandles.length === 0) {
+        if (scan.skippedDirs > 0) log(`Skipped ${scan.skippedDirs} folder(s) that could not be read`, 'warning');
+        if (scan.handles.length === 0) {
             log('No audio files found in the selected folder', 'warning');
             return;
         }
 
-        log(`Found ${fileHandles.length} audio file(s)`, 'success');
-        uploadQueue.queueFilesForSync(fileHandles);
+        log(`Found ${scan.handles.length} audio file(s) in ${scan.dirs} folder(s), ${scan.seconds.toFixed(1)}s (${Math.round(scan.filesPerSec)} files/s)`, 'success');
+        log(`Queued ${scan.handles.length} track(s). Click “Sync iPod” to transfer.`, 'success');
+        void folderQueue.finish();
     } catch (e) {
         if (dropZoneText) dropZoneText.textContent = originalDropText;
         if (saveBtn && appState.isConnected && appState.wasmReady) saveBtn.disabled = false;
@@ -415,38 +523,77 @@ async function uploadFolder() {
     }
 }
 
+// Mirror a local library: plan against the iPod, confirm, then apply only the delta.
+async function mirrorFolder() {
+    const dropZoneText = document.getElementById('dropZone')?.querySelector('p');
+    const originalDropText = dropZoneText?.textContent || '';
+
+    try {
+        const dirHandle = await window.showDirectoryPicker({ mode: 'read' });
+        const plan = await syncPlanner.planFromFolder(dirHandle, {
+            onProgress: ({ phase, done, total }) => {
+                if (!dropZoneText) return;
+                dropZoneText.textContent = phase === 'scan'
+                    ? `Scanning folder... Found ${done} files`
+                    : `Reading tags... ${done} of ${total}`;
+            },
+        });
+        if (dropZoneText) dropZoneText.textContent = originalDropText;
+        if (!plan) return;
+
+        const summary = syncPlanner.describePlan(plan);
+        log(summary.replace('\n', ' '), 'info');
+        const changes = plan.add.length + plan.replace.length + plan.metadata.length + plan.delete.length;
+        if (changes === 0) {
+            log('iPod already matches this folder', 'success');
+            return;
+        }
+        if (!confirm(`Mirror "${dirHandle.name}" to the iPod?\n\n${summary}`)) return;
+
+        await syncPlanner.applyPlan(plan);
+    } catch (e) {
+        if (dropZoneText) dropZoneText.textContent = originalDropText;
+        if (e.name === 'AbortError') {
+            log('Folder selection cancelled', 'warning');
+        } else {
+            log(`Mirror folder error: ${e.message}`, 'error');
+        }
+    }
+}
+
 // === Search / playlist selection ===
 function selectPlaylist(index) {
+    trackSearch.cancel();
     trackSelection.clearSelection();
     appState.currentPlaylistIndex = index;
     renderSidebarPlaylists();
     if (index === -1) {
-        renderTracks({ tracks: getAllTracksWithQueued(), escapeHtml, selectedTrackIds: appState.selectedTrackIds });
+        renderAllTracks();
         trackSelection.applySelectionToDom();
     } else {
         loadPlaylistTracks(index);
     }
 }
 
-function filterTracks() {
-    const query = (document.getElementById('searchBox')?.value || '').toLowerCase();
+async function filterTracks() {
+    const query = (document.getElementById('searchBox')?.value || '').trim();
     const idx = appState.currentPlaylistIndex;
     if (!query) {
+        trackSearch.cancel();
         if (idx === -1) {
-            renderTracks({ tracks: getAllTracksWithQueued(), escapeHtml, selectedTrackIds: appState.selectedTrackIds });
+            renderAllTracks();
             trackSelection.applySelectionToDom();
         }
         else loadPlaylistTracks(idx);
         return;
     }
 
-    const base = idx === -1 ? getAllTracksWithQueued() : (appState.tracks || []);
-    const filtered = base.filter(track =>
-        (track.title && track.title.toLowerCase().includes(query)) ||
-        (track.artist && track.artist.toLowerCase().includes(query)) ||
-        (track.album && track.album.toLowerCase().includes(query))
-    );
-    renderTracks({ tracks: filtered, escapeHtml, selectedTrackIds: appState.selectedTrackIds });
+    const result = await trackSearch.search(idx === -1
+        ? { tracks: appState.tracks || [], queued: getQueuedTrackRows(), query }
+        : { tracks: playlistViewTracks, query });
+    // Superseded by a newer keystroke or a view change
+    if (!result || appState.currentPlaylistIndex !== idx) return;
+    renderTracks({ tracks: result.tracks, queued: result.queued, escapeHtml, selectedTrackIds: trackSelection.isSelected });
     trackSelection.applySelectionToDom();
 }
 
@@ -492,7 +639,7 @@ const contextMenu = createContextMenu({
     log,
     getAllPlaylists: () => appState.playlists,
     getCurrentPlaylistIndex: () => appState.currentPlaylistIndex,
-    getSelectedTrackIds: () => appState.selectedTrackIds,
+    getSelectedTrackIds: () => trackSelection.getSelectedTrackIds(),
     ensureTrackSelected: (trackId) => trackSelection.ensureTrackSelected(trackId),
     actions: {
         deletePlaylist,
@@ -502,14 +649,124 @@ const contextMenu = createContextMenu({
         addTracksToPlaylist: trackOps.addTracksToPlaylist,
         removeTrackFromPlaylist: trackOps.removeTrackFromPlaylist,
         removeTracksFromPlaylist: trackOps.removeTracksFromPlaylist,
+        sortPlaylist: trackOps.sortPlaylist,
     }
 });
 
+// Explicit maintenance: normal syncs only append to the artwork files.
+async function compactArtwork() {
+    if (!appState.isConnected) {
+        log('Please connect an iPod first', 'warning');
+        return;
+    }
+    try {
+        await artwork.compact(appState.ipodHandle);
+    } catch (e) {
+        log(`Artwork compaction failed: ${e?.message || e}`, 'error');
+    }
+}
+
+function logFirstPaths(label, relPaths, limit = 20) {
+    for (const relPath of relPaths.slice(0, limit)) log(`${label}: ${relPath}`, 'info');
+    if (relPaths.length > limit) log(`... and ${relPaths.length - limit} more`, 'info');
+}
+
+// Clean-up progress uses the sync modal's progress bar
+function showCleanUpProgress(status, { detail = '', percent = 0 } = {}) {
+    modals.showUpload();
+    syncPipeline.setUploadModalState({ title: 'Cleaning up iPod...', status, detail, percent, showOk: false });
+}
+
+function percentOf(done, total) {
+    return total > 0 ? Math.round((done / total) * 100) : 0;
+}
+
+// Reconcile the database with the files on the device: tracks whose audio is gone, and
+// audio files in iPod_Control/Music that no track references (left by interrupted syncs).
+async function cleanUpIpod() {
+    if (!appState.isConnected) {
+        log('Please connect an iPod first', 'warning');
+        return;
+    }
+    try {
+        showCleanUpProgress('Checking for missing audio files...');
+        const missingReport = await missingFiles.scan(appState.ipodHandle, {
+            onProgress: ({ foldersDone, folders, checked }) => {
+                showCleanUpProgress('Checking for missing audio files...', {
+                    detail: `${checked} track(s) checked`,
+                    percent: percentOf(foldersDone, folders),
+                });
+            },
+        });
+        syncPipeline.dismissUploadModal();
+        if (missingReport && missingReport.missing.length > 0) {
+            const { missing } = missingReport;
+            logFirstPaths('Missing', missing.map((m) => m.relPath));
+            if (confirm(`${missing.length} track(s) point to audio files that are no longer on the iPod.\n\nRemove them from the library?`)) {
+                const removed = missingFiles.removeTracks(missing.map((m) => m.trackIndex));
+                await refreshCurrentView();
+                log(`Removed ${removed} track(s) without audio. Click “Sync iPod” to save.`, 'success');
+            }
+        }
+
+        showCleanUpProgress('Looking for unused files...');
+        const report = await orphanScanner.scan(appState.ipodHandle, {
+            onProgress: ({ foldersDone, folders, scannedFiles, orphans }) => {
+                showCleanUpProgress('Looking for unused files...', {
+                    detail: `${scannedFiles} file(s) scanned, ${orphans} unused`,
+                    percent: percentOf(foldersDone, folders),
+                });
+            },
+        });
+        syncPipeline.dismissUploadModal();
+        if (!report || report.orphans.length === 0) return;
+
+        const mb = (report.orphanBytes / (1024 * 1024)).toFixed(1);
+        logFirstPaths('Orphan', report.orphans.map((o) => o.relPath));
+        if (!confirm(`Found ${report.orphans.length} file(s) (${mb} MB) on the iPod that no track uses.\n\nDelete them?`)) return;
+
+        showCleanUpProgress('Deleting unused files...');
+        await orphanScanner.deleteOrphans(report.orphans, {
+            onProgress: ({ done, total, reclaimedBytes }) => {
+                showCleanUpProgress('Deleting unused files...', {
+                    detail: `${done} of ${total} (${(reclaimedBytes / (1024 * 1024)).toFixed(1)} MB freed)`,
+                    percent: percentOf(done, total),
+                });
+            },
+        });
+    } catch (e) {
+        log(`iPod clean-up failed: ${e?.message || e}`, 'error');
+    } finally {
+        syncPipeline.dismissUploadModal();
+    }
+}
+
+// Connect another iPod that receives the same queued uploads on the next sync.
+async function addSyncTarget() {
+    if (!appState.isConnected) {
+        log('Connect an iPod first', 'warning');
+        return;
+    }
+    try {
+        const handle = await window.showDirectoryPicker({ mode: 'readwrite' });
+        await syncTargets.addTarget(handle, { primaryHandle: appState.ipodHandle });
+        const names = syncTargets.list().map((t) => t.name);
+        if (names.length > 0) log(`Queued uploads will also be synced to: ${names.join(', ')}`, 'info');
+    } catch (e) {
+        if (e.name === 'AbortError') {
+            log('Folder selection cancelled', 'warning');
+        } else {
+            log(`Could not add iPod: ${e?.message || e}`, 'error');
+        }
+    }
+}
+
 // === Expose globals for inline HTML handlers ===
 Object.assign(window, {
     selectIpodFolder,
     uploadTracks,
     uploadFolder,
+    mirrorFolder,
     saveDatabase: syncPipeline.saveDatabase,
     refreshTracks,
     showNewPlaylistModal,
@@ -533,6 +790,9 @@ Object.assign(window, {
     confirmBugReport,
     showConsoleModal,
     hideConsoleModal,
+    compactArtwork,
+    cleanUpIpod,
+    addSyncTarget,
 });
 
 // === Initialization ===
@@ -561,6 +821,7 @@ document.addEventListener('DOMContentLoaded', async () => {
     contextMenu.attachPlaylistContextMenus();
     contextMenu.attachTrackContextMenus();
     trackSelection.attach();
+    playlistReorder.attach();
 
     const ok = await wasm.initWasm();
     appState.wasmReady = ok;
@@ -568,8 +829,8 @@ document.addEventListener('DOMContentLoaded', async () => {
 });
 
 document.addEventListener('keydown', (e) => {
-    // Cmd/Ctrl + A: select all visible tracks in table
-    if ((e.ctrlKey || e.metaKey) && e.key === 'a') {
+    // Cmd/Ctrl + A: select all visible tracks in table; with Shift: invert the selection
+    if ((e.ctrlKey || e.metaKey) && e.key.toLowerCase() === 'a') {
         const tag = String(e.target?.tagName || '').toLowerCase();
         const isTypingContext =
             tag === 'input' ||
@@ -578,7 +839,8 @@ document.addEventListener('keydown', (e) => {
             e.target?.isContentEditable;
         if (!isTypingContext) {
             e.preventDefault();
-            trackSelection.selectAllVisible();
+            if (e.shiftKey) trackSelection.invertSelection();
+            else trackSelection.selectAllVisible();
         }
         return;
     }
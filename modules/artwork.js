@@ -0,0 +1,205 @@
+/**
+ * Album artwork: embedded cover -> decoded pixels -> WASM thumbnail pipeline (artwork.c).
+ *
+ * The browser decodes the JPEG/PNG (no image codecs are compiled into the WASM module);
+ * C resizes and converts to every cover format the device lists and stages .ithmb data
+ * plus a rewritten ArtworkDB, which are copied to iPod_Control/Artwork on sync.
+ */
+import { parseBlob } from 'music-metadata';
+
+// Larger covers are pre-shrunk by the browser; the biggest iPod cover format is 720x480.
+const MAX_DECODE_EDGE = 1024;
+
+// Cover of the last source file, shared by every manager: a fan-out sync sets the same
+// file's cover on several iPods and should parse and decode it only once.
+let lastCover = { file: null, picture: null, decoded: null };
+
+// inContext(fn) runs synchronous WASM calls on this manager's database (a fan-out target's
+// context); reading and decoding covers happens outside it.
+export function createArtworkManager({ wasm, fsSync, log, inContext = (fn) => fn() } = {}) {
+    const stats = { rendered: 0, shared: 0 };
+
+    function isAvailable() {
+        return Boolean(wasm?.wasmHasFunction?.('ipod_track_set_artwork_rgba') && wasm.getModule()?.HEAPU8)
+            && inContext(() => wasm.wasmCall('ipod_device_supports_artwork')) === 1;
+    }
+
+    /**
+     * Load the device's ArtworkDB so existing covers survive the next rewrite.
+     * Call right after ipod_parse_db.
+     */
+    async function loadFromDevice(ipodHandle) {
+        if (!isAvailable()) return 0;
+        const bytes = await fsSync.readArtworkDb(ipodHandle);
+        if (!bytes || bytes.length === 0) return 0;
+
+        const ptr = wasm.wasmAlloc(bytes.length);
+        if (!ptr) return 0;
+        try {
+            wasm.wasmWriteBytes(ptr, bytes);
+            const count = inContext(() => wasm.wasmCallWithError('ipod_artwork_load_db', ptr, bytes.length));
+            if (count > 0) log?.(`Loaded ${count} cover image(s) from ArtworkDB`, 'info');
+            return count > 0 ? count : 0;
+        } finally {
+            wasm.wasmFree(ptr);
+        }
+    }
+
+    async function extractCover(file) {
+        const metadata = await parseBlob(file, { skipCovers: false, skipPostHeaders: true, duration: false });
+        const pictures = metadata?.common?.picture || [];
+        if (pictures.length === 0) return null;
+        const front = pictures.find((p) => /front/i.test(String(p.type || ''))) || pictures[0];
+        return front?.data?.length ? front : null;
+    }
+
+    async function decodeToRgba(picture) {
+        const blob = new Blob([picture.data], { type: picture.format || 'image/jpeg' });
+        const bitmap = await createImageBitmap(blob);
+        try {
+            const scale = Math.min(1, MAX_DECODE_EDGE / Math.max(bitmap.width, bitmap.height));
+            const width = Math.max(1, Math.round(bitmap.width * scale));
+            const height = Math.max(1, Math.round(bitmap.height * scale));
+            const canvas = new OffscreenCanvas(width, height);
+            const ctx = canvas.getContext('2d');
+            ctx.drawImage(bitmap, 0, 0, width, height);
+            const { data } = ctx.getImageData(0, 0, width, height);
+            return { rgba: data, width, height };
+        } finally {
+            bitmap.close?.();
+        }
+    }
+
+    /**
+     * Render the embedded cover of `sourceFile` onto the track at `trackIndex`.
+     * Tracks with byte-identical covers (an album) share one rendered image: the cover is
+     * decoded and rendered only on the first track that uses it.
+     * Returns true if artwork was set; missing covers and decode failures are not errors.
+     */
+    async function setTrackArtworkFromFile(trackIndex, sourceFile) {
+        if (!sourceFile || trackIndex < 0 || !isAvailable()) return false;
+
+        if (lastCover.file !== sourceFile) {
+            let picture;
+            try {
+                picture = await extractCover(sourceFile);
+            } catch (e) {
+                log?.(`Could not read cover art from ${sourceFile.name}: ${e?.message || e}`, 'warning');
+                return false;
+            }
+            lastCover = { file: sourceFile, picture, decoded: null };
+        }
+        const cover = lastCover;
+        const { picture } = cover;
+        if (!picture) return false;
+
+        const srcPtr = wasm.wasmAlloc(picture.data.length);
+        if (!srcPtr) return false;
+        try {
+            wasm.wasmWriteBytes(srcPtr, picture.data);
+            const cached = inContext(() => wasm.wasmCall('ipod_track_set_artwork_cached', trackIndex, srcPtr, picture.data.length));
+            if (cached === 1) {
+                stats.shared += 1;
+                return true;
+            }
+
+            if (!cover.decoded) {
+                try {
+                    cover.decoded = await decodeToRgba(picture);
+                } catch (e) {
+                    log?.(`Could not decode cover art from ${sourceFile.name}: ${e?.message || e}`, 'warning');
+                    return false;
+                }
+            }
+            const decoded = cover.decoded;
+
+            const { rgba, width, height } = decoded;
+            const ptr = wasm.wasmAlloc(rgba.length);
+            if (!ptr) return false;
+            try {
+                wasm.wasmWriteBytes(ptr, rgba);
+                const res = inContext(() => wasm.wasmCallWithError(
+                    'ipod_track_set_artwork_rgba', trackIndex, ptr, width, height, srcPtr, picture.data.length
+                ));
+                if (res === 0) stats.rendered += 1;
+                return res === 0;
+            } finally {
+                wasm.wasmFree(ptr);
+            }
+        } finally {
+            wasm.wasmFree(srcPtr);
+        }
+    }
+
+    /**
+     * Copy staged .ithmb files and the rewritten ArtworkDB to the device.
+     * Call after ipod_write_db and before the iTunesDB is copied.
+     */
+    async function syncToIpod(ipodHandle, { onProgress } = {}) {
+        if (!wasm?.wasmHasFunction?.('ipod_artwork_get_staged_files_json')) return { ok: true, syncedCount: 0 };
+        if (stats.rendered + stats.shared > 0) {
+            log?.(`Artwork: ${stats.rendered} cover(s) rendered, ${stats.shared} track(s) reused an identical cover`, 'info');
+            stats.rendered = 0;
+            stats.shared = 0;
+        }
+
+        const files = inContext(() => wasm.wasmGetJson('ipod_artwork_get_staged_files_json')) || [];
+        if (files.length === 0) return { ok: true, syncedCount: 0 };
+
+        const res = await fsSync.syncArtworkToIpod(ipodHandle, files, { onProgress });
+        if (res.ok) {
+            inContext(() => wasm.wasmCall('ipod_artwork_commit_staged'));
+        } else {
+            log?.('Artwork could not be copied to the iPod; covers will be missing for new tracks', 'warning');
+        }
+        return res;
+    }
+
+    /**
+     * Maintenance pass: rewrite the .ithmb files without the space left by removed covers.
+     * Live thumbnails are copied into new files, the new ArtworkDB is written, and only then
+     * are the old files deleted, so an interrupted compaction leaves the device readable.
+     */
+    async function compact(ipodHandle, { onProgress } = {}) {
+        if (!wasm?.wasmHasFunction?.('ipod_artwork_compact_plan_json')) {
+            log?.('Artwork compaction is not available in this build', 'warning');
+            return false;
+        }
+        const plan = inContext(() => wasm.wasmGetJson('ipod_artwork_compact_plan_json'));
+        if (!plan) {
+            const errPtr = wasm.wasmCall('ipod_get_last_error');
+            log?.(wasm.wasmGetString(errPtr) || 'Could not plan artwork compaction', 'warning');
+            return false;
+        }
+        if (plan.moves.length === 0 && plan.obsolete.length === 0) {
+            log?.('Artwork is already compact', 'info');
+            return true;
+        }
+
+        await fsSync.copyArtworkRanges(ipodHandle, plan.moves, { onProgress });
+        if (inContext(() => wasm.wasmCallWithError('ipod_artwork_compact_apply')) < 0) return false;
+
+        const res = await syncToIpod(ipodHandle);
+        if (!res.ok) return false;
+
+        for (const name of plan.obsolete) {
+            try {
+                await fsSync.deleteFileFromIpodRelativePath(ipodHandle, `iPod_Control/Artwork/${name}`);
+            } catch (e) {
+                log?.(`Could not delete ${name}: ${e?.message || e}`, 'warning');
+            }
+        }
+
+        const mb = (n) => (n / (1024 * 1024)).toFixed(1);
+        log?.(`Artwork compacted: ${mb(plan.bytesBefore)} MB -> ${mb(plan.bytesAfter)} MB`, 'success');
+        return true;
+    }
+
+    return {
+        isAvailable,
+        loadFromDevice,
+        setTrackArtworkFromFile,
+        syncToIpod,
+        compact,
+    };
+}
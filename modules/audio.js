@@ -5,6 +5,7 @@
 // Bundled by Vite; avoids CDN imports.
 // We intentionally avoid decoding audio.
 import { parseBlob } from 'music-metadata';
+import { hasMp3VbrHeader } from './tagRegions.js';
 
 export function getFiletypeFromName(filename) {
     const lower = String(filename || '').toLowerCase();
@@ -14,6 +15,10 @@ export function getFiletypeFromName(filename) {
     return 'MPEG audio file';
 }
 
+export function isMp3File(filename) {
+    return String(filename || '').toLowerCase().endsWith('.mp3');
+}
+
 export function isAudioFile(filename) {
     const ext = String(filename || '').toLowerCase().split('.').pop();
     return ['mp3', 'm4a', 'aac', 'wav', 'aiff', 'flac'].includes(ext);
@@ -60,71 +65,111 @@ async function getDurationViaHtmlAudioMetadata(file) {
     });
 }
 
-export async function readAudioMetadata(file) {
-    // IMPORTANT: Never return NaN/Infinity here.
-    // Emscripten coerces NaN/Infinity to 0 for int args, producing 0:00 durations on-device.
-    const DEFAULT_PROPS = { duration: 180000, bitrate: 192, samplerate: 44100 }; // 3:00 fallback
+// IMPORTANT: Never return NaN/Infinity from the helpers below.
+// Emscripten coerces NaN/Infinity to 0 for int args, producing 0:00 durations on-device.
+const DEFAULT_PROPS = { duration: 180000, bitrate: 192, samplerate: 44100 }; // 3:00 fallback
 
-    try {
-        // duration=false avoids full-file scans unless the parser can infer duration from headers.
-        const metadata = await parseBlob(file, { skipCovers: true, skipPostHeaders: true, duration: false });
+export const PARSE_OPTIONS = { skipCovers: true, skipPostHeaders: true, duration: false };
 
-        const c = metadata?.common || {};
-        const fmt = metadata?.format || {};
+/**
+ * Map a music-metadata result onto our tag shape. Safe to call from workers (no DOM access).
+ */
+export function tagsFromMetadata(metadata, fileName) {
+    const c = metadata?.common || {};
+    const trackNo = Number.isFinite(c.track?.no) ? c.track.no : (Number.isFinite(c.track) ? c.track : 0);
+    const year = Number.isFinite(c.year) ? c.year : 0;
 
-        const trackNo = Number.isFinite(c.track?.no) ? c.track.no : (Number.isFinite(c.track) ? c.track : 0);
-        const year = Number.isFinite(c.year) ? c.year : 0;
+    return {
+        title: c.title || String(fileName || '').replace(/\.[^/.]+$/, ''),
+        artist: c.artist || 'Unknown Artist',
+        album: c.album || 'Unknown Album',
+        genre: (Array.isArray(c.genre) ? c.genre[0] : c.genre) || '',
+        track: Number.isFinite(trackNo) ? trackNo : 0,
+        year,
+    };
+}
 
-        const tags = {
-            title: c.title || file.name.replace(/\.[^/.]+$/, ''),
-            artist: c.artist || 'Unknown Artist',
-            album: c.album || 'Unknown Album',
-            genre: (Array.isArray(c.genre) ? c.genre[0] : c.genre) || '',
-            track: Number.isFinite(trackNo) ? trackNo : 0,
-            year,
-        };
+/**
+ * Header-derived stream properties; each field is null when the parser could not infer it.
+ */
+export function formatFromMetadata(metadata) {
+    const fmt = metadata?.format || {};
+    return {
+        durationSec: Number.isFinite(fmt.duration) && fmt.duration > 0 ? fmt.duration : null,
+        // fmt.bitrate is bits/second; convert to kbps (this is the "real" bitrate from parser).
+        bitrateKbps: Number.isFinite(fmt.bitrate) && fmt.bitrate > 0 ? Math.round(fmt.bitrate / 1000) : null,
+        samplerateHz: Number.isFinite(fmt.sampleRate) && fmt.sampleRate > 0 ? fmt.sampleRate : null,
+    };
+}
 
-        // Prefer music-metadata duration when available
-        let durationSec = Number.isFinite(fmt.duration) && fmt.duration > 0 ? fmt.duration : null;
-        if (!durationSec) {
-            // Cheap fallback: HTML metadata (still avoids full decode)
-            durationSec = await getDurationViaHtmlAudioMetadata(file);
+/**
+ * Fill in whatever the tag parser could not provide (main thread only: may use HTML Audio).
+ * `scanStreamProps(file)` (optional) computes exact stream properties, e.g. by walking
+ * MP3 frame headers; it is preferred over HTML Audio, which is unreliable for VBR. It runs
+ * when there is no duration, or when `durationExact` is false (an MP3 without a
+ * Xing/VBRI/Info header, whose parser duration is a CBR estimate), unless `frameScanned`
+ * says a scan was already tried (in a metadata worker).
+ */
+export async function finishAudioProps(file, {
+    durationSec = null,
+    bitrateKbps = null,
+    samplerateHz = null,
+    durationExact = null,
+    frameScanned = false,
+} = {}, { scanStreamProps } = {}) {
+    if ((!durationSec || durationExact === false) && !frameScanned && typeof scanStreamProps === 'function') {
+        const scanned = await scanStreamProps(file);
+        if (scanned?.durationSec > 0) {
+            durationSec = scanned.durationSec;
+            // The first frame's bitrate says nothing about a VBR stream; use the scanned average.
+            bitrateKbps = scanned.bitrateKbps || null;
+            samplerateHz = samplerateHz || scanned.samplerateHz || null;
         }
+    }
+    if (!durationSec) {
+        // Cheap fallback: HTML metadata (still avoids full decode)
+        durationSec = await getDurationViaHtmlAudioMetadata(file);
+    }
 
-        const duration = Number.isFinite(durationSec) && durationSec > 0
-            ? Math.max(1, Math.floor(durationSec * 1000))
-            : DEFAULT_PROPS.duration;
+    const duration = Number.isFinite(durationSec) && durationSec > 0
+        ? Math.max(1, Math.floor(durationSec * 1000))
+        : DEFAULT_PROPS.duration;
 
-        // fmt.bitrate is bits/second; convert to kbps (this is the "real" bitrate from parser).
-        const bitrateKbpsFromFmt = Number.isFinite(fmt.bitrate) ? Math.round(fmt.bitrate / 1000) : null;
+    // If parser doesn't provide bitrate, fall back to average bitrate using duration.
+    const avgKbps = Number.isFinite(durationSec) && durationSec > 0
+        ? Math.floor((file.size * 8) / durationSec / 1000)
+        : null;
 
-        // If parser doesn't provide bitrate, fall back to average bitrate using duration.
-        const avgKbps = Number.isFinite(durationSec) && durationSec > 0
-            ? Math.floor((file.size * 8) / durationSec / 1000)
-            : null;
+    const bitrate = (Number.isFinite(bitrateKbps) && bitrateKbps > 0)
+        ? bitrateKbps
+        : (Number.isFinite(avgKbps) && avgKbps > 0 ? avgKbps : DEFAULT_PROPS.bitrate);
 
-        const bitrate = (Number.isFinite(bitrateKbpsFromFmt) && bitrateKbpsFromFmt > 0)
-            ? bitrateKbpsFromFmt
-            : (Number.isFinite(avgKbps) && avgKbps > 0 ? avgKbps : DEFAULT_PROPS.bitrate);
+    const samplerate = Number.isFinite(samplerateHz) && samplerateHz > 0 ? samplerateHz : DEFAULT_PROPS.samplerate;
 
-        const samplerate = Number.isFinite(fmt.sampleRate) && fmt.sampleRate > 0 ? fmt.sampleRate : DEFAULT_PROPS.samplerate;
+    return { duration, bitrate, samplerate };
+}
 
-        return { tags, props: { duration, bitrate, samplerate } };
+export async function readAudioMetadata(file, options = {}) {
+    try {
+        // duration=false avoids full-file scans unless the parser can infer duration from headers.
+        const metadata = await parseBlob(file, PARSE_OPTIONS);
+        const tags = tagsFromMetadata(metadata, file.name);
+        const format = formatFromMetadata(metadata);
+        if (isMp3File(file.name)) format.durationExact = await hasMp3VbrHeader(file);
+        const props = await finishAudioProps(file, format, options);
+        return { tags, props };
     } catch (_) {
         // Fallback: filename tags + (optional) HTML duration + average bitrate
-        const tags = fallbackTagsFromFilename(file);
-        const durationSec = await getDurationViaHtmlAudioMetadata(file);
-        const duration = Number.isFinite(durationSec) && durationSec > 0
-            ? Math.max(1, Math.floor(durationSec * 1000))
-            : DEFAULT_PROPS.duration;
-        const avgKbps = Number.isFinite(durationSec) && durationSec > 0
-            ? Math.floor((file.size * 8) / durationSec / 1000)
-            : null;
-        const bitrate = Number.isFinite(avgKbps) && avgKbps > 0 ? avgKbps : DEFAULT_PROPS.bitrate;
-        return { tags, props: { duration, bitrate, samplerate: DEFAULT_PROPS.samplerate } };
+        return fallbackAudioMetadata(file, options);
     }
 }
 
+export async function fallbackAudioMetadata(file, options = {}) {
+    const tags = fallbackTagsFromFilename(file);
+    const props = await finishAudioProps(file, {}, options);
+    return { tags, props };
+}
+
 export async function readAudioTags(file) {
     const m = await readAudioMetadata(file);
     return m.tags;
@@ -0,0 +1,22 @@
+/**
+ * Run `fn(item, index)` over `items` with at most `limit` calls in flight.
+ * Resolves to the results in input order; a rejected call rejects the whole run
+ * (wrap `fn` to collect per-item failures instead).
+ */
+export async function mapWithConcurrency(items, limit, fn) {
+    const list = Array.from(items || []);
+    const results = new Array(list.length);
+    let next = 0;
+
+    async function runner() {
+        while (next < list.length) {
+            const i = next++;
+            results[i] = await fn(list[i], i);
+        }
+    }
+
+    const runners = [];
+    for (let k = 0; k < Math.max(1, Math.min(limit, list.length)); k++) runners.push(runner());
+    await Promise.all(runners);
+    return results;
+}
@@ -82,6 +82,13 @@ export function createContextMenu({
             return;
         }
 
+        document.getElementById('contextSortPlaylist')?.addEventListener('click', async () => {
+            if (state.type === 'playlist' && state.playlistIndex != null) {
+                await actions?.sortPlaylist?.(state.playlistIndex, 'artist,album,cd_nr,track_nr');
+                hideContextMenu();
+            }
+        });
+
         deletePlaylistBtn.addEventListener('click', async () => {
             if (state.type === 'playlist' && state.playlistIndex != null) {
                 await actions?.deletePlaylist?.(state.playlistIndex);
@@ -161,6 +168,8 @@ export function createContextMenu({
             state.trackIds = [];
 
             deletePlaylistBtn.style.display = 'block';
+            const sortPlaylistBtn = document.getElementById('contextSortPlaylist');
+            if (sortPlaylistBtn) sortPlaylistBtn.style.display = playlist?.is_smart ? 'none' : 'block';
             deleteTrackBtn.style.display = 'none';
             addToPlaylistBtn.style.display = 'none';
             removeFromPlaylistBtn.style.display = 'none';
@@ -204,6 +213,8 @@ export function createContextMenu({
             state.playlistIndex = getCurrentPlaylistIndex?.() ?? -1;
 
             deletePlaylistBtn.style.display = 'none';
+            const sortPlaylistBtn = document.getElementById('contextSortPlaylist');
+            if (sortPlaylistBtn) sortPlaylistBtn.style.display = 'none';
             deleteTrackBtn.style.display = 'block';
             addToPlaylistBtn.style.display = 'block';
 
@@ -0,0 +1,60 @@
+/**
+ * Directory handle cache for the connected device, keyed by relative directory path
+ * ("iPod_Control/Music/F12"). Every getDirectoryHandle is a round trip to the (often slow)
+ * device, so resolving the same folders for each file of a large batch dominates small writes.
+ *
+ * Entries hold promises, so concurrent callers share one lookup. Failed lookups are evicted.
+ * Call clear() when the device goes away; a different root handle also resets the cache.
+ */
+export function createDirHandleCache() {
+    let root = null;
+    const handles = new Map();
+
+    function clear() {
+        root = null;
+        handles.clear();
+    }
+
+    function splitPath(relPath) {
+        return String(relPath || '').split('/').filter(Boolean);
+    }
+
+    function getDir(rootHandle, relDir, { create = false } = {}) {
+        if (!rootHandle) return Promise.reject(new Error('No iPod handle'));
+        if (rootHandle !== root) {
+            handles.clear();
+            root = rootHandle;
+        }
+
+        const parts = splitPath(relDir);
+        if (parts.length === 0) return Promise.resolve(rootHandle);
+
+        // FAT32 is case-insensitive: "F00" and "f00" are the same folder
+        const key = parts.join('/').toLowerCase();
+        const cached = handles.get(key);
+        if (cached) return cached;
+
+        const name = parts[parts.length - 1];
+        const promise = getDir(rootHandle, parts.slice(0, -1).join('/'), { create })
+            .then((parent) => parent.getDirectoryHandle(name, { create }));
+        handles.set(key, promise);
+        promise.catch(() => {
+            if (handles.get(key) === promise) handles.delete(key);
+        });
+        return promise;
+    }
+
+    /** Resolve the parent folder of a relative file path. Returns { dirHandle, fileName }. */
+    async function getParentDir(rootHandle, relPath, { create = false } = {}) {
+        const parts = splitPath(relPath);
+        if (parts.length === 0) throw new Error('Invalid destination path');
+        const dirHandle = await getDir(rootHandle, parts.slice(0, -1).join('/'), { create });
+        return { dirHandle, fileName: parts[parts.length - 1] };
+    }
+
+    return {
+        getDir,
+        getParentDir,
+        clear,
+    };
+}
@@ -0,0 +1,75 @@
+/**
+ * Breadth-first scan of a local folder for audio files.
+ *
+ * Each level of subfolders is listed with bounded concurrency, so a large library is not
+ * walked one directory at a time. Only FileSystemFileHandles are collected; callers call
+ * getFile() when they actually need the bytes. Matches are handed out in batches through
+ * onBatch() while the scan is still running.
+ */
+
+import { mapWithConcurrency } from './concurrency.js';
+
+const DEFAULT_CONCURRENCY = 8;
+const DEFAULT_BATCH_SIZE = 250;
+
+/**
+ * Scan `dirHandle` for files accepted by `isAudioFile(name)`.
+ * onBatch(handles) receives matches in batches of `batchSize`, in discovery order.
+ * onProgress({ files, dirs, filesPerSec }) is called after each folder is listed.
+ * Folders that cannot be listed are skipped and counted.
+ * Resolves to { handles, dirs, skippedDirs, seconds, filesPerSec }.
+ */
+export async function scanAudioFileHandles(dirHandle, {
+    isAudioFile,
+    concurrency = DEFAULT_CONCURRENCY,
+    batchSize = DEFAULT_BATCH_SIZE,
+    onBatch,
+    onProgress,
+} = {}) {
+    const startedAt = performance.now();
+    const handles = [];
+    let batch = [];
+    let dirs = 0;
+    let skippedDirs = 0;
+
+    const filesPerSec = () => {
+        const elapsed = (performance.now() - startedAt) / 1000;
+        return elapsed > 0 ? handles.length / elapsed : 0;
+    };
+
+    const flush = async () => {
+        if (batch.length === 0) return;
+        const ready = batch;
+        batch = [];
+        try { await onBatch?.(ready); } catch (_) {}
+    };
+
+    async function listDirectory(dir) {
+        const subdirs = [];
+        try {
+            for await (const entry of dir.values()) {
+                if (entry.kind === 'directory') {
+                    subdirs.push(entry);
+                } else if (entry.kind === 'file' && isAudioFile(entry.name)) {
+                    handles.push(entry);
+                    batch.push(entry);
+                }
+            }
+        } catch (_) {
+            skippedDirs += 1;
+        }
+        dirs += 1;
+        if (batch.length >= batchSize) await flush();
+        try { onProgress?.({ files: handles.length, dirs, filesPerSec: filesPerSec() }); } catch (_) {}
+        return subdirs;
+    }
+
+    for (let level = [dirHandle]; level.length > 0;) {
+        const children = await mapWithConcurrency(level, concurrency, listDirectory);
+        level = children.flat();
+    }
+    await flush();
+
+    const seconds = (performance.now() - startedAt) / 1000;
+    return { handles, dirs, skippedDirs, seconds, filesPerSec: filesPerSec() };
+}
@@ -1,4 +1,10 @@
-export function createFsSync({ log, wasm, mountpoint = '/iPod' }) {
+import { mapWithConcurrency } from './concurrency.js';
+import { createDirHandleCache } from './dirHandleCache.js';
+
+const DELETE_CONCURRENCY = 8;
+
+// inContext(fn) runs synchronous WASM calls on this iPod's database (a fan-out target's context)
+export function createFsSync({ log, wasm, mountpoint = '/iPod', dirCache = createDirHandleCache(), inContext = (fn) => fn() }) {
     function getFS() {
         const Module = wasm.getModule();
         return Module?.FS;
@@ -91,7 +97,7 @@ export function createFsSync({ log, wasm, mountpoint = '/iPod' }) {
         try { FS.mkdir(mountpoint); } catch (_) {}
 
         // Set mountpoint in WASM
-        wasm.wasmCallWithStrings('ipod_set_mountpoint', [mountpoint]);
+        inContext(() => wasm.wasmCallWithStrings('ipod_set_mountpoint', [mountpoint]));
 
         // Create directory structure
         const dirs = [
@@ -117,8 +123,8 @@ export function createFsSync({ log, wasm, mountpoint = '/iPod' }) {
         const FS = getFS();
         if (!FS) throw new Error('WASM FS not ready');
 
-        const iPodControlHandle = await handle.getDirectoryHandle('iPod_Control', { create: false });
-        const iTunesHandle = await iPodControlHandle.getDirectoryHandle('iTunes', { create: false });
+        const iPodControlHandle = await dirCache.getDir(handle, 'iPod_Control');
+        const iTunesHandle = await dirCache.getDir(handle, 'iPod_Control/iTunes');
 
         // Copy classic iTunesDB if present
         try {
@@ -256,24 +262,19 @@ export function createFsSync({ log, wasm, mountpoint = '/iPod' }) {
         }
     }
 
+    // Open a writable for a device file, creating parent directories as needed.
+    async function openIpodWritable(ipodHandle, relativePath) {
+        if (!ipodHandle) throw new Error('No iPod handle');
+        const { dirHandle, fileName } = await dirCache.getParentDir(ipodHandle, relativePath, { create: true });
+        const fileHandle = await dirHandle.getFileHandle(fileName, { create: true });
+        return fileHandle.createWritable();
+    }
+
     async function writeFileToIpodRelativePath(ipodHandle, relativePath, file, { onProgress } = {}) {
         if (!ipodHandle) throw new Error('No iPod handle');
         if (!file) throw new Error('No file provided');
 
-        const parts = String(relativePath || '').split('/').filter(Boolean);
-        if (parts.length === 0) throw new Error('Invalid destination path');
-
-        const fileName = parts[parts.length - 1];
-        const dirParts = parts.slice(0, -1);
-
-        // Create directories as needed
-        let currentDir = ipodHandle;
-        for (const dir of dirParts) {
-            currentDir = await currentDir.getDirectoryHandle(dir, { create: true });
-        }
-
-        const fileHandle = await currentDir.getFileHandle(fileName, { create: true });
-        const writable = await fileHandle.createWritable();
+        const writable = await openIpodWritable(ipodHandle, relativePath);
 
         // Use native stream piping for better throughput (still constant-memory).
         // If progress is needed, count bytes via a TransformStream.
@@ -306,8 +307,8 @@ export function createFsSync({ log, wasm, mountpoint = '/iPod' }) {
         if (!ipodHandle) return { ok: false, errorCount: 1, syncedCount: 0, skippedCount: 0 };
 
         const tasks = [
-            { virtualPath: `${mountpoint}/iPod_Control/iTunes/iTunesDB`, dirPath: ['iPod_Control', 'iTunes'], fileName: 'iTunesDB', optional: false },
-            { virtualPath: `${mountpoint}/iPod_Control/iTunes/iTunesSD`, dirPath: ['iPod_Control', 'iTunes'], fileName: 'iTunesSD', optional: true },
+            { virtualPath: `${mountpoint}/iPod_Control/iTunes/iTunesDB`, fileName: 'iTunesDB', optional: false },
+            { virtualPath: `${mountpoint}/iPod_Control/iTunes/iTunesSD`, fileName: 'iTunesSD', optional: true },
         ];
 
         let done = 0;
@@ -321,8 +322,7 @@ export function createFsSync({ log, wasm, mountpoint = '/iPod' }) {
             try { onProgress?.({ phase: 'ipod', current: done, total, percent, detail }); } catch (_) {}
         };
 
-        const iPodControlHandle = await ipodHandle.getDirectoryHandle('iPod_Control', { create: true });
-        const iTunesHandle = await iPodControlHandle.getDirectoryHandle('iTunes', { create: true });
+        const iTunesHandle = await dirCache.getDir(ipodHandle, 'iPod_Control/iTunes', { create: true });
 
         for (const t of tasks) {
             const ok = await syncVirtualFileToRealInternal(iTunesHandle, t.virtualPath, t.fileName, t.optional);
@@ -334,6 +334,112 @@ export function createFsSync({ log, wasm, mountpoint = '/iPod' }) {
         return { ok: errorCount === 0, errorCount, syncedCount, skippedCount: 0 };
     }
 
+    /**
+     * Read iPod_Control/Artwork/ArtworkDB from the device, or null if it does not exist.
+     */
+    async function readArtworkDb(ipodHandle) {
+        if (!ipodHandle) return null;
+        try {
+            const artworkHandle = await dirCache.getDir(ipodHandle, 'iPod_Control/Artwork');
+            const fileHandle = await artworkHandle.getFileHandle('ArtworkDB', { create: false });
+            const file = await fileHandle.getFile();
+            return new Uint8Array(await file.arrayBuffer());
+        } catch (_) {
+            return null;
+        }
+    }
+
+    /**
+     * Copy staged artwork files from MEMFS into iPod_Control/Artwork, in order (.ithmb first,
+     * ArtworkDB last). Entries with an `offset` carry only the new thumbnails, written into the
+     * existing device file at that position (the browser still rewrites that file, see
+     * writeVirtualFileAt); the rest replace the file. Stops at the first failure so the device never
+     * gets an ArtworkDB that points at thumbnails which were not written.
+     */
+    async function syncArtworkToIpod(ipodHandle, files, { onProgress } = {}) {
+        if (!ipodHandle || !Array.isArray(files) || files.length === 0) return { ok: true, syncedCount: 0 };
+
+        const artworkHandle = await dirCache.getDir(ipodHandle, 'iPod_Control/Artwork', { create: true });
+
+        let syncedCount = 0;
+        for (const f of files) {
+            const ok = Number(f.offset) > 0
+                ? await writeVirtualFileAt(artworkHandle, f.path, f.name, Number(f.offset))
+                : await syncVirtualFileToRealInternal(artworkHandle, f.path, f.name, false);
+            if (!ok) return { ok: false, syncedCount };
+            syncedCount += 1;
+            const percent = Math.round((syncedCount / files.length) * 100);
+            try { onProgress?.({ phase: 'artwork', current: syncedCount, total: files.length, percent, detail: f.name }); } catch (_) {}
+        }
+        return { ok: true, syncedCount };
+    }
+
+    // Only the appended bytes leave MEMFS, but the device file is not patched in place: a
+    // directory picked by the user has no in-place write path (sync access handles are
+    // OPFS-only), so createWritable({ keepExistingData }) copies the whole file into a swap
+    // file and close() swaps it in. The log line reports that copy so its cost is visible.
+    async function writeVirtualFileAt(realDirHandle, virtualPath, fileName, offset) {
+        const FS = getFS();
+        if (!FS) throw new Error('WASM FS not ready');
+        try {
+            const started = performance.now();
+            const data = FS.readFile(virtualPath);
+            const fileHandle = await realDirHandle.getFileHandle(fileName, { create: true });
+            const existingSize = (await fileHandle.getFile()).size;
+            const writable = await fileHandle.createWritable({ keepExistingData: true });
+            await writable.write({ type: 'write', position: offset, data });
+            await writable.close();
+            const ms = Math.round(performance.now() - started);
+            log(`Appended ${data.length} bytes to ${fileName} (browser rewrote ${Math.max(existingSize, offset + data.length)} bytes via its swap file, ${ms} ms)`, 'info');
+            return true;
+        } catch (e) {
+            log(`Failed to append to ${fileName}: ${e.message}`, 'warning');
+            return false;
+        }
+    }
+
+    /**
+     * Copy byte ranges between .ithmb files in iPod_Control/Artwork (artwork compaction).
+     * `moves` are [{ src, srcOffset, size, dst, dstOffset }] sorted by dst and dstOffset;
+     * each destination is written from scratch.
+     */
+    async function copyArtworkRanges(ipodHandle, moves, { onProgress } = {}) {
+        const artworkHandle = await dirCache.getDir(ipodHandle, 'iPod_Control/Artwork');
+
+        const sources = new Map();
+        const getSource = async (name) => {
+            if (!sources.has(name)) {
+                const handle = await artworkHandle.getFileHandle(name, { create: false });
+                sources.set(name, await handle.getFile());
+            }
+            return sources.get(name);
+        };
+
+        const totalBytes = moves.reduce((sum, m) => sum + m.size, 0);
+        let copiedBytes = 0;
+        let writable = null;
+        let currentDst = null;
+        try {
+            for (const m of moves) {
+                if (m.dst !== currentDst) {
+                    if (writable) await writable.close();
+                    const dstHandle = await artworkHandle.getFileHandle(m.dst, { create: true });
+                    writable = await dstHandle.createWritable();
+                    currentDst = m.dst;
+                }
+                const src = await getSource(m.src);
+                await writable.write({ type: 'write', position: m.dstOffset, data: src.slice(m.srcOffset, m.srcOffset + m.size) });
+                copiedBytes += m.size;
+                const percent = totalBytes > 0 ? Math.round((copiedBytes / totalBytes) * 100) : 100;
+                try { onProgress?.({ phase: 'artwork', copiedBytes, totalBytes, percent, detail: m.dst }); } catch (_) {}
+            }
+            if (writable) await writable.close();
+        } catch (e) {
+            try { await writable?.abort(e); } catch (_) {}
+            throw e;
+        }
+    }
+
     async function syncVirtualFileToRealInternal(realDirHandle, virtualPath, fileName, optional = false) {
         const FS = getFS();
         if (!FS) throw new Error('WASM FS not ready');
@@ -361,29 +467,66 @@ export function createFsSync({ log, wasm, mountpoint = '/iPod' }) {
 
     async function deleteFileFromIpodRelativePath(ipodHandle, relativePath) {
         if (!ipodHandle) throw new Error('No iPod handle');
-        const parts = String(relativePath || '').split('/').filter(Boolean);
-        if (parts.length === 0) throw new Error('Invalid destination path');
+        const { dirHandle, fileName } = await dirCache.getParentDir(ipodHandle, relativePath);
 
-        const fileName = parts[parts.length - 1];
-        const dirParts = parts.slice(0, -1);
+        // Spec: FileSystemDirectoryHandle.removeEntry(name, { recursive? })
+        await dirHandle.removeEntry(fileName, { recursive: false });
+    }
 
-        let currentDir = ipodHandle;
-        for (const dir of dirParts) {
-            currentDir = await currentDir.getDirectoryHandle(dir, { create: false });
+    /**
+     * Delete many files, grouped by parent folder so each folder's (cached) handle is hot while
+     * its files are removed. Removals run with bounded concurrency. Files that are already
+     * gone count as deleted. Returns { deleted, failed: [{ relPath, error }] }.
+     */
+    async function deleteFilesFromIpod(ipodHandle, relPaths, { onProgress } = {}) {
+        if (!ipodHandle) throw new Error('No iPod handle');
+
+        const byDir = new Map();
+        for (const relPath of relPaths || []) {
+            const parts = String(relPath || '').split('/').filter(Boolean);
+            if (parts.length === 0) continue;
+            const dir = parts.slice(0, -1).join('/');
+            if (!byDir.has(dir)) byDir.set(dir, []);
+            byDir.get(dir).push({ relPath, fileName: parts[parts.length - 1] });
         }
 
-        // Spec: FileSystemDirectoryHandle.removeEntry(name, { recursive? })
-        await currentDir.removeEntry(fileName, { recursive: false });
+        const items = [...byDir.entries()].flatMap(([dir, files]) => files.map((f) => ({ dir, ...f })));
+        const total = items.length;
+        let done = 0;
+        let deleted = 0;
+        const failed = [];
+
+        await mapWithConcurrency(items, DELETE_CONCURRENCY, async ({ dir, relPath, fileName }) => {
+            try {
+                const dirHandle = await dirCache.getDir(ipodHandle, dir);
+                await dirHandle.removeEntry(fileName, { recursive: false });
+                deleted += 1;
+            } catch (e) {
+                if (e?.name === 'NotFoundError') deleted += 1;
+                else failed.push({ relPath, error: e });
+            }
+            done += 1;
+            const percent = Math.round((done / total) * 100);
+            try { onProgress?.({ phase: 'delete', current: done, total, percent, detail: relPath }); } catch (_) {}
+        });
+
+        return { deleted, failed };
     }
 
     return {
         mountpoint,
+        dirCache,
         verifyIpodStructure,
         setupWasmFilesystem,
         syncDbToIpod,
+        readArtworkDb,
+        syncArtworkToIpod,
+        copyArtworkRanges,
+        openIpodWritable,
         writeFileToIpodRelativePath,
         reserveVirtualPath,
         deleteFileFromIpodRelativePath,
+        deleteFilesFromIpod,
     };
 }
 
@@ -2,6 +2,7 @@ export function createIpodConnectionMonitor({
     appState,
     wasm,
     log,
+    dirCache,
     updateConnectionStatus,
     enableUIIfReady,
     renderTracks,
@@ -32,6 +33,7 @@ export function createIpodConnectionMonitor({
         // Reset app state
         appState.isConnected = false;
         appState.ipodHandle = null;
+        dirCache?.clear();
         appState.tracks = [];
         appState.playlists = [];
         appState.currentPlaylistIndex = -1;
@@ -57,8 +59,11 @@ export function createIpodConnectionMonitor({
             busy = true;
             try {
                 // Lightweight probe: does the expected iPod structure still exist?
-                const control = await appState.ipodHandle.getDirectoryHandle('iPod_Control', { create: false });
-                const itunes = await control.getDirectoryHandle('iTunes', { create: false });
+                // The cached folder handle still hits the device on getFileHandle below.
+                const itunes = dirCache
+                    ? await dirCache.getDir(appState.ipodHandle, 'iPod_Control/iTunes')
+                    : await (await appState.ipodHandle.getDirectoryHandle('iPod_Control', { create: false }))
+                        .getDirectoryHandle('iTunes', { create: false });
                 // Classic devices have iTunesDB; newer ones (Nano5G, etc.) have iTunesCDB instead.
                 try {
                     await itunes.getFileHandle('iTunesDB', { create: false });
@@ -0,0 +1,130 @@
+/**
+ * Worker pool for tag extraction during large imports.
+ *
+ * Files are handed out in small batches to whichever worker is idle, so a slow file only
+ * stalls its own batch. Batches from every extract() call share one FIFO queue and a worker
+ * holds one batch at a time, so overlapping calls (a folder scan queues many) never run more
+ * parses than there are workers. Each finished batch is reported through onBatch() so the
+ * caller can update the UI once per batch instead of once per file, without the workers
+ * waiting on it.
+ */
+
+const DEFAULT_BATCH_SIZE = 16;
+
+function defaultPoolSize() {
+    const hc = Number(globalThis.navigator?.hardwareConcurrency || 0);
+    return Number.isFinite(hc) && hc > 0 ? hc : 4;
+}
+
+export function createMetadataPool({ size = defaultPoolSize(), batchSize = DEFAULT_BATCH_SIZE, log } = {}) {
+    const poolSize = Math.max(1, Math.floor(size));
+    const workers = [];
+    // Batches waiting for an idle worker: { items, job }, across all extract() calls
+    const queue = [];
+    let workersUnavailable = false;
+    let nextBatchId = 1;
+
+    function spawnWorker() {
+        // Vite bundles module workers referenced this way (including the music-metadata import).
+        return new Worker(new URL('./metadataWorker.js', import.meta.url), { type: 'module' });
+    }
+
+    function ensureWorkers() {
+        if (workersUnavailable) return false;
+        if (workers.length > 0) return true;
+        try {
+            for (let i = 0; i < poolSize; i++) {
+                workers.push({ worker: spawnWorker(), busy: false });
+            }
+            return true;
+        } catch (e) {
+            log?.(`Metadata workers unavailable, reading tags on the main thread (${e?.message || e})`, 'warning');
+            workers.forEach((w) => w.worker.terminate());
+            workers.length = 0;
+            workersUnavailable = true;
+            return false;
+        }
+    }
+
+    function runBatch(slot, items) {
+        const batchId = nextBatchId++;
+        slot.busy = true;
+        return new Promise((resolve) => {
+            const onMessage = (e) => {
+                if (e.data?.type !== 'results' || e.data.batchId !== batchId) return;
+                cleanup();
+                resolve({ results: e.data.results || [], scanStats: e.data.scanStats || null });
+            };
+            const onError = (e) => {
+                cleanup();
+                // Worker crashed mid-batch: report every item as failed; the caller can
+                // still compute metadata lazily at sync time.
+                resolve({ results: items.map((it) => ({ key: it.key, ok: false, error: e?.message || 'Worker error' })), scanStats: null });
+            };
+            const cleanup = () => {
+                slot.worker.removeEventListener('message', onMessage);
+                slot.worker.removeEventListener('error', onError);
+                slot.busy = false;
+            };
+            slot.worker.addEventListener('message', onMessage);
+            slot.worker.addEventListener('error', onError);
+            slot.worker.postMessage({ type: 'extract', batchId, items });
+        });
+    }
+
+    // Hand queued batches to idle workers; each worker comes back here when its batch is done
+    function pump() {
+        for (const slot of workers) {
+            if (slot.busy || queue.length === 0) continue;
+            const { items, job } = queue.shift();
+            runBatch(slot, items).then(({ results, scanStats }) => {
+                job.handoffs.push(Promise.resolve().then(() => job.onBatch?.(results, { scanStats })).catch(() => {}));
+                if (--job.pending === 0) job.done();
+                pump();
+            });
+        }
+    }
+
+    /**
+     * Extract tags for `items` ([{ key, file?, handle? }]).
+     * Resolves once every batch has been reported via onBatch(results, { scanStats }) and
+     * every onBatch call has settled. onBatch calls may overlap; they do not hold up the
+     * workers. `scanStats` is the worker's MP3 frame-scan throughput for the batch, or null.
+     * Returns false when workers cannot be used (caller should fall back).
+     */
+    async function extract(items, { onBatch } = {}) {
+        const list = Array.from(items || []);
+        if (list.length === 0) return true;
+        if (!ensureWorkers()) return false;
+
+        // Workers move straight on to their next batch; the caller's onBatch work (main
+        // thread) runs alongside and is only waited for at the end.
+        const job = { onBatch, pending: 0, handoffs: [], done: null };
+        const finished = new Promise((resolve) => { job.done = resolve; });
+        for (let i = 0; i < list.length; i += batchSize) {
+            queue.push({ items: list.slice(i, i + batchSize), job });
+            job.pending++;
+        }
+        pump();
+        await finished;
+        await Promise.all(job.handoffs);
+        return true;
+    }
+
+    function terminate() {
+        workers.forEach((w) => w.worker.terminate());
+        workers.length = 0;
+        // Batches still queued will not run: fail them so their extract() calls settle
+        for (const { items, job } of queue.splice(0)) {
+            const results = items.map((it) => ({ key: it.key, ok: false, error: 'Pool terminated' }));
+            job.handoffs.push(Promise.resolve().then(() => job.onBatch?.(results, { scanStats: null })).catch(() => {}));
+            if (--job.pending === 0) job.done();
+        }
+    }
+
+    return {
+        extract,
+        terminate,
+        size: poolSize,
+    };
+}
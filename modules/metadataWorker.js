@@ -0,0 +1,108 @@
+/**
+ * Metadata worker: parses tags for a batch of queued files off the main thread.
+ *
+ * Message in:  { type: 'extract', batchId, items: [{ key, file?, handle? }] }
+ * Message out: { type: 'results', batchId, results: [{ key, ok, tags, format, error }], scanStats }
+ *
+ * `format` carries header-derived values only (null when unknown); the main thread fills in
+ * anything missing (HTML Audio duration, defaults) since that needs the DOM. MP3s without a
+ * Xing/VBRI/Info header are frame-scanned here for an exact duration, so the whole-file read
+ * stays off the main thread; `scanStats` reports the batch's scan throughput.
+ */
+
+import { parseBlob, parseBuffer } from 'music-metadata';
+import { PARSE_OPTIONS, tagsFromMetadata, formatFromMetadata, isMp3File } from './audio.js';
+import { readTagRegion } from './tagRegions.js';
+import { createStandaloneMp3Scanner } from './mp3Duration.js';
+
+let frameScanner = null;
+
+function getFrameScanner() {
+    frameScanner ??= createStandaloneMp3Scanner();
+    return frameScanner;
+}
+
+function mimeTypeForName(name) {
+    const ext = String(name || '').toLowerCase().split('.').pop();
+    switch (ext) {
+        case 'mp3': return 'audio/mpeg';
+        case 'm4a': case 'aac': return 'audio/mp4';
+        case 'flac': return 'audio/flac';
+        case 'wav': return 'audio/wav';
+        case 'aiff': case 'aif': return 'audio/aiff';
+        default: return undefined;
+    }
+}
+
+async function parseRegionOrBlob(file) {
+    let region = null;
+    try {
+        region = await readTagRegion(file);
+    } catch (_) {
+        region = null;
+    }
+
+    if (region) {
+        try {
+            const metadata = await parseBuffer(region.bytes, {
+                mimeType: mimeTypeForName(file.name),
+                size: region.size,
+                path: file.name,
+            }, PARSE_OPTIONS);
+            const format = formatFromMetadata(metadata);
+            // Bitrate derived from a synthesized buffer's size is meaningless; let the
+            // main thread compute the average from the real file size instead. So is an MP3
+            // duration that was not read from a Xing/VBRI/Info header (a CBR size estimate).
+            if (region.synthesized) format.bitrateKbps = null;
+            if (region.synthesized && region.vbrHeader === false) format.durationSec = null;
+            if (region.vbrHeader !== undefined) format.durationExact = region.vbrHeader;
+            return { metadata, format };
+        } catch (_) {
+            // fall through to the full Blob parse
+        }
+    }
+
+    const metadata = await parseBlob(file, PARSE_OPTIONS);
+    const format = formatFromMetadata(metadata);
+    if (region?.vbrHeader !== undefined) format.durationExact = region.vbrHeader;
+    return { metadata, format };
+}
+
+// Exact duration for an MP3 whose duration is not from a Xing/VBRI/Info header. Without
+// the scanner module, `format` is left for the main thread to scan.
+async function scanFrames(file, format) {
+    if (!isMp3File(file.name) || format.durationExact === true) return;
+    const scanner = await getFrameScanner();
+    if (!scanner) return;
+    const scanned = await scanner.scanStreamProps(file);
+    format.frameScanned = true;
+    if (!(scanned?.durationSec > 0)) return;
+    format.durationSec = scanned.durationSec;
+    format.bitrateKbps = scanned.bitrateKbps || null;
+    format.samplerateHz = format.samplerateHz || scanned.samplerateHz || null;
+    format.durationExact = true;
+}
+
+async function extractOne(item) {
+    try {
+        const file = item.file || (item.handle ? await item.handle.getFile() : null);
+        if (!file) throw new Error('No file');
+        const { metadata, format } = await parseRegionOrBlob(file);
+        await scanFrames(file, format);
+        return { key: item.key, ok: true, tags: tagsFromMetadata(metadata, file.name), format };
+    } catch (e) {
+        return { key: item.key, ok: false, error: String(e?.message || e) };
+    }
+}
+
+self.onmessage = async (e) => {
+    const msg = e.data || {};
+    if (msg.type !== 'extract') return;
+
+    const results = [];
+    for (const item of msg.items || []) {
+        results.push(await extractOne(item));
+    }
+    const scanStats = (await frameScanner)?.drainStats() || null;
+    self.postMessage({ type: 'results', batchId: msg.batchId, results, scanStats });
+};
@@ -0,0 +1,113 @@
+/**
+ * Missing-file detector: database tracks whose audio file is gone from the device.
+ *
+ * Track paths come from WASM in one packed buffer. Instead of a getFileHandle per track,
+ * each Music/Fxx folder is listed once (concurrently) and every track in it is checked
+ * against the listing. Misses are removed with one ipod_remove_tracks call.
+ */
+import { mapWithConcurrency } from './concurrency.js';
+
+const FOLDER_CONCURRENCY = 4;
+
+export function createMissingFileDetector({ wasm, log, dirCache } = {}) {
+    function isAvailable() {
+        return Boolean(wasm?.wasmHasFunction?.('ipod_get_track_paths_packed'));
+    }
+
+    function readTrackPaths() {
+        const ptr = wasm.wasmCall('ipod_get_track_paths_packed');
+        if (!ptr) return null;
+        const packed = wasm.wasmGetString(ptr);
+        wasm.wasmCall('ipod_free_string', ptr);
+        return packed ? packed.split('\n') : [];
+    }
+
+    async function resolveDir(rootHandle, relDir) {
+        if (dirCache) return dirCache.getDir(rootHandle, relDir);
+        let handle = rootHandle;
+        for (const part of relDir.split('/').filter(Boolean)) {
+            handle = await handle.getDirectoryHandle(part, { create: false });
+        }
+        return handle;
+    }
+
+    /**
+     * Returns { missing: [{ trackIndex, relPath }], checked }, or null if unavailable.
+     * Track indices are only valid until the database changes.
+     */
+    async function scan(ipodHandle, { onProgress } = {}) {
+        if (!isAvailable()) {
+            log?.('Missing-file check is not available in this build', 'warning');
+            return null;
+        }
+        const trackPaths = readTrackPaths();
+        if (!trackPaths) return null;
+
+        // Folder (case-folded, FAT32 is case-insensitive) -> tracks in it
+        const byDir = new Map();
+        trackPaths.forEach((relPath, trackIndex) => {
+            if (!relPath) return;
+            const slash = relPath.lastIndexOf('/');
+            const dir = relPath.slice(0, slash);
+            const key = dir.toLowerCase();
+            if (!byDir.has(key)) byDir.set(key, { dir, tracks: [] });
+            byDir.get(key).tracks.push({ trackIndex, relPath, name: relPath.slice(slash + 1).toLowerCase() });
+        });
+
+        const startedAt = performance.now();
+        const missing = [];
+        let checked = 0;
+        let foldersDone = 0;
+        await mapWithConcurrency([...byDir.values()], FOLDER_CONCURRENCY, async ({ dir, tracks }) => {
+            const present = new Set();
+            try {
+                const dirHandle = await resolveDir(ipodHandle, dir);
+                for await (const entry of dirHandle.values()) {
+                    if (entry.kind === 'file') present.add(entry.name.toLowerCase());
+                }
+            } catch (e) {
+                if (e?.name !== 'NotFoundError') throw e;
+                // Whole folder gone: every track in it is missing
+            }
+            for (const t of tracks) {
+                if (!present.has(t.name)) missing.push({ trackIndex: t.trackIndex, relPath: t.relPath });
+            }
+            checked += tracks.length;
+            foldersDone += 1;
+            try { onProgress?.({ foldersDone, folders: byDir.size, checked }); } catch (_) {}
+        });
+
+        missing.sort((a, b) => a.trackIndex - b.trackIndex);
+        const elapsedSec = (performance.now() - startedAt) / 1000;
+        log?.(
+            `Checked ${checked} track file(s) in ${byDir.size} folder(s) in ${elapsedSec.toFixed(1)}s: ${missing.length} missing`,
+            missing.length > 0 ? 'warning' : 'success'
+        );
+        return { missing, checked };
+    }
+
+    /** Remove the given tracks from the database in one call. Returns the number removed. */
+    function removeTracks(trackIndices) {
+        if (trackIndices.length === 0) return 0;
+        const ints = Int32Array.from(trackIndices);
+        const ptr = wasm.wasmAlloc(ints.byteLength);
+        if (!ptr) return 0;
+        try {
+            wasm.wasmWriteBytes(ptr, new Uint8Array(ints.buffer));
+            const removed = wasm.wasmCall('ipod_remove_tracks', ptr, ints.length);
+            if (removed < 0) {
+                log?.(`Could not remove tracks: ${wasm.wasmGetString(wasm.wasmCall('ipod_get_last_error'))}`, 'error');
+                return 0;
+            }
+            return removed;
+        } finally {
+            wasm.wasmFree(ptr);
+        }
+    }
+
+    return {
+        isAvailable,
+        scan,
+        removeTracks,
+    };
+}
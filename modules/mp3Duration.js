@@ -0,0 +1,159 @@
+/**
+ * Exact MP3 duration via the WASM frame scanner (mp3_scan.c).
+ *
+ * Streams the file through a fixed scratch buffer in WASM memory, so memory use stays
+ * constant regardless of file size. Used for every MP3 whose duration does not come from a
+ * Xing/VBRI/Info header. Imports scan in the metadata workers, each with its own copy of the
+ * scanner (public/mp3_scan.mjs); the main module's copy covers the paths without workers.
+ */
+
+const SCRATCH_BYTES = 1 << 20; // 1MB
+const STANDALONE_MODULE_URL = '/mp3_scan.mjs';
+
+export function createMp3DurationScanner({ wasm, log } = {}) {
+    let scratchPtr = 0;
+    let scanChain = Promise.resolve();
+    const stats = { files: 0, bytes: 0, scanMs: 0, totalMs: 0 };
+
+    function isAvailable() {
+        return Boolean(wasm?.wasmHasFunction?.('ipod_mp3_scan_feed') && wasm.getModule()?.HEAPU8);
+    }
+
+    function ensureScratch() {
+        if (scratchPtr) return scratchPtr;
+        const ptr = wasm.wasmAlloc(SCRATCH_BYTES);
+        scratchPtr = ptr || 0;
+        return scratchPtr;
+    }
+
+    function feed(bytes) {
+        for (let off = 0; off < bytes.length; off += SCRATCH_BYTES) {
+            const part = bytes.subarray(off, Math.min(bytes.length, off + SCRATCH_BYTES));
+            wasm.wasmWriteBytes(scratchPtr, part);
+            wasm.wasmCall('ipod_mp3_scan_feed', scratchPtr, part.length);
+        }
+    }
+
+    async function scanOne(file) {
+        if (!isAvailable() || !ensureScratch()) return null;
+
+        const startedAt = performance.now();
+        let scanMs = 0;
+
+        const reader = file.stream().getReader();
+        wasm.wasmCall('ipod_mp3_scan_begin');
+        try {
+            for (;;) {
+                const { done, value } = await reader.read();
+                if (done) break;
+                const t0 = performance.now();
+                feed(value);
+                scanMs += performance.now() - t0;
+            }
+        } catch (e) {
+            log?.(`MP3 frame scan failed for ${file.name}: ${e?.message || e}`, 'warning');
+            return null;
+        } finally {
+            try { reader.releaseLock(); } catch (_) {}
+        }
+
+        const durationMs = wasm.wasmCall('ipod_mp3_scan_finish');
+        const result = durationMs > 0
+            ? {
+                durationSec: durationMs / 1000,
+                bitrateKbps: wasm.wasmCall('ipod_mp3_scan_avg_bitrate') || null,
+                samplerateHz: wasm.wasmCall('ipod_mp3_scan_samplerate') || null,
+            }
+            : null;
+
+        stats.files += 1;
+        stats.bytes += file.size;
+        stats.scanMs += scanMs;
+        stats.totalMs += performance.now() - startedAt;
+        return result;
+    }
+
+    /**
+     * Returns { durationSec, bitrateKbps, samplerateHz } or null if the file is not an
+     * MP3, the scanner is not built into the module, or no frames were found.
+     */
+    function scanStreamProps(file) {
+        if (!file || !String(file.name || '').toLowerCase().endsWith('.mp3')) return Promise.resolve(null);
+        // The C scanner holds one file's state, so scans are serialized.
+        const run = scanChain.then(() => scanOne(file));
+        scanChain = run.catch(() => {});
+        return run;
+    }
+
+    /**
+     * Return and reset the throughput counters (e.g. to hand a worker's scans to the page).
+     */
+    function drainStats() {
+        const drained = { ...stats };
+        stats.files = 0;
+        stats.bytes = 0;
+        stats.scanMs = 0;
+        stats.totalMs = 0;
+        return drained;
+    }
+
+    /**
+     * Count scans done elsewhere (a metadata worker) in the next throughput report.
+     */
+    function addStats(more) {
+        if (!more) return;
+        stats.files += more.files || 0;
+        stats.bytes += more.bytes || 0;
+        stats.scanMs += more.scanMs || 0;
+        stats.totalMs += more.totalMs || 0;
+    }
+
+    /**
+     * Log and reset throughput since the last report (no-op if nothing was scanned).
+     */
+    function reportThroughput() {
+        if (stats.files === 0) return;
+        const { files, bytes, scanMs, totalMs } = drainStats();
+        const mb = bytes / (1024 * 1024);
+        const scanRate = scanMs > 0 ? mb / (scanMs / 1000) : 0;
+        const totalRate = totalMs > 0 ? mb / (totalMs / 1000) : 0;
+        log?.(
+            `Frame-scanned ${files} MP3(s), ${mb.toFixed(1)} MB: ` +
+            `${scanRate.toFixed(0)} MB/s scan, ${totalRate.toFixed(0)} MB/s including reads`,
+            'info'
+        );
+    }
+
+    return {
+        isAvailable,
+        scanStreamProps,
+        drainStats,
+        addStats,
+        reportThroughput,
+    };
+}
+
+/**
+ * Scanner backed by the standalone scanner module, for workers (which cannot load the main
+ * module). Resolves to null when the module is missing or fails to load.
+ */
+export async function createStandaloneMp3Scanner({ url = STANDALONE_MODULE_URL, log } = {}) {
+    try {
+        const { default: createMp3ScanModule } = await import(/* @vite-ignore */ url);
+        const Module = await createMp3ScanModule();
+        // The slice of the wasmApi surface the scanner uses
+        const wasm = {
+            getModule: () => Module,
+            wasmHasFunction: (funcName) => typeof Module[`_${funcName}`] === 'function',
+            wasmCall: (funcName, ...args) => Module[`_${funcName}`](...args),
+            wasmAlloc: (size) => Module._malloc(size) || 0,
+            wasmWriteBytes: (ptr, bytes) => {
+                Module.HEAPU8.set(bytes, ptr);
+                return true;
+            },
+        };
+        return createMp3DurationScanner({ wasm, log });
+    } catch (_) {
+        return null;
+    }
+}
@@ -0,0 +1,131 @@
+/**
+ * Orphan file scanner for iPod_Control/Music.
+ *
+ * Interrupted syncs can leave audio files in Music/Fxx that no track references. Folders are
+ * listed concurrently; each folder's file names go to the WASM path index in one call
+ * (ipod_path_set_filter_unreferenced), so the per-file cost is a hash lookup in C.
+ */
+import { mapWithConcurrency } from './concurrency.js';
+
+const FOLDER_CONCURRENCY = 4;
+const DELETE_BATCH_SIZE = 32;
+
+export function createOrphanScanner({ appState, wasm, log } = {}) {
+    function isAvailable() {
+        return Boolean(wasm?.wasmHasFunction?.('ipod_path_set_begin'));
+    }
+
+    async function listFolder(dirHandle) {
+        const files = [];
+        for await (const entry of dirHandle.values()) {
+            if (entry.kind === 'file' && !entry.name.startsWith('.')) files.push(entry);
+        }
+        return files;
+    }
+
+    /**
+     * Returns { orphans: [{ relPath, name, size, dirHandle }], scannedFiles, orphanBytes },
+     * or null if the path index is unavailable.
+     */
+    async function scan(ipodHandle, { onProgress } = {}) {
+        if (!isAvailable()) {
+            log?.('Orphan scan is not available in this build', 'warning');
+            return null;
+        }
+
+        const controlHandle = await ipodHandle.getDirectoryHandle('iPod_Control', { create: false });
+        const musicHandle = await controlHandle.getDirectoryHandle('Music', { create: false });
+        const folders = [];
+        for await (const entry of musicHandle.values()) {
+            if (entry.kind === 'directory' && /^F\d+$/i.test(entry.name)) folders.push(entry);
+        }
+
+        if (wasm.wasmCallWithError('ipod_path_set_begin') < 0) return null;
+
+        // Files of tracks deleted in this session stay until "Sync iPod" removes them; the
+        // device's iTunesDB still references them, so they are not orphans yet.
+        const pendingDeletes = new Set((appState.pendingFileDeletes || []).map((p) => String(p).toLowerCase()));
+
+        const startedAt = performance.now();
+        let scannedFiles = 0;
+        let foldersDone = 0;
+        const orphans = [];
+        try {
+            await mapWithConcurrency(folders, FOLDER_CONCURRENCY, async (folder) => {
+                const entries = await listFolder(folder);
+                const relPaths = entries.map((e) => `iPod_Control/Music/${folder.name}/${e.name}`);
+
+                const indices = relPaths.length > 0 ? filterUnreferenced(relPaths) : [];
+
+                for (const i of indices) {
+                    const relPath = relPaths[i];
+                    if (pendingDeletes.has(relPath.toLowerCase())) continue;
+                    let size = 0;
+                    try { size = (await entries[i].getFile()).size; } catch (_) {}
+                    orphans.push({ relPath, name: entries[i].name, size, dirHandle: folder });
+                }
+
+                scannedFiles += entries.length;
+                foldersDone += 1;
+                try { onProgress?.({ phase: 'scan', foldersDone, folders: folders.length, scannedFiles, orphans: orphans.length }); } catch (_) {}
+            });
+        } finally {
+            wasm.wasmCall('ipod_path_set_end');
+        }
+
+        const orphanBytes = orphans.reduce((sum, o) => sum + o.size, 0);
+        const elapsedSec = (performance.now() - startedAt) / 1000;
+        log?.(
+            `Scanned ${scannedFiles} file(s) in ${folders.length} folder(s) in ${elapsedSec.toFixed(1)}s: ` +
+            `${orphans.length} orphan(s), ${(orphanBytes / (1024 * 1024)).toFixed(1)} MB`,
+            orphans.length > 0 ? 'warning' : 'success'
+        );
+        return { orphans, scannedFiles, orphanBytes };
+    }
+
+    function filterUnreferenced(relPaths) {
+        const ptr = wasm.wasmCallWithStrings('ipod_path_set_filter_unreferenced', [relPaths.join('\n')]);
+        if (!ptr) return [];
+        const json = wasm.wasmGetString(ptr);
+        wasm.wasmCall('ipod_free_string', ptr);
+        try {
+            return JSON.parse(json) || [];
+        } catch (_) {
+            return [];
+        }
+    }
+
+    /**
+     * Delete orphans in batches (one removeEntry per file, batches run concurrently).
+     * Returns { deleted, failed, reclaimedBytes }.
+     */
+    async function deleteOrphans(orphans, { onProgress } = {}) {
+        let deleted = 0;
+        let failed = 0;
+        let reclaimedBytes = 0;
+
+        for (let off = 0; off < orphans.length; off += DELETE_BATCH_SIZE) {
+            const batch = orphans.slice(off, off + DELETE_BATCH_SIZE);
+            await mapWithConcurrency(batch, FOLDER_CONCURRENCY, async (o) => {
+                try {
+                    await o.dirHandle.removeEntry(o.name, { recursive: false });
+                    deleted += 1;
+                    reclaimedBytes += o.size;
+                } catch (e) {
+                    failed += 1;
+                    log?.(`Could not delete ${o.relPath}: ${e?.message || e}`, 'warning');
+                }
+            });
+            try { onProgress?.({ phase: 'delete', done: deleted + failed, total: orphans.length, reclaimedBytes }); } catch (_) {}
+        }
+
+        log?.(`Deleted ${deleted} orphan file(s), reclaimed ${(reclaimedBytes / (1024 * 1024)).toFixed(1)} MB`, failed ? 'warning' : 'success');
+        return { deleted, failed, reclaimedBytes };
+    }
+
+    return {
+        isAvailable,
+        scan,
+        deleteOrphans,
+    };
+}
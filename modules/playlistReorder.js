@@ -0,0 +1,76 @@
+import { getTrackViewIds } from './uiRender.js';
+
+/**
+ * Drag-to-reorder rows of a regular playlist. Rows rendered with `reorderable` carry their
+ * playlist position in data-pos; dragging a selected row moves the whole selection.
+ */
+export function createPlaylistReorder({ appState, getSelectedTrackIds, moveTracksInPlaylist } = {}) {
+    let dragPositions = null;
+
+    function rowPosition(row) {
+        const pos = Number(row?.getAttribute('data-pos'));
+        return Number.isFinite(pos) ? pos : -1;
+    }
+
+    function clearDropMarkers(tbody) {
+        for (const row of tbody.querySelectorAll('tr.drop-before, tr.drop-after')) {
+            row.classList.remove('drop-before', 'drop-after');
+        }
+    }
+
+    function dropTarget(e) {
+        const row = e.target?.closest?.('tr[data-pos]');
+        if (!row) return null;
+        const rect = row.getBoundingClientRect();
+        const after = e.clientY > rect.top + rect.height / 2;
+        return { row, dest: rowPosition(row) + (after ? 1 : 0), after };
+    }
+
+    function attach() {
+        const tbody = document.getElementById('trackTableBody');
+        if (!tbody || tbody.dataset.reorderHandler) return;
+
+        tbody.addEventListener('dragstart', (e) => {
+            const row = e.target?.closest?.('tr[data-pos]');
+            if (!row) return;
+            const selected = new Set(getSelectedTrackIds?.() || []);
+            const rowId = Number(row.getAttribute('data-track-id'));
+            // The selection may include rows the virtual table has not rendered
+            dragPositions = selected.has(rowId)
+                ? getTrackViewIds().map((id, pos) => (selected.has(id) ? pos : -1)).filter((p) => p >= 0)
+                : [rowPosition(row)].filter((p) => p >= 0);
+            e.dataTransfer.effectAllowed = 'move';
+            e.dataTransfer.setData('text/plain', String(dragPositions.length));
+        });
+
+        tbody.addEventListener('dragover', (e) => {
+            if (!dragPositions) return;
+            const target = dropTarget(e);
+            if (!target) return;
+            e.preventDefault();
+            clearDropMarkers(tbody);
+            target.row.classList.add(target.after ? 'drop-after' : 'drop-before');
+        });
+
+        tbody.addEventListener('dragend', () => {
+            dragPositions = null;
+            clearDropMarkers(tbody);
+        });
+
+        tbody.addEventListener('drop', async (e) => {
+            if (!dragPositions) return;
+            const target = dropTarget(e);
+            const positions = dragPositions;
+            dragPositions = null;
+            clearDropMarkers(tbody);
+            if (!target) return;
+            e.preventDefault();
+            e.stopPropagation();
+            await moveTracksInPlaylist(appState.currentPlaylistIndex, positions, target.dest);
+        });
+
+        tbody.dataset.reorderHandler = 'true';
+    }
+
+    return { attach };
+}
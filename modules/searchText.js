@@ -0,0 +1,14 @@
+/**
+ * Case folding shared by the search worker and its main-thread fallback.
+ */
+
+// Lowercase and drop diacritics, so "beyonce" finds "Beyoncé"
+export function foldSearchText(s) {
+    return String(s ?? '').normalize('NFKD').replace(/\p{M}/gu, '').toLowerCase();
+}
+
+// Searchable text of a [title, artist, album] row. The separator keeps a query from
+// matching across the end of one field and the start of the next.
+export function searchRowText(row) {
+    return foldSearchText(`${row?.[0] || ''}\u0001${row?.[1] || ''}\u0001${row?.[2] || ''}`);
+}
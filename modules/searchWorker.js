@@ -0,0 +1,59 @@
+/**
+ * Search worker: holds a case-folded index of the library so filtering never scans
+ * 50k tracks on the main thread.
+ *
+ * Message in:  { type: 'index', indexId, rows: [[title, artist, album], ...] }
+ *              { type: 'query', seq, indexId, query, extra: [[title, artist, album], ...] }
+ * Message out: { type: 'results', seq, positions: Int32Array, extraPositions: Int32Array }
+ *              { type: 'cancelled', seq }
+ *
+ * `positions` index into the indexed rows, `extraPositions` into `extra` (queued uploads,
+ * which change too often to be worth indexing). A query is scanned in slices; when a newer
+ * query arrives in between, the older one stops and reports 'cancelled'.
+ */
+
+import { foldSearchText, searchRowText } from './searchText.js';
+
+const SLICE_ROWS = 4096;
+
+let indexId = 0;
+let indexText = [];
+let latestSeq = 0;
+
+function yieldToMessages() {
+    return new Promise((resolve) => setTimeout(resolve, 0));
+}
+
+async function scan(texts, needle, seq) {
+    const hits = [];
+    for (let i = 0; i < texts.length; i++) {
+        if (i > 0 && i % SLICE_ROWS === 0) {
+            await yieldToMessages();
+            if (seq !== latestSeq) return null;
+        }
+        if (texts[i].includes(needle)) hits.push(i);
+    }
+    return Int32Array.from(hits);
+}
+
+async function runQuery(msg) {
+    const needle = foldSearchText(msg.query);
+    const positions = msg.indexId === indexId ? await scan(indexText, needle, msg.seq) : new Int32Array(0);
+    const extra = positions ? await scan((msg.extra || []).map(searchRowText), needle, msg.seq) : null;
+    if (!positions || !extra || msg.seq !== latestSeq) {
+        self.postMessage({ type: 'cancelled', seq: msg.seq });
+        return;
+    }
+    self.postMessage({ type: 'results', seq: msg.seq, positions, extraPositions: extra }, [positions.buffer, extra.buffer]);
+}
+
+self.onmessage = (e) => {
+    const msg = e.data || {};
+    if (msg.type === 'index') {
+        indexId = msg.indexId;
+        indexText = (msg.rows || []).map(searchRowText);
+    } else if (msg.type === 'query') {
+        latestSeq = msg.seq;
+        void runQuery(msg);
+    }
+};
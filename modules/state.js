@@ -15,7 +15,7 @@ export function createAppState(initialState = {}) {
         wasmReady: false,
         pendingUploads: [], // queued files to be processed on sync
         pendingFileDeletes: [], // relative FS paths to delete on next sync
-        selectedTrackIds: [], // numeric track indices selected in the UI
+        selectedTrackIds: [], // numeric track indices selected in the UI (builds without the WASM selection bitset)
         ...initialState,
     };
 
@@ -1,7 +1,14 @@
+import { teeFileToWritables } from './teeWriter.js';
+import { mapWithConcurrency } from './concurrency.js';
+
+// Queued handles resolved to Files this many at a time before uploading starts
+const FILE_OPEN_CONCURRENCY = 8;
+
 export function createSyncPipeline({
     appState,
     wasm,
     fsSync,
+    artwork,
     paths,
     log,
     logWasmError,
@@ -13,6 +20,7 @@ export function createSyncPipeline({
     transcodeFlacToAlacM4a,
     getFiletypeFromName,
     formatDuration,
+    getSyncTargets,
 } = {}) {
     function setUploadModalState({ title, status, detail, percent, showOk, okLabel } = {}) {
         const titleEl = document.getElementById('uploadTitle');
@@ -54,18 +62,20 @@ export function createSyncPipeline({
         });
     }
 
-    async function uploadSingleTrack(file, precomputedMeta = null, { destName } = {}) {
-        if (!file) return false;
-        const meta = precomputedMeta || (await getOrComputeQueuedMeta(null, file));
-        const audioProps = {
-            duration: meta.durationMs,
-            bitrate: meta.bitrateKbps,
-            samplerate: meta.samplerateHz,
-        };
+    // The connected iPod, in the same shape as the fan-out targets from syncTargets.js.
+    function primaryDevice() {
+        const ctx = wasm.wasmHasFunction?.('ipod_ctx_current') ? wasm.wasmCall('ipod_ctx_current') : 1;
+        return { ctx, name: appState.ipodHandle?.name || 'iPod', ipodHandle: appState.ipodHandle, fsSync, paths, artwork, primary: true };
+    }
 
-        const effectiveName = String(destName || file.name || 'track');
-        const filetype = getFiletypeFromName(effectiveName);
+    // Run fn (synchronous WASM calls only) against device's database. A single device needs
+    // no context switching.
+    function inDevice(devices, device, fn) {
+        return devices.length > 1 ? wasm.wasmWithContext(device.ctx, fn) : fn();
+    }
 
+    // Add the track to the device's database and reserve its destination path.
+    function addTrackToDb(device, file, meta, effectiveName, where) {
         const trackIndex = wasm.wasmAddTrack({
             title: meta.title || file.name.replace(/\.[^/.]+$/, ''),
             artist: meta.artist,
@@ -74,52 +84,46 @@ export function createSyncPipeline({
             trackNr: meta.trackNr || 0,
             cdNr: 0,
             year: meta.year || 0,
-            durationMs: audioProps.duration,
-            bitrateKbps: audioProps.bitrate,
-            samplerateHz: audioProps.samplerate,
+            durationMs: meta.durationMs,
+            bitrateKbps: meta.bitrateKbps,
+            samplerateHz: meta.samplerateHz,
             sizeBytes: file.size,
-            filetype,
+            filetype: getFiletypeFromName(effectiveName),
         });
 
         if (trackIndex < 0) {
-            logWasmError?.('Failed to add track');
-            return false;
+            logWasmError?.(`Failed to add track${where}`);
+            return null;
         }
 
         const destPathPtr = wasm.wasmCallWithStrings('ipod_get_track_dest_path', [effectiveName]);
         if (!destPathPtr) {
-            log?.('Failed to get destination path', 'error');
-            return false;
+            log?.(`Failed to get destination path${where}`, 'error');
+            return null;
         }
 
         const destPath = wasm.wasmGetString(destPathPtr);
         wasm.wasmCall('ipod_free_string', destPathPtr);
         if (!destPath) {
-            log?.('Failed to read destination path', 'error');
-            return false;
+            log?.(`Failed to read destination path${where}`, 'error');
+            return null;
         }
 
-        const relFsPath = paths.toRelFsPathFromVfs(destPath);
-
         // Reserve this path in MEMFS to avoid collisions when generating multiple tracks.
-        try { fsSync.reserveVirtualPath(destPath); } catch (_) {}
+        try { device.fsSync.reserveVirtualPath(destPath); } catch (_) {}
 
-        // Upload audio directly to the real iPod filesystem (no MEMFS audio staging)
-        try {
-            await fsSync.writeFileToIpodRelativePath(appState.ipodHandle, relFsPath, file);
-        } catch (e) {
-            log?.(`Failed to write file to iPod: ${e?.message || e}`, 'error');
-            wasm.wasmCallWithError('ipod_remove_track', trackIndex);
-            return false;
-        }
+        return { device, trackIndex, destPath, relFsPath: device.paths.toRelFsPathFromVfs(destPath) };
+    }
 
+    // Point the track at its written file and add it to the open playlist (synchronous).
+    function finalizeTrack({ device, trackIndex, destPath, relFsPath }, file) {
         // Finalize track metadata WITHOUT requiring the file to exist in MEMFS.
         const finalizePathPtr = wasm.wasmAllocString(destPath);
         const result = wasm.wasmCallWithError('ipod_finalize_last_track_no_stat', finalizePathPtr, file.size);
         wasm.wasmFreeString(finalizePathPtr);
 
         if (result !== 0) {
-            const ipodPath = paths.toIpodDbPathFromRel(relFsPath) || '';
+            const ipodPath = device.paths.toIpodDbPathFromRel(relFsPath) || '';
             const setPathRes = wasm.wasmCallWithStrings('ipod_track_set_path', [ipodPath], [trackIndex]);
             if (setPathRes !== 0) {
                 wasm.wasmCallWithError('ipod_remove_track', trackIndex);
@@ -127,20 +131,180 @@ export function createSyncPipeline({
             }
         }
 
+        // The open playlist belongs to the connected iPod's database
         const idx = appState.currentPlaylistIndex;
-        if (idx >= 0 && idx < appState.playlists.length) {
+        if (device.primary && idx >= 0 && idx < appState.playlists.length) {
             wasm.wasmCall('ipod_playlist_add_track', idx, trackIndex);
         }
+        return true;
+    }
+
+    // Finalize the track on its device, then set its cover. Reading and decoding the cover
+    // runs outside the device's context; its artwork manager enters it for the WASM calls.
+    async function finishTrack(devices, slot, file, artworkSource, written) {
+        if (!inDevice(devices, slot.device, () => finalizeTrack(slot, file))) return false;
+
+        // Covers come from the original file (FLAC transcodes drop embedded pictures).
+        await slot.device.artwork?.setTrackArtworkFromFile(slot.trackIndex, artworkSource || file);
+        written?.push({ device: slot.device, relFsPath: slot.relFsPath });
+        return true;
+    }
+
+    /**
+     * Add `file` to every device in `devices` (the connected iPod first). The source is
+     * read once: with several devices its stream is tee'd to one writer per device.
+     * Returns whether the track landed on the connected iPod. Files that landed are
+     * appended to `written` as { device, relFsPath }.
+     */
+    async function uploadSingleTrack(file, precomputedMeta = null, { destName, artworkSource, devices = [primaryDevice()], written } = {}) {
+        if (!file) return false;
+        const meta = precomputedMeta || (await getOrComputeQueuedMeta(null, file));
+        const effectiveName = String(destName || file.name || 'track');
+        const where = (device) => (devices.length > 1 ? ` (${device.name})` : '');
+
+        const slots = [];
+        for (const device of devices) {
+            const slot = inDevice(devices, device, () => addTrackToDb(device, file, meta, effectiveName, where(device)));
+            if (slot) slots.push(slot);
+        }
+        if (slots.length === 0) return false;
+
+        // Upload audio directly to the real iPod filesystem (no MEMFS audio staging)
+        let errors;
+        if (slots.length === 1) {
+            const { device, relFsPath } = slots[0];
+            try {
+                await device.fsSync.writeFileToIpodRelativePath(device.ipodHandle, relFsPath, file);
+                errors = [null];
+            } catch (e) {
+                errors = [e];
+            }
+        } else {
+            const openErrors = [];
+            const writables = await Promise.all(slots.map(({ device, relFsPath }, i) =>
+                device.fsSync.openIpodWritable(device.ipodHandle, relFsPath).catch((e) => {
+                    openErrors[i] = e;
+                    return null;
+                })
+            ));
+            errors = (await teeFileToWritables(file, writables)).map((e, i) => openErrors[i] || e);
+        }
+
+        let landed = false;
+        for (let i = 0; i < slots.length; i++) {
+            const slot = slots[i];
+            let ok = false;
+            if (errors[i]) {
+                log?.(`Failed to write file to iPod${where(slot.device)}: ${errors[i]?.message || errors[i]}`, 'error');
+                inDevice(devices, slot.device, () => wasm.wasmCallWithError('ipod_remove_track', slot.trackIndex));
+            } else {
+                ok = await finishTrack(devices, slot, file, artworkSource, written);
+            }
+            if (slot.device === devices[0]) landed = ok;
+        }
 
-        log?.(`Added: ${meta.title || file.name} (${formatDuration(audioProps.duration)})`, 'success');
+        log?.(`Added: ${meta.title || file.name} (${formatDuration(meta.durationMs)})`, landed ? 'success' : 'warning');
+        return landed;
+    }
+
+    // Open a transaction on each device so a failed write can undo this sync's edits
+    // in memory. Returns the devices that have one (a build without them: none).
+    function beginSyncTransactions(devices) {
+        const inTxn = new Set();
+        for (const device of devices) {
+            if (inDevice(devices, device, () => wasm.wasmTxn?.('begin')) === 0) inTxn.add(device);
+        }
+        return inTxn;
+    }
+
+    // Undo this sync's edits on `device` and delete the audio files already written to it,
+    // so its database again matches the iPod's. Returns whether it was rolled back.
+    async function rollbackDevice(devices, device, inTxn, written) {
+        if (!inTxn.delete(device)) return false;
+        const undone = inDevice(devices, device, () => wasm.wasmTxn('rollback'));
+        if (undone < 0) return false;
+        const orphans = written.filter((w) => w.device === device).map((w) => w.relFsPath);
+        if (orphans.length > 0) {
+            await device.fsSync.deleteFilesFromIpod(device.ipodHandle, orphans).catch((e) => {
+                log?.(`Could not remove uploaded files${devices.length > 1 ? ` (${device.name})` : ''}: ${e?.message || e}`, 'warning');
+            });
+        }
+        log?.(`Reverted ${undone} change(s)${devices.length > 1 ? ` on ${device.name}` : ''}`, 'info');
         return true;
     }
 
-    async function saveDatabase() {
+    function commitDevice(devices, device, inTxn) {
+        if (inTxn.delete(device)) inDevice(devices, device, () => wasm.wasmTxn('commit'));
+    }
+
+    // The sync stopped after the connected iPod's database was written: keep what the
+    // other devices staged, as before transactions existed.
+    function commitAll(devices, inTxn) {
+        for (const device of [...inTxn]) commitDevice(devices, device, inTxn);
+    }
+
+    // Copy staged covers. Like a failed ArtworkDB write, a failed copy only costs covers:
+    // it is logged, and the database write it follows is neither failed nor rolled back.
+    async function syncArtwork(manager, ipodHandle, { where = '', onProgress } = {}) {
+        try {
+            await manager?.syncToIpod(ipodHandle, { onProgress });
+        } catch (e) {
+            log?.(`Artwork could not be copied${where}: ${e?.message || e}`, 'warning');
+        }
+    }
+
+    /**
+     * Write the database of every fan-out target and copy it over. Databases are written
+     * one context at a time; the iTunesDB copies only read MEMFS and run side by side.
+     * Returns the names of the targets that failed.
+     */
+    async function syncTargetDevices(targets, { devices, inTxn, written }) {
+        const failed = [];
+        const copies = [];
+        for (const target of targets) {
+            setUploadModalState({ status: `Preparing database for ${target.name}...`, detail: '' });
+            let ok = false;
+            try {
+                ok = wasm.wasmWithContext(target.ctx, () => wasm.wasmCallWithError('ipod_write_db') === 0);
+            } catch (e) {
+                log?.(`Sync to ${target.name} failed: ${e?.message || e}`, 'error');
+            }
+            // Copied outside the context; the target's artwork manager enters it for its WASM calls
+            if (ok) await syncArtwork(target.artwork, target.ipodHandle, { where: ` (${target.name})` });
+            if (!ok) {
+                await rollbackDevice(devices, target, inTxn, written);
+                failed.push(target.name);
+                continue;
+            }
+            commitDevice(devices, target, inTxn);
+            copies.push(target.fsSync.syncDbToIpod(target.ipodHandle).then(
+                (res) => { if (!res?.ok) failed.push(target.name); },
+                (e) => {
+                    log?.(`Sync to ${target.name} failed: ${e?.message || e}`, 'error');
+                    failed.push(target.name);
+                }
+            ));
+        }
+        setUploadModalState({ status: `Copying databases to ${targets.length} other iPod(s)...`, detail: '' });
+        await Promise.all(copies);
+        return failed;
+    }
+
+    /**
+     * Sync queued uploads, edits and deletions to the connected iPod. Queued uploads are
+     * also written to every fan-out target (default: getSyncTargets()), reading and
+     * transcoding each file once.
+     */
+    async function saveDatabase({ targets } = {}) {
         if (!appState.isConnected) {
             log?.('Please connect an iPod first', 'warning');
             return;
         }
+        const extraTargets = targets ?? getSyncTargets?.() ?? [];
+        const devices = [primaryDevice(), ...extraTargets];
+        if (extraTargets.length > 0) {
+            log?.(`Syncing to ${devices.length} iPods: ${devices.map((d) => d.name).join(', ')}`, 'info');
+        }
 
         modals.showUpload();
         setUploadModalState({
@@ -151,6 +315,10 @@ export function createSyncPipeline({
             showOk: false,
         });
 
+        // Edits made by this sync can be undone if writing the database fails
+        const inTxn = beginSyncTransactions(devices);
+        const written = [];
+
         // 1) Process queued uploads
         const queue = appState.pendingUploads || [];
         const toStage = queue.filter((q) => q.status !== 'staged');
@@ -171,10 +339,13 @@ export function createSyncPipeline({
             };
 
             const flacTasks = [];
+            const files = await mapWithConcurrency(toStage, FILE_OPEN_CONCURRENCY,
+                (item) => (item.kind === 'handle' ? item.handle.getFile() : item.file));
 
             // Kick off FLAC transcodes early so they can overlap with MP3 uploads.
-            for (const item of toStage) {
-                const file = item.kind === 'handle' ? await item.handle.getFile() : item.file;
+            for (let i = 0; i < toStage.length; i++) {
+                const item = toStage[i];
+                const file = files[i];
                 const lowerName = String(file?.name || '').toLowerCase();
                 if (!lowerName.endsWith('.flac')) continue;
 
@@ -206,7 +377,7 @@ export function createSyncPipeline({
 
                         await enqueueUpload(async () => {
                             updateUploadProgress(completed + 1, total, m4aFile.name);
-                            const ok = await uploadSingleTrack(m4aFile, combinedMeta, { destName: m4aFile.name });
+                            const ok = await uploadSingleTrack(m4aFile, combinedMeta, { destName: m4aFile.name, artworkSource: file, devices, written });
                             if (ok) item.status = 'staged';
                             completed += 1;
                             updateUploadProgress(completed, total, m4aFile.name);
@@ -220,15 +391,16 @@ export function createSyncPipeline({
             }
 
             // Process non-FLAC uploads sequentially (while FLAC transcodes run in background).
-            for (const item of toStage) {
-                const file = item.kind === 'handle' ? await item.handle.getFile() : item.file;
+            for (let i = 0; i < toStage.length; i++) {
+                const item = toStage[i];
+                const file = files[i];
                 const lowerName = String(file?.name || '').toLowerCase();
                 if (lowerName.endsWith('.flac')) continue; // handled by background tasks
 
                 const meta = await getOrComputeQueuedMeta(item, file);
                 await enqueueUpload(async () => {
                     updateUploadProgress(completed + 1, total, file?.name || item.name || 'Unknown');
-                    const ok = await uploadSingleTrack(file, meta);
+                    const ok = await uploadSingleTrack(file, meta, { devices, written });
                     if (ok) item.status = 'staged';
                     completed += 1;
                     updateUploadProgress(completed, total, file?.name || item.name || 'Unknown');
@@ -247,6 +419,12 @@ export function createSyncPipeline({
         setUploadModalState({ status: 'Preparing database...', detail: '' });
         const result = wasm.wasmCallWithError('ipod_write_db');
         if (result !== 0) {
+            // Put the database back as it was loaded; the uploads stay queued for a retry
+            if (await rollbackDevice(devices, devices[0], inTxn, written)) {
+                for (const item of toStage) item.status = 'queued';
+                await refreshCurrentView();
+            }
+            for (const target of extraTargets) await rollbackDevice(devices, target, inTxn, written);
             setUploadModalState({
                 title: 'Upload failed',
                 status: 'Failed to prepare database.',
@@ -257,9 +435,23 @@ export function createSyncPipeline({
             return;
         }
 
-        // 3) Copy iTunesDB (+ optional iTunesSD) to iPod, then apply deletions
+        commitDevice(devices, devices[0], inTxn);
+
+        // 3) Copy artwork, then iTunesDB (+ optional iTunesSD) to iPod, then apply deletions
         try {
             setUploadModalState({ status: 'Uploading to iPod...', detail: '', percent: 0 });
+            await syncArtwork(artwork, appState.ipodHandle, {
+                onProgress: ({ percent, detail }) => {
+                    setUploadModalState({
+                        title: 'Syncing to iPod...',
+                        status: 'Copying artwork...',
+                        detail: detail || '',
+                        percent,
+                        showOk: false,
+                    });
+                }
+            });
+
             const res = await fsSync.syncDbToIpod(appState.ipodHandle, {
                 onProgress: ({ percent, detail }) => {
                     setUploadModalState({
@@ -273,6 +465,7 @@ export function createSyncPipeline({
             });
 
             if (!res?.ok) {
+                commitAll(devices, inTxn);
                 setUploadModalState({
                     title: 'Upload finished with errors',
                     status: 'Some files could not be uploaded.',
@@ -286,17 +479,25 @@ export function createSyncPipeline({
 
             const pendingDeletes = appState.pendingFileDeletes || [];
             if (pendingDeletes.length > 0) {
-                for (const relFsPath of pendingDeletes) {
-                    try {
-                        await fsSync.deleteFileFromIpodRelativePath(appState.ipodHandle, relFsPath);
-                        log?.(`Deleted file: ${relFsPath}`, 'info');
-                    } catch (e) {
-                        log?.(`Could not delete file: ${relFsPath} (${e?.message || e})`, 'warning');
+                const { deleted, failed } = await fsSync.deleteFilesFromIpod(appState.ipodHandle, pendingDeletes, {
+                    onProgress: ({ current, total, percent }) => {
+                        setUploadModalState({
+                            title: 'Syncing to iPod...',
+                            status: 'Removing deleted tracks...',
+                            detail: `${current} of ${total}`,
+                            percent,
+                            showOk: false,
+                        });
                     }
+                });
+                for (const { relPath, error } of failed) {
+                    log?.(`Could not delete file: ${relPath} (${error?.message || error})`, 'warning');
                 }
+                log?.(`Deleted ${deleted} file(s) from iPod`, failed.length ? 'warning' : 'info');
             }
         } catch (e) {
             log?.(`Sync failed: ${e?.message || e}`, 'error');
+            commitAll(devices, inTxn);
             setUploadModalState({
                 title: 'Upload failed',
                 status: 'Uploading to iPod failed.',
@@ -307,10 +508,27 @@ export function createSyncPipeline({
             return;
         }
 
+        // 4) Other iPods: only queued uploads fan out; edits and deletions are per device
+        const failedTargets = extraTargets.length > 0 ? await syncTargetDevices(extraTargets, { devices, inTxn, written }) : [];
+
         appState.pendingUploads = [];
         appState.pendingFileDeletes = [];
 
         await refreshCurrentView();
+
+        if (failedTargets.length > 0) {
+            log?.(`Sync failed for: ${failedTargets.join(', ')}`, 'error');
+            setUploadModalState({
+                title: 'Sync finished with errors',
+                status: `Could not sync: ${failedTargets.join(', ')}`,
+                detail: 'Please check the console log for details.',
+                percent: 100,
+                showOk: true,
+                okLabel: 'OK',
+            });
+            return;
+        }
+
         log?.('Sync complete', 'success');
 
         setUploadModalState({
@@ -0,0 +1,177 @@
+/**
+ * Differential sync against a local music folder ("mirror").
+ *
+ * Tags are read for every local file, then matched against the iPod database by the
+ * C planner (sync_plan.c). The plan only touches the delta: new files are queued, changed
+ * audio is replaced, retagged files get a metadata-only update, and iPod tracks with no
+ * local counterpart are removed.
+ */
+
+// Rough device write throughput for the estimate (USB 2.0 iPods sustain ~10-20 MB/s).
+const WRITE_MB_PER_SEC = 12;
+// Per-file overhead: handle creation, DB entry, FS metadata.
+const PER_FILE_SEC = 0.05;
+// FLACs are uploaded as ALAC, which compresses a few percent worse than FLAC. The
+// converted size is only known after transcoding, so the plan estimates it.
+const ALAC_BYTES_PER_FLAC_BYTE = 1.05;
+
+export function createSyncPlanner({
+    appState,
+    wasm,
+    paths,
+    log,
+    uploadQueue,
+    collectAudioFiles,
+    refreshCurrentView,
+} = {}) {
+    function isAvailable() {
+        return Boolean(wasm?.wasmHasFunction?.('ipod_sync_plan_begin'));
+    }
+
+    function isTranscoded(file) {
+        return String(file?.name || '').toLowerCase().endsWith('.flac');
+    }
+
+    // Bytes the upload writes to the device: the file itself, or its ALAC conversion
+    function uploadBytes(file) {
+        return isTranscoded(file) ? Math.round(file.size * ALAC_BYTES_PER_FLAC_BYTE) : file.size;
+    }
+
+    function estimate(raw) {
+        const filesToWrite = raw.add.length + raw.replace.length;
+        const seconds = raw.bytesToWrite / (WRITE_MB_PER_SEC * 1024 * 1024) + filesToWrite * PER_FILE_SEC;
+        return { filesToWrite, bytesToWrite: raw.bytesToWrite, bytesToDelete: raw.bytesToDelete, seconds };
+    }
+
+    /**
+     * Scan `dirHandle`, read tags and build a plan. Returns null if planning is unavailable
+     * or failed. Track indices in the plan are only valid until the database changes.
+     */
+    async function planFromFolder(dirHandle, { onProgress } = {}) {
+        if (!isAvailable()) {
+            log?.('Sync planning is not available in this build', 'warning');
+            return null;
+        }
+
+        const files = await collectAudioFiles(dirHandle, [], (count) => {
+            try { onProgress?.({ phase: 'scan', done: count }); } catch (_) {}
+        });
+        if (files.length === 0) {
+            log?.('No audio files found in the selected folder', 'warning');
+            return null;
+        }
+
+        const startedAt = performance.now();
+        const metas = await uploadQueue.readMetaForFiles(files, {
+            onProgress: ({ done, total }) => {
+                try { onProgress?.({ phase: 'tags', done, total }); } catch (_) {}
+            },
+        });
+        log?.(`Read tags for ${files.length} local file(s) in ${((performance.now() - startedAt) / 1000).toFixed(1)}s`, 'info');
+
+        if (wasm.wasmCallWithError('ipod_sync_plan_begin') < 0) return null;
+        let raw;
+        try {
+            files.forEach((file, i) => {
+                const meta = metas[i];
+                wasm.wasmSyncPlanAddLocal(i, {
+                    title: meta.title,
+                    artist: meta.artist,
+                    album: meta.album,
+                    genre: meta.genre,
+                    trackNr: meta.trackNr,
+                    year: meta.year,
+                    sizeBytes: file.size,
+                    writeBytes: uploadBytes(file),
+                    durationMs: meta.durationMs,
+                    transcoded: isTranscoded(file),
+                });
+            });
+            raw = wasm.wasmGetJson('ipod_sync_plan_get_json');
+        } finally {
+            wasm.wasmCall('ipod_sync_plan_end');
+        }
+        if (!raw) return null;
+
+        return { files, metas, ...raw, estimate: estimate(raw) };
+    }
+
+    function describePlan(plan) {
+        const mb = (n) => (n / (1024 * 1024)).toFixed(1);
+        const e = plan.estimate;
+        const minutes = Math.max(1, Math.round(e.seconds / 60));
+        return [
+            `${plan.add.length} to add, ${plan.replace.length} changed, ` +
+                `${plan.metadata.length} tag update(s), ${plan.delete.length} to delete, ${plan.unchanged} unchanged.`,
+            `About ${mb(e.bytesToWrite)} MB to write (~${minutes} min), ${mb(e.bytesToDelete)} MB freed.`,
+        ].join('\n');
+    }
+
+    /**
+     * Apply a plan to the in-memory database and upload queue. Nothing touches the device
+     * until the next "Sync iPod".
+     */
+    async function applyPlan(plan) {
+        // 1) Metadata-only updates first, while track indices are still the planned ones.
+        // One batch call per set of tags present (tags a file lacks are left unchanged).
+        const batches = new Map();
+        for (const [localId, trackIndex] of plan.metadata) {
+            const meta = plan.metas[localId];
+            const values = {};
+            for (const key of ['title', 'artist', 'album', 'genre']) {
+                if (meta[key] != null) values[key] = meta[key];
+            }
+            values.trackNr = meta.trackNr || 0;
+            values.year = meta.year || 0;
+            const keys = Object.keys(values).join();
+            if (!batches.has(keys)) batches.set(keys, { indices: [], values: [] });
+            batches.get(keys).indices.push(trackIndex);
+            batches.get(keys).values.push(values);
+        }
+        let updated = 0;
+        for (const { indices, values } of batches.values()) {
+            updated += Math.max(0, wasm.wasmUpdateTracksBatch(indices, values));
+        }
+
+        // 2) Remove replaced and missing tracks, highest index first so indices don't shift.
+        const removals = [...plan.replace.map(([, trackIndex]) => trackIndex), ...plan.delete].sort((a, b) => b - a);
+        const deletes = [];
+        let removed = 0;
+        if (wasm.wasmHasFunction('ipod_remove_tracks_by_handle')) {
+            // Resolve every track first, then remove them by stable handle in one call. Only
+            // tracks that really left the database give up their files.
+            const tracks = removals
+                .map((trackIndex) => wasm.wasmGetJson('ipod_get_track_json', trackIndex))
+                .filter((track) => track?.handle);
+            removed = Math.max(0, wasm.wasmRemoveTracksByHandle(tracks.map((track) => track.handle)));
+            for (const track of wasm.wasmRemovedTracks(tracks, removed)) {
+                if (track.ipod_path) deletes.push(paths.toRelFsPathFromIpodDbPath(track.ipod_path));
+            }
+        } else {
+            for (const trackIndex of removals) {
+                const track = wasm.wasmGetJson('ipod_get_track_json', trackIndex);
+                const relFsPath = track?.ipod_path ? paths.toRelFsPathFromIpodDbPath(track.ipod_path) : null;
+                if (wasm.wasmCall('ipod_remove_track', trackIndex) !== 0) continue;
+                removed++;
+                if (relFsPath) deletes.push(relFsPath);
+            }
+        }
+        if (deletes.length > 0) {
+            appState.pendingFileDeletes = [...(appState.pendingFileDeletes || []), ...deletes];
+        }
+
+        // 3) Queue new and changed files with the tags we already read.
+        const toUpload = [...plan.add, ...plan.replace.map(([localId]) => localId)];
+        uploadQueue.queueFilesWithMeta(toUpload.map((localId) => ({ file: plan.files[localId], meta: plan.metas[localId] })));
+
+        await refreshCurrentView?.();
+        log?.(`Mirror plan applied: ${toUpload.length} queued, ${updated} retagged, ${removed} removed. Click “Sync iPod” to transfer.`, 'success');
+    }
+
+    return {
+        isAvailable,
+        planFromFolder,
+        describePlan,
+        applyPlan,
+    };
+}
@@ -0,0 +1,102 @@
+/**
+ * Extra iPods for fan-out sync.
+ *
+ * Each target gets its own WASM context (its own iTunesDB), MEMFS mountpoint,
+ * directory-handle cache and artwork manager. saveDatabase reads and transcodes
+ * each queued file once and writes it to the connected iPod and to every target.
+ */
+import { createFsSync } from './fsSync.js';
+import { createPaths } from './paths.js';
+import { createArtworkManager } from './artwork.js';
+import { createDirHandleCache } from './dirHandleCache.js';
+
+export function createSyncTargets({ wasm, log } = {}) {
+    const targets = [];
+    let nextMount = 2;
+
+    function isAvailable() {
+        return Boolean(wasm?.wasmHasFunction?.('ipod_ctx_open'));
+    }
+
+    async function isAlreadyAdded(handle, primaryHandle) {
+        for (const other of [primaryHandle, ...targets.map((t) => t.ipodHandle)]) {
+            if (other && (await other.isSameEntry?.(handle))) return true;
+        }
+        return false;
+    }
+
+    /**
+     * Load the iPod at `handle` into its own context. Returns the target, or null.
+     */
+    async function addTarget(handle, { primaryHandle } = {}) {
+        if (!isAvailable()) {
+            log?.('Syncing to several iPods is not available in this build', 'warning');
+            return null;
+        }
+        if (await isAlreadyAdded(handle, primaryHandle)) {
+            log?.(`${handle.name} is already connected`, 'warning');
+            return null;
+        }
+
+        const mountpoint = `/iPod${nextMount++}`;
+        let ctx = -1;
+        // The target's WASM calls, one synchronous section at a time; its file I/O runs outside
+        const inContext = (fn) => wasm.wasmWithContext(ctx, fn);
+        const fsSync = createFsSync({ log, wasm, mountpoint, dirCache: createDirHandleCache(), inContext });
+        if (!(await fsSync.verifyIpodStructure(handle))) {
+            log?.(`${handle.name} does not look like an iPod root`, 'error');
+            return null;
+        }
+
+        ctx = wasm.wasmOpenContext(mountpoint);
+        if (ctx < 0) return null;
+
+        const target = {
+            ctx,
+            name: handle.name,
+            ipodHandle: handle,
+            fsSync,
+            paths: createPaths({ wasm, mountpoint }),
+            artwork: createArtworkManager({ wasm, fsSync, log, inContext }),
+        };
+        try {
+            await fsSync.setupWasmFilesystem(handle);
+            inContext(() => {
+                if (wasm.wasmCallWithError('ipod_parse_db') !== 0) throw new Error('could not read its iTunesDB');
+            });
+            await target.artwork.loadFromDevice(handle);
+        } catch (e) {
+            log?.(`Could not add ${handle.name}: ${e?.message || e}`, 'error');
+            wasm.wasmCloseContext(ctx);
+            return null;
+        }
+
+        targets.push(target);
+        log?.(`Added sync target: ${handle.name}`, 'success');
+        return target;
+    }
+
+    function removeTarget(target) {
+        const i = targets.indexOf(target);
+        if (i < 0) return;
+        targets.splice(i, 1);
+        wasm.wasmCloseContext(target.ctx);
+        log?.(`Removed sync target: ${target.name}`, 'info');
+    }
+
+    function clear() {
+        [...targets].forEach(removeTarget);
+    }
+
+    function list() {
+        return [...targets];
+    }
+
+    return {
+        isAvailable,
+        addTarget,
+        removeTarget,
+        clear,
+        list,
+    };
+}
@@ -0,0 +1,204 @@
+/**
+ * Tag region reader: pulls only the byte ranges a tag parser needs out of an audio Blob,
+ * instead of handing the parser the whole file.
+ *
+ * - MP3: ID3v2 tag + the first few frames (Xing/VBRI/Info header lives in frame 1), plus the
+ *   ID3v1/APEv2 tags at the end of the file.
+ * - FLAC: "fLaC" + every metadata block except PICTURE (covers can be megabytes).
+ * - M4A/AAC (MP4): ftyp + moov, wherever moov lives (head for faststart files, tail otherwise).
+ * - WAV/AIFF: the head probe (fmt/COMM and the data chunk header are at the front).
+ *
+ * Returns { bytes, size, synthesized } where `size` is what the parser should be told the
+ * file size is. Synthesized buffers are not a contiguous slice of the file, so callers should
+ * not trust size-derived values (bitrate, CBR duration estimates) from the parser for them.
+ * MP3 regions also carry `vbrHeader`: whether frame 1 is a Xing/Info/VBRI header, i.e.
+ * whether the parser's duration comes from a frame count rather than the byte size.
+ * Returns null when the format is not recognised; callers fall back to parsing the Blob.
+ */
+
+const HEAD_PROBE_BYTES = 64 * 1024;
+const MP3_FRAMES_BYTES = 16 * 1024;
+const ID3V1_BYTES = 128;
+const APE_FOOTER_BYTES = 32;
+const MAX_APE_BYTES = 1024 * 1024;
+const MAX_MOOV_BYTES = 32 * 1024 * 1024;
+
+async function readRange(blob, start, end) {
+    const s = Math.max(0, Math.min(blob.size, start));
+    const e = Math.max(s, Math.min(blob.size, end));
+    return new Uint8Array(await blob.slice(s, e).arrayBuffer());
+}
+
+function ascii(bytes, offset, length) {
+    let s = '';
+    for (let i = 0; i < length && offset + i < bytes.length; i++) {
+        s += String.fromCharCode(bytes[offset + i]);
+    }
+    return s;
+}
+
+function concatBytes(parts) {
+    const total = parts.reduce((n, p) => n + p.length, 0);
+    const out = new Uint8Array(total);
+    let pos = 0;
+    for (const p of parts) {
+        out.set(p, pos);
+        pos += p.length;
+    }
+    return out;
+}
+
+// True when the first MPEG frame at or after `offset` is a Xing/Info/VBRI header frame.
+function hasVbrHeaderFrame(bytes, offset) {
+    const limit = Math.min(bytes.length - 4, offset + MP3_FRAMES_BYTES);
+    for (let i = offset; i <= limit; i++) {
+        if (bytes[i] !== 0xff || (bytes[i + 1] & 0xe0) !== 0xe0) continue;
+        const version = (bytes[i + 1] >> 3) & 0x03; // 3 = MPEG-1, 1 = reserved
+        const layer = (bytes[i + 1] >> 1) & 0x03;
+        const bitrateIndex = (bytes[i + 2] >> 4) & 0x0f;
+        const samplerateIndex = (bytes[i + 2] >> 2) & 0x03;
+        if (version === 1 || layer === 0 || bitrateIndex === 0x0f || samplerateIndex === 3) continue;
+        const mono = ((bytes[i + 3] >> 6) & 0x03) === 0x03;
+        const sideInfo = version === 3 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+        const tag = ascii(bytes, i + 4 + sideInfo, 4);
+        return tag === 'Xing' || tag === 'Info' || ascii(bytes, i + 36, 4) === 'VBRI';
+    }
+    return false;
+}
+
+// ID3v1 (last 128 bytes) and APEv2 (footer just before ID3v1, or at EOF) live at the end of
+// an MP3. Returns the bytes from the start of those tags to EOF (empty when there are none).
+async function readMp3Tail(blob, headEnd) {
+    const probeStart = Math.max(headEnd, blob.size - ID3V1_BYTES - APE_FOOTER_BYTES);
+    const probe = await readRange(blob, probeStart, blob.size);
+    let tailStart = blob.size;
+
+    if (blob.size - ID3V1_BYTES >= probeStart && ascii(probe, blob.size - ID3V1_BYTES - probeStart, 3) === 'TAG') {
+        tailStart = blob.size - ID3V1_BYTES;
+    }
+    const footerStart = tailStart - APE_FOOTER_BYTES;
+    if (footerStart >= probeStart && ascii(probe, footerStart - probeStart, 8) === 'APETAGEX') {
+        const footer = new DataView(probe.buffer, probe.byteOffset + footerStart - probeStart, APE_FOOTER_BYTES);
+        // Tag size counts items + footer; the optional header adds another 32 bytes.
+        const tagSize = footer.getUint32(12, true);
+        const hasHeader = (footer.getUint32(20, true) & 0x80000000) !== 0;
+        const apeStart = tailStart - tagSize - (hasHeader ? APE_FOOTER_BYTES : 0);
+        if (tagSize >= APE_FOOTER_BYTES && tagSize <= MAX_APE_BYTES && apeStart >= headEnd) tailStart = apeStart;
+    }
+
+    if (tailStart >= blob.size) return new Uint8Array(0);
+    return tailStart >= probeStart ? probe.subarray(tailStart - probeStart) : readRange(blob, tailStart, blob.size);
+}
+
+// Offset of the first MPEG frame: past a leading ID3v2 tag, if any.
+function mp3FramesStart(head) {
+    if (ascii(head, 0, 3) !== 'ID3' || head.length < 10) return 0;
+    // Syncsafe size excludes the 10-byte header (and the optional 10-byte footer).
+    const tagSize = ((head[6] & 0x7f) << 21) | ((head[7] & 0x7f) << 14) | ((head[8] & 0x7f) << 7) | (head[9] & 0x7f);
+    const hasFooter = (head[5] & 0x10) !== 0;
+    return 10 + tagSize + (hasFooter ? 10 : 0);
+}
+
+async function readMp3Region(blob, head) {
+    const framesStart = mp3FramesStart(head);
+    const end = framesStart + MP3_FRAMES_BYTES;
+    const front = end <= head.length ? head.subarray(0, end) : await readRange(blob, 0, end);
+    const vbrHeader = hasVbrHeaderFrame(front, framesStart);
+    if (end >= blob.size) return { bytes: front, size: blob.size, synthesized: false, vbrHeader };
+
+    // Front + tail tags, laid out as a short file so the parser finds ID3v1/APE at its end.
+    const bytes = concatBytes([front, await readMp3Tail(blob, end)]);
+    return { bytes, size: bytes.length, synthesized: true, vbrHeader };
+}
+
+async function readFlacRegion(blob, head) {
+    const parts = [new Uint8Array([0x66, 0x4c, 0x61, 0x43])]; // "fLaC"
+    const blocks = [];
+    let offset = 4;
+    let isLast = false;
+
+    while (!isLast && offset + 4 <= blob.size) {
+        const hdr = offset + 4 <= head.length ? head.subarray(offset, offset + 4) : await readRange(blob, offset, offset + 4);
+        if (hdr.length < 4) break;
+        isLast = (hdr[0] & 0x80) !== 0;
+        const type = hdr[0] & 0x7f;
+        const length = (hdr[1] << 16) | (hdr[2] << 8) | hdr[3];
+        // 6 = PICTURE; skipped entirely (we never read covers during tag enrichment).
+        if (type !== 6) blocks.push({ type, start: offset, end: offset + 4 + length });
+        offset += 4 + length;
+    }
+
+    if (blocks.length === 0) return null;
+
+    for (let i = 0; i < blocks.length; i++) {
+        const b = blocks[i];
+        const block = b.end <= head.length ? head.slice(b.start, b.end) : await readRange(blob, b.start, b.end);
+        // Re-flag the last kept block so the parser stops at the end of our buffer.
+        block[0] = (block[0] & 0x7f) | (i === blocks.length - 1 ? 0x80 : 0);
+        parts.push(block);
+    }
+
+    const bytes = concatBytes(parts);
+    return { bytes, size: bytes.length, synthesized: true };
+}
+
+async function readMp4Region(blob, head) {
+    let ftyp = null;
+    let moov = null;
+    let offset = 0;
+
+    while (offset + 8 <= blob.size && !(ftyp && moov)) {
+        const hdr = offset + 16 <= head.length ? head.subarray(offset, offset + 16) : await readRange(blob, offset, offset + 16);
+        if (hdr.length < 8) break;
+        const view = new DataView(hdr.buffer, hdr.byteOffset, hdr.byteLength);
+        let size = view.getUint32(0);
+        const type = ascii(hdr, 4, 4);
+        if (size === 1 && hdr.length >= 16) {
+            size = Number(view.getBigUint64(8));
+        } else if (size === 0) {
+            size = blob.size - offset; // extends to EOF
+        }
+        if (size < 8) break;
+
+        if (type === 'ftyp') ftyp = { start: offset, end: offset + size };
+        if (type === 'moov') moov = { start: offset, end: offset + size };
+        offset += size;
+    }
+
+    if (!moov || moov.end - moov.start > MAX_MOOV_BYTES) return null;
+
+    const parts = [];
+    if (ftyp) parts.push(ftyp.end <= head.length ? head.subarray(ftyp.start, ftyp.end) : await readRange(blob, ftyp.start, ftyp.end));
+    parts.push(moov.end <= head.length ? head.subarray(moov.start, moov.end) : await readRange(blob, moov.start, moov.end));
+
+    const bytes = concatBytes(parts);
+    return { bytes, size: bytes.length, synthesized: true };
+}
+
+export async function readTagRegion(blob) {
+    if (!blob || !blob.size) return null;
+    const head = await readRange(blob, 0, HEAD_PROBE_BYTES);
+
+    const magic4 = ascii(head, 0, 4);
+    if (magic4 === 'fLaC') return readFlacRegion(blob, head);
+    if (ascii(head, 4, 4) === 'ftyp') return readMp4Region(blob, head);
+    if (magic4 === 'RIFF' || magic4 === 'FORM') return { bytes: head, size: blob.size, synthesized: false };
+
+    // ID3v2-prefixed or bare MPEG frame sync.
+    if (ascii(head, 0, 3) === 'ID3' || (head[0] === 0xff && (head[1] & 0xe0) === 0xe0)) {
+        return readMp3Region(blob, head);
+    }
+    return null;
+}
+
+/**
+ * Whether an MP3's first frame is a Xing/Info/VBRI header, i.e. whether a tag parser's
+ * duration for it is a frame count rather than an estimate from the file size.
+ */
+export async function hasMp3VbrHeader(blob) {
+    if (!blob || !blob.size) return false;
+    const head = await readRange(blob, 0, HEAD_PROBE_BYTES);
+    const framesStart = mp3FramesStart(head);
+    const end = framesStart + MP3_FRAMES_BYTES;
+    return hasVbrHeaderFrame(end <= head.length ? head : await readRange(blob, 0, end), framesStart);
+}
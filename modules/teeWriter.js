@@ -0,0 +1,47 @@
+/**
+ * Stream one file to several writables while reading it only once.
+ * Each chunk is written to every destination before the next one is read, so the
+ * copy runs at the pace of the slowest device. A destination that fails is aborted
+ * and dropped, and the others carry on.
+ * Returns one entry per writable: null on success, or the error.
+ */
+export async function teeFileToWritables(file, writables) {
+    const errors = writables.map((w) => (w ? null : new Error('No destination')));
+    const live = () => writables.filter((w, i) => w && !errors[i]);
+
+    const fail = async (i, e) => {
+        errors[i] = e;
+        try { await writables[i].abort(e); } catch (_) {}
+    };
+
+    const reader = file.stream().getReader();
+    try {
+        while (live().length > 0) {
+            const { done, value } = await reader.read();
+            if (done) break;
+            await Promise.all(writables.map(async (w, i) => {
+                if (!w || errors[i]) return;
+                try {
+                    await w.write(value);
+                } catch (e) {
+                    await fail(i, e);
+                }
+            }));
+        }
+    } catch (e) {
+        // Reading the source failed: every destination is incomplete
+        await Promise.all(writables.map((w, i) => (w && !errors[i] ? fail(i, e) : null)));
+    } finally {
+        try { await reader.cancel(); } catch (_) {}
+    }
+
+    await Promise.all(writables.map(async (w, i) => {
+        if (!w || errors[i]) return;
+        try {
+            await w.close();
+        } catch (e) {
+            errors[i] = e;
+        }
+    }));
+    return errors;
+}
@@ -6,17 +6,37 @@ export function createTrackOps({
     logWasmError,
     refreshCurrentView,
     loadPlaylists,
+    selectTracks,
+    getSelectedTrackIds,
+    movePlaylistViewRows,
 } = {}) {
+    // Bulk operations hand the tracks to C as the selection bitset (one call, no id list).
+    // Returns a function that puts the user's selection back, or null if the build lacks funcName.
+    function selectForBulk(ids, funcName) {
+        if (!selectTracks || !getSelectedTrackIds || !wasm.wasmHasFunction(funcName)) return null;
+        const saved = getSelectedTrackIds();
+        selectTracks(ids);
+        return () => selectTracks(saved);
+    }
+
+    // Track JSON for a list index: the loaded row while it is still current, else one WASM call
+    function trackAt(id) {
+        const listed = appState.tracks?.[id];
+        return listed?.id === id ? listed : wasm.wasmGetJson('ipod_get_track_json', id);
+    }
+
     async function deleteTrackInternal(trackId, { confirmOnce = true, refresh = true, logSuccess = true } = {}) {
         if (confirmOnce && !confirm('Are you sure you want to delete this track?')) return false;
 
-        // Grab the file path before removing the track (indexes shift after delete).
-        const track = wasm.wasmGetJson('ipod_get_track_json', trackId);
+        // Grab the file path and handle before removing the track (indexes shift after delete).
+        const track = trackAt(trackId);
         const ipodPath = track?.ipod_path;
         const relFsPath = ipodPath ? paths.toRelFsPathFromIpodDbPath(ipodPath) : null;
 
-        const result = wasm.wasmCallWithError('ipod_remove_track', trackId);
-        if (result !== 0) return false;
+        const removed = track?.handle && wasm.wasmHasFunction('ipod_remove_tracks_by_handle')
+            ? wasm.wasmRemoveTracksByHandle([track.handle]) === 1
+            : wasm.wasmCallWithError('ipod_remove_track', trackId) === 0;
+        if (!removed) return false;
 
         // Defer the actual file delete until the next "Sync iPod".
         if (relFsPath) {
@@ -33,6 +53,14 @@ export function createTrackOps({
         await deleteTrackInternal(trackId, { confirmOnce: true, refresh: true, logSuccess: true });
     }
 
+    // Queue the audio files of removed tracks for deletion on the next sync
+    function markFilesForDeletion(tracks) {
+        const deletes = tracks.filter((track) => track.ipod_path).map((track) => paths.toRelFsPathFromIpodDbPath(track.ipod_path));
+        if (deletes.length === 0) return;
+        appState.pendingFileDeletes = [...(appState.pendingFileDeletes || []), ...deletes];
+        log?.(`Marked ${deletes.length} file(s) for deletion on next sync`, 'info');
+    }
+
     async function deleteTracks(trackIds) {
         const ids = Array.from(new Set((trackIds || []).map(Number))).filter(Number.isFinite);
         if (ids.length === 0) return;
@@ -41,12 +69,27 @@ export function createTrackOps({
             return;
         }
 
-        // Delete from highest index to lowest so indices don't shift under us.
-        const sorted = [...ids].sort((a, b) => b - a);
         let okCount = 0;
-        for (const id of sorted) {
-            const ok = await deleteTrackInternal(id, { confirmOnce: false, refresh: false, logSuccess: false });
-            if (ok) okCount++;
+        // No selection to restore afterwards: C clears it, as removal shifts the indices it holds
+        if (selectForBulk(ids, 'ipod_sel_remove_tracks')) {
+            // Read the tracks first: indices shift once they are gone.
+            const tracks = ids.map(trackAt).filter(Boolean);
+            const removed = wasm.wasmSelection('remove_tracks');
+            okCount = removed > 0 ? removed : 0;
+            markFilesForDeletion(wasm.wasmRemovedTracks(tracks, removed));
+        } else if (wasm.wasmHasFunction('ipod_remove_tracks_by_handle')) {
+            // Stable handles: resolve everything first, then remove in one call in any order.
+            const tracks = ids.map(trackAt).filter((track) => track?.handle);
+            const removed = wasm.wasmRemoveTracksByHandle(tracks.map((track) => track.handle));
+            okCount = removed > 0 ? removed : 0;
+            markFilesForDeletion(wasm.wasmRemovedTracks(tracks, removed));
+        } else {
+            // Delete from highest index to lowest so indices don't shift under us.
+            const sorted = [...ids].sort((a, b) => b - a);
+            for (const id of sorted) {
+                const ok = await deleteTrackInternal(id, { confirmOnce: false, refresh: false, logSuccess: false });
+                if (ok) okCount++;
+            }
         }
 
         await refreshCurrentView();
@@ -90,9 +133,17 @@ export function createTrackOps({
         }
 
         let okCount = 0;
-        for (const tid of ids) {
-            const result = wasm.wasmCall('ipod_playlist_add_track', playlistIndex, tid);
-            if (result === 0) okCount++;
+        const restoreSelection = selectForBulk(ids, 'ipod_sel_playlist_add');
+        if (restoreSelection) {
+            // Tracks already in the playlist are skipped and not counted
+            const added = wasm.wasmSelection('playlist_add', playlistIndex);
+            restoreSelection();
+            okCount = added > 0 ? added : 0;
+        } else {
+            for (const tid of ids) {
+                const result = wasm.wasmCall('ipod_playlist_add_track', playlistIndex, tid);
+                if (result === 0) okCount++;
+            }
         }
 
         await loadPlaylists();
@@ -141,13 +192,66 @@ export function createTrackOps({
         if (!confirm(`Remove ${ids.length} track(s) from "${playlist.name}"?`)) return;
 
         let okCount = 0;
-        for (const tid of ids) {
-            const result = wasm.wasmCall('ipod_playlist_remove_track', idx, tid);
-            if (result === 0) okCount++;
+        const restoreSelection = selectForBulk(ids, 'ipod_sel_playlist_remove');
+        if (restoreSelection) {
+            // Counts entries, so a track listed twice counts twice
+            const removed = wasm.wasmSelection('playlist_remove', idx);
+            restoreSelection();
+            okCount = removed > 0 ? removed : 0;
+        } else {
+            for (const tid of ids) {
+                const result = wasm.wasmCall('ipod_playlist_remove_track', idx, tid);
+                if (result === 0) okCount++;
+            }
         }
 
         await refreshCurrentView();
-        log?.(`Removed ${okCount}/${ids.length} track(s) from playlist: ${playlist.name}`, okCount === ids.length ? 'success' : 'warning');
+        log?.(`Removed ${okCount}/${ids.length} track(s) from playlist: ${playlist.name}`, okCount >= ids.length ? 'success' : 'warning');
+    }
+
+    function writeInts(values) {
+        const ints = Int32Array.from(values);
+        const ptr = wasm.wasmAlloc(ints.byteLength);
+        if (ptr) wasm.wasmWriteBytes(ptr, new Uint8Array(ints.buffer));
+        return ptr;
+    }
+
+    /**
+     * Move the tracks at `positions` (within the playlist) in front of position `dest`,
+     * counted before the move. Returns the new position of the first moved track, or -1.
+     */
+    async function moveTracksInPlaylist(playlistIndex, positions, dest) {
+        if (!positions?.length) return -1;
+        const ptr = writeInts(positions);
+        if (!ptr) return -1;
+        let first;
+        try {
+            first = wasm.wasmCall('ipod_playlist_move_tracks', playlistIndex, ptr, positions.length, dest);
+        } finally {
+            wasm.wasmFree(ptr);
+        }
+        if (first == null || first < 0) {
+            logWasmError?.('Failed to move tracks');
+            return -1;
+        }
+        // Same tracks, new order: move the loaded rows rather than reload the playlist
+        if (movePlaylistViewRows) movePlaylistViewRows(positions, dest);
+        else await refreshCurrentView();
+        return first;
+    }
+
+    async function sortPlaylist(playlistIndex, keys) {
+        const playlist = appState.playlists?.[playlistIndex];
+        if (!playlist || playlist.is_master) return;
+        const keysPtr = wasm.wasmAllocString(keys);
+        const result = wasm.wasmCall('ipod_playlist_sort', playlistIndex, keysPtr);
+        wasm.wasmFreeString(keysPtr);
+        if (result !== 0) {
+            logWasmError?.('Failed to sort playlist');
+            return;
+        }
+        await refreshCurrentView();
+        log?.(`Sorted playlist: ${playlist.name}`, 'success');
     }
 
     return {
@@ -156,7 +260,9 @@ export function createTrackOps({
         addTrackToPlaylist,
         addTracksToPlaylist,
         removeTrackFromPlaylist,
-        removeTracksFromPlaylist
+        removeTracksFromPlaylist,
+        moveTracksInPlaylist,
+        sortPlaylist,
     };
 }
 
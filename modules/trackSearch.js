@@ -0,0 +1,135 @@
+/**
+ * Track filtering for the search box.
+ *
+ * The library is indexed once in a worker (modules/searchWorker.js) and re-sent only when the
+ * track list itself changes. Keystrokes are debounced; a query superseded by a newer one
+ * resolves to null, and the worker abandons its scan. Without workers the same matching runs
+ * on the main thread.
+ */
+
+import { foldSearchText, searchRowText } from './searchText.js';
+
+const DEFAULT_DEBOUNCE_MS = 120;
+
+function searchRow(track) {
+    return [track?.title, track?.artist, track?.album];
+}
+
+export function createTrackSearch({ debounceMs = DEFAULT_DEBOUNCE_MS, log } = {}) {
+    let worker = null;
+    let workerUnavailable = false;
+    let indexedTracks = null;
+    let nextIndexId = 1;
+    let indexId = 0;
+    let nextSeq = 1;
+    let timer = null;
+    let pending = null; // { seq, resolve } of the query in flight or waiting out the debounce
+
+    function ensureWorker() {
+        if (worker) return true;
+        if (workerUnavailable) return false;
+        try {
+            worker = new Worker(new URL('./searchWorker.js', import.meta.url), { type: 'module' });
+            worker.addEventListener('message', onMessage);
+            worker.addEventListener('error', onError);
+            return true;
+        } catch (e) {
+            log?.(`Search worker unavailable, filtering on the main thread (${e?.message || e})`, 'warning');
+            workerUnavailable = true;
+            return false;
+        }
+    }
+
+    function settle(seq, value) {
+        if (!pending || pending.seq !== seq) return;
+        const { resolve } = pending;
+        pending = null;
+        resolve(value);
+    }
+
+    function onMessage(e) {
+        const msg = e.data || {};
+        if (msg.type === 'results' && pending?.seq === msg.seq) {
+            settle(msg.seq, { positions: msg.positions, extraPositions: msg.extraPositions });
+        } else if (msg.type === 'cancelled') {
+            settle(msg.seq, null);
+        }
+    }
+
+    function onError(e) {
+        // Drop the worker and answer this query on the main thread
+        log?.(`Search worker failed, filtering on the main thread (${e?.message || 'worker error'})`, 'warning');
+        worker?.terminate();
+        worker = null;
+        workerUnavailable = true;
+        indexedTracks = null;
+        if (pending?.job) settle(pending.seq, matchOnMainThread(pending.job));
+    }
+
+    function matchOnMainThread({ tracks, queued, query }) {
+        const needle = foldSearchText(query);
+        const match = (list) => {
+            const hits = [];
+            list.forEach((track, i) => {
+                if (searchRowText(searchRow(track)).includes(needle)) hits.push(i);
+            });
+            return hits;
+        };
+        return { positions: match(tracks), extraPositions: match(queued) };
+    }
+
+    function run(seq, job) {
+        if (!ensureWorker()) {
+            settle(seq, matchOnMainThread(job));
+            return;
+        }
+        if (indexedTracks !== job.tracks) {
+            indexedTracks = job.tracks;
+            indexId = nextIndexId++;
+            worker.postMessage({ type: 'index', indexId, rows: job.tracks.map(searchRow) });
+        }
+        pending.job = job;
+        worker.postMessage({ type: 'query', seq, indexId, query: job.query, extra: job.queued.map(searchRow) });
+    }
+
+    /** Forget the pending query (it resolves to null). */
+    function cancel() {
+        clearTimeout(timer);
+        timer = null;
+        if (pending) settle(pending.seq, null);
+    }
+
+    /**
+     * Filter `tracks` (indexed; pass the same array again to reuse the index) and `queued`
+     * rows by title, artist or album. Resolves to { tracks, queued } with the matches in
+     * order, or to null when a newer search or cancel() superseded this one.
+     */
+    function search({ tracks = [], queued = [], query = '' } = {}) {
+        cancel();
+        const seq = nextSeq++;
+        const job = { tracks, queued, query };
+        return new Promise((resolve) => {
+            pending = { seq, resolve };
+            timer = setTimeout(() => {
+                timer = null;
+                run(seq, job);
+            }, debounceMs);
+        }).then((result) => result && {
+            tracks: Array.from(result.positions, (i) => tracks[i]),
+            queued: Array.from(result.extraPositions, (i) => queued[i]),
+        });
+    }
+
+    function terminate() {
+        cancel();
+        worker?.terminate();
+        worker = null;
+        indexedTracks = null;
+    }
+
+    return {
+        search,
+        cancel,
+        terminate,
+    };
+}
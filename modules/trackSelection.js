@@ -1,21 +1,145 @@
-export function createTrackSelection({ appState, log } = {}) {
+import { getTrackViewIds, setRenderedSelection } from './uiRender.js';
+
+// Selection held as an id array in appState (builds without the WASM bitset)
+function createArrayStore(appState) {
+    let source = null;
+    let set = new Set();
+
+    function current() {
+        const ids = appState?.selectedTrackIds;
+        if (ids !== source) {
+            source = ids;
+            set = new Set(Array.isArray(ids) ? ids.filter((n) => Number.isFinite(n)) : []);
+        }
+        return set;
+    }
+
+    function store(next) {
+        appState.selectedTrackIds = [...next];
+    }
+
+    return {
+        ids: () => [...current()],
+        has: (id) => current().has(id),
+        count: () => current().size,
+        clear: () => store([]),
+        set(ids, on) {
+            const next = new Set(current());
+            for (const id of ids) {
+                if (on) next.add(id);
+                else next.delete(id);
+            }
+            store(next);
+        },
+        invert(ids) {
+            const next = new Set(current());
+            for (const id of ids) {
+                if (next.has(id)) next.delete(id);
+                else next.add(id);
+            }
+            store(next);
+        },
+    };
+}
+
+// Runs of consecutive ids at least this long are set with one word-wide call
+const MIN_RANGE_RUN = 64;
+
+// Selection held in the WASM bitset (bit i = track index i), which the bulk track operations
+// read directly. Single bits are flipped in place; runs and invert go through C word-wide.
+function createBitsetStore(wasm) {
+    const words = (fit = false) => wasm.wasmSelectionWords({ fit });
+
+    function has(id) {
+        const w = words();
+        return Boolean(w && id >= 0 && (id >>> 5) < w.length && ((w[id >>> 5] >>> (id & 31)) & 1));
+    }
+
+    function ids() {
+        const w = words();
+        const out = [];
+        if (!w) return out;
+        for (let i = 0; i < w.length; i++) {
+            for (let bits = w[i]; bits; bits &= bits - 1) out.push(i * 32 + 31 - Math.clz32(bits & -bits));
+        }
+        return out;
+    }
+
+    function setBit(w, id, on) {
+        if (!(id >= 0) || (id >>> 5) >= w.length) return;
+        if (on) w[id >>> 5] |= 1 << (id & 31);
+        else w[id >>> 5] &= ~(1 << (id & 31));
+    }
+
+    function set(list, on) {
+        let w = words(true);
+        if (!w) return;
+        for (let i = 0; i < list.length;) {
+            let j = i + 1;
+            while (j < list.length && list[j] === list[j - 1] + 1) j++;
+            if (j - i >= MIN_RANGE_RUN) {
+                wasm.wasmSelection('set_range', list[i], list[j - 1] + 1, on ? 1 : 0);
+                w = words();
+            } else {
+                for (let k = i; k < j; k++) setBit(w, list[k], on);
+            }
+            i = j;
+        }
+    }
+
+    function invert(list) {
+        const w = words(true);
+        if (!w) return;
+        const size = wasm.wasmCall('ipod_sel_size') || 0;
+        // The whole library in order (All Tracks, unfiltered): one word-wide pass
+        if (list.length === size && list[0] === 0 && list[size - 1] === size - 1) {
+            wasm.wasmSelection('invert');
+            return;
+        }
+        for (const id of list) setBit(w, id, !has(id));
+    }
+
+    return {
+        ids,
+        has,
+        count: () => Math.max(0, wasm.wasmSelection('count')),
+        clear: () => wasm.wasmSelection('clear'),
+        set,
+        invert,
+    };
+}
+
+export function createTrackSelection({ appState, wasm, log } = {}) {
     const state = {
         // Anchor for shift-select
         anchorTrackId: null,
     };
+    let arrayStore = null;
+    let bitsetStore = null;
+
+    // The bitset needs the loaded WASM module, so pick the store on use
+    function selection() {
+        if (wasm?.wasmHasFunction?.('ipod_sel_buffer')) return (bitsetStore ??= createBitsetStore(wasm));
+        return (arrayStore ??= createArrayStore(appState));
+    }
 
     function isSelectableTrackId(trackId) {
         return Number.isFinite(trackId) && trackId >= 0;
     }
 
     function getSelectedTrackIds() {
-        const ids = appState?.selectedTrackIds || [];
-        return Array.isArray(ids) ? ids.filter((n) => Number.isFinite(n)) : [];
+        return selection().ids();
+    }
+
+    function isSelected(trackId) {
+        return selection().has(trackId);
     }
 
     function setSelectedTrackIds(ids) {
-        const unique = Array.from(new Set((ids || []).filter((n) => Number.isFinite(n))));
-        appState.selectedTrackIds = unique;
+        const unique = Array.from(new Set((ids || []).filter((n) => isSelectableTrackId(n))));
+        const store = selection();
+        store.clear();
+        store.set(unique, true);
         applySelectionToDom();
     }
 
@@ -24,32 +148,19 @@ export function createTrackSelection({ appState, log } = {}) {
         setSelectedTrackIds([]);
     }
 
+    // Every track in the current view, including rows the virtual table has not rendered
     function getVisibleTrackIds() {
-        const tbody = document.getElementById('trackTableBody');
-        if (!tbody) return [];
-        const rows = Array.from(tbody.querySelectorAll('tr[data-track-id]'));
-        const ids = rows
-            .map((row) => Number(row.getAttribute('data-track-id')))
-            .filter((n) => Number.isFinite(n));
-        return ids;
+        return getTrackViewIds().filter((n) => Number.isFinite(n));
     }
 
     function applySelectionToDom() {
-        const tbody = document.getElementById('trackTableBody');
-        if (!tbody) return;
-        const selected = new Set(getSelectedTrackIds());
-        for (const row of Array.from(tbody.querySelectorAll('tr'))) {
-            const id = Number(row.getAttribute('data-track-id'));
-            const isSelected = Number.isFinite(id) && selected.has(id);
-            row.classList.toggle('selected', isSelected);
-        }
+        setRenderedSelection(isSelected);
     }
 
     function ensureTrackSelected(trackId) {
         const id = Number(trackId);
         if (!isSelectableTrackId(id)) return;
-        const selected = getSelectedTrackIds();
-        if (selected.includes(id)) return;
+        if (isSelected(id)) return;
         state.anchorTrackId = id;
         setSelectedTrackIds([id]);
     }
@@ -66,9 +177,7 @@ export function createTrackSelection({ appState, log } = {}) {
 
         const metaOrCtrl = Boolean(e.metaKey || e.ctrlKey);
         const shift = Boolean(e.shiftKey);
-
-        const current = getSelectedTrackIds();
-        const currentSet = new Set(current);
+        const store = selection();
 
         if (shift) {
             const visible = getVisibleTrackIds();
@@ -77,26 +186,23 @@ export function createTrackSelection({ appState, log } = {}) {
             const b = visible.indexOf(clickedId);
             if (a === -1 || b === -1) {
                 state.anchorTrackId = clickedId;
-                setSelectedTrackIds(metaOrCtrl ? [...currentSet, clickedId] : [clickedId]);
+                if (!metaOrCtrl) store.clear();
+                store.set([clickedId], true);
+                applySelectionToDom();
                 return;
             }
             const [start, end] = a < b ? [a, b] : [b, a];
-            const range = visible.slice(start, end + 1);
             state.anchorTrackId = anchor;
-            if (metaOrCtrl) {
-                for (const id of range) currentSet.add(id);
-                setSelectedTrackIds([...currentSet]);
-            } else {
-                setSelectedTrackIds(range);
-            }
+            if (!metaOrCtrl) store.clear();
+            store.set(visible.slice(start, end + 1), true);
+            applySelectionToDom();
             return;
         }
 
         if (metaOrCtrl) {
-            if (currentSet.has(clickedId)) currentSet.delete(clickedId);
-            else currentSet.add(clickedId);
+            store.set([clickedId], !store.has(clickedId));
             state.anchorTrackId = clickedId;
-            setSelectedTrackIds([...currentSet]);
+            applySelectionToDom();
             return;
         }
 
@@ -122,14 +228,23 @@ export function createTrackSelection({ appState, log } = {}) {
         setSelectedTrackIds(visible);
     }
 
+    function invertSelection() {
+        const visible = getVisibleTrackIds();
+        if (visible.length === 0) return;
+        state.anchorTrackId = null;
+        selection().invert(visible);
+        applySelectionToDom();
+    }
+
     return {
         attach,
         clearSelection,
         applySelectionToDom,
         getSelectedTrackIds,
         setSelectedTrackIds,
+        isSelected,
         ensureTrackSelected,
         selectAllVisible,
+        invertSelection,
     };
 }
-
@@ -26,21 +26,239 @@ export function updateConnectionStatus(connected) {
 
 export function enableUIIfReady({ wasmReady, isConnected }) {
     const ready = Boolean(wasmReady && isConnected);
-    ['uploadBtn', 'uploadFolderBtn', 'saveBtn', 'refreshBtn', 'newPlaylistBtn'].forEach(id => {
+    ['uploadBtn', 'uploadFolderBtn', 'mirrorFolderBtn', 'saveBtn', 'refreshBtn', 'newPlaylistBtn'].forEach(id => {
         const el = document.getElementById(id);
         if (el) el.disabled = !ready;
     });
 }
 
-export function renderTracks({ tracks, escapeHtml, selectedTrackIds } = {}) {
+// The track table is virtualized: only the rows in view, plus OVERSCAN_ROWS on each side,
+// exist in the DOM. Spacer rows stand in for the rest so the scrollbar covers the whole
+// list, and a render costs the same for 50 tracks or 50,000.
+//
+// Rows are keyed by data-id (the track's stable handle) and patched in place: a render rebuilds
+// only rows whose content changed. Anything that depends on where a row sits - its number,
+// list index, playlist position - is written onto the row separately, so an insert or delete
+// above the window renumbers rows instead of rebuilding them.
+const OVERSCAN_ROWS = 20;
+const ESTIMATED_ROW_HEIGHT = 45;
+
+const trackView = {
+    tracks: [],
+    queued: [],
+    escapeHtml: (s) => String(s ?? ''),
+    isSelected: () => false,
+    reorderable: false,
+    rowHeight: 0,
+    start: 0,
+    end: 0,
+    scrollAttached: false,
+};
+
+function trackViewLength() {
+    return trackView.tracks.length + trackView.queued.length;
+}
+
+function trackViewRow(i) {
+    const n = trackView.tracks.length;
+    return i < n ? trackView.tracks[i] : trackView.queued[i - n];
+}
+
+function selectableId(track) {
+    const id = Number(track.id);
+    return !track.__queued && Number.isFinite(id) && id >= 0 ? id : null;
+}
+
+// Library rows carry a handle that survives inserts and deletes; the list index does not
+function rowKey(track) {
+    return String(track.handle ?? track.id);
+}
+
+// Row markup without the selection class or anything position-dependent (see setRowPosition)
+function trackRowHtml(track) {
+    const { escapeHtml } = trackView;
+    const isQueued = Boolean(track.__queued);
+    const title = escapeHtml(track.title || 'Unknown') + (isQueued ? ' *' : '');
+    const artist = escapeHtml(track.artist || (isQueued ? 'Queued' : 'Unknown'));
+    const album = escapeHtml(track.album || 'Unknown');
+    const genre = escapeHtml(track.genre || '');
+    const duration = formatDuration(track.tracklen);
+
+    const actionHtml = isQueued
+        ? `<button class="btn btn-secondary" onclick="removeQueuedTrack(Number(this.closest('tr').dataset.queueIndex))" style="padding: 6px 10px; font-size: 12px;">
+                Remove
+           </button>`
+        : `<button class="btn btn-secondary" onclick="deleteTrack(Number(this.closest('tr').dataset.trackId))" style="padding: 6px 10px; font-size: 12px;">
+                Delete
+           </button>`;
+
+    return `<tr data-id="${escapeHtml(rowKey(track))}"${isQueued ? ' data-queued="true"' : ''}>
+            <td class="position"></td>
+            <td class="title">${title}</td>
+            <td>${artist}</td>
+            <td>${album}</td>
+            <td>${genre}</td>
+            <td class="duration">${duration}</td>
+            <td>${actionHtml}</td>
+        </tr>`;
+}
+
+// Write the row's number, track id and playlist position; untouched when they have not moved
+function setRowPosition(row, track, index) {
+    const id = selectableId(track);
+    const pos = id !== null && trackView.reorderable ? index : null;
+    const queueIndex = track.__queued ? track._queueIndex : null;
+    if (row._index === index && row._id === id && row._pos === pos && row._queueIndex === queueIndex) return;
+
+    if (row._index !== index) row.firstElementChild.textContent = String(index + 1);
+    if (id !== null) row.setAttribute('data-track-id', String(id));
+    else row.removeAttribute('data-track-id');
+    if (pos !== null) {
+        row.setAttribute('data-pos', String(pos));
+        row.setAttribute('draggable', 'true');
+    } else {
+        row.removeAttribute('data-pos');
+        row.removeAttribute('draggable');
+    }
+    if (queueIndex !== null) row.setAttribute('data-queue-index', String(queueIndex));
+    else row.removeAttribute('data-queue-index');
+
+    row._index = index;
+    row._id = id;
+    row._pos = pos;
+    row._queueIndex = queueIndex;
+}
+
+function createRow(html) {
+    const template = document.createElement('template');
+    template.innerHTML = html;
+    const row = template.content.firstElementChild;
+    row._html = html;
+    return row;
+}
+
+function spacerRow(tbody, position) {
+    let row = tbody.querySelector(`tr.virtual-spacer[data-spacer="${position}"]`);
+    if (!row) {
+        row = createRow(`<tr class="virtual-spacer" data-spacer="${position}" aria-hidden="true"><td colspan="7"></td></tr>`);
+    }
+    return row;
+}
+
+// Rows [start, end) needed to fill the container's viewport at its scroll position.
+function visibleRange(container, table) {
+    const count = trackViewLength();
+    const rowHeight = trackView.rowHeight || ESTIMATED_ROW_HEIGHT;
+    const headerHeight = table.tHead?.offsetHeight || 0;
+    const viewport = container.clientHeight || window.innerHeight;
+    const first = Math.floor(Math.max(0, container.scrollTop - headerHeight) / rowHeight);
+    const start = Math.max(0, Math.min(count, first) - OVERSCAN_ROWS);
+    const end = Math.min(count, first + Math.ceil(viewport / rowHeight) + OVERSCAN_ROWS);
+    return { start, end };
+}
+
+// Make tbody hold rows [start, end), reusing every row whose key and markup are unchanged.
+function patchTrackRows(tbody, start, end) {
+    const existing = new Map();
+    for (const row of tbody.querySelectorAll('tr[data-id]')) {
+        const key = row.getAttribute('data-id');
+        // A playlist can list a track twice; only the first row of a key is reused
+        if (existing.has(key)) row.remove();
+        else existing.set(key, row);
+    }
+
+    const top = spacerRow(tbody, 'top');
+    const bottom = spacerRow(tbody, 'bottom');
+    const rowHeight = trackView.rowHeight || ESTIMATED_ROW_HEIGHT;
+    top.firstElementChild.style.height = `${start * rowHeight}px`;
+    bottom.firstElementChild.style.height = `${(trackViewLength() - end) * rowHeight}px`;
+    if (tbody.firstElementChild !== top) tbody.insertBefore(top, tbody.firstElementChild);
+
+    let cursor = top.nextElementSibling;
+    for (let i = start; i < end; i++) {
+        const track = trackViewRow(i);
+        const key = rowKey(track);
+        const html = trackRowHtml(track);
+        let row = existing.get(key);
+        if (row && row._html === html) {
+            existing.delete(key);
+        } else {
+            row = createRow(html);
+        }
+        setRowPosition(row, track, i);
+        const id = selectableId(track);
+        row.classList.toggle('selected', id !== null && trackView.isSelected(id));
+        if (row === cursor) {
+            cursor = cursor.nextElementSibling;
+        } else {
+            tbody.insertBefore(row, cursor);
+        }
+    }
+
+    for (const row of existing.values()) row.remove();
+    if (tbody.lastElementChild !== bottom) tbody.appendChild(bottom);
+}
+
+function renderTrackWindow(force = false) {
+    const tbody = document.getElementById('trackTableBody');
+    const table = document.getElementById('trackTable');
+    const container = document.getElementById('trackTableContainer');
+    if (!tbody || !table || !container) return;
+
+    const { start, end } = visibleRange(container, table);
+    if (!force && start === trackView.start && end === trackView.end) return;
+    trackView.start = start;
+    trackView.end = end;
+
+    patchTrackRows(tbody, start, end);
+
+    // Rows are one line high; measure once, then redo this window with the real height
+    if (!trackView.rowHeight) {
+        const row = tbody.querySelector('tr[data-id]');
+        const measured = row ? row.getBoundingClientRect().height : 0;
+        if (measured > 0) {
+            trackView.rowHeight = measured;
+            if (Math.abs(measured - ESTIMATED_ROW_HEIGHT) >= 1) renderTrackWindow(true);
+        }
+    }
+}
+
+function attachTrackScroll() {
+    const container = document.getElementById('trackTableContainer');
+    if (!container || trackView.scrollAttached) return;
+    let frame = 0;
+    const onScroll = () => {
+        if (frame) return;
+        frame = requestAnimationFrame(() => {
+            frame = 0;
+            renderTrackWindow();
+        });
+    };
+    container.addEventListener('scroll', onScroll, { passive: true });
+    window.addEventListener('resize', onScroll);
+    trackView.scrollAttached = true;
+}
+
+/**
+ * Render a track list. `queued` rows (pending uploads) are shown after `tracks`; passing
+ * them separately spares callers from concatenating the whole library on every queue change.
+ * Rows are keyed across renders by `handle`, or by `id` for rows without one (queued rows
+ * need a stable `id`). `selectedTrackIds` takes the same forms as setRenderedSelection().
+ */
+export function renderTracks({ tracks, queued, escapeHtml, selectedTrackIds, reorderable = false } = {}) {
     const tbody = document.getElementById('trackTableBody');
     const table = document.getElementById('trackTable');
     const emptyState = document.getElementById('emptyState');
     if (!tbody || !table || !emptyState) return;
 
-    const selectedSet = new Set(Array.isArray(selectedTrackIds) ? selectedTrackIds : []);
+    trackView.tracks = tracks || [];
+    trackView.queued = queued || [];
+    trackView.escapeHtml = escapeHtml || trackView.escapeHtml;
+    trackView.isSelected = selectionPredicate(selectedTrackIds);
+    trackView.reorderable = reorderable;
 
-    if (!tracks || tracks.length === 0) {
+    if (trackViewLength() === 0) {
+        tbody.innerHTML = '';
         table.style.display = 'none';
         emptyState.style.display = 'flex';
         emptyState.innerHTML = `
@@ -53,41 +271,38 @@ export function renderTracks({ tracks, escapeHtml, selectedTrackIds } = {}) {
     table.style.display = 'table';
     emptyState.style.display = 'none';
 
-    tbody.innerHTML = tracks.map((track, index) => {
-        const isQueued = Boolean(track.__queued);
-        const numericId = Number(track.id);
-        const isSelectable = !isQueued && Number.isFinite(numericId) && numericId >= 0;
-        const isSelected = isSelectable && selectedSet.has(numericId);
-        const title = escapeHtml(track.title || 'Unknown') + (isQueued ? ' *' : '');
-        const artist = escapeHtml(track.artist || (isQueued ? 'Queued' : 'Unknown'));
-        const album = escapeHtml(track.album || 'Unknown');
-        const genre = escapeHtml(track.genre || '');
-        const duration = formatDuration(track.tracklen);
-
-        const actionHtml = isQueued
-            ? `<button class="btn btn-secondary" onclick="removeQueuedTrack(${track._queueIndex})" style="padding: 6px 10px; font-size: 12px;">
-                    Remove
-               </button>`
-            : `<button class="btn btn-secondary" onclick="deleteTrack(${track.id})" style="padding: 6px 10px; font-size: 12px;">
-                    Delete
-               </button>`;
-
-        const attrs = isSelectable
-            ? `data-track-id="${escapeHtml(String(numericId))}"`
-            : `data-queued="true"`;
-
-        return `
-            <tr class="${isSelected ? 'selected' : ''}" data-id="${escapeHtml(String(track.id))}" ${attrs}>
-                <td>${index + 1}</td>
-                <td class="title">${title}</td>
-                <td>${artist}</td>
-                <td>${album}</td>
-                <td>${genre}</td>
-                <td class="duration">${duration}</td>
-                <td>${actionHtml}</td>
-            </tr>
-        `;
-    }).join('');
+    attachTrackScroll();
+    renderTrackWindow(true);
+}
+
+/**
+ * Track ids of every row in the current view, in display order (null for queued rows),
+ * including rows scrolled out of the DOM. Index i is the row's playlist position when the
+ * view is reorderable.
+ */
+export function getTrackViewIds() {
+    return [...trackView.tracks.map(selectableId), ...trackView.queued.map(() => null)];
+}
+
+// Selection as an `id => boolean` test; callers pass either a test or an array of ids
+function selectionPredicate(selected) {
+    if (typeof selected === 'function') return selected;
+    const ids = new Set(Array.isArray(selected) ? selected : []);
+    return (id) => ids.has(id);
+}
+
+/**
+ * Update which rows are highlighted, for rendered rows and rows rendered later.
+ * `selected` is an array of track ids or an `id => boolean` test.
+ */
+export function setRenderedSelection(selected) {
+    trackView.isSelected = selectionPredicate(selected);
+    const tbody = document.getElementById('trackTableBody');
+    if (!tbody) return;
+    for (const row of tbody.querySelectorAll('tr[data-id]')) {
+        const id = Number(row.getAttribute('data-track-id'));
+        row.classList.toggle('selected', Number.isFinite(id) && trackView.isSelected(id));
+    }
 }
 
 export function renderPlaylists({ playlists, currentPlaylistIndex, allTracksCount, escapeHtml }) {
@@ -96,6 +311,7 @@ export function renderPlaylists({ playlists, currentPlaylistIndex, allTracksCoun
 
     let html = `
         <li class="playlist-item ${currentPlaylistIndex === -1 ? 'active' : ''}"
+            data-all-tracks="true"
             onclick="selectPlaylist(-1)">
             <span>All Tracks</span>
             <span class="track-count">${allTracksCount}</span>
@@ -119,3 +335,8 @@ export function renderPlaylists({ playlists, currentPlaylistIndex, allTracksCoun
     list.innerHTML = html;
 }
 
+// Update the sidebar's "All Tracks" count without re-rendering the playlist list
+export function updateAllTracksCount(count) {
+    const el = document.querySelector('#playlistList [data-all-tracks] .track-count');
+    if (el && el.textContent !== String(count)) el.textContent = String(count);
+}
@@ -1,39 +1,131 @@
+import { finishAudioProps, fallbackAudioMetadata } from './audio.js';
+
 export function createUploadQueue({
     appState,
     log,
     readAudioMetadata,
+    metadataPool,
+    durationScanner,
     rerenderAllTracksIfVisible,
 } = {}) {
-    function appendPendingUploads(queued) {
-        appState.pendingUploads = [...(appState.pendingUploads || []), ...queued];
-        log?.(`Queued ${queued.length} track(s). Click “Sync iPod” to transfer.`, 'success');
+    const audioOptions = { scanStreamProps: durationScanner?.scanStreamProps };
+
+    // Appends in place: a folder scan adds many small batches, and copying the queue for each
+    // one would cost O(N²) over the scan
+    function appendPendingUploads(queued, { announce = true } = {}) {
+        if (!appState.pendingUploads) appState.pendingUploads = [];
+        const pending = appState.pendingUploads;
+        for (const item of queued) pending.push(item);
+        if (announce) log?.(`Queued ${queued.length} track(s). Click “Sync iPod” to transfer.`, 'success');
         rerenderAllTracksIfVisible?.();
     }
 
-    async function enrichQueuedUploadsWithTags(queued, getFile) {
-        // Best-effort metadata read (fast; does not stage audio into WASM FS)
+    function toQueuedMeta(tags, props) {
+        return {
+            title: tags.title,
+            artist: tags.artist,
+            album: tags.album,
+            genre: tags.genre,
+            durationMs: props.duration,
+            bitrateKbps: props.bitrate,
+            samplerateHz: props.samplerate,
+            trackNr: tags.track || 0,
+            year: tags.year || 0,
+        };
+    }
+
+    // Items are updated in place (item.meta), so there is nothing to copy; just redraw
+    function refreshQueueView() {
+        rerenderAllTracksIfVisible?.();
+    }
+
+    async function enrichSequentially(queued, getFile, onBatch) {
         for (const item of queued) {
             try {
                 const file = await getFile(item);
                 const { tags, props } = await readAudioMetadata(file);
-                item.meta = {
-                    title: tags.title,
-                    artist: tags.artist,
-                    album: tags.album,
-                    genre: tags.genre,
-                    durationMs: props.duration,
-                    bitrateKbps: props.bitrate,
-                    samplerateHz: props.samplerate,
-                    trackNr: tags.track || 0,
-                    year: tags.year || 0,
-                };
+                item.meta = toQueuedMeta(tags, props);
             } catch (_) {
                 // ignore
             }
+            onBatch?.(1);
+        }
+    }
+
+    // Fill item.meta for each item (worker pool when available); onBatch(n) after each batch.
+    async function readMetaInto(items, getFile, onBatch) {
+        const byKey = new Map(items.map((item, i) => [i, item]));
+        const jobs = items.map((item, i) => ({ key: i, file: item.file, handle: item.handle }));
+
+        const usedWorkers = metadataPool
+            ? await metadataPool.extract(jobs, {
+                onBatch: async (results, { scanStats } = {}) => {
+                    durationScanner?.addStats?.(scanStats);
+                    for (const r of results) {
+                        const item = byKey.get(r.key);
+                        if (!item || item.meta) continue;
+                        try {
+                            const file = await getFile(item);
+                            if (r.ok) {
+                                const props = await finishAudioProps(file, r.format, audioOptions);
+                                item.meta = toQueuedMeta(r.tags, props);
+                            } else {
+                                const { tags, props } = await fallbackAudioMetadata(file, audioOptions);
+                                item.meta = toQueuedMeta(tags, props);
+                            }
+                        } catch (_) {
+                            // ignore; sync computes metadata lazily if still missing
+                        }
+                    }
+                    onBatch?.(results.length);
+                },
+            })
+            : false;
+
+        if (!usedWorkers) {
+            await enrichSequentially(items, getFile, onBatch);
         }
+    }
+
+    function logTagReads(count, startedAt) {
+        const elapsedSec = (performance.now() - startedAt) / 1000;
+        if (count > 1) {
+            log?.(`Read tags for ${count} file(s) in ${elapsedSec.toFixed(1)}s`, 'info');
+        }
+        durationScanner?.reportThroughput?.();
+    }
+
+    // report: false when the caller logs timing for a larger run (a folder scan)
+    async function enrichQueuedUploadsWithTags(queued, getFile, { report = true } = {}) {
+        // Best-effort metadata read (fast; does not stage audio into WASM FS)
+        const startedAt = performance.now();
+
+        // One UI refresh per batch, not per file.
+        await readMetaInto(queued, getFile, refreshQueueView);
+
+        if (report) logTagReads(queued.length, startedAt);
         // Trigger UI refresh with updated metadata
-        appState.pendingUploads = [...(appState.pendingUploads || [])];
-        rerenderAllTracksIfVisible?.();
+        refreshQueueView();
+    }
+
+    /**
+     * Read queue-shaped metadata for files without queueing them (sync planning).
+     * Every file gets a result: unreadable tags fall back to the file name.
+     */
+    async function readMetaForFiles(files, { onProgress } = {}) {
+        const items = (files || []).map((file) => ({ file, meta: null }));
+        let done = 0;
+        await readMetaInto(items, (item) => item.file, (n) => {
+            done += n;
+            try { onProgress?.({ done, total: items.length }); } catch (_) {}
+        });
+        for (const item of items) {
+            if (item.meta) continue;
+            const { tags, props } = await fallbackAudioMetadata(item.file, audioOptions);
+            item.meta = toQueuedMeta(tags, props);
+        }
+        durationScanner?.reportThroughput?.();
+        return items.map((item) => item.meta);
     }
 
     async function getOrComputeQueuedMeta(item, file) {
@@ -51,23 +143,14 @@ export function createUploadQueue({
         if (hasCoreFields) return existing;
 
         const { tags, props } = await readAudioMetadata(file);
-        const computed = {
-            title: tags.title,
-            artist: tags.artist,
-            album: tags.album,
-            genre: tags.genre,
-            durationMs: props.duration,
-            bitrateKbps: props.bitrate,
-            samplerateHz: props.samplerate,
-            trackNr: tags.track || 0,
-            year: tags.year || 0,
-        };
+        const computed = toQueuedMeta(tags, props);
 
         if (item) item.meta = computed;
         return computed;
     }
 
-    function queueUploads({ kind, items, getFileForTags }) {
+    // Resolves once the best-effort tag read for these items has finished
+    function queueUploads({ kind, items, getFileForTags, announce, report }) {
         const queued = (items || []).map((value) => ({
             kind,
             handle: kind === 'handle' ? value : undefined,
@@ -77,21 +160,58 @@ export function createUploadQueue({
             meta: null,
         }));
 
-        appendPendingUploads(queued);
+        appendPendingUploads(queued, { announce });
 
-        if (getFileForTags) {
-            void enrichQueuedUploadsWithTags(queued, getFileForTags);
-        }
+        return getFileForTags ? enrichQueuedUploadsWithTags(queued, getFileForTags, { report }) : Promise.resolve();
     }
 
     function queueFileHandlesForSync(fileHandles) {
-        queueUploads({
+        return queueUploads({
             kind: 'handle',
             items: fileHandles,
             getFileForTags: (item) => item.handle.getFile(),
         });
     }
 
+    /**
+     * Queue a folder scan's matches batch by batch as they are found. Their tag reads share
+     * the metadata pool's queue; timing and scan throughput are logged once, from finish(),
+     * after every batch's reads are done (the caller logs the queued total).
+     */
+    function startFolderQueue() {
+        const startedAt = performance.now();
+        const reads = [];
+        let count = 0;
+        return {
+            add(fileHandles) {
+                count += fileHandles.length;
+                reads.push(queueUploads({
+                    kind: 'handle',
+                    items: fileHandles,
+                    announce: false,
+                    report: false,
+                    getFileForTags: (item) => item.handle.getFile(),
+                }));
+            },
+            async finish() {
+                await Promise.all(reads);
+                if (count > 0) logTagReads(count, startedAt);
+            },
+        };
+    }
+
+    // Queue files whose metadata was already read (e.g. by the sync planner).
+    function queueFilesWithMeta(entries) {
+        const queued = (entries || []).map(({ file, meta }) => ({
+            kind: 'file',
+            file,
+            name: file?.name || 'Unknown',
+            status: 'queued',
+            meta: meta || null,
+        }));
+        if (queued.length > 0) appendPendingUploads(queued);
+    }
+
     function queueFilesForSync(files) {
         queueUploads({
             kind: 'file',
@@ -101,17 +221,19 @@ export function createUploadQueue({
     }
 
     function removeQueuedTrack(queueIndex) {
-        const q = [...(appState.pendingUploads || [])];
+        const q = appState.pendingUploads || [];
         if (queueIndex < 0 || queueIndex >= q.length) return;
         q.splice(queueIndex, 1);
-        appState.pendingUploads = q;
         rerenderAllTracksIfVisible?.();
         log?.('Removed queued track', 'info');
     }
 
     return {
         queueFileHandlesForSync,
+        startFolderQueue,
         queueFilesForSync,
+        queueFilesWithMeta,
+        readMetaForFiles,
         removeQueuedTrack,
         getOrComputeQueuedMeta,
     };
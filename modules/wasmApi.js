@@ -1,6 +1,10 @@
+// Calls that may move or free the selection bitset (see wasmSelectionWords)
+const SELECTION_MOVERS = /^ipod_(sel_|parse_db$|close_db$|init_new$|ctx_)/;
+
 export function createWasmApi({ log, createModule = globalThis.createIPodModule } = {}) {
     let wasmReady = false;
     let Module = null;
+    let selectionView = null;
 
     async function initWasm() {
         log?.('Loading WASM module...');
@@ -9,7 +13,7 @@ export function createWasmApi({ log, createModule = globalThis.createIPodModule
                 throw new Error('createIPodModule not found (is ipod_manager.js loaded?)');
             }
             Module = await createModule({
-                print: (text) => log?.(text, 'info'),
+                print: (text) => log?.(text, String(text).startsWith('[WARN]') ? 'warning' : 'info'),
                 printErr: (text) => log?.(text, 'error'),
             });
             wasmReady = true;
@@ -38,6 +42,7 @@ export function createWasmApi({ log, createModule = globalThis.createIPodModule
         }
         try {
             const func = Module[`_${funcName}`];
+            if (selectionView && SELECTION_MOVERS.test(funcName)) selectionView = null;
             if (!func) {
                 log?.(`WASM function not found: ${funcName}`, 'error');
                 return null;
@@ -65,6 +70,26 @@ export function createWasmApi({ log, createModule = globalThis.createIPodModule
         if (ptr && Module) Module._free(ptr);
     }
 
+    // Raw buffer in WASM memory (0 on failure); release it with wasmFree.
+    function wasmAlloc(size) {
+        return Module?._malloc ? Module._malloc(Math.max(1, size)) || 0 : 0;
+    }
+
+    function wasmFree(ptr) {
+        if (ptr && Module) Module._free(ptr);
+    }
+
+    function wasmHasFunction(funcName) {
+        return Boolean(wasmReady && Module && typeof Module[`_${funcName}`] === 'function');
+    }
+
+    // Copy bytes into WASM memory at ptr (HEAPU8 is re-read each time; it is replaced on memory growth).
+    function wasmWriteBytes(ptr, bytes) {
+        if (!ptr || !Module?.HEAPU8) return false;
+        Module.HEAPU8.set(bytes, ptr);
+        return true;
+    }
+
     function wasmCallWithStrings(funcName, stringArgs = [], otherArgs = []) {
         if (!Module) return null;
         const stringPtrs = stringArgs.map(wasmAllocString);
@@ -139,6 +164,221 @@ export function createWasmApi({ log, createModule = globalThis.createIPodModule
         );
     }
 
+    // Pass -1 (or omit) for numeric fields that should stay unchanged; null strings are kept.
+    function wasmUpdateTrack(trackIndex, { title = null, artist = null, album = null, genre = null, trackNr = -1, year = -1, rating = -1 } = {}) {
+        if (!wasmReady || !Module?.ccall) return -1;
+        const num = (v) => (Number.isFinite(v) ? v : -1);
+        return Module.ccall(
+            'ipod_update_track',
+            'number',
+            ['number','string','string','string','string','number','number','number'],
+            [trackIndex, title, artist, album, genre, num(trackNr), num(year), num(rating)]
+        );
+    }
+
+    // Same as wasmUpdateTrack, keyed by the track's stable handle (decimal string from track JSON).
+    function wasmUpdateTrackByHandle(handle, { title = null, artist = null, album = null, genre = null, trackNr = -1, year = -1, rating = -1 } = {}) {
+        if (!wasmReady || !Module?.ccall) return -1;
+        const num = (v) => (Number.isFinite(v) ? v : -1);
+        return Module.ccall(
+            'ipod_update_track_by_handle',
+            'number',
+            ['string','string','string','string','string','number','number','number'],
+            [String(handle), title, artist, album, genre, num(trackNr), num(year), num(rating)]
+        );
+    }
+
+    // Bit order of the field mask of ipod_update_tracks_batch (k_track_fields in ipod_manager.c).
+    const TRACK_FIELDS = [
+        'title', 'artist', 'album', 'genre', 'trackNr', 'year', 'rating',
+        'albumArtist', 'composer', 'comment', 'grouping', 'description', 'category', 'keywords',
+        'sortTitle', 'sortArtist', 'sortAlbum', 'sortAlbumArtist', 'sortComposer',
+        'tracks', 'cdNr', 'cds', 'bpm', 'compilation', 'volume', 'startTime', 'stopTime',
+        'checked', 'skipWhenShuffling', 'rememberPlaybackPosition',
+    ];
+    const NUMERIC_FIELDS = new Set(TRACK_FIELDS.slice(TRACK_FIELDS.indexOf('tracks')).concat(['trackNr', 'year', 'rating']));
+
+    // Pack field groups for ipod_update_tracks_batch: { mask, bytes }, or null when no known field is set.
+    function packTrackFields(groups) {
+        const fields = TRACK_FIELDS.filter((name) => groups[0] && name in groups[0]);
+        if (fields.length === 0) return null;
+        const mask = fields.reduce((m, name) => m | (1 << TRACK_FIELDS.indexOf(name)), 0) >>> 0;
+
+        const encode = (name, v) => (NUMERIC_FIELDS.has(name) ? String(Math.trunc(Number(v) || 0)) : String(v ?? ''));
+        const packed = groups.map((g) => fields.map((name) => `${encode(name, g[name]).replace(/\0/g, '')}\0`).join('')).join('');
+        return { mask, bytes: new TextEncoder().encode(packed) };
+    }
+
+    /**
+     * Update many tracks in one call. `values` is either one object applied to every track
+     * (e.g. { albumArtist: 'Various Artists', compilation: 1 }) or an array with one object
+     * per index, all with the same keys. null/'' clears a string field. Returns the number
+     * of tracks updated, or -1.
+     */
+    function wasmUpdateTracksBatch(trackIndices, values) {
+        if (!wasmReady || !Module || !trackIndices?.length) return 0;
+        const groups = Array.isArray(values) ? values : [values];
+        if (groups.length !== 1 && groups.length !== trackIndices.length) return -1;
+        const packed = packTrackFields(groups);
+        if (!packed) return 0;
+        const { mask, bytes } = packed;
+        const ints = Int32Array.from(trackIndices);
+
+        const indicesPtr = wasmAlloc(ints.byteLength);
+        const valuesPtr = wasmAlloc(bytes.byteLength);
+        try {
+            if (!indicesPtr || !valuesPtr) {
+                log?.('WASM error (ipod_update_tracks_batch): out of memory', 'error');
+                return -1;
+            }
+            wasmWriteBytes(indicesPtr, new Uint8Array(ints.buffer));
+            wasmWriteBytes(valuesPtr, bytes);
+            const updated = wasmCall('ipod_update_tracks_batch', indicesPtr, ints.length, mask, valuesPtr, bytes.byteLength);
+            if (updated < 0) {
+                log?.(`WASM error (ipod_update_tracks_batch): ${wasmGetString(wasmCall('ipod_get_last_error')) || 'Unknown error'}`, 'error');
+            }
+            return updated;
+        } finally {
+            wasmFree(indicesPtr);
+            wasmFree(valuesPtr);
+        }
+    }
+
+    // Same as wasmUpdateTracksBatch with one values object, applied to the selected tracks.
+    function wasmUpdateSelectedTracks(values) {
+        if (!wasmHasFunction('ipod_sel_update_tracks')) return -1;
+        const packed = packTrackFields([values]);
+        if (!packed) return 0;
+        const valuesPtr = wasmAlloc(packed.bytes.byteLength);
+        if (!valuesPtr) {
+            log?.('WASM error (ipod_sel_update_tracks): out of memory', 'error');
+            return -1;
+        }
+        try {
+            wasmWriteBytes(valuesPtr, packed.bytes);
+            const updated = wasmCall('ipod_sel_update_tracks', packed.mask, valuesPtr, packed.bytes.byteLength);
+            if (updated < 0) {
+                log?.(`WASM error (ipod_sel_update_tracks): ${wasmGetString(wasmCall('ipod_get_last_error')) || 'Unknown error'}`, 'error');
+            }
+            return updated;
+        } finally {
+            wasmFree(valuesPtr);
+        }
+    }
+
+    /**
+     * The track selection bitset in WASM memory as a Uint32Array (bit i = track index i),
+     * or null when the build lacks it. Read and write the words in place. The view is cached
+     * until a call may have moved the buffer or memory growth replaced HEAPU8; pass
+     * fit: true before writing, so tracks added since are covered.
+     */
+    function wasmSelectionWords({ fit = false } = {}) {
+        if (!wasmHasFunction('ipod_sel_buffer')) return null;
+        if (fit || !selectionView || selectionView.buffer !== Module.HEAPU8.buffer) {
+            const ptr = wasmCall('ipod_sel_buffer');
+            const words = Math.ceil((wasmCall('ipod_sel_size') || 0) / 32);
+            selectionView = ptr ? new Uint32Array(Module.HEAPU8.buffer, ptr, words) : null;
+        }
+        return selectionView;
+    }
+
+    // Word-wide selection operations and bulk edits of the selected tracks:
+    // 'clear' | 'set_range' | 'invert' | 'count' | 'remove_tracks' | 'playlist_add' |
+    // 'playlist_remove'. Returns the C result, or -1 on error (or when the build lacks it).
+    function wasmSelection(action, ...args) {
+        const funcName = `ipod_sel_${action}`;
+        if (!wasmHasFunction(funcName)) return -1;
+        const result = wasmCall(funcName, ...args);
+        if (!(result >= 0)) {
+            log?.(`WASM error (${funcName}): ${wasmGetString(wasmCall('ipod_get_last_error')) || 'Unknown error'}`, 'error');
+            return -1;
+        }
+        return result;
+    }
+
+    // Remove tracks by handle in one call; order does not matter. Returns the number removed.
+    function wasmRemoveTracksByHandle(handles) {
+        const list = (handles || []).map(String).filter(Boolean);
+        if (list.length === 0) return 0;
+        return wasmCallWithStrings('ipod_remove_tracks_by_handle', [list.join('\n')]);
+    }
+
+    // After a bulk removal reported `removed`, the rows of `tracks` (JSON with a `handle`, read
+    // before removing) whose track is really gone. A partial removal is resolved by looking each
+    // handle up; if the build cannot, no row is returned, so no kept track loses its file.
+    function wasmRemovedTracks(tracks, removed) {
+        const list = tracks || [];
+        if (!(removed > 0)) return [];
+        if (removed >= list.length) return list;
+        if (!wasmHasFunction('ipod_track_index_by_handle')) return [];
+        return list.filter((t) => t?.handle && wasmCallWithStrings('ipod_track_index_by_handle', [String(t.handle)]) < 0);
+    }
+
+    // Several iPods in one module: every other call acts on the selected context (1 = default).
+    // Opening one leaves the active context as it was; reach it through wasmWithContext.
+    function wasmOpenContext(mountpoint) {
+        const previous = wasmCall('ipod_ctx_current');
+        const ctx = wasmCallWithStrings('ipod_ctx_open', [mountpoint]);
+        if (!(ctx > 0)) {
+            log?.(`Failed to open iPod context at ${mountpoint}: ${wasmGetString(wasmCall('ipod_get_last_error')) || 'Unknown error'}`, 'error');
+            return -1;
+        }
+        if (previous > 0) wasmSelectContext(previous);
+        return ctx;
+    }
+
+    function wasmSelectContext(ctx) {
+        return wasmCallWithError('ipod_ctx_select', ctx);
+    }
+
+    function wasmCloseContext(ctx) {
+        return wasmCallWithError('ipod_ctx_close', ctx);
+    }
+
+    // Run fn with ctx selected, then restore the previous context (also when fn throws).
+    // The selection is module-wide, so fn must be synchronous: while it awaited, every
+    // other caller (UI refresh, search sync, metadata batches) would hit ctx's database.
+    // Do file I/O outside and enter the context only for the WASM calls.
+    function wasmWithContext(ctx, fn) {
+        const previous = wasmCall('ipod_ctx_current');
+        if (wasmSelectContext(ctx) !== 0) throw new Error(`Cannot select iPod context ${ctx}`);
+        let result;
+        try {
+            result = fn();
+        } finally {
+            if (previous > 0) wasmSelectContext(previous);
+        }
+        if (typeof result?.then === 'function') throw new Error('wasmWithContext: fn must be synchronous');
+        return result;
+    }
+
+    // Batch edits on the selected context, with an undo log kept in C.
+    // action: 'begin' | 'commit' | 'rollback'. Returns 0 for begin, the number of logged
+    // operations for commit/rollback, or -1 on error (or when the build lacks transactions).
+    function wasmTxn(action) {
+        const funcName = `ipod_txn_${action}`;
+        if (!wasmHasFunction(funcName)) return -1;
+        const result = wasmCall(funcName);
+        if (!(result >= 0)) {
+            log?.(`WASM error (${funcName}): ${wasmGetString(wasmCall('ipod_get_last_error')) || 'Unknown error'}`, 'error');
+            return -1;
+        }
+        return result;
+    }
+
+    // sizeBytes/writeBytes go to C as doubles, so sizes past 2GB are not truncated;
+    // writeBytes defaults to sizeBytes (uploaded as is).
+    function wasmSyncPlanAddLocal(localId, { title, artist, album, genre, trackNr, year, sizeBytes, writeBytes = sizeBytes, durationMs, transcoded }) {
+        if (!wasmReady || !Module?.ccall) return -1;
+        const int = (v) => (Number.isFinite(v) && v > 0 ? Math.floor(v) : 0);
+        return Module.ccall(
+            'ipod_sync_plan_add_local',
+            'number',
+            ['number','string','string','string','string','number','number','number','number','number','number'],
+            [localId, title || '', artist || '', album || '', genre || '', int(trackNr), int(year), int(sizeBytes), int(writeBytes), int(durationMs), transcoded ? 1 : 0]
+        );
+    }
+
     return {
         initWasm,
         isReady,
@@ -147,10 +387,28 @@ export function createWasmApi({ log, createModule = globalThis.createIPodModule
         wasmGetString,
         wasmAllocString,
         wasmFreeString,
+        wasmAlloc,
+        wasmFree,
+        wasmHasFunction,
+        wasmWriteBytes,
         wasmCallWithStrings,
         wasmGetJson,
         wasmCallWithError,
         wasmAddTrack,
+        wasmUpdateTrack,
+        wasmUpdateTrackByHandle,
+        wasmUpdateTracksBatch,
+        wasmUpdateSelectedTracks,
+        wasmSelectionWords,
+        wasmSelection,
+        wasmRemoveTracksByHandle,
+        wasmRemovedTracks,
+        wasmOpenContext,
+        wasmSelectContext,
+        wasmCloseContext,
+        wasmWithContext,
+        wasmTxn,
+        wasmSyncPlanAddLocal,
     };
 }
 
@@ -0,0 +1,378 @@
+/*
+ * mp3_scan.c - Streaming MPEG audio frame scanner for TunesReloaded
+ *
+ * Computes an exact MP3 duration by walking every frame header and summing
+ * samples-per-frame, for files whose Xing/VBRI header is missing (where the
+ * browser's estimate is often wrong for VBR).
+ *
+ * Data is fed in chunks from JavaScript (File.stream()), so the whole file
+ * never has to live in WASM memory. Sync-word search uses WASM SIMD when the
+ * module is built with -msimd128; frame-to-frame jumps need no search at all.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <emscripten.h>
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+/* ============================================================================
+ * MPEG Header Tables
+ * ============================================================================ */
+
+/* Bitrates in kbps, indexed [version_is_mpeg1 ? 0 : 1][layer - 1][bitrate_index] */
+static const uint16_t k_bitrates[2][3][16] = {
+    { /* MPEG-1 */
+        { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },  /* Layer I */
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },     /* Layer II */
+        { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },      /* Layer III */
+    },
+    { /* MPEG-2 / MPEG-2.5 */
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },     /* Layer I */
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },          /* Layer II */
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },          /* Layer III */
+    },
+};
+
+/* Sample rates in Hz, indexed [version bits][samplerate_index] (version 1 is reserved) */
+static const uint32_t k_samplerates[4][3] = {
+    { 11025, 12000, 8000 },   /* MPEG-2.5 */
+    { 0, 0, 0 },              /* reserved */
+    { 22050, 24000, 16000 },  /* MPEG-2 */
+    { 44100, 48000, 32000 },  /* MPEG-1 */
+};
+
+typedef struct {
+    uint32_t frame_len;     /* bytes, including header */
+    uint32_t samples;       /* samples per channel in this frame */
+    uint32_t samplerate;
+    uint32_t side_info;     /* Layer III side info size (for Xing/Info lookup) */
+    uint8_t  lock_bits;     /* version + layer + samplerate index, must stay constant */
+} FrameInfo;
+
+/* ============================================================================
+ * Scanner State
+ * ============================================================================ */
+
+typedef struct {
+    int       started;
+    int       locked;
+    uint8_t   lock_bits;
+    uint32_t  samplerate;
+    uint64_t  skip;             /* bytes still to skip (ID3v2 tag or current frame body) */
+    uint8_t   carry[4];         /* partial header straddling two chunks */
+    uint32_t  carry_len;
+    uint64_t  total_samples;
+    uint64_t  audio_bytes;
+    uint32_t  frame_count;
+    uint64_t  bytes_fed;
+    int       has_pending;      /* a frame waits for the header after it to confirm it */
+    int       pending_is_tag;   /* ... and it is the Xing/Info/VBRI frame, not audio */
+    int       pending_chained;  /* ... and it starts where the frame before it ended */
+    FrameInfo pending;
+    uint64_t  pending_end;      /* stream offset just past the pending frame */
+    int       done;             /* trailing tag reached; the rest is not audio */
+} Mp3ScanState;
+
+static Mp3ScanState g_scan;
+
+/* ============================================================================
+ * Helpers
+ * ============================================================================ */
+
+/**
+ * Decode a 4-byte frame header. Returns 1 and fills @info if the header is
+ * a valid, non-free-format MPEG audio header.
+ */
+static int parse_frame_header(const uint8_t *h, FrameInfo *info) {
+    if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) return 0;
+
+    uint32_t version = (h[1] >> 3) & 0x03;    /* 0=2.5, 1=reserved, 2=MPEG-2, 3=MPEG-1 */
+    uint32_t layer_bits = (h[1] >> 1) & 0x03; /* 1=III, 2=II, 3=I */
+    uint32_t br_index = (h[2] >> 4) & 0x0F;
+    uint32_t sr_index = (h[2] >> 2) & 0x03;
+    uint32_t padding = (h[2] >> 1) & 0x01;
+    uint32_t mono = ((h[3] >> 6) & 0x03) == 0x03;
+
+    if (version == 1 || layer_bits == 0 || br_index == 0 || br_index == 15 || sr_index == 3) return 0;
+
+    uint32_t layer = 4 - layer_bits;          /* 1, 2 or 3 */
+    int mpeg1 = (version == 3);
+    uint32_t bitrate = (uint32_t)k_bitrates[mpeg1 ? 0 : 1][layer - 1][br_index] * 1000;
+    uint32_t samplerate = k_samplerates[version][sr_index];
+
+    if (layer == 1) {
+        info->samples = 384;
+        info->frame_len = (12 * bitrate / samplerate + padding) * 4;
+    } else if (layer == 2 || mpeg1) {
+        info->samples = 1152;
+        info->frame_len = 144 * bitrate / samplerate + padding;
+    } else {
+        /* Layer III, MPEG-2/2.5 */
+        info->samples = 576;
+        info->frame_len = 72 * bitrate / samplerate + padding;
+    }
+
+    if (info->frame_len < 4) return 0;
+
+    info->samplerate = samplerate;
+    info->side_info = mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+    info->lock_bits = (uint8_t)((version << 4) | (layer_bits << 2) | sr_index);
+    return 1;
+}
+
+/**
+ * True if the frame starting at @frame carries a Xing/Info/VBRI tag instead
+ * of audio (encoders write it as the first frame; players skip it).
+ */
+static int is_vbr_tag_frame(const uint8_t *frame, size_t avail, const FrameInfo *info) {
+    size_t xing_off = 4 + info->side_info;
+    if (avail >= xing_off + 4 &&
+        (memcmp(frame + xing_off, "Xing", 4) == 0 || memcmp(frame + xing_off, "Info", 4) == 0)) {
+        return 1;
+    }
+    if (avail >= 36 + 4 && memcmp(frame + 36, "VBRI", 4) == 0) {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Find the next candidate sync word (0xFF followed by a byte with the top
+ * three bits set). Returns the offset, or @n if none was found; a trailing
+ * 0xFF at p[n-1] is returned so the caller can carry it into the next chunk.
+ */
+static size_t find_sync(const uint8_t *p, size_t n) {
+    size_t i = 0;
+#ifdef __wasm_simd128__
+    const v128_t ff = wasm_i8x16_splat((int8_t)0xFF);
+    const v128_t e0 = wasm_i8x16_splat((int8_t)0xE0);
+    for (; i + 17 <= n; i += 16) {
+        v128_t b0 = wasm_v128_load(p + i);
+        v128_t b1 = wasm_v128_load(p + i + 1);
+        v128_t hit = wasm_v128_and(wasm_i8x16_eq(b0, ff), wasm_u8x16_ge(b1, e0));
+        uint32_t mask = (uint32_t)wasm_i8x16_bitmask(hit);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    for (; i < n; i++) {
+        if (p[i] != 0xFF) continue;
+        if (i + 1 == n || (p[i + 1] & 0xE0) == 0xE0) return i;
+    }
+    return n;
+}
+
+/**
+ * True if @p starts an ID3v1 or APEv2 tag, which only follow the audio.
+ */
+static int is_trailing_tag(const uint8_t *p, size_t avail) {
+    return (avail >= 3 && memcmp(p, "TAG", 3) == 0) || (avail >= 8 && memcmp(p, "APETAGEX", 8) == 0);
+}
+
+/**
+ * Count the pending frame: whatever follows it (a matching header, a
+ * trailing tag or the end of the data) has shown it to be real.
+ */
+static void confirm_pending(void) {
+    if (!g_scan.has_pending) return;
+    g_scan.has_pending = 0;
+    if (g_scan.pending_is_tag) return;
+    g_scan.total_samples += g_scan.pending.samples;
+    g_scan.audio_bytes += g_scan.pending.frame_len;
+    g_scan.frame_count++;
+}
+
+/**
+ * Take a header at stream offset @at as the next frame. It confirms the
+ * pending frame if it starts right where that one ends. Otherwise the pending
+ * frame was followed by something else: it still counts if the frame before
+ * it led there, and is dropped as a stray sync pattern if a resync found it.
+ */
+static void take_frame(const FrameInfo *info, uint64_t at, int is_tag) {
+    int chained = g_scan.has_pending && g_scan.pending_end == at;
+    if (chained || (g_scan.has_pending && g_scan.pending_chained)) confirm_pending();
+    g_scan.has_pending = 1;
+    g_scan.pending_chained = chained;
+    g_scan.pending_is_tag = is_tag;
+    g_scan.pending = *info;
+    g_scan.pending_end = at + info->frame_len;
+}
+
+/**
+ * Accept a frame header found at @frame, stream offset @at (with @avail bytes
+ * of the chunk from there on). A header right where the previous frame ended
+ * only has to match the stream; one found by resyncing also needs the next
+ * header to agree with it. When that is visible in this chunk a mismatch
+ * rejects the candidate right away, otherwise take_frame() waits for it.
+ */
+static int accept_frame(const uint8_t *frame, size_t avail, const FrameInfo *info, uint64_t at) {
+    if (g_scan.locked && info->lock_bits != g_scan.lock_bits) return 0;
+
+    int chained = g_scan.has_pending && g_scan.pending_end == at;
+    if (!chained && avail >= (size_t)info->frame_len + 4) {
+        FrameInfo next;
+        const uint8_t *after = frame + info->frame_len;
+        int next_ok = parse_frame_header(after, &next) && next.lock_bits == info->lock_bits;
+        /* Once locked, the last frame may be followed by a tag instead */
+        if (!next_ok && !(g_scan.locked && is_trailing_tag(after, avail - info->frame_len))) {
+            return 0;
+        }
+    }
+
+    int is_tag = 0;
+    if (!g_scan.locked) {
+        g_scan.locked = 1;
+        g_scan.lock_bits = info->lock_bits;
+        g_scan.samplerate = info->samplerate;
+        /* First frame: don't count a Xing/Info/VBRI header frame as audio */
+        is_tag = g_scan.frame_count == 0 && is_vbr_tag_frame(frame, avail, info);
+    }
+    take_frame(info, at, is_tag);
+    return 1;
+}
+
+/* ============================================================================
+ * Public API
+ * ============================================================================ */
+
+/**
+ * Reset the scanner for a new file.
+ */
+EMSCRIPTEN_KEEPALIVE
+void ipod_mp3_scan_begin(void) {
+    memset(&g_scan, 0, sizeof(g_scan));
+}
+
+/**
+ * Feed the next chunk of the file, in order.
+ * The first chunk should be at least 10 bytes so an ID3v2 header can be skipped.
+ * Returns 0 on success, -1 on bad arguments.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_mp3_scan_feed(const unsigned char *data, int len) {
+    if (!data || len < 0) return -1;
+
+    size_t n = (size_t)len;
+    size_t pos = 0;
+    uint64_t base = g_scan.bytes_fed;   /* stream offset of data[0] */
+    g_scan.bytes_fed += n;
+    if (g_scan.done) return 0;
+
+    if (!g_scan.started) {
+        g_scan.started = 1;
+        if (n >= 10 && memcmp(data, "ID3", 3) == 0) {
+            uint64_t tag_size = ((uint64_t)(data[6] & 0x7F) << 21) | ((uint64_t)(data[7] & 0x7F) << 14) |
+                                ((uint64_t)(data[8] & 0x7F) << 7) | (uint64_t)(data[9] & 0x7F);
+            int has_footer = (data[5] & 0x10) != 0;
+            g_scan.skip = 10 + tag_size + (has_footer ? 10 : 0);
+        }
+    }
+
+    /* Complete a header that straddled the previous chunk boundary */
+    if (g_scan.carry_len > 0 && g_scan.skip == 0) {
+        size_t need = 4 - g_scan.carry_len;
+        if (n < need) {
+            memcpy(g_scan.carry + g_scan.carry_len, data, n);
+            g_scan.carry_len += (uint32_t)n;
+            return 0;
+        }
+        uint8_t hdr[4];
+        memcpy(hdr, g_scan.carry, g_scan.carry_len);
+        memcpy(hdr + g_scan.carry_len, data, need);
+
+        FrameInfo info;
+        if (parse_frame_header(hdr, &info) && (!g_scan.locked || info.lock_bits == g_scan.lock_bits)) {
+            /* The frame body is not contiguous here, so the Xing check is skipped;
+             * a tag frame can only be the very first frame, which never straddles. */
+            if (!g_scan.locked) {
+                g_scan.locked = 1;
+                g_scan.lock_bits = info.lock_bits;
+                g_scan.samplerate = info.samplerate;
+            }
+            take_frame(&info, base - g_scan.carry_len, 0);
+            pos = need;
+            g_scan.skip = info.frame_len - 4;
+        }
+        /* On a bad header, resync from the start of this chunk (the carried
+         * bytes are dropped; at worst one frame is missed inside garbage). */
+        g_scan.carry_len = 0;
+    }
+
+    while (pos < n) {
+        if (g_scan.skip > 0) {
+            size_t step = (g_scan.skip < (uint64_t)(n - pos)) ? (size_t)g_scan.skip : (n - pos);
+            pos += step;
+            g_scan.skip -= step;
+            continue;
+        }
+
+        /* A tag right after the last frame ends the audio; sync patterns inside it are not frames */
+        if (g_scan.has_pending && base + pos == g_scan.pending_end && is_trailing_tag(data + pos, n - pos)) {
+            confirm_pending();
+            g_scan.done = 1;
+            break;
+        }
+
+        size_t off = pos + find_sync(data + pos, n - pos);
+        if (off >= n) break;
+
+        if (n - off < 4) {
+            /* Header straddles into the next chunk */
+            g_scan.carry_len = (uint32_t)(n - off);
+            memcpy(g_scan.carry, data + off, g_scan.carry_len);
+            break;
+        }
+
+        FrameInfo info;
+        if (parse_frame_header(data + off, &info) && accept_frame(data + off, n - off, &info, base + off)) {
+            pos = off;
+            g_scan.skip = info.frame_len;
+        } else {
+            pos = off + 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Finish scanning. Returns the exact duration in milliseconds, or -1 if no
+ * MPEG audio frames were found. A last frame cut off by the end of the data
+ * is not counted, nor is one a resync found in trailing garbage.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_mp3_scan_finish(void) {
+    if (g_scan.has_pending && g_scan.pending_end <= g_scan.bytes_fed &&
+        (g_scan.pending_chained || g_scan.pending_end == g_scan.bytes_fed)) {
+        confirm_pending();
+    }
+    if (g_scan.frame_count == 0 || g_scan.samplerate == 0) return -1;
+    return (int)(g_scan.total_samples * 1000 / g_scan.samplerate);
+}
+
+/**
+ * Number of audio frames counted by the last scan.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_mp3_scan_frame_count(void) {
+    return (int)g_scan.frame_count;
+}
+
+/**
+ * Sample rate (Hz) of the last scanned stream, 0 if unknown.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_mp3_scan_samplerate(void) {
+    return (int)g_scan.samplerate;
+}
+
+/**
+ * Average bitrate (kbps) over all audio frames of the last scan, 0 if unknown.
+ */
+EMSCRIPTEN_KEEPALIVE
+int ipod_mp3_scan_avg_bitrate(void) {
+    if (g_scan.total_samples == 0 || g_scan.samplerate == 0) return 0;
+    /* bits / seconds / 1000 == bytes * 8 * samplerate / samples / 1000 */
+    return (int)(g_scan.audio_bytes * 8 * g_scan.samplerate / g_scan.total_samples / 1000);
+}
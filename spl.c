@@ -0,0 +1,801 @@
+/*
+ * spl.c - Smart playlist evaluation for TunesReloaded
+ *
+ * Rules of all smart playlists are compiled once (operands case-folded,
+ * relative dates resolved, referenced playlists turned into hash sets), then
+ * the library is walked once: each track is tested against every smart
+ * playlist, and its case-folded strings are computed at most once no matter
+ * how many rules look at them. Limits and limit sorting are applied per
+ * playlist on the matched set afterwards.
+ *
+ * The compiled state is kept afterwards so single-track edits can be applied
+ * incrementally: a field -> smart playlist dependency map tells which
+ * playlists must re-test a changed track, and membership of unlimited
+ * playlists is patched in place. Limited playlists and "in the last" date
+ * rules are settled by spl_refresh() before the database is written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "spl.h"
+#include "itdb_device.h"
+
+/* Action bits: 0x01000000 marks string actions, 0x02000000 negates */
+#define SPL_ACTION_NOT 0x02000000
+
+typedef enum {
+    RULE_UNKNOWN,
+    RULE_STRING,
+    RULE_INT,
+    RULE_DATE,
+    RULE_BOOLEAN,
+    RULE_BINARY_AND,
+    RULE_PLAYLIST
+} RuleType;
+
+/* Case-folded string slots cached per track */
+typedef enum {
+    STR_TITLE, STR_ALBUM, STR_ARTIST, STR_GENRE, STR_KIND, STR_COMMENT,
+    STR_COMPOSER, STR_GROUPING, STR_ALBUMARTIST, STR_DESCRIPTION,
+    STR_CATEGORY, STR_TVSHOW,
+    N_STR_SLOTS
+} StrSlot;
+
+typedef struct {
+    guint32     field;
+    guint32     action;         /* with SPL_ACTION_NOT cleared */
+    gboolean    negate;
+    RuleType    type;
+    int         slot;           /* RULE_STRING: StrSlot */
+    gchar      *folded;         /* RULE_STRING: case-folded operand */
+    gint64      from;
+    gint64      to;
+    gint64      span;           /* IS_IN_THE_LAST: seconds back from now */
+    Itdb_Playlist *ref;         /* RULE_PLAYLIST: referenced playlist */
+    GHashTable *members;        /* RULE_PLAYLIST: Itdb_Track* set */
+} CompiledRule;
+
+typedef struct {
+    Itdb_Playlist *pl;
+    CompiledRule  *rules;
+    guint          n_rules;
+    gboolean       match_any;
+    gboolean       use_rules;
+    gboolean       checked_only;
+    gboolean       limited;
+    gboolean       timed;       /* has "in the last" rules */
+    gboolean       dirty;       /* limited: matches changed since the last limit */
+    GHashTable    *matched;     /* Itdb_Track* -> its pl->members node (limited: itself) */
+    GList         *tail;        /* last node of pl->members (unlimited only) */
+} CompiledSpl;
+
+typedef struct {
+    const Itdb_Track *track;
+    gchar *folded[N_STR_SLOTS];
+} TrackView;
+
+static CompiledSpl *g_spls = NULL;
+static guint g_n_spls = 0;
+static gboolean g_compiled = FALSE;
+/* ITDB_SPLFIELD_* -> GPtrArray of smart playlist indices whose rules test it */
+static GHashTable *g_field_deps = NULL;
+
+/* ============================================================================
+ * Fields
+ * ============================================================================ */
+
+static int string_slot(guint32 field) {
+    switch (field) {
+    case ITDB_SPLFIELD_SONG_NAME:   return STR_TITLE;
+    case ITDB_SPLFIELD_ALBUM:       return STR_ALBUM;
+    case ITDB_SPLFIELD_ARTIST:      return STR_ARTIST;
+    case ITDB_SPLFIELD_GENRE:       return STR_GENRE;
+    case ITDB_SPLFIELD_KIND:        return STR_KIND;
+    case ITDB_SPLFIELD_COMMENT:     return STR_COMMENT;
+    case ITDB_SPLFIELD_COMPOSER:    return STR_COMPOSER;
+    case ITDB_SPLFIELD_GROUPING:    return STR_GROUPING;
+    case ITDB_SPLFIELD_ALBUMARTIST: return STR_ALBUMARTIST;
+    case ITDB_SPLFIELD_DESCRIPTION: return STR_DESCRIPTION;
+    case ITDB_SPLFIELD_CATEGORY:    return STR_CATEGORY;
+    case ITDB_SPLFIELD_TVSHOW:      return STR_TVSHOW;
+    default:                        return -1;
+    }
+}
+
+static const gchar *track_string(const Itdb_Track *t, int slot) {
+    switch (slot) {
+    case STR_TITLE:       return t->title;
+    case STR_ALBUM:       return t->album;
+    case STR_ARTIST:      return t->artist;
+    case STR_GENRE:       return t->genre;
+    case STR_KIND:        return t->filetype;
+    case STR_COMMENT:     return t->comment;
+    case STR_COMPOSER:    return t->composer;
+    case STR_GROUPING:    return t->grouping;
+    case STR_ALBUMARTIST: return t->albumartist;
+    case STR_DESCRIPTION: return t->description;
+    case STR_CATEGORY:    return t->category;
+    case STR_TVSHOW:      return t->tvshow;
+    default:              return NULL;
+    }
+}
+
+static RuleType rule_type(guint32 field) {
+    if (string_slot(field) >= 0) return RULE_STRING;
+    switch (field) {
+    case ITDB_SPLFIELD_BITRATE:
+    case ITDB_SPLFIELD_SAMPLE_RATE:
+    case ITDB_SPLFIELD_YEAR:
+    case ITDB_SPLFIELD_TRACKNUMBER:
+    case ITDB_SPLFIELD_SIZE:
+    case ITDB_SPLFIELD_TIME:
+    case ITDB_SPLFIELD_PLAYCOUNT:
+    case ITDB_SPLFIELD_DISC_NUMBER:
+    case ITDB_SPLFIELD_RATING:
+    case ITDB_SPLFIELD_BPM:
+    case ITDB_SPLFIELD_SEASON_NR:
+    case ITDB_SPLFIELD_SKIPCOUNT:
+        return RULE_INT;
+    case ITDB_SPLFIELD_DATE_MODIFIED:
+    case ITDB_SPLFIELD_DATE_ADDED:
+    case ITDB_SPLFIELD_LAST_PLAYED:
+    case ITDB_SPLFIELD_LAST_SKIPPED:
+        return RULE_DATE;
+    case ITDB_SPLFIELD_COMPILATION:
+    case ITDB_SPLFIELD_PODCAST:
+        return RULE_BOOLEAN;
+    case ITDB_SPLFIELD_VIDEO_KIND:
+        return RULE_BINARY_AND;
+    case ITDB_SPLFIELD_PLAYLIST:
+        return RULE_PLAYLIST;
+    default:
+        return RULE_UNKNOWN;
+    }
+}
+
+static gint64 track_int(const Itdb_Track *t, guint32 field) {
+    switch (field) {
+    case ITDB_SPLFIELD_BITRATE:       return t->bitrate;
+    case ITDB_SPLFIELD_SAMPLE_RATE:   return t->samplerate;
+    case ITDB_SPLFIELD_YEAR:          return t->year;
+    case ITDB_SPLFIELD_TRACKNUMBER:   return t->track_nr;
+    case ITDB_SPLFIELD_SIZE:          return t->size;
+    case ITDB_SPLFIELD_TIME:          return t->tracklen;
+    case ITDB_SPLFIELD_PLAYCOUNT:     return t->playcount;
+    case ITDB_SPLFIELD_DISC_NUMBER:   return t->cd_nr;
+    case ITDB_SPLFIELD_RATING:        return t->rating;
+    case ITDB_SPLFIELD_BPM:           return t->BPM;
+    case ITDB_SPLFIELD_SEASON_NR:     return t->season_nr;
+    case ITDB_SPLFIELD_SKIPCOUNT:     return t->skipcount;
+    case ITDB_SPLFIELD_DATE_MODIFIED: return (gint64)t->time_modified;
+    case ITDB_SPLFIELD_DATE_ADDED:    return (gint64)t->time_added;
+    case ITDB_SPLFIELD_LAST_PLAYED:   return (gint64)t->time_played;
+    case ITDB_SPLFIELD_LAST_SKIPPED:  return (gint64)t->last_skipped;
+    case ITDB_SPLFIELD_COMPILATION:   return t->compilation;
+    case ITDB_SPLFIELD_PODCAST:       return (t->mediatype & ITDB_MEDIATYPE_PODCAST) != 0;
+    case ITDB_SPLFIELD_VIDEO_KIND:    return t->mediatype;
+    default:                          return 0;
+    }
+}
+
+static const gchar *track_folded(TrackView *tv, int slot) {
+    if (!tv->folded[slot]) {
+        const gchar *s = track_string(tv->track, slot);
+        tv->folded[slot] = g_utf8_casefold(s ? s : "", -1);
+    }
+    return tv->folded[slot];
+}
+
+static void track_view_clear(TrackView *tv) {
+    for (int i = 0; i < N_STR_SLOTS; i++) {
+        g_free(tv->folded[i]);
+        tv->folded[i] = NULL;
+    }
+}
+
+/* ============================================================================
+ * Compile
+ * ============================================================================ */
+
+static Itdb_Playlist *playlist_by_id(Itdb_iTunesDB *itdb, guint64 id) {
+    for (GList *l = itdb->playlists; l != NULL; l = l->next) {
+        Itdb_Playlist *pl = (Itdb_Playlist *)l->data;
+        if (pl && pl->id == id) return pl;
+    }
+    return NULL;
+}
+
+static void compile_rule(Itdb_iTunesDB *itdb, const Itdb_SPLRule *src, CompiledRule *r, time_t now) {
+    r->field = src->field;
+    r->negate = (src->action & SPL_ACTION_NOT) != 0;
+    r->action = src->action & ~SPL_ACTION_NOT;
+    r->type = rule_type(src->field);
+    r->from = (gint64)src->fromvalue;
+    r->to = (gint64)src->tovalue;
+
+    switch (r->type) {
+    case RULE_STRING:
+        r->slot = string_slot(src->field);
+        r->folded = g_utf8_casefold(src->string ? src->string : "", -1);
+        break;
+    case RULE_DATE:
+        if (r->action == ITDB_SPLACTION_IS_IN_THE_LAST) {
+            /* fromdate counts units back from now (stored negative) */
+            gint64 units = src->fromdate < 0 ? -src->fromdate : src->fromdate;
+            r->span = units * (gint64)src->fromunits;
+            r->from = (gint64)now - r->span;
+        } else {
+            /* Absolute dates are stored in Mac time (device local, since
+             * 1904); track times are Unix time_t */
+            r->from = (gint64)device_time_mac_to_time_t(itdb->device, src->fromvalue);
+            r->to = (gint64)device_time_mac_to_time_t(itdb->device, src->tovalue);
+        }
+        break;
+    case RULE_PLAYLIST:
+        r->members = g_hash_table_new(g_direct_hash, g_direct_equal);
+        r->ref = playlist_by_id(itdb, src->fromvalue);
+        for (GList *m = r->ref ? r->ref->members : NULL; m != NULL; m = m->next) {
+            g_hash_table_add(r->members, m->data);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void free_index_array(gpointer data) {
+    g_ptr_array_free((GPtrArray *)data, TRUE);
+}
+
+/* Record that smart playlist @index tests @field */
+static void add_field_dep(guint32 field, guint index) {
+    GPtrArray *deps = g_hash_table_lookup(g_field_deps, GUINT_TO_POINTER(field));
+    if (!deps) {
+        deps = g_ptr_array_new();
+        g_hash_table_insert(g_field_deps, GUINT_TO_POINTER(field), deps);
+    }
+    /* Playlists are compiled in index order, so repeats are adjacent */
+    if (deps->len > 0 && deps->pdata[deps->len - 1] == GUINT_TO_POINTER(index)) return;
+    g_ptr_array_add(deps, GUINT_TO_POINTER(index));
+}
+
+static void compile_spl(Itdb_iTunesDB *itdb, Itdb_Playlist *pl, guint index, time_t now) {
+    CompiledSpl *spl = &g_spls[index];
+    spl->pl = pl;
+    spl->match_any = pl->splrules.match_operator == ITDB_SPLMATCH_OR;
+    spl->use_rules = pl->splpref.checkrules != 0;
+    spl->checked_only = pl->splpref.matchcheckedonly != 0;
+    spl->limited = pl->splpref.checklimits != 0;
+    spl->matched = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    spl->n_rules = g_list_length(pl->splrules.rules);
+    spl->rules = g_new0(CompiledRule, spl->n_rules ? spl->n_rules : 1);
+    guint i = 0;
+    for (GList *l = pl->splrules.rules; l != NULL; l = l->next) {
+        CompiledRule *r = &spl->rules[i++];
+        compile_rule(itdb, (const Itdb_SPLRule *)l->data, r, now);
+        if (r->type == RULE_DATE && r->action == ITDB_SPLACTION_IS_IN_THE_LAST) spl->timed = TRUE;
+        /* Playlist rules follow membership changes, not track fields */
+        if (spl->use_rules && r->type != RULE_UNKNOWN && r->type != RULE_PLAYLIST) {
+            add_field_dep(r->field, index);
+        }
+    }
+}
+
+void spl_reset(void) {
+    for (guint s = 0; s < g_n_spls; s++) {
+        CompiledSpl *spl = &g_spls[s];
+        for (guint i = 0; i < spl->n_rules; i++) {
+            g_free(spl->rules[i].folded);
+            if (spl->rules[i].members) g_hash_table_destroy(spl->rules[i].members);
+        }
+        g_free(spl->rules);
+        if (spl->matched) g_hash_table_destroy(spl->matched);
+    }
+    g_free(g_spls);
+    g_spls = NULL;
+    g_n_spls = 0;
+    g_compiled = FALSE;
+    if (g_field_deps) {
+        g_hash_table_destroy(g_field_deps);
+        g_field_deps = NULL;
+    }
+}
+
+
+/* ============================================================================
+ * Evaluate
+ * ============================================================================ */
+
+static gboolean eval_int(guint32 action, gint64 v, gint64 from, gint64 to) {
+    switch (action) {
+    case ITDB_SPLACTION_IS_INT:          return v == from;
+    case ITDB_SPLACTION_IS_GREATER_THAN: return v > from;
+    case ITDB_SPLACTION_IS_LESS_THAN:    return v < from;
+    case ITDB_SPLACTION_IS_IN_THE_RANGE:
+        return from <= to ? (v >= from && v <= to) : (v >= to && v <= from);
+    case ITDB_SPLACTION_BINARY_AND:      return (v & from) != 0;
+    default:                             return FALSE;
+    }
+}
+
+static gboolean eval_string(guint32 action, const gchar *v, const gchar *operand) {
+    switch (action) {
+    case ITDB_SPLACTION_IS_STRING: return strcmp(v, operand) == 0;
+    case ITDB_SPLACTION_CONTAINS:  return strstr(v, operand) != NULL;
+    case ITDB_SPLACTION_STARTS_WITH:
+        return strncmp(v, operand, strlen(operand)) == 0;
+    case ITDB_SPLACTION_ENDS_WITH: {
+        size_t lv = strlen(v), lo = strlen(operand);
+        return lv >= lo && strcmp(v + lv - lo, operand) == 0;
+    }
+    default:
+        return FALSE;
+    }
+}
+
+static gboolean eval_rule(const CompiledRule *r, TrackView *tv) {
+    gboolean res;
+    switch (r->type) {
+    case RULE_STRING:
+        res = eval_string(r->action, track_folded(tv, r->slot), r->folded);
+        break;
+    case RULE_INT:
+    case RULE_BINARY_AND:
+        res = eval_int(r->action, track_int(tv->track, r->field), r->from, r->to);
+        break;
+    case RULE_DATE: {
+        gint64 v = track_int(tv->track, r->field);
+        res = r->action == ITDB_SPLACTION_IS_IN_THE_LAST ? v > r->from : eval_int(r->action, v, r->from, r->to);
+        break;
+    }
+    case RULE_BOOLEAN:
+        res = (track_int(tv->track, r->field) != 0) == (r->from != 0);
+        break;
+    case RULE_PLAYLIST:
+        res = g_hash_table_contains(r->members, tv->track);
+        break;
+    default:
+        /* Unsupported field: never matches, negated or not */
+        return FALSE;
+    }
+    return r->negate ? !res : res;
+}
+
+static gboolean spl_matches(const CompiledSpl *spl, TrackView *tv) {
+    /* checked == 0 means the track is checked */
+    if (spl->checked_only && tv->track->checked != 0) return FALSE;
+    if (!spl->use_rules || spl->n_rules == 0) return TRUE;
+
+    for (guint i = 0; i < spl->n_rules; i++) {
+        gboolean hit = eval_rule(&spl->rules[i], tv);
+        if (spl->match_any && hit) return TRUE;
+        if (!spl->match_any && !hit) return FALSE;
+    }
+    return !spl->match_any;
+}
+
+/* ============================================================================
+ * Limits
+ * ============================================================================ */
+
+typedef struct {
+    Itdb_Track *track;
+    guint       pos;
+    gchar      *collate;
+} LimitItem;
+
+/* qsort has no user data argument; limit sorts never nest */
+static guint32 g_limit_sort = 0;
+
+static gint64 limit_sort_value(const Itdb_Track *t, guint32 sort) {
+    switch (sort & 0x7FFFFFFF) {
+    case ITDB_LIMITSORT_MOST_RECENTLY_ADDED:  return (gint64)t->time_added;
+    case ITDB_LIMITSORT_MOST_OFTEN_PLAYED:    return t->playcount;
+    case ITDB_LIMITSORT_MOST_RECENTLY_PLAYED: return (gint64)t->time_played;
+    case ITDB_LIMITSORT_HIGHEST_RATING:       return t->rating;
+    default:                                  return 0;
+    }
+}
+
+static int compare_limit_items(const void *pa, const void *pb) {
+    const LimitItem *a = (const LimitItem *)pa;
+    const LimitItem *b = (const LimitItem *)pb;
+    int c;
+    if (a->collate) {
+        c = strcmp(a->collate, b->collate);
+    } else {
+        /* Numeric sorts are "most/highest" first; the high bit reverses them */
+        gint64 x = limit_sort_value(a->track, g_limit_sort);
+        gint64 y = limit_sort_value(b->track, g_limit_sort);
+        c = (x < y) - (x > y);
+        if (g_limit_sort & 0x80000000) c = -c;
+    }
+    return c ? c : (a->pos > b->pos) - (a->pos < b->pos);
+}
+
+static const gchar *limit_sort_string(const Itdb_Track *t, guint32 sort) {
+    switch (sort) {
+    case ITDB_LIMITSORT_SONG_NAME: return t->title;
+    case ITDB_LIMITSORT_ALBUM:     return t->album;
+    case ITDB_LIMITSORT_ARTIST:    return t->artist;
+    case ITDB_LIMITSORT_GENRE:     return t->genre;
+    default:                       return NULL;
+    }
+}
+
+static void sort_for_limit(GPtrArray *tracks, guint32 sort) {
+    guint n = tracks->len;
+    if (n < 2) return;
+
+    if (sort == ITDB_LIMITSORT_RANDOM) {
+        for (guint i = n - 1; i > 0; i--) {
+            guint j = (guint)g_random_int_range(0, (gint32)i + 1);
+            gpointer tmp = tracks->pdata[i];
+            tracks->pdata[i] = tracks->pdata[j];
+            tracks->pdata[j] = tmp;
+        }
+        return;
+    }
+
+    gboolean by_string = sort == ITDB_LIMITSORT_SONG_NAME || sort == ITDB_LIMITSORT_ALBUM ||
+                         sort == ITDB_LIMITSORT_ARTIST || sort == ITDB_LIMITSORT_GENRE;
+    LimitItem *items = g_new0(LimitItem, n);
+    for (guint i = 0; i < n; i++) {
+        items[i].track = (Itdb_Track *)tracks->pdata[i];
+        items[i].pos = i;
+        if (by_string) {
+            const gchar *s = limit_sort_string(items[i].track, sort);
+            gchar *fold = g_utf8_casefold(s ? s : "", -1);
+            items[i].collate = g_utf8_collate_key(fold, -1);
+            g_free(fold);
+        }
+    }
+    g_limit_sort = sort;
+    qsort(items, n, sizeof(LimitItem), compare_limit_items);
+    for (guint i = 0; i < n; i++) {
+        tracks->pdata[i] = items[i].track;
+        g_free(items[i].collate);
+    }
+    g_free(items);
+}
+
+static guint64 limit_cost(const Itdb_Track *t, guint32 limittype) {
+    switch (limittype) {
+    case ITDB_LIMITTYPE_MINUTES:
+    case ITDB_LIMITTYPE_HOURS:   return (guint64)(t->tracklen > 0 ? t->tracklen : 0);
+    case ITDB_LIMITTYPE_MB:
+    case ITDB_LIMITTYPE_GB:      return (guint64)(t->size > 0 ? t->size : 0);
+    default:                     return 1;
+    }
+}
+
+static guint64 limit_budget(guint32 limittype, guint32 limitvalue) {
+    switch (limittype) {
+    case ITDB_LIMITTYPE_MINUTES: return (guint64)limitvalue * 60 * 1000;
+    case ITDB_LIMITTYPE_HOURS:   return (guint64)limitvalue * 60 * 60 * 1000;
+    case ITDB_LIMITTYPE_MB:      return (guint64)limitvalue * 1024 * 1024;
+    case ITDB_LIMITTYPE_GB:      return (guint64)limitvalue * 1024 * 1024 * 1024;
+    default:                     return limitvalue;
+    }
+}
+
+/* Sort by the limit order and keep tracks while they fit the budget */
+static void apply_limit(const Itdb_Playlist *pl, GPtrArray *tracks) {
+    if (!pl->splpref.checklimits) return;
+
+    sort_for_limit(tracks, pl->splpref.limitsort);
+    guint64 budget = limit_budget(pl->splpref.limittype, pl->splpref.limitvalue);
+    guint64 used = 0;
+    guint keep = 0;
+    while (keep < tracks->len) {
+        guint64 cost = limit_cost((const Itdb_Track *)tracks->pdata[keep], pl->splpref.limittype);
+        if (used + cost > budget) break;
+        used += cost;
+        keep++;
+    }
+    g_ptr_array_set_size(tracks, keep);
+}
+
+static void set_members(Itdb_Playlist *pl, GPtrArray *tracks) {
+    GList *members = NULL;
+    for (guint i = tracks->len; i > 0; i--) members = g_list_prepend(members, tracks->pdata[i - 1]);
+    g_list_free(pl->members);
+    pl->members = members;
+    pl->num = (gint)tracks->len;
+}
+
+/* Index pl->members so single tracks can be added and removed in O(1) */
+static void index_members(CompiledSpl *spl) {
+    g_hash_table_remove_all(spl->matched);
+    spl->tail = NULL;
+    for (GList *m = spl->pl->members; m != NULL; m = m->next) {
+        g_hash_table_insert(spl->matched, m->data, m);
+        spl->tail = m;
+    }
+}
+
+/* Install @matches (library order) as the members of @spl */
+static void commit_matches(CompiledSpl *spl, GPtrArray *matches) {
+    if (spl->limited) {
+        /* Remember every match: the limit is re-applied when they change */
+        g_hash_table_remove_all(spl->matched);
+        for (guint i = 0; i < matches->len; i++) {
+            g_hash_table_insert(spl->matched, matches->pdata[i], matches->pdata[i]);
+        }
+        apply_limit(spl->pl, matches);
+        set_members(spl->pl, matches);
+        spl->dirty = FALSE;
+    } else {
+        set_members(spl->pl, matches);
+        index_members(spl);
+    }
+}
+
+/* ============================================================================
+ * Update
+ * ============================================================================ */
+
+/* Smart playlists without live update keep the members they were saved with */
+static gboolean is_live_spl(const Itdb_Playlist *pl) {
+    return pl && pl->is_spl && pl->splpref.liveupdate;
+}
+
+int spl_update_all(Itdb_iTunesDB *itdb) {
+    spl_reset();
+    if (!itdb) return 0;
+
+    for (GList *l = itdb->playlists; l != NULL; l = l->next) {
+        Itdb_Playlist *pl = (Itdb_Playlist *)l->data;
+        if (is_live_spl(pl)) g_n_spls++;
+    }
+    g_compiled = TRUE;
+    if (g_n_spls == 0) return 0;
+
+    time_t now = time(NULL);
+    g_spls = g_new0(CompiledSpl, g_n_spls);
+    g_field_deps = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_index_array);
+    guint s = 0;
+    for (GList *l = itdb->playlists; l != NULL; l = l->next) {
+        Itdb_Playlist *pl = (Itdb_Playlist *)l->data;
+        if (is_live_spl(pl)) compile_spl(itdb, pl, s++, now);
+    }
+
+    GPtrArray **matches = g_new0(GPtrArray *, g_n_spls);
+    for (s = 0; s < g_n_spls; s++) matches[s] = g_ptr_array_new();
+
+    /* One pass over the library for all smart playlists */
+    TrackView tv = { 0 };
+    for (GList *l = itdb->tracks; l != NULL; l = l->next) {
+        Itdb_Track *track = (Itdb_Track *)l->data;
+        if (!track) continue;
+        tv.track = track;
+        for (s = 0; s < g_n_spls; s++) {
+            if (spl_matches(&g_spls[s], &tv)) g_ptr_array_add(matches[s], track);
+        }
+        track_view_clear(&tv);
+    }
+
+    for (s = 0; s < g_n_spls; s++) {
+        commit_matches(&g_spls[s], matches[s]);
+        g_ptr_array_free(matches[s], TRUE);
+    }
+    g_free(matches);
+    return (int)g_n_spls;
+}
+
+int spl_refresh(Itdb_iTunesDB *itdb) {
+    if (!g_compiled) return spl_update_all(itdb);
+    if (!itdb) return 0;
+
+    time_t now = time(NULL);
+    int updated = 0;
+    for (guint s = 0; s < g_n_spls; s++) {
+        CompiledSpl *spl = &g_spls[s];
+        if (!spl->timed && !spl->dirty) continue;
+
+        /* "In the last" windows moved since they were resolved: re-test the
+         * library. Otherwise only the limit needs re-applying to the matches. */
+        for (guint i = 0; spl->timed && i < spl->n_rules; i++) {
+            CompiledRule *r = &spl->rules[i];
+            if (r->type == RULE_DATE && r->action == ITDB_SPLACTION_IS_IN_THE_LAST) {
+                r->from = (gint64)now - r->span;
+            }
+        }
+        GPtrArray *matches = g_ptr_array_new();
+        TrackView tv = { 0 };
+        for (GList *l = itdb->tracks; l != NULL; l = l->next) {
+            Itdb_Track *track = (Itdb_Track *)l->data;
+            if (!track) continue;
+            gboolean hit;
+            if (spl->timed) {
+                tv.track = track;
+                hit = spl_matches(spl, &tv);
+                track_view_clear(&tv);
+            } else {
+                hit = g_hash_table_contains(spl->matched, track);
+            }
+            if (hit) g_ptr_array_add(matches, track);
+        }
+        commit_matches(spl, matches);
+        g_ptr_array_free(matches, TRUE);
+        updated++;
+    }
+    return updated;
+}
+
+/* ============================================================================
+ * Incremental maintenance
+ * ============================================================================ */
+
+static void member_append(CompiledSpl *spl, Itdb_Track *track) {
+    GList *node = g_list_alloc();
+    node->data = track;
+    node->prev = spl->tail;
+    node->next = NULL;
+    if (spl->tail) spl->tail->next = node;
+    else spl->pl->members = node;
+    spl->tail = node;
+    spl->pl->num++;
+    g_hash_table_insert(spl->matched, track, node);
+}
+
+static void member_remove(CompiledSpl *spl, Itdb_Track *track) {
+    GList *node = (GList *)g_hash_table_lookup(spl->matched, track);
+    if (!node) return;
+    if (node == spl->tail) spl->tail = node->prev;
+    spl->pl->members = g_list_delete_link(spl->pl->members, node);
+    spl->pl->num--;
+    g_hash_table_remove(spl->matched, track);
+}
+
+/* Re-test one track against one smart playlist and patch its membership */
+static void retest(CompiledSpl *spl, TrackView *tv) {
+    Itdb_Track *track = (Itdb_Track *)tv->track;
+    gboolean hit = spl_matches(spl, tv);
+    if (hit == g_hash_table_contains(spl->matched, track)) return;
+
+    if (spl->limited) {
+        if (hit) g_hash_table_insert(spl->matched, track, track);
+        else g_hash_table_remove(spl->matched, track);
+        spl->dirty = TRUE;
+    } else if (hit) {
+        member_append(spl, track);
+    } else {
+        member_remove(spl, track);
+    }
+}
+
+void spl_track_added(Itdb_Track *track) {
+    if (!g_compiled || !track) return;
+
+    TrackView tv = { 0 };
+    tv.track = track;
+    for (guint s = 0; s < g_n_spls; s++) retest(&g_spls[s], &tv);
+    track_view_clear(&tv);
+}
+
+void spl_track_changed(Itdb_Track *track, const guint32 *fields, guint n_fields) {
+    if (!g_compiled || g_n_spls == 0 || !track) return;
+
+    gboolean *affected = g_new0(gboolean, g_n_spls);
+    for (guint f = 0; f < n_fields; f++) {
+        GPtrArray *deps = g_hash_table_lookup(g_field_deps, GUINT_TO_POINTER(fields[f]));
+        for (guint i = 0; deps && i < deps->len; i++) {
+            affected[GPOINTER_TO_UINT(deps->pdata[i])] = TRUE;
+        }
+    }
+
+    TrackView tv = { 0 };
+    tv.track = track;
+    for (guint s = 0; s < g_n_spls; s++) {
+        CompiledSpl *spl = &g_spls[s];
+        /* Limit sorts and budgets look at fields the rules may not */
+        if (spl->limited && g_hash_table_contains(spl->matched, track)) spl->dirty = TRUE;
+        if (affected[s]) retest(spl, &tv);
+    }
+    track_view_clear(&tv);
+    g_free(affected);
+}
+
+void spl_track_removed(Itdb_Track *track) {
+    if (!g_compiled || !track) return;
+
+    for (guint s = 0; s < g_n_spls; s++) {
+        CompiledSpl *spl = &g_spls[s];
+        for (guint i = 0; i < spl->n_rules; i++) {
+            if (spl->rules[i].members) g_hash_table_remove(spl->rules[i].members, track);
+        }
+        if (!g_hash_table_contains(spl->matched, track)) continue;
+        if (spl->limited) {
+            /* Still in pl->members: the caller unlinks it from every playlist */
+            g_hash_table_remove(spl->matched, track);
+            spl->dirty = TRUE;
+        } else {
+            member_remove(spl, track);
+        }
+    }
+}
+
+/* TRUE if @pl is one of the compiled smart playlists */
+static gboolean playlist_is_compiled(const Itdb_Playlist *pl) {
+    for (guint s = 0; s < g_n_spls; s++) {
+        if (g_spls[s].pl == pl) return TRUE;
+    }
+    return FALSE;
+}
+
+void spl_playlist_track_changed(Itdb_Playlist *pl, Itdb_Track *track, gboolean added) {
+    if (!g_compiled || !pl || !track) return;
+
+    /* Hand-edited smart playlist: start over on the next refresh */
+    if (playlist_is_compiled(pl)) {
+        spl_reset();
+        return;
+    }
+
+    TrackView tv = { 0 };
+    tv.track = track;
+    for (guint s = 0; s < g_n_spls; s++) {
+        CompiledSpl *spl = &g_spls[s];
+        gboolean refs = FALSE;
+        for (guint i = 0; i < spl->n_rules; i++) {
+            CompiledRule *r = &spl->rules[i];
+            if (r->type != RULE_PLAYLIST || r->ref != pl) continue;
+            if (added) g_hash_table_add(r->members, track);
+            else g_hash_table_remove(r->members, track);
+            refs = TRUE;
+        }
+        if (refs && spl->use_rules) retest(spl, &tv);
+    }
+    track_view_clear(&tv);
+}
+
+void spl_playlist_removed(Itdb_Playlist *pl) {
+    if (!g_compiled || !pl) return;
+
+    gboolean stale = playlist_is_compiled(pl);
+    for (guint s = 0; !stale && s < g_n_spls; s++) {
+        for (guint i = 0; i < g_spls[s].n_rules; i++) {
+            if (g_spls[s].rules[i].ref == pl) stale = TRUE;
+        }
+    }
+    if (stale) spl_reset();
+}
+
+/* ============================================================================
+ * Parked State (several databases per module)
+ * ============================================================================ */
+
+struct SplState {
+    CompiledSpl *spls;
+    guint        n_spls;
+    gboolean     compiled;
+    GHashTable  *field_deps;
+};
+
+SplState *spl_state_detach(void) {
+    SplState *state = g_new0(SplState, 1);
+    state->spls = g_spls;
+    state->n_spls = g_n_spls;
+    state->compiled = g_compiled;
+    state->field_deps = g_field_deps;
+
+    g_spls = NULL;
+    g_n_spls = 0;
+    g_compiled = FALSE;
+    g_field_deps = NULL;
+    return state;
+}
+
+void spl_state_attach(SplState *state) {
+    spl_reset();
+    if (!state) return;
+    g_spls = state->spls;
+    g_n_spls = state->n_spls;
+    g_compiled = state->compiled;
+    g_field_deps = state->field_deps;
+    g_free(state);
+}
@@ -0,0 +1,58 @@
+/*
+ * spl.h - Smart playlist evaluation for TunesReloaded
+ *
+ * Recomputes the members of smart playlists (is_spl) from their rules,
+ * limits and sort mode, so they can be written as live smart playlists
+ * instead of being frozen into static ones.
+ */
+
+#ifndef TUNESRELOADED_SPL_H
+#define TUNESRELOADED_SPL_H
+
+#include "itdb.h"
+
+/*
+ * Evaluate every live-updating smart playlist of @itdb in one pass over the
+ * library and replace its members; ones with splpref.liveupdate off keep the
+ * members they were saved with. The compiled rules are kept for the
+ * incremental calls below. Returns the number of smart playlists updated.
+ */
+int spl_update_all(Itdb_iTunesDB *itdb);
+
+/*
+ * Settle what the incremental calls deferred: re-apply limits whose matches
+ * changed and re-test playlists with "in the last" rules. Falls back to
+ * spl_update_all() when nothing is compiled. Returns the number of smart
+ * playlists recomputed.
+ */
+int spl_refresh(Itdb_iTunesDB *itdb);
+
+/* Drop compiled rules (call when the database is closed or reloaded) */
+void spl_reset(void);
+
+/*
+ * Incremental maintenance: no-ops until spl_update_all() has run.
+ * spl_track_changed() re-tests @track only against the smart playlists whose
+ * rules reference one of @fields (ITDB_SPLFIELD_* values).
+ * spl_track_removed() must be called before the track is unlinked and freed.
+ */
+void spl_track_added(Itdb_Track *track);
+void spl_track_changed(Itdb_Track *track, const guint32 *fields, guint n_fields);
+void spl_track_removed(Itdb_Track *track);
+
+/* A regular playlist gained or lost @track (feeds "playlist is" rules) */
+void spl_playlist_track_changed(Itdb_Playlist *pl, Itdb_Track *track, gboolean added);
+
+/* Call before @pl is removed from the database */
+void spl_playlist_removed(Itdb_Playlist *pl);
+
+/* Compiled rules of a database that is not the active one */
+typedef struct SplState SplState;
+
+/* Take the compiled rules out of the module, leaving it empty */
+SplState *spl_state_detach(void);
+
+/* Drop the current rules and install @state (consumed; NULL = empty) */
+void spl_state_attach(SplState *state);
+
+#endif /* TUNESRELOADED_SPL_H */
@@ -0,0 +1,296 @@
+/*
+ * sync_plan.c - Differential sync planner for TunesReloaded
+ *
+ * Two indexes over the iPod's tracks:
+ *   - metadata key: hash of normalized artist/album/title (case-folded,
+ *     accents and punctuation dropped), finds the "same song";
+ *   - shape key: file size (duration checked on match), finds the same audio
+ *     file whose tags were edited locally.
+ * Each track can be claimed by one local file; unclaimed tracks are the
+ * delete-missing set.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "sync_plan.h"
+
+/* Durations of a transcode and its source differ by encoder padding */
+#define DURATION_TOLERANCE_MS 2000
+
+typedef struct PlanTrack PlanTrack;
+struct PlanTrack {
+    Itdb_Track *track;
+    gint        index;
+    guint64     meta_key;
+    guint64     shape_key;
+    gboolean    claimed;
+    PlanTrack  *next_meta;      /* chain of tracks with the same meta_key */
+    PlanTrack  *next_shape;
+};
+
+typedef struct {
+    gint    local_id;
+    gint    action;
+    gint    track_index;
+    guint64 write_bytes;
+} PlanEntry;
+
+static PlanTrack *g_tracks = NULL;
+static guint g_n_tracks = 0;
+static GHashTable *g_by_meta = NULL;    /* &meta_key -> first PlanTrack */
+static GHashTable *g_by_shape = NULL;   /* &shape_key -> first PlanTrack */
+
+static PlanEntry *g_entries = NULL;
+static guint g_n_entries = 0;
+static guint g_entries_cap = 0;
+static gboolean g_active = FALSE;
+
+/* ============================================================================
+ * Keys
+ * ============================================================================ */
+
+static guint64 fnv_mix(guint64 h, guint32 v) {
+    for (int i = 0; i < 4; i++) {
+        h ^= (v >> (i * 8)) & 0xFF;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* Upload fills these in for missing tags; treat them like an empty tag */
+static gboolean is_placeholder(const char *s) {
+    return !s || !*s || strcmp(s, "Unknown Artist") == 0 || strcmp(s, "Unknown Album") == 0;
+}
+
+static guint64 hash_normalized(guint64 h, const char *s) {
+    if (!is_placeholder(s)) {
+        gchar *norm = g_utf8_normalize(s, -1, G_NORMALIZE_ALL);
+        gchar *fold = g_utf8_casefold(norm ? norm : s, -1);
+        /* NFKD splits accents into combining marks, which are not alnum */
+        for (const gchar *p = fold; p && *p; p = g_utf8_next_char(p)) {
+            gunichar c = g_utf8_get_char(p);
+            if (g_unichar_isalnum(c)) h = fnv_mix(h, c);
+        }
+        g_free(fold);
+        g_free(norm);
+    }
+    return fnv_mix(h, 0x1F); /* field separator */
+}
+
+static guint64 meta_key(const char *title, const char *artist, const char *album) {
+    guint64 h = 0xcbf29ce484222325ULL;
+    h = hash_normalized(h, artist);
+    h = hash_normalized(h, album);
+    h = hash_normalized(h, title);
+    return h;
+}
+
+static guint64 shape_key(guint64 size_bytes) {
+    return size_bytes;
+}
+
+static gboolean same_string(const char *a, const char *b) {
+    if (is_placeholder(a) || is_placeholder(b)) return is_placeholder(a) == is_placeholder(b);
+    return strcmp(a, b) == 0;
+}
+
+/* ============================================================================
+ * Plan
+ * ============================================================================ */
+
+void sync_plan_reset(void) {
+    if (g_by_meta) g_hash_table_destroy(g_by_meta);
+    if (g_by_shape) g_hash_table_destroy(g_by_shape);
+    g_by_meta = NULL;
+    g_by_shape = NULL;
+    g_free(g_tracks);
+    g_tracks = NULL;
+    g_n_tracks = 0;
+    g_free(g_entries);
+    g_entries = NULL;
+    g_n_entries = 0;
+    g_entries_cap = 0;
+    g_active = FALSE;
+}
+
+int sync_plan_begin(Itdb_iTunesDB *itdb) {
+    sync_plan_reset();
+    if (!itdb) return -1;
+
+    g_n_tracks = g_list_length(itdb->tracks);
+    g_tracks = g_malloc0(sizeof(PlanTrack) * (g_n_tracks ? g_n_tracks : 1));
+    g_by_meta = g_hash_table_new(g_int64_hash, g_int64_equal);
+    g_by_shape = g_hash_table_new(g_int64_hash, g_int64_equal);
+
+    /* Walk backwards so each chain ends up in track order */
+    GList *l = g_list_last(itdb->tracks);
+    for (gint i = (gint)g_n_tracks - 1; l != NULL; l = l->prev, i--) {
+        Itdb_Track *track = (Itdb_Track *)l->data;
+        PlanTrack *pt = &g_tracks[i];
+        pt->track = track;
+        pt->index = i;
+        if (!track) continue;
+
+        pt->meta_key = meta_key(track->title, track->artist, track->album);
+        pt->next_meta = g_hash_table_lookup(g_by_meta, &pt->meta_key);
+        g_hash_table_insert(g_by_meta, &pt->meta_key, pt);
+
+        pt->shape_key = shape_key((guint64)track->size);
+        pt->next_shape = g_hash_table_lookup(g_by_shape, &pt->shape_key);
+        g_hash_table_insert(g_by_shape, &pt->shape_key, pt);
+    }
+
+    g_active = TRUE;
+    return (int)g_n_tracks;
+}
+
+static gboolean same_audio(const Itdb_Track *track, guint64 size_bytes, guint32 duration_ms, int transcoded) {
+    gint64 diff = (gint64)track->tracklen - (gint64)duration_ms;
+    if (diff < 0) diff = -diff;
+    if (transcoded) return diff <= DURATION_TOLERANCE_MS;
+    return (guint64)track->size == size_bytes && diff <= DURATION_TOLERANCE_MS;
+}
+
+static void record(int local_id, int action, int track_index, guint64 write_bytes) {
+    if (g_n_entries == g_entries_cap) {
+        g_entries_cap = g_entries_cap ? g_entries_cap * 2 : 1024;
+        g_entries = g_realloc(g_entries, sizeof(PlanEntry) * g_entries_cap);
+    }
+    PlanEntry *e = &g_entries[g_n_entries++];
+    e->local_id = local_id;
+    e->action = action;
+    e->track_index = track_index;
+    e->write_bytes = write_bytes;
+}
+
+int sync_plan_add_local(int local_id, const char *title, const char *artist, const char *album,
+                        const char *genre, int track_nr, int year, guint64 size_bytes,
+                        guint64 write_bytes, guint32 duration_ms, int transcoded, int *track_index) {
+    if (track_index) *track_index = -1;
+    if (!g_active) return -1;
+
+    /* Same song: prefer a copy whose audio also matches (duplicates on the iPod) */
+    guint64 key = meta_key(title, artist, album);
+    PlanTrack *song = NULL;
+    for (PlanTrack *pt = g_hash_table_lookup(g_by_meta, &key); pt; pt = pt->next_meta) {
+        if (pt->claimed) continue;
+        if (same_audio(pt->track, size_bytes, duration_ms, transcoded)) {
+            song = pt;
+            break;
+        }
+        if (!song) song = pt;
+    }
+
+    int action;
+    PlanTrack *match = song;
+    if (song) {
+        if (!same_audio(song->track, size_bytes, duration_ms, transcoded)) {
+            action = SYNC_PLAN_REPLACE;
+        } else {
+            const Itdb_Track *t = song->track;
+            gboolean tags_equal = same_string(t->title, title) && same_string(t->artist, artist) &&
+                                  same_string(t->album, album) && same_string(t->genre, genre) &&
+                                  t->track_nr == track_nr && t->year == year;
+            action = tags_equal ? SYNC_PLAN_UNCHANGED : SYNC_PLAN_METADATA;
+        }
+    } else {
+        /* Same file, retagged locally (not possible to tell for transcodes) */
+        match = NULL;
+        if (!transcoded) {
+            guint64 skey = shape_key(size_bytes);
+            for (PlanTrack *pt = g_hash_table_lookup(g_by_shape, &skey); pt; pt = pt->next_shape) {
+                if (!pt->claimed && same_audio(pt->track, size_bytes, duration_ms, 0)) {
+                    match = pt;
+                    break;
+                }
+            }
+        }
+        action = match ? SYNC_PLAN_METADATA : SYNC_PLAN_ADD;
+    }
+
+    if (match) {
+        match->claimed = TRUE;
+        if (track_index) *track_index = match->index;
+    }
+    record(local_id, action, match ? match->index : -1, write_bytes);
+    return action;
+}
+
+/* ============================================================================
+ * Output
+ * ============================================================================ */
+
+typedef struct {
+    char  *data;
+    size_t len;
+    size_t cap;
+} JsonBuf;
+
+static void jb_printf(JsonBuf *b, const char *fmt, ...) {
+    va_list args;
+    for (;;) {
+        va_start(args, fmt);
+        int n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, args);
+        va_end(args);
+        if (n < 0) return;
+        if (b->len + (size_t)n < b->cap) {
+            b->len += (size_t)n;
+            return;
+        }
+        size_t cap = b->cap * 2;
+        while (cap <= b->len + (size_t)n) cap *= 2;
+        char *grown = realloc(b->data, cap);
+        if (!grown) return;
+        b->data = grown;
+        b->cap = cap;
+    }
+}
+
+static void emit_action(JsonBuf *b, const char *name, int action, gboolean with_track) {
+    jb_printf(b, "\"%s\":[", name);
+    gboolean first = TRUE;
+    for (guint i = 0; i < g_n_entries; i++) {
+        const PlanEntry *e = &g_entries[i];
+        if (e->action != action) continue;
+        if (with_track) jb_printf(b, "%s[%d,%d]", first ? "" : ",", e->local_id, e->track_index);
+        else jb_printf(b, "%s%d", first ? "" : ",", e->local_id);
+        first = FALSE;
+    }
+    jb_printf(b, "],");
+}
+
+char *sync_plan_json(void) {
+    if (!g_active) return NULL;
+
+    JsonBuf b = { malloc(65536), 0, 65536 };
+    if (!b.data) return NULL;
+    b.data[0] = '\0';
+
+    guint64 bytes_write = 0, bytes_delete = 0;
+    guint unchanged = 0;
+    for (guint i = 0; i < g_n_entries; i++) {
+        const PlanEntry *e = &g_entries[i];
+        if (e->action == SYNC_PLAN_ADD || e->action == SYNC_PLAN_REPLACE) bytes_write += e->write_bytes;
+        if (e->action == SYNC_PLAN_REPLACE) bytes_delete += (guint32)g_tracks[e->track_index].track->size;
+        if (e->action == SYNC_PLAN_UNCHANGED) unchanged++;
+    }
+
+    jb_printf(&b, "{");
+    emit_action(&b, "add", SYNC_PLAN_ADD, FALSE);
+    emit_action(&b, "replace", SYNC_PLAN_REPLACE, TRUE);
+    emit_action(&b, "metadata", SYNC_PLAN_METADATA, TRUE);
+
+    jb_printf(&b, "\"delete\":[");
+    gboolean first = TRUE;
+    for (guint i = 0; i < g_n_tracks; i++) {
+        if (g_tracks[i].claimed || !g_tracks[i].track) continue;
+        jb_printf(&b, "%s%d", first ? "" : ",", g_tracks[i].index);
+        bytes_delete += (guint32)g_tracks[i].track->size;
+        first = FALSE;
+    }
+    jb_printf(&b, "],\"unchanged\":%u,\"bytesToWrite\":%llu,\"bytesToDelete\":%llu}",
+              unchanged, (unsigned long long)bytes_write, (unsigned long long)bytes_delete);
+    return b.data;
+}
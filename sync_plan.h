@@ -0,0 +1,45 @@
+/*
+ * sync_plan.h - Differential sync planner for TunesReloaded
+ *
+ * Matches a local music library (fed in one file at a time from JavaScript)
+ * against the tracks of the loaded iTunesDB and classifies each local file,
+ * so mirroring a library only transfers the delta.
+ */
+
+#ifndef TUNESRELOADED_SYNC_PLAN_H
+#define TUNESRELOADED_SYNC_PLAN_H
+
+#include "itdb.h"
+
+/* Per-file decisions returned by sync_plan_add_local() */
+#define SYNC_PLAN_UNCHANGED 0   /* same tags, same audio */
+#define SYNC_PLAN_ADD       1   /* not on the iPod */
+#define SYNC_PLAN_REPLACE   2   /* same song, audio changed */
+#define SYNC_PLAN_METADATA  3   /* same audio, tags changed */
+
+/* Index the tracks of @itdb. Returns the number of tracks indexed. */
+int sync_plan_begin(Itdb_iTunesDB *itdb);
+
+/*
+ * Classify one local file. @transcoded is non-zero when the iPod copy is a
+ * transcode (FLAC -> ALAC), so sizes cannot be compared and durations are used.
+ * @write_bytes is what uploading the file writes to the device (for a
+ * transcode, the expected size of the converted file); it feeds bytesToWrite.
+ * Writes the matched track index (or -1) to @track_index.
+ * Returns a SYNC_PLAN_* code, or -1 if no plan is active.
+ */
+int sync_plan_add_local(int local_id, const char *title, const char *artist, const char *album,
+                        const char *genre, int track_nr, int year, guint64 size_bytes,
+                        guint64 write_bytes, guint32 duration_ms, int transcoded, int *track_index);
+
+/*
+ * Finished plan as JSON (caller frees): {"add":[local],"replace":[[local,track]],
+ * "metadata":[[local,track]],"delete":[track],"unchanged":N,"bytesToWrite":N,
+ * "bytesToDelete":N}. Tracks no local file matched are listed under "delete".
+ */
+char *sync_plan_json(void);
+
+/* Free the active plan */
+void sync_plan_reset(void);
+
+#endif /* TUNESRELOADED_SYNC_PLAN_H */
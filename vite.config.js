@@ -12,6 +12,11 @@ export default defineConfig({
       },
     },
   },
+  worker: {
+    // The metadata worker imports music-metadata, which lazy-loads its parsers via
+    // dynamic import(); only ES workers support that code-splitting.
+    format: 'es',
+  },
   optimizeDeps: {
     // ffmpeg.wasm spawns a module worker; Vite's dep optimizer can break the worker URL
     // and produce missing ".../.vite/deps/worker.js?worker_file&type=module" errors.